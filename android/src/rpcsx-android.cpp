@@ -308,7 +308,7 @@ static FileType getFileType(const fs::file &file) {
     return FileType::Rap;
   }
 
-  if (iso_dev::open(std::make_unique<file_view_block_dev>(file))) {
+  if (file_view_block_dev device(file); iso_dev::probe(device)) {
     return FileType::Iso;
   }
 
@@ -57,6 +57,7 @@
 #include "util/atomic_bit_set.h"
 #include "util/init_mutex.hpp"
 #include "util/sysinfo.hpp"
+#include "util/timer_wheel.hpp"
 #include <algorithm>
 #include <deque>
 #include <optional>
@@ -1581,8 +1582,8 @@ thread_local DECLARE(lv2_obj::g_to_notify){};
 thread_local DECLARE(lv2_obj::g_postpone_notify_barrier){};
 thread_local DECLARE(lv2_obj::g_to_awake);
 
-// Scheduler queue for timeouts (wait until -> thread)
-static std::deque<std::pair<u64, class cpu_thread *>> g_waiting;
+// Scheduler queue for timeouts
+static timer_wheel<cpu_thread, &cpu_thread::lv2_timeout> g_waiting;
 
 // Threads which must call lv2_obj::sleep before the scheduler starts
 static std::deque<class cpu_thread *> g_to_sleep;
@@ -1815,12 +1816,7 @@ bool lv2_obj::sleep_unlocked(cpu_thread &thread, u64 timeout,
     const u64 wait_until = start_time + std::min<u64>(timeout, ~start_time);
 
     // Register timeout if necessary
-    for (auto it = g_waiting.cbegin(), end = g_waiting.cend();; it++) {
-      if (it == end || it->first > wait_until) {
-        g_waiting.emplace(it, wait_until, &thread);
-        break;
-      }
-    }
+    g_waiting.insert(thread, wait_until);
   }
 
   return return_val;
@@ -1958,13 +1954,7 @@ bool lv2_obj::awake_unlocked(cpu_thread *cpu, s32 prio) {
     }
 
     // Unregister timeout if necessary
-    for (auto it = g_waiting.cbegin(), end = g_waiting.cend(); it != end;
-         it++) {
-      if (it->second == cpu) {
-        g_waiting.erase(it);
-        break;
-      }
-    }
+    g_waiting.erase(*cpu);
 
     ppu_log.trace("awake(): %s", cpu->id);
     return true;
@@ -2102,17 +2092,12 @@ void lv2_obj::schedule_all(u64 current_time) {
   }
 
   // Check registered timeouts
-  while (!g_waiting.empty()) {
-    const auto pair = &g_waiting.front();
-
+  if (!g_waiting.empty()) {
     if (!current_time) {
       current_time = get_guest_system_time();
     }
 
-    if (pair->first <= current_time) {
-      const auto target = pair->second;
-      g_waiting.pop_front();
-
+    g_waiting.expire(current_time, [&](cpu_thread *target) {
       if (target != cpu_thread::get_current()) {
         // Change cpu_thread::state for the lightweight notification to work
         ensure(!target->state.test_and_set(cpu_flag::notify));
@@ -2126,10 +2111,7 @@ void lv2_obj::schedule_all(u64 current_time) {
           *it++ = &target->state;
         }
       }
-    } else {
-      // The list is sorted so assume no more timeouts
-      break;
-    }
+    });
   }
 
   if (it < std::end(g_to_notify)) {
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "orbis-config.hpp"
+#include <atomic>
+#include <cstdint>
+
+namespace orbis {
+inline constexpr auto kLioNop = 0;
+inline constexpr auto kLioWrite = 1;
+inline constexpr auto kLioRead = 2;
+
+inline constexpr auto kLioNoWait = 0;
+inline constexpr auto kLioWait = 1;
+inline constexpr auto kAioListIoMax = 16;
+
+// aio_cancel results
+inline constexpr auto kAioCanceled = 1;
+inline constexpr auto kAioNotCanceled = 2;
+inline constexpr auto kAioAllDone = 3;
+
+inline constexpr auto kSigEvNone = 0;
+inline constexpr auto kSigEvSignal = 1;
+inline constexpr auto kSigEvKevent = 3;
+
+struct sigevent {
+  sint sigev_notify;
+  sint sigev_signo; // kqueue descriptor for kSigEvKevent
+  ptr<void> sigev_value;
+  slong sigev_spare[8];
+};
+
+struct osigevent {
+  sint sigev_notify;
+  sint sigev_signo;
+  ptr<void> sigev_value;
+};
+
+struct aiocb {
+  sint aio_fildes;
+  off_t aio_offset;
+  ptr<void> aio_buf;
+  size_t aio_nbytes;
+
+  // osigevent of the legacy aio syscalls
+  sint aio_spare[2];
+  ptr<void> aio_spare2;
+
+  sint aio_lio_opcode;
+  sint aio_reqprio;
+  slong aio_status;
+  slong aio_error;
+  ptr<void> aio_kernelinfo;
+  sigevent aio_sigevent;
+};
+
+static_assert(sizeof(sigevent) == 80);
+static_assert(sizeof(osigevent) == 16);
+static_assert(sizeof(aiocb) == 160);
+
+struct AioStats {
+  // requests submitted to io_uring and to the fallback thread pool
+  std::atomic<std::uint64_t> ringRequests{0};
+  std::atomic<std::uint64_t> poolRequests{0};
+
+  // io_uring_enter calls used for submission
+  std::atomic<std::uint64_t> ringSubmits{0};
+
+  std::atomic<std::uint64_t> queueDepth{0};
+  std::atomic<std::uint64_t> maxQueueDepth{0};
+  std::atomic<std::uint64_t> bytesInFlight{0};
+
+  std::atomic<std::uint64_t> completions{0};
+  std::atomic<std::uint64_t> bytesTransferred{0};
+
+  // time between submission and completion
+  std::atomic<std::uint64_t> latencyNs{0};
+  std::atomic<std::uint64_t> maxLatencyNs{0};
+};
+
+/// \brief Statistics of the asynchronous I/O engine of this host process.
+AioStats &getAioStats();
+void printAioStats();
+} // namespace orbis
@@ -2,13 +2,27 @@
 #include "file.hpp"
 #include "note.hpp"
 #include "rx/SharedCV.hpp"
-#include <list>
+#include <utility>
 
 namespace orbis {
 struct KQueue : orbis::File {
   rx::shared_cv cv;
   kstring name;
-  kvector<KEvent> triggeredEvents;
-  std::list<KNote, kallocator<KNote>> notes;
+  kmap<std::pair<uintptr_t, sshort>, KNote> notes;
+
+  // triggered notes in trigger order, lock is never held while acquiring
+  // other locks
+  rx::shared_mutex readyMtx;
+  KNote *readyHead = nullptr;
+  KNote *readyTail = nullptr;
+
+  // notes on host descriptors without event emitter, have to be polled
+  kvector<KNote *> polledNotes;
+
+  /// \brief Appends note to the ready list. Returns false if the note was
+  /// already queued. Waiters are woken only if \p notify is set.
+  bool pushReady(KNote *note, bool notify = true);
+  void removeReady(KNote *note);
+  KNote *popReady();
 };
 } // namespace orbis
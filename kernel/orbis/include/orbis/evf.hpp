@@ -1,5 +1,6 @@
 #pragma once
 #include "KernelAllocator.hpp"
+#include "rx/SharedAtomic.hpp"
 #include "rx/SharedMutex.hpp"
 #include "thread/Thread.hpp"
 #include <atomic>
@@ -59,6 +60,12 @@ struct EventFlag final {
   rx::shared_mutex queueMtx;
   kvector<WaitingThread> waitingThreads;
 
+  // incremented when a thread fails to acquire the pattern, lets host
+  // consumers of the flag sleep until the guest waits for them. Points to
+  // kernel memory of the consumer, which can share it between several flags.
+  // Protected by queueMtx
+  rx::shared_atomic32 *waitWatcher = nullptr;
+
   enum class NotifyType { Set, Cancel, Destroy };
 
   EventFlag() = default;
@@ -79,6 +86,18 @@ struct EventFlag final {
 
   std::size_t set(std::uint64_t bits) { return notify(NotifyType::Set, bits); }
 
+  void notifyWaitWatchers() {
+    if (waitWatcher != nullptr) {
+      waitWatcher->fetch_add(1, std::memory_order::release);
+      waitWatcher->notify_all();
+    }
+  }
+
+  void setWaitWatcher(rx::shared_atomic32 *watcher) {
+    rx::writer_lock lock(queueMtx);
+    waitWatcher = watcher;
+  }
+
   void clear(std::uint64_t bits) {
     rx::writer_lock lock(queueMtx);
     value.fetch_and(bits, std::memory_order::relaxed);
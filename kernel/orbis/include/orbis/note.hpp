@@ -4,7 +4,9 @@
 #include "orbis-config.hpp"
 #include "rx/Rc.hpp"
 #include "rx/SharedMutex.hpp"
+#include <array>
 #include <limits>
+#include <optional>
 #include <set>
 
 namespace orbis {
@@ -76,7 +78,7 @@ struct EventEmitter;
 struct KQueue;
 struct KNote {
   rx::shared_mutex mutex;
-  KQueue *queue;
+  KQueue *queue = nullptr;
   rx::Ref<File> file;
   KEvent event{};
   bool enabled = true;
@@ -84,30 +86,88 @@ struct KNote {
   void *linked = nullptr; // TODO: use rx::Ref<>
   kvector<rx::Ref<EventEmitter>> emitters;
 
+  // intrusive link in the queue ready list, protected by KQueue::readyMtx
+  KNote *readyPrev = nullptr;
+  KNote *readyNext = nullptr;
+  bool ready = false;
+
   ~KNote();
+
+  /// \brief Marks note as triggered and puts it to the queue ready list.
+  /// Caller must hold note mutex.
+  void trigger();
 };
 
 struct EventEmitter : rx::RcBase {
+  using NoteSet = std::set<KNote *, std::less<>, kallocator<KNote *>>;
+
+  // subscribed notes of one filter, keyed by event identifier
+  using IdentMap = kmap<uintptr_t, NoteSet>;
+
+  static constexpr auto kAnyIdent = std::numeric_limits<uintptr_t>::max();
+
   rx::shared_mutex mutex;
-  std::set<KNote *, std::less<>, kallocator<KNote *>> notes;
 
+  // subscribed notes, bucketed by filter
+  std::array<IdentMap, kEvFiltSysCount> notes;
+
+  static constexpr std::size_t getFilterIndex(sshort filter) {
+    return static_cast<std::size_t>(-(filter + 1));
+  }
+
+  IdentMap *getNotes(sshort filter) {
+    auto index = getFilterIndex(filter);
+    return index < notes.size() ? &notes[index] : nullptr;
+  }
+
+  /// \brief Adds note to the filter and identifier bucket without linking
+  /// emitter to the note. Fails with INVAL if the emitter has no bucket for
+  /// the note filter. Caller must hold emitter mutex.
+  ErrorCode addNote(KNote *note);
+
+  /// \brief Removes note from its bucket. Caller must hold emitter mutex.
+  void removeNote(KNote *note);
+
+  /// \brief Triggers notes of the filter. Only notes with identifier equal
+  /// to \p ident are visited unless it is kAnyIdent.
   void emit(sshort filter, uint fflags = 0, intptr_t data = 0,
-            uintptr_t ident = std::numeric_limits<uintptr_t>::max());
-  void emit(sshort filter, void *userData,
+            uintptr_t ident = kAnyIdent);
+
+  /// \brief Triggers notes of the filter with identifier in the inclusive
+  /// range, \p filterFn returns event data for notes to trigger.
+  void emit(sshort filter, uintptr_t firstIdent, uintptr_t lastIdent,
+            void *userData,
             std::optional<intptr_t> (*filterFn)(void *userData, KNote *note));
 
+  void emit(sshort filter, void *userData,
+            std::optional<intptr_t> (*filterFn)(void *userData, KNote *note)) {
+    emit(filter, 0, kAnyIdent, userData, filterFn);
+  }
+
+  template <typename T>
+  void emit(sshort filter, uintptr_t firstIdent, uintptr_t lastIdent, T &&fn)
+    requires requires(KNote *note) {
+      { fn(note) } -> std::same_as<std::optional<intptr_t>>;
+    }
+  {
+    emit(filter, firstIdent, lastIdent, &fn,
+         [](void *userData, KNote *note) {
+           return (*static_cast<std::remove_cvref_t<T> *>(userData))(note);
+         });
+  }
+
   template <typename T>
   void emit(sshort filter, T &&fn)
     requires requires(KNote *note) {
       { fn(note) } -> std::same_as<std::optional<intptr_t>>;
     }
   {
-    emit(filter, &fn, [](void *userData, KNote *note) {
-      return (*static_cast<std::remove_cvref_t<T> *>(userData))(note);
-    });
+    emit(filter, 0, kAnyIdent, std::forward<T>(fn));
   }
 
-  void subscribe(KNote *note);
+  /// \brief Adds note to its bucket and links emitter to the note. Fails
+  /// with INVAL if the note filter is not supported.
+  ErrorCode subscribe(KNote *note);
   void unsubscribe(KNote *note);
 };
 } // namespace orbis
@@ -5,13 +5,57 @@
 #include "rx/Rc.hpp"
 #include "rx/SharedCV.hpp"
 #include "rx/SharedMutex.hpp"
+#include <atomic>
+#include <cstdint>
 #include <utility>
 
 namespace orbis {
-struct Pipe : File {
-  rx::shared_cv cv;
+///
+/// \brief Ring buffer of one direction of a pipe.
+///
+/// Readers are serialized by the mutex of the reading end and writers by the
+/// mutex of the writing end, so the ring has single producer and single
+/// consumer and data is copied without holding any other lock.
+///
+struct PipeChannel : rx::RcBase {
+  static constexpr std::size_t kBufferSize = 64 * 1024;
+
   kvector<std::byte> data;
-  rx::Ref<Pipe> other;
+
+  // monotonic positions, offset in data is position modulo kBufferSize
+  std::atomic<std::uint64_t> readPos{0};
+  std::atomic<std::uint64_t> writePos{0};
+
+  // set when the last reference of the end is released
+  std::atomic<bool> readerClosed{false};
+  std::atomic<bool> writerClosed{false};
+
+  rx::Ref<EventEmitter> readerEvent;
+  rx::Ref<EventEmitter> writerEvent;
+
+  // blocked readers and writers of the ring
+  rx::shared_mutex waitMtx;
+  rx::shared_cv cv;
+  std::atomic<std::uint32_t> waiters{0};
+};
+
+///
+/// \brief One end of a bidirectional pipe.
+///
+/// Ends do not reference each other, each end reads from one channel and
+/// writes to the other. Releasing the end closes both channels for the peer,
+/// blocked peer reader gets end of file and blocked peer writer gets EPIPE.
+///
+struct Pipe : File {
+  static constexpr std::size_t kBufferSize = PipeChannel::kBufferSize;
+
+  // writes up to this size are never interleaved with other writes
+  static constexpr std::size_t kAtomicWriteSize = 512;
+
+  rx::Ref<PipeChannel> readChannel;
+  rx::Ref<PipeChannel> writeChannel;
+
+  ~Pipe();
 };
 
 std::pair<rx::Ref<Pipe>, rx::Ref<Pipe>> createPipe();
@@ -37,6 +37,9 @@ struct ProcessOps {
                              ptr<void> info, ulong infoSize);
   SysResult (*query_memory_protection)(Thread *thread, ptr<void> address,
                                        ptr<MemoryProtection> protection);
+  SysResult (*query_memory_backing)(Thread *thread, ptr<const void> addr,
+                                    uint64_t *object, uint64_t *inode,
+                                    uint64_t *offset);
 
   SysResult (*open)(Thread *thread, ptr<const char> path, sint flags, sint mode,
                     rx::Ref<File> *file);
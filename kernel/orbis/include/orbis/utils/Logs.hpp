@@ -1,6 +1,9 @@
 #pragma once
 #include <atomic>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace orbis {
 inline namespace logs {
@@ -18,6 +21,39 @@ enum class LogLevel : unsigned char {
 // Currently enabled log level
 inline std::atomic<LogLevel> logs_level = LogLevel::Notice;
 
+enum class LogMode : unsigned char {
+  // format and print on the calling thread
+  Sync,
+
+  // copy arguments to a per-thread ring, format and print to stderr on the
+  // formatter thread
+  Text,
+
+  // copy arguments to a per-thread ring, formatter thread writes records to a
+  // binary file without formatting
+  Binary,
+};
+
+enum class LogDropPolicy : unsigned char {
+  // drop the record if ring of the thread is full
+  Drop,
+
+  // wait until formatter thread frees space in the ring
+  Block,
+};
+
+// Kind of the argument in the binary log
+enum class LogArgKind : unsigned char {
+  String,
+  Unsigned,
+  Signed,
+  Float,
+  Bool,
+  Pointer,
+};
+
+inline std::atomic<LogMode> logs_mode = LogMode::Sync;
+
 template <typename T, typename = void> struct log_class_string {
   static const T &get_object(const void *arg) {
     return *static_cast<const T *>(arg);
@@ -73,12 +109,43 @@ struct log_class_string<const char8_t *, void> : log_class_string<char *> {};
 template <typename... Args>
 using log_args_t = const void *(&&)[sizeof...(Args) + 1];
 
+// Arguments which can be formatted from a copy of their bytes, everything else
+// is formatted to a string on the calling thread by the deferred logger
+template <typename T>
+constexpr bool log_is_raw_v =
+    std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+    (std::is_pointer_v<T> &&
+     std::is_base_of_v<log_class_string<void *, void>, log_class_string<T>>);
+
+template <typename T> constexpr LogArgKind log_arg_kind() {
+  if constexpr (!log_is_raw_v<T>) {
+    return LogArgKind::String;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return LogArgKind::Bool;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return LogArgKind::Float;
+  } else if constexpr (std::is_pointer_v<T>) {
+    return LogArgKind::Pointer;
+  } else if constexpr (std::is_enum_v<T>) {
+    return std::is_signed_v<std::underlying_type_t<T>> ? LogArgKind::Signed
+                                                        : LogArgKind::Unsigned;
+  } else {
+    return std::is_signed_v<T> ? LogArgKind::Signed : LogArgKind::Unsigned;
+  }
+}
+
 struct log_type_info {
   decltype(&log_class_string<int>::format) log_string;
 
+  // size of the argument copy, 0 for arguments formatted to a string
+  unsigned char raw_size;
+  LogArgKind kind;
+
   template <typename T> static constexpr log_type_info make() {
     return log_type_info{
         &log_class_string<T>::format,
+        log_is_raw_v<T> ? static_cast<unsigned char>(sizeof(T)) : 0,
+        log_arg_kind<T>(),
     };
   }
 };
@@ -90,6 +157,34 @@ constexpr const log_type_info type_info_v[sizeof...(Args) + 1]{
 void _orbis_log_print(LogLevel lvl, std::string_view msg,
                       std::string_view names, const log_type_info *sup, ...);
 
+///
+/// \brief Selects how log records are formatted and written.
+///
+/// In deferred modes the calling thread only copies the message, argument
+/// names and raw arguments to its ring, the background formatter thread
+/// prints them or writes them to \p path in binary form. Message and names
+/// must have static storage duration, which is the case for the ORBIS_LOG_*
+/// macros. Fatal records are always printed synchronously after the pending
+/// records.
+///
+/// Binary log starts with "ORBISLOG" and a 32-bit version followed by
+/// records starting with a tag byte, all integers are little endian:
+///   1 site:    u32 id, u8 level, u16 msg size, msg, u16 names size, names,
+///              u16 arg count, {u8 kind, u8 size} per argument
+///   2 record:  u32 site id, u32 thread id, u64 timestamp ns,
+///              u32 payload size, payload
+///   3 dropped: u64 total count of dropped records
+/// Payload contains raw bytes of every argument, string arguments are
+/// prefixed with u32 size. Records of different threads are not ordered.
+///
+void log_configure(LogMode mode, LogDropPolicy policy, std::string path = {});
+
+/// \brief Waits until the formatter thread writes all pending records.
+void log_flush();
+
+/// \brief Count of records dropped because of full ring.
+std::uint64_t log_dropped_count();
+
 template <typename... Args>
 void _orbis_log_impl(LogLevel lvl, std::string_view msg, std::string_view names,
                      const Args &...args) {
@@ -2,90 +2,242 @@
 
 #include "thread/Process.hpp"
 #include <algorithm>
+#include <vector>
 
 orbis::KNote::~KNote() {
   while (!emitters.empty()) {
     emitters.back()->unsubscribe(this);
   }
 
-  if (linked == nullptr) {
+  if (linked != nullptr && event.filter == kEvFiltProc) {
+    auto proc = static_cast<Process *>(linked);
+
+    std::lock_guard lock(proc->event.mutex);
+    proc->event.removeNote(this);
+  }
+
+  // no emitter can reach the note anymore
+  if (queue != nullptr) {
+    queue->removeReady(this);
+  }
+}
+
+void orbis::KNote::trigger() {
+  triggered = true;
+  queue->pushReady(this);
+}
+
+bool orbis::KQueue::pushReady(KNote *note, bool notify) {
+  {
+    std::lock_guard lock(readyMtx);
+
+    if (note->ready) {
+      return false;
+    }
+
+    note->ready = true;
+    note->readyNext = nullptr;
+    note->readyPrev = readyTail;
+
+    if (readyTail != nullptr) {
+      readyTail->readyNext = note;
+    } else {
+      readyHead = note;
+    }
+
+    readyTail = note;
+  }
+
+  if (notify) {
+    cv.notify_all(mtx);
+  }
+
+  return true;
+}
+
+void orbis::KQueue::removeReady(KNote *note) {
+  std::lock_guard lock(readyMtx);
+
+  if (!note->ready) {
     return;
   }
 
-  if (event.filter == kEvFiltProc) {
-    auto proc = static_cast<Process *>(linked);
+  if (note->readyPrev != nullptr) {
+    note->readyPrev->readyNext = note->readyNext;
+  } else {
+    readyHead = note->readyNext;
+  }
 
-    std::lock_guard lock(proc->event.mutex);
-    proc->event.notes.erase(this);
+  if (note->readyNext != nullptr) {
+    note->readyNext->readyPrev = note->readyPrev;
+  } else {
+    readyTail = note->readyPrev;
+  }
+
+  note->ready = false;
+  note->readyPrev = nullptr;
+  note->readyNext = nullptr;
+}
+
+orbis::KNote *orbis::KQueue::popReady() {
+  std::lock_guard lock(readyMtx);
+
+  auto note = readyHead;
+  if (note == nullptr) {
+    return nullptr;
+  }
+
+  readyHead = note->readyNext;
+  if (readyHead != nullptr) {
+    readyHead->readyPrev = nullptr;
+  } else {
+    readyTail = nullptr;
+  }
+
+  note->ready = false;
+  note->readyNext = nullptr;
+  return note;
+}
+
+namespace {
+// queues with notes triggered by the current emit, every queue is woken once
+// after all notes are visited
+thread_local std::vector<orbis::KQueue *> g_emitQueues;
+
+void triggerDeferred(orbis::KNote *note) {
+  note->triggered = true;
+
+  if (note->queue->pushReady(note, false)) {
+    g_emitQueues.push_back(note->queue);
   }
 }
 
+void wakeQueues() {
+  if (g_emitQueues.size() > 1) {
+    std::ranges::sort(g_emitQueues);
+    auto [first, last] = std::ranges::unique(g_emitQueues);
+    g_emitQueues.erase(first, last);
+  }
+
+  for (auto queue : g_emitQueues) {
+    queue->cv.notify_all(queue->mtx);
+  }
+
+  g_emitQueues.clear();
+}
+
+template <typename T>
+void forEachNote(orbis::EventEmitter::IdentMap &filterNotes,
+                 uintptr_t firstIdent, uintptr_t lastIdent, T &&fn) {
+  for (auto it = filterNotes.lower_bound(firstIdent);
+       it != filterNotes.end() && it->first <= lastIdent; ++it) {
+    for (auto note : it->second) {
+      fn(note);
+    }
+  }
+}
+} // namespace
+
 void orbis::EventEmitter::emit(sshort filter, uint fflags, intptr_t data,
                                uintptr_t ident) {
   std::lock_guard lock(mutex);
 
-  for (auto note : notes) {
-    if (note->event.filter != filter) {
-      continue;
-    }
+  auto filterNotes = getNotes(filter);
+  if (filterNotes == nullptr) {
+    return;
+  }
+
+  auto firstIdent = ident == kAnyIdent ? 0 : ident;
+
+  forEachNote(*filterNotes, firstIdent, ident, [&](KNote *note) {
     if (fflags != 0) {
       if ((note->event.fflags & fflags) == 0) {
-        continue;
+        return;
       }
 
       note->event.fflags = fflags;
     }
 
-    if (ident != std::numeric_limits<uintptr_t>::max() &&
-        note->event.ident != ident) {
-      continue;
-    }
-
     std::lock_guard lock(note->mutex);
 
     if (note->triggered) {
-      continue;
+      return;
     }
 
-    note->triggered = true;
     note->event.data = data;
-    note->queue->cv.notify_all(note->queue->mtx);
-  }
+    triggerDeferred(note);
+  });
+
+  // queue can be destroyed only after its notes are unsubscribed, so wake
+  // them before emitter mutex is released
+  wakeQueues();
 }
 
 void orbis::EventEmitter::emit(
-    sshort filter, void *userData,
+    sshort filter, uintptr_t firstIdent, uintptr_t lastIdent, void *userData,
     std::optional<intptr_t> (*filterFn)(void *userData, KNote *note)) {
   std::lock_guard lock(mutex);
 
-  for (auto note : notes) {
-    if (note->event.filter != filter) {
-      continue;
-    }
+  auto filterNotes = getNotes(filter);
+  if (filterNotes == nullptr) {
+    return;
+  }
 
+  forEachNote(*filterNotes, firstIdent, lastIdent, [&](KNote *note) {
     std::lock_guard lock(note->mutex);
 
     if (note->triggered) {
-      continue;
+      return;
     }
 
     if (auto data = filterFn(userData, note)) {
       note->event.data = *data;
-      note->triggered = true;
-      note->queue->cv.notify_all(note->queue->mtx);
+      triggerDeferred(note);
     }
+  });
+
+  wakeQueues();
+}
+
+orbis::ErrorCode orbis::EventEmitter::addNote(KNote *note) {
+  auto filterNotes = getNotes(note->event.filter);
+  if (filterNotes == nullptr) {
+    return ErrorCode::INVAL;
   }
+
+  (*filterNotes)[note->event.ident].insert(note);
+  return {};
 }
 
-void orbis::EventEmitter::subscribe(KNote *note) {
+void orbis::EventEmitter::removeNote(KNote *note) {
+  auto filterNotes = getNotes(note->event.filter);
+  if (filterNotes == nullptr) {
+    return;
+  }
+
+  auto it = filterNotes->find(note->event.ident);
+  if (it == filterNotes->end()) {
+    return;
+  }
+
+  it->second.erase(note);
+
+  if (it->second.empty()) {
+    filterNotes->erase(it);
+  }
+}
+
+orbis::ErrorCode orbis::EventEmitter::subscribe(KNote *note) {
   std::lock_guard lock(mutex);
-  notes.insert(note);
+  ORBIS_RET_ON_ERROR(addNote(note));
+
   note->emitters.emplace_back(this);
+  return {};
 }
 
 void orbis::EventEmitter::unsubscribe(KNote *note) {
   std::lock_guard lock(mutex);
-  notes.erase(note);
+  removeNote(note);
 
   auto it = std::ranges::find(note->emitters, this);
   if (it == note->emitters.end()) {
@@ -100,4 +252,4 @@ void orbis::EventEmitter::unsubscribe(KNote *note) {
   }
 
   note->emitters.pop_back();
-}
\ No newline at end of file
+}
@@ -75,6 +75,7 @@ orbis::ErrorCode orbis::EventFlag::wait(Thread *thread, std::uint8_t waitMode,
     }
 
     waitingThreads.emplace_back(waitingThread);
+    notifyWaitWatchers();
 
     {
       orbis::scoped_unblock unblock;
@@ -115,6 +116,7 @@ orbis::ErrorCode orbis::EventFlag::tryWait(Thread *thread,
     return {};
   }
 
+  notifyWaitWatchers();
   return ErrorCode::BUSY;
 }
 
@@ -4,75 +4,242 @@
 #include "thread/Thread.hpp"
 #include "uio.hpp"
 #include "utils/Logs.hpp"
+#include <algorithm>
+#include <cstring>
 #include <span>
 
+static constexpr auto kRingMask = orbis::PipeChannel::kBufferSize - 1;
+static_assert((orbis::PipeChannel::kBufferSize & kRingMask) == 0);
+
+static orbis::ErrorCode copyOut(orbis::Uio *uio, void *dst, const void *src,
+                                std::size_t size) {
+  if (uio->segflg != orbis::UioSeg::UserSpace) {
+    std::memcpy(dst, src, size);
+    return {};
+  }
+
+  return orbis::uwriteRaw(dst, src, size);
+}
+
+static orbis::ErrorCode copyIn(orbis::Uio *uio, void *dst, const void *src,
+                               std::size_t size) {
+  if (uio->segflg != orbis::UioSeg::UserSpace) {
+    std::memcpy(dst, src, size);
+    return {};
+  }
+
+  return orbis::ureadRaw(dst, src, size);
+}
+
+static orbis::ErrorCode ringRead(orbis::PipeChannel *pipe, orbis::Uio *uio,
+                                 std::uint64_t pos, std::byte *dst,
+                                 std::size_t size) {
+  auto offset = pos & kRingMask;
+  auto first = std::min(size, orbis::PipeChannel::kBufferSize - offset);
+
+  ORBIS_RET_ON_ERROR(copyOut(uio, dst, pipe->data.data() + offset, first));
+  return copyOut(uio, dst + first, pipe->data.data(), size - first);
+}
+
+static orbis::ErrorCode ringWrite(orbis::PipeChannel *pipe, orbis::Uio *uio,
+                                  std::uint64_t pos, const std::byte *src,
+                                  std::size_t size) {
+  auto offset = pos & kRingMask;
+  auto first = std::min(size, orbis::PipeChannel::kBufferSize - offset);
+
+  ORBIS_RET_ON_ERROR(copyIn(uio, pipe->data.data() + offset, src, first));
+  return copyIn(uio, pipe->data.data(), src + first, size - first);
+}
+
+// file mutex is held by the callers of every read and write op, it is released
+// while sleeping so other operations on the end are not blocked by the
+// sleeper. Callers must reload the ring positions after wait
+template <typename T>
+static void waitRing(orbis::PipeChannel *pipe, orbis::File *file, T &&pred) {
+  file->mtx.unlock();
+
+  {
+    std::lock_guard lock(pipe->waitMtx);
+
+    // pairs with the fence in wakeRing, either the waiter observes new
+    // position or the other side observes the waiter
+    pipe->waiters.fetch_add(1, std::memory_order::seq_cst);
+
+    while (!pred()) {
+      orbis::scoped_unblock unblock;
+      pipe->cv.wait(pipe->waitMtx);
+    }
+
+    pipe->waiters.fetch_sub(1, std::memory_order::relaxed);
+  }
+
+  file->mtx.lock();
+}
+
+static void wakeRing(orbis::PipeChannel *pipe) {
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+
+  if (pipe->waiters.load(std::memory_order::relaxed) != 0) {
+    std::lock_guard lock(pipe->waitMtx);
+    pipe->cv.notify_all(pipe->waitMtx);
+  }
+}
+
 static orbis::ErrorCode pipe_read(orbis::File *file, orbis::Uio *uio,
                                   orbis::Thread *thread) {
-  auto pipe = static_cast<orbis::Pipe *>(file);
-  while (true) {
-    if (pipe->data.empty()) {
-      // pipe->cv.wait(file->mtx);
-      // ORBIS_LOG_ERROR(__FUNCTION__, "wakeup", thread->name.c_str(),
-      // thread->tid, file); continue;
-      return orbis::ErrorCode::WOULDBLOCK;
-    }
+  auto pipe = static_cast<orbis::Pipe *>(file)->readChannel.get();
 
-    for (auto vec : std::span(uio->iov, uio->iovcnt)) {
-      auto size = std::min<std::size_t>(pipe->data.size(), vec.len);
+  std::uint64_t requested = 0;
+  for (auto vec : std::span(uio->iov, uio->iovcnt)) {
+    requested += vec.len;
+  }
 
-      if (size == 0) {
-        pipe->data.clear();
-        continue;
-      }
+  if (requested == 0) {
+    return {};
+  }
 
-      if (size > pipe->data.size()) {
-        size = pipe->data.size();
-      }
+  std::uint64_t readPos;
+  std::uint64_t available;
 
-      uio->offset += size;
-      std::memcpy(vec.base, pipe->data.data(), size);
+  while (true) {
+    readPos = pipe->readPos.load(std::memory_order::relaxed);
+    available = pipe->writePos.load(std::memory_order::acquire) - readPos;
 
-      ORBIS_LOG_ERROR(__FUNCTION__, thread->name.c_str(), thread->tid, file,
-                      size, pipe->data.size(), uio->offset, file->nextOff);
+    if (available != 0) {
+      break;
+    }
 
-      if (pipe->data.size() == size) {
-        pipe->data.clear();
-        break;
-      }
+    // end of file
+    if (pipe->writerClosed.load(std::memory_order::acquire)) {
+      return {};
+    }
 
-      std::memmove(pipe->data.data(), pipe->data.data() + size,
-                   pipe->data.size() - size);
-      pipe->data.resize(pipe->data.size() - size);
+    if (file->noBlock()) {
+      return orbis::ErrorCode::WOULDBLOCK;
     }
 
-    break;
+    waitRing(pipe, file, [&] {
+      return pipe->writePos.load(std::memory_order::seq_cst) != readPos ||
+             pipe->writerClosed.load(std::memory_order::seq_cst);
+    });
   }
 
-  pipe->event->emit(orbis::kEvFiltWrite);
+  std::uint64_t count = 0;
+  for (auto vec : std::span(uio->iov, uio->iovcnt)) {
+    auto size = std::min(vec.len, available - count);
+
+    ORBIS_RET_ON_ERROR(ringRead(pipe, uio, readPos + count,
+                                static_cast<std::byte *>(vec.base), size));
+    count += size;
+
+    if (count == available) {
+      break;
+    }
+  }
+
+  pipe->readPos.store(readPos + count, std::memory_order::release);
+  wakeRing(pipe);
+
+  uio->resid -= count;
+  uio->offset += count;
+  pipe->writerEvent->emit(orbis::kEvFiltWrite);
   return {};
 }
 
 static orbis::ErrorCode pipe_write(orbis::File *file, orbis::Uio *uio,
                                    orbis::Thread *thread) {
-  auto pipe = static_cast<orbis::Pipe *>(file)->other;
-  ORBIS_LOG_ERROR(__FUNCTION__, thread->name.c_str(), thread->tid, file);
+  auto pipe = static_cast<orbis::Pipe *>(file)->writeChannel.get();
+  auto writePos = pipe->writePos.load(std::memory_order::relaxed);
+  auto getSpace = [&] {
+    return orbis::PipeChannel::kBufferSize -
+           (writePos - pipe->readPos.load(std::memory_order::seq_cst));
+  };
+  auto isReaderClosed = [&] {
+    return pipe->readerClosed.load(std::memory_order::seq_cst);
+  };
 
-  std::size_t cnt = 0;
+  if (isReaderClosed()) {
+    return orbis::ErrorCode::PIPE;
+  }
+
+  std::uint64_t requested = 0;
   for (auto vec : std::span(uio->iov, uio->iovcnt)) {
-    auto offset = pipe->data.size();
-    pipe->data.resize(offset + vec.len);
-    ORBIS_RET_ON_ERROR(orbis::ureadRaw(pipe->data.data(), vec.base, vec.len));
-    cnt += vec.len;
+    requested += vec.len;
+  }
+
+  if (requested <= orbis::Pipe::kAtomicWriteSize) {
+    // small write is copied at once after the whole size is available, the
+    // file mutex is not released during the copy, so other writers of the
+    // end cannot interleave with it
+    while (getSpace() < requested) {
+      if (file->noBlock()) {
+        return orbis::ErrorCode::WOULDBLOCK;
+      }
+
+      waitRing(pipe, file,
+               [&] { return getSpace() >= requested || isReaderClosed(); });
+      writePos = pipe->writePos.load(std::memory_order::relaxed);
+
+      if (isReaderClosed()) {
+        return orbis::ErrorCode::PIPE;
+      }
+    }
+  }
+
+  std::uint64_t count = 0;
+  bool isBroken = false;
+
+  for (auto vec : std::span(uio->iov, uio->iovcnt)) {
+    auto src = static_cast<const std::byte *>(vec.base);
+    std::uint64_t copied = 0;
+
+    while (copied < vec.len) {
+      auto space = getSpace();
+
+      if (space == 0) {
+        if (file->noBlock()) {
+          break;
+        }
+
+        waitRing(pipe, file,
+                 [&] { return getSpace() != 0 || isReaderClosed(); });
+
+        // other writer could advance the ring while the mutex was released
+        writePos = pipe->writePos.load(std::memory_order::relaxed);
+
+        if (isReaderClosed()) {
+          isBroken = true;
+          break;
+        }
+
+        continue;
+      }
+
+      auto size = std::min(space, vec.len - copied);
+      ORBIS_RET_ON_ERROR(ringWrite(pipe, uio, writePos, src + copied, size));
+
+      writePos += size;
+      copied += size;
+      count += size;
+
+      // publish every chunk, reader has to drain the ring before the writer
+      // can continue
+      pipe->writePos.store(writePos, std::memory_order::release);
+      wakeRing(pipe);
+      pipe->readerEvent->emit(orbis::kEvFiltRead);
+    }
+
+    if (copied < vec.len) {
+      break;
+    }
   }
 
-  pipe->event->emit(orbis::kEvFiltRead);
-  pipe->cv.notify_one(file->mtx);
-  uio->resid -= cnt;
-  uio->offset += cnt;
+  if (count == 0 && requested != 0) {
+    return isBroken ? orbis::ErrorCode::PIPE : orbis::ErrorCode::WOULDBLOCK;
+  }
 
-  ORBIS_LOG_ERROR(__FUNCTION__, thread->name.c_str(), thread->tid, file,
-                  uio->resid, uio->offset, file->nextOff, cnt);
-  thread->where();
+  uio->resid -= count;
+  uio->offset += count;
   return {};
 }
 
@@ -81,6 +248,21 @@ static orbis::FileOps pipe_ops = {
     .write = pipe_write,
 };
 
+orbis::Pipe::~Pipe() {
+  // last reference of the end is the close of the end, wake blocked peer
+  if (readChannel != nullptr) {
+    readChannel->readerClosed.store(true, std::memory_order::seq_cst);
+    wakeRing(readChannel.get());
+    readChannel->writerEvent->emit(orbis::kEvFiltWrite);
+  }
+
+  if (writeChannel != nullptr) {
+    writeChannel->writerClosed.store(true, std::memory_order::seq_cst);
+    wakeRing(writeChannel.get());
+    writeChannel->readerEvent->emit(orbis::kEvFiltRead);
+  }
+}
+
 std::pair<rx::Ref<orbis::Pipe>, rx::Ref<orbis::Pipe>> orbis::createPipe() {
   auto a = knew<Pipe>();
   auto b = knew<Pipe>();
@@ -88,7 +270,16 @@ std::pair<rx::Ref<orbis::Pipe>, rx::Ref<orbis::Pipe>> orbis::createPipe() {
   b->event = knew<EventEmitter>();
   a->ops = &pipe_ops;
   b->ops = &pipe_ops;
-  a->other = b;
-  b->other = a;
+
+  // data written to one end is read from the other
+  for (auto [reader, writer] : {std::pair{a, b}, std::pair{b, a}}) {
+    auto channel = knew<PipeChannel>();
+    channel->data.resize(PipeChannel::kBufferSize);
+    channel->readerEvent = reader->event;
+    channel->writerEvent = writer->event;
+    reader->readChannel = channel;
+    writer->writeChannel = channel;
+  }
+
   return {a, b};
 }
@@ -4,8 +4,8 @@
 
 #include "thread/Process.hpp"
 #include "utils/Logs.hpp"
+#include <algorithm>
 #include <chrono>
-#include <list>
 #include <span>
 #include <sys/select.h>
 
@@ -60,33 +60,41 @@ static bool isWriteEventTriggered(int hostFd) {
 }
 
 namespace orbis {
-static SysResult keventChange(KQueue *kq, KEvent &change, Thread *thread) {
-  auto nodeIt = kq->notes.end();
-  for (auto it = kq->notes.begin(); it != kq->notes.end(); ++it) {
-    if (it->event.ident == change.ident && it->event.filter == change.filter) {
-      nodeIt = it;
-      break;
-    }
+static void eraseNote(KQueue *kq, decltype(kq->notes)::iterator it) {
+  if (auto polledIt = std::ranges::find(kq->polledNotes, &it->second);
+      polledIt != kq->polledNotes.end()) {
+    *polledIt = kq->polledNotes.back();
+    kq->polledNotes.pop_back();
   }
 
+  kq->notes.erase(it);
+}
+
+static SysResult keventChange(KQueue *kq, KEvent &change, Thread *thread) {
+  auto nodeIt = kq->notes.find(std::pair(change.ident, change.filter));
+
   if (change.flags & kEvDelete) {
     if (nodeIt == kq->notes.end()) {
       return orbis::ErrorCode::NOENT;
     }
 
-    kq->notes.erase(nodeIt);
+    eraseNote(kq, nodeIt);
     nodeIt = kq->notes.end();
   }
 
   std::unique_lock<rx::shared_mutex> noteLock;
   if (change.flags & kEvAdd) {
     if (nodeIt == kq->notes.end()) {
-      auto &note = kq->notes.emplace_front();
+      nodeIt = kq->notes
+                   .emplace(std::piecewise_construct,
+                            std::forward_as_tuple(change.ident, change.filter),
+                            std::forward_as_tuple())
+                   .first;
+      auto &note = nodeIt->second;
       note.event.flags &= ~(kEvAdd | kEvDelete | kEvDisable | kEvEnable);
       note.queue = kq;
       note.event = change;
       note.enabled = true;
-      nodeIt = kq->notes.begin();
 
       if (change.filter == kEvFiltProc) {
         auto process = findProcessById(change.ident);
@@ -94,16 +102,19 @@ static SysResult keventChange(KQueue *kq, KEvent &change, Thread *thread) {
           return ErrorCode::SRCH;
         }
 
-        noteLock = std::unique_lock(nodeIt->mutex);
-
         std::unique_lock lock(process->event.mutex);
-        process->event.notes.insert(&*nodeIt);
-        nodeIt->linked = process;
+        if (auto error = process->event.addNote(&note);
+            error != ErrorCode{}) {
+          eraseNote(kq, nodeIt);
+          return error;
+        }
+
+        noteLock = std::unique_lock(note.mutex);
+        note.linked = process;
         if ((change.fflags & orbis::kNoteExit) != 0 &&
             process->exitStatus.has_value()) {
           note.event.data = *process->exitStatus;
-          note.triggered = true;
-          kq->cv.notify_all(kq->mtx);
+          note.trigger();
         }
       } else if (change.filter == kEvFiltRead ||
                  change.filter == kEvFiltWrite) {
@@ -113,18 +124,28 @@ static SysResult keventChange(KQueue *kq, KEvent &change, Thread *thread) {
           return ErrorCode::BADF;
         }
 
-        nodeIt->file = fd;
+        note.file = fd;
 
         if (auto eventEmitter = fd->event) {
-          eventEmitter->subscribe(&*nodeIt);
-          nodeIt->triggered = true;
-          kq->cv.notify_all(kq->mtx);
-        } else if (note.file->hostFd < 0) {
+          if (auto error = eventEmitter->subscribe(&note);
+              error != ErrorCode{}) {
+            eraseNote(kq, nodeIt);
+            return error;
+          }
+
+          note.trigger();
+        } else if (note.file->hostFd >= 0) {
+          kq->polledNotes.push_back(&note);
+        } else {
           ORBIS_LOG_ERROR("Unimplemented event emitter", change.ident);
         }
       } else if (change.filter == kEvFiltGraphicsCore ||
                  change.filter == kEvFiltDisplay) {
-        g_context->deviceEventEmitter->subscribe(&*nodeIt);
+        if (auto error = g_context->deviceEventEmitter->subscribe(&note);
+            error != ErrorCode{}) {
+          eraseNote(kq, nodeIt);
+          return error;
+        }
       }
     }
   }
@@ -137,58 +158,59 @@ static SysResult keventChange(KQueue *kq, KEvent &change, Thread *thread) {
     return orbis::ErrorCode::NOENT;
   }
 
+  auto &note = nodeIt->second;
+
   if (change.filter == kEvFiltDisplay || change.filter == kEvFiltGraphicsCore) {
     change.flags |= kEvClear;
   }
 
   if (!noteLock.owns_lock()) {
-    noteLock = std::unique_lock(nodeIt->mutex);
+    noteLock = std::unique_lock(note.mutex);
   }
 
   if (change.flags & kEvDisable) {
-    nodeIt->enabled = false;
+    note.enabled = false;
   }
   if (change.flags & kEvEnable) {
-    nodeIt->enabled = true;
+    note.enabled = true;
+
+    if (note.triggered) {
+      kq->pushReady(&note);
+    }
   }
   if (change.flags & kEvClear) {
-    nodeIt->triggered = false;
+    note.triggered = false;
   }
 
   if (change.filter == kEvFiltUser) {
     auto fflags = 0;
     switch (change.fflags & kNoteFFCtrlMask) {
     case kNoteFFAnd:
-      fflags = nodeIt->event.fflags & change.fflags;
+      fflags = note.event.fflags & change.fflags;
       break;
     case kNoteFFOr:
-      fflags = nodeIt->event.fflags | change.fflags;
+      fflags = note.event.fflags | change.fflags;
       break;
     case kNoteFFCopy:
       fflags = change.fflags;
       break;
     }
 
-    nodeIt->event.fflags =
-        (nodeIt->event.fflags & ~kNoteFFlagsMask) | (fflags & kNoteFFlagsMask);
+    note.event.fflags =
+        (note.event.fflags & ~kNoteFFlagsMask) | (fflags & kNoteFFlagsMask);
 
     if (change.fflags & kNoteTrigger) {
-      nodeIt->event.udata = change.udata;
-      nodeIt->triggered = true;
-      kq->cv.notify_all(kq->mtx);
+      note.event.udata = change.udata;
+      note.trigger();
     }
   } else if (change.filter == kEvFiltDisplay && change.ident >> 48 == 0x6301) {
-    nodeIt->triggered = true;
-    kq->cv.notify_all(kq->mtx);
+    note.trigger();
   } else if (change.filter == kEvFiltGraphicsCore && change.ident == 0x84) {
-    nodeIt->triggered = true;
-    nodeIt->event.data |= 1000ull << 16; // clock
-
-    kq->cv.notify_all(kq->mtx);
+    note.event.data |= 1000ull << 16; // clock
+    note.trigger();
   } else if (g_context->fwType == FwType::Ps5 &&
              change.filter == kEvFiltGraphicsCore && change.ident == 0) {
-    nodeIt->triggered = true;
-    kq->cv.notify_all(kq->mtx);
+    note.trigger();
   }
 
   return {};
@@ -270,6 +292,7 @@ orbis::SysResult orbis::sys_kevent(Thread *thread, sint fd,
   std::vector<KEvent> result;
   result.reserve(nevents);
 
+  std::vector<KNote *> requeue;
   ErrorCode errorCode{};
 
   while (true) {
@@ -277,75 +300,80 @@ orbis::SysResult orbis::sys_kevent(Thread *thread, sint fd,
 
     {
       std::lock_guard lock(kq->mtx);
-      while (result.size() < nevents && !kq->triggeredEvents.empty()) {
-        result.push_back(kq->triggeredEvents.back());
-        kq->triggeredEvents.pop_back();
+
+      for (auto note : kq->polledNotes) {
+        std::lock_guard lock(note->mutex);
+
+        if (note->triggered) {
+          continue;
+        }
+
+        bool isTriggered = note->event.filter == kEvFiltRead
+                               ? isReadEventTriggered(note->file->hostFd)
+                               : isWriteEventTriggered(note->file->hostFd);
+
+        if (isTriggered) {
+          note->trigger();
+        } else {
+          canSleep = false;
+        }
       }
 
-      if (result.empty()) {
-        for (auto it = kq->notes.begin(); it != kq->notes.end();) {
-          auto &note = *it;
-          bool erase = false;
-          {
-            std::lock_guard lock(note.mutex);
-
-            if (!note.triggered) {
-              if (note.event.filter == kEvFiltRead) {
-                if (note.file->hostFd >= 0) {
-                  if (isReadEventTriggered(note.file->hostFd)) {
-                    note.triggered = true;
-                  } else {
-                    canSleep = false;
-                  }
-                }
-              } else if (note.event.filter == kEvFiltWrite) {
-                if (note.file->hostFd >= 0) {
-                  if (isWriteEventTriggered(note.file->hostFd)) {
-                    note.triggered = true;
-                  } else {
-                    canSleep = false;
-                  }
-                }
-              }
-            }
-
-            if (note.enabled && note.triggered) {
-              result.push_back(note.event);
-
-              if (note.event.filter == kEvFiltDisplay) {
-                note.triggered = false;
-              } else if (note.event.filter == kEvFiltGraphicsCore &&
-                         note.event.ident != 0x84) {
-                note.triggered = false;
-              }
-
-              if (note.event.flags & kEvDispatch) {
-                note.enabled = false;
-              }
-
-              if (note.event.flags & kEvOneshot) {
-                erase = true;
-              }
-
-              if (note.event.filter == kEvFiltRead ||
-                  note.event.filter == kEvFiltWrite) {
-                note.triggered = false;
-              }
-            }
+      // only triggered notes are visited, cost does not depend on the count of
+      // registered events
+      while (result.size() < nevents) {
+        auto note = kq->popReady();
+        if (note == nullptr) {
+          break;
+        }
+
+        bool erase = false;
+        {
+          std::lock_guard lock(note->mutex);
+
+          if (!note->enabled || !note->triggered) {
+            continue;
+          }
+
+          result.push_back(note->event);
+
+          if (note->event.filter == kEvFiltDisplay) {
+            note->triggered = false;
+          } else if (note->event.filter == kEvFiltGraphicsCore &&
+                     note->event.ident != 0x84) {
+            note->triggered = false;
+          }
+
+          if (note->event.flags & kEvDispatch) {
+            note->enabled = false;
+          }
+
+          if (note->event.flags & kEvOneshot) {
+            erase = true;
           }
 
-          if (erase) {
-            it = kq->notes.erase(it);
-          } else {
-            ++it;
+          if (note->event.filter == kEvFiltRead ||
+              note->event.filter == kEvFiltWrite) {
+            note->triggered = false;
+          }
+
+          // level triggered note, report it again on the next call
+          if (!erase && note->enabled && note->triggered) {
+            requeue.push_back(note);
           }
         }
 
-        while (result.size() > nevents) {
-          kq->triggeredEvents.push_back(result.back());
-          result.pop_back();
+        if (erase) {
+          eraseNote(kq.get(), kq->notes.find(std::pair(note->event.ident,
+                                                       note->event.filter)));
         }
       }
+
+      for (auto note : requeue) {
+        kq->pushReady(note);
+      }
+
+      requeue.clear();
     }
 
     if (!result.empty()) {
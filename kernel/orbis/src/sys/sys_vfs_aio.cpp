@@ -1,53 +1,1105 @@
+#include "aio.hpp"
+#include "event.hpp"
+#include "file.hpp"
+#include "rx/print.hpp"
 #include "sys/sysproto.hpp"
+#include "thread/Process.hpp"
+#include "thread/Thread.hpp"
+#include "time.hpp"
+#include "uio.hpp"
+#include "utils/Logs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <linux/io_uring.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <span>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static constexpr auto kOSync = 0x80;
+
+static orbis::AioStats g_aioStats;
+
+namespace orbis {
+namespace {
+using clock = std::chrono::steady_clock;
+
+enum class AioOp : std::uint8_t { Read, Write, Sync };
+
+struct AioGroup {
+  uintptr_t ident = 0;
+  sigevent event{};
+  rx::Ref<KQueue> kq;
+  pid_t pid = -1;
+
+  // requests not completed yet, protected by engine mutex
+  std::uint32_t pending = 0;
+};
+
+struct AioRequest {
+  pid_t pid = -1;
+  ptr<aiocb> guestCb = nullptr;
+  rx::Ref<File> file;
+  sint fd = -1;
+  AioOp op = AioOp::Read;
+  ::iovec iov{};
+  off_t offset = 0;
+  sigevent event{};
+  rx::Ref<KQueue> kq;
+  std::shared_ptr<AioGroup> group;
+  clock::time_point submitTime;
+
+  // fields below are protected by engine mutex
+  bool queued = false;
+  bool inRing = false;
+  bool rejected = false;
+  bool done = false;
+  ssize_t result = 0;
+  ErrorCode error{};
+};
+
+///
+/// \brief Minimal io_uring wrapper, liburing is not a dependency.
+///
+/// Submission side must be externally synchronized, completions are reaped
+/// by a single thread.
+///
+class IoUring {
+  int mFd = -1;
+  void *mRing = MAP_FAILED;
+  std::size_t mRingSize = 0;
+  io_uring_sqe *mSqes = nullptr;
+  std::size_t mSqesSize = 0;
+
+  unsigned *mSqHead = nullptr;
+  unsigned *mSqTail = nullptr;
+  unsigned *mSqArray = nullptr;
+  unsigned mSqMask = 0;
+  unsigned mSqEntries = 0;
+  unsigned mSqLocalTail = 0;
+
+  unsigned *mCqHead = nullptr;
+  unsigned *mCqTail = nullptr;
+  io_uring_cqe *mCqes = nullptr;
+  unsigned mCqMask = 0;
+
+public:
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+
+  ~IoUring() {
+    if (mSqes != nullptr) {
+      ::munmap(mSqes, mSqesSize);
+    }
+
+    if (mRing != MAP_FAILED) {
+      ::munmap(mRing, mRingSize);
+    }
+
+    if (mFd >= 0) {
+      ::close(mFd);
+    }
+  }
+
+  bool create(unsigned entries) {
+    io_uring_params params{};
+    mFd = ::syscall(SYS_io_uring_setup, entries, &params);
+    if (mFd < 0) {
+      return false;
+    }
+
+    // kernels without single ring mapping are too old to bother
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+      return false;
+    }
+
+    mRingSize =
+        std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    mRing = ::mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    if (mRing == MAP_FAILED) {
+      return false;
+    }
+
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = ::mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+
+    auto base = static_cast<std::byte *>(mRing);
+    auto at = [base](std::uint32_t offset) {
+      return reinterpret_cast<unsigned *>(base + offset);
+    };
+
+    mSqes = static_cast<io_uring_sqe *>(sqes);
+    mSqHead = at(params.sq_off.head);
+    mSqTail = at(params.sq_off.tail);
+    mSqArray = at(params.sq_off.array);
+    mSqMask = *at(params.sq_off.ring_mask);
+    mSqEntries = params.sq_entries;
+    mSqLocalTail = *mSqTail;
+
+    mCqHead = at(params.cq_off.head);
+    mCqTail = at(params.cq_off.tail);
+    mCqes = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+    mCqMask = *at(params.cq_off.ring_mask);
+    return true;
+  }
+
+  unsigned getEntryCount() const { return mSqEntries; }
+
+  io_uring_sqe *getSqe() {
+    auto head = std::atomic_ref(*mSqHead).load(std::memory_order::acquire);
+    if (mSqLocalTail - head >= mSqEntries) {
+      return nullptr;
+    }
+
+    auto index = mSqLocalTail++ & mSqMask;
+    mSqArray[index] = index;
+
+    auto sqe = mSqes + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  int submit() {
+    std::atomic_ref(*mSqTail).store(mSqLocalTail, std::memory_order::release);
+
+    auto head = std::atomic_ref(*mSqHead).load(std::memory_order::acquire);
+    auto count = mSqLocalTail - head;
+
+    int result;
+    do {
+      result = ::syscall(SYS_io_uring_enter, mFd, count, 0, 0, nullptr, 0);
+    } while (result < 0 && errno == EINTR);
+
+    return result;
+  }
+
+  /// \brief Drops entries the kernel did not consume, in submission order
+  /// they are the last ones.
+  void discardPending() {
+    mSqLocalTail = std::atomic_ref(*mSqHead).load(std::memory_order::acquire);
+    std::atomic_ref(*mSqTail).store(mSqLocalTail, std::memory_order::release);
+  }
+
+  int wait() {
+    return ::syscall(SYS_io_uring_enter, mFd, 0, 1, IORING_ENTER_GETEVENTS,
+                     nullptr, 0);
+  }
+
+  template <typename T> void reap(T &&fn) {
+    auto head = *mCqHead;
+    auto tail = std::atomic_ref(*mCqTail).load(std::memory_order::acquire);
+
+    for (; head != tail; ++head) {
+      fn(mCqes[head & mCqMask]);
+    }
+
+    std::atomic_ref(*mCqHead).store(head, std::memory_order::release);
+  }
+};
+
+static void updateMax(std::atomic<std::uint64_t> &max, std::uint64_t value) {
+  auto prev = max.load(std::memory_order::relaxed);
+  while (prev < value &&
+         !max.compare_exchange_weak(prev, value, std::memory_order::relaxed)) {
+  }
+}
+
+static void setupEngineThread(const char *name) {
+  // process directed guest signals must be delivered to guest threads
+  sigset_t set;
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+  pthread_setname_np(pthread_self(), name);
+}
+
+// process directed signal, delivered to a running thread that accepts it
+static void sendProcessSignal(pid_t pid, int signo) {
+  auto process = findProcessById(pid);
+  if (process == nullptr) {
+    return;
+  }
+
+  Thread *target = nullptr;
+  process->threadsMap.walk([&](auto, Thread *thread) {
+    if (target == nullptr && thread->state == ThreadState::RUNNING &&
+        thread->sigMask.test(signo)) {
+      target = thread;
+    }
+  });
+
+  if (target != nullptr) {
+    target->sendSignal(signo);
+  }
+}
+
+static void deliver(const sigevent &event, KQueue *kq, uintptr_t ident,
+                    sshort filter, pid_t pid) {
+  if (event.sigev_notify == kSigEvKevent && kq != nullptr) {
+    std::lock_guard lock(kq->mtx);
+
+    auto it = kq->notes.find(std::pair(ident, filter));
+    if (it == kq->notes.end()) {
+      return;
+    }
+
+    std::lock_guard noteLock(it->second.mutex);
+    it->second.trigger();
+  } else if (event.sigev_notify == kSigEvSignal) {
+    sendProcessSignal(pid, event.sigev_signo);
+  }
+}
+
+static ErrorCode registerNotify(Thread *thread, const sigevent &event,
+                                uintptr_t ident, sshort filter,
+                                rx::Ref<KQueue> &result) {
+  if (event.sigev_notify == kSigEvNone || event.sigev_notify == kSigEvSignal) {
+    return {};
+  }
+
+  if (event.sigev_notify != kSigEvKevent) {
+    ORBIS_LOG_TODO("aio: unsupported notification", event.sigev_notify);
+    return {};
+  }
+
+  auto kq =
+      thread->tproc->fileDescriptors.get(event.sigev_signo).cast<KQueue>();
+  if (kq == nullptr) {
+    return ErrorCode::BADF;
+  }
+
+  std::lock_guard lock(kq->mtx);
+  auto [it, inserted] = kq->notes.try_emplace(std::pair(ident, filter));
+  auto &note = it->second;
+
+  std::lock_guard noteLock(note.mutex);
+  if (!inserted) {
+    // control block reused before the previous event was received
+    note.triggered = false;
+    kq->removeReady(&note);
+  }
+
+  note.queue = kq.get();
+  note.event = {
+      .ident = ident,
+      .filter = filter,
+      .flags = kEvOneshot,
+      .udata = event.sigev_value,
+  };
+  note.enabled = true;
+
+  result = std::move(kq);
+  return {};
+}
+
+static std::pair<ssize_t, ErrorCode> executeHost(AioRequest &request) {
+  auto hostFd = request.file->hostFd;
+  ssize_t result = 0;
+
+  switch (request.op) {
+  case AioOp::Read:
+    result = ::preadv(hostFd, &request.iov, 1, request.offset);
+    break;
+  case AioOp::Write:
+    result = ::pwritev(hostFd, &request.iov, 1, request.offset);
+    break;
+  case AioOp::Sync:
+    result = ::fsync(hostFd);
+    break;
+  }
+
+  if (result < 0) {
+    return {-1, toErrorCode(static_cast<std::errc>(errno))};
+  }
+
+  return {result, {}};
+}
+
+static std::pair<ssize_t, ErrorCode> executeFileOps(Thread *thread,
+                                                    AioRequest &request) {
+  if (request.op == AioOp::Sync) {
+    return {0, {}};
+  }
+
+  auto fn = request.op == AioOp::Read ? request.file->ops->read
+                                      : request.file->ops->write;
+  if (fn == nullptr) {
+    return {-1, ErrorCode::NOTSUP};
+  }
+
+  std::lock_guard lock(request.file->mtx);
+  IoVec vec{.base = request.iov.iov_base, .len = request.iov.iov_len};
+
+  Uio io{
+      .offset = static_cast<std::uint64_t>(request.offset),
+      .iov = &vec,
+      .iovcnt = 1,
+      .segflg = UioSeg::UserSpace,
+      .rw = request.op == AioOp::Read ? UioRw::Read : UioRw::Write,
+      .td = thread,
+  };
+
+  auto error = fn(request.file.get(), &io, thread);
+  if (error != ErrorCode{} && error != ErrorCode::AGAIN) {
+    return {-1, error};
+  }
+
+  return {static_cast<ssize_t>(io.offset - request.offset), {}};
+}
+
+///
+/// \brief Asynchronous I/O engine of the host process.
+///
+/// Requests on host descriptors are submitted to io_uring in batches, thread
+/// pool is used when io_uring is not available or full. Requests on emulated
+/// files are executed by the submitting thread.
+///
+/// Requests are kept in the table until completion is reported to the guest
+/// with aio_return or aio_waitcomplete.
+///
+struct AioEngine {
+  static constexpr unsigned kRingEntries = 128;
+  static constexpr unsigned kPoolThreadCount = 4;
+
+  using Key = std::pair<pid_t, ptr<aiocb>>;
+
+  rx::shared_mutex mtx;
+  rx::shared_cv completionCv;
+  rx::shared_cv poolCv;
+  std::map<Key, std::shared_ptr<AioRequest>> requests;
+  std::deque<std::shared_ptr<AioRequest>> poolQueue;
+
+  IoUring ring;
+  bool hasRing = false;
+  unsigned ringInFlight = 0;
+
+  AioEngine() {
+    hasRing = ring.create(kRingEntries);
+
+    if (hasRing) {
+      std::thread([this] { ringEntry(); }).detach();
+    } else {
+      ORBIS_LOG_WARNING("aio: io_uring is not available, using thread pool");
+    }
+
+    for (unsigned i = 0; i < kPoolThreadCount; ++i) {
+      std::thread([this] { poolEntry(); }).detach();
+    }
+  }
+
+  void submit(Thread *thread,
+              std::span<const std::shared_ptr<AioRequest>> batch) {
+    std::vector<AioRequest *> local;
+    std::vector<std::shared_ptr<AioRequest>> ringBatch;
+    bool wakePool = false;
+
+    {
+      std::lock_guard lock(mtx);
+
+      for (auto &request : batch) {
+        request->submitTime = clock::now();
+        updateMax(g_aioStats.maxQueueDepth,
+                  g_aioStats.queueDepth.fetch_add(
+                      1, std::memory_order::relaxed) +
+                      1);
+        g_aioStats.bytesInFlight.fetch_add(request->iov.iov_len,
+                                           std::memory_order::relaxed);
+
+        auto [it, inserted] =
+            requests.try_emplace(Key(request->pid, request->guestCb), request);
+
+        if (!inserted) {
+          if (!it->second->done) {
+            // control block is still in use
+            request->rejected = true;
+            local.push_back(request.get());
+            continue;
+          }
+
+          it->second = request;
+        }
+
+        if (request->file->hostFd < 0) {
+          local.push_back(request.get());
+          continue;
+        }
+
+        io_uring_sqe *sqe = nullptr;
+        if (hasRing && ringInFlight < ring.getEntryCount()) {
+          sqe = ring.getSqe();
+        }
+
+        if (sqe == nullptr) {
+          request->queued = true;
+          poolQueue.push_back(request);
+          wakePool = true;
+          g_aioStats.poolRequests.fetch_add(1, std::memory_order::relaxed);
+          continue;
+        }
+
+        switch (request->op) {
+        case AioOp::Read:
+          sqe->opcode = IORING_OP_READV;
+          break;
+        case AioOp::Write:
+          sqe->opcode = IORING_OP_WRITEV;
+          break;
+        case AioOp::Sync:
+          sqe->opcode = IORING_OP_FSYNC;
+          break;
+        }
+
+        sqe->fd = request->file->hostFd;
+        if (request->op != AioOp::Sync) {
+          sqe->addr = reinterpret_cast<std::uint64_t>(&request->iov);
+          sqe->len = 1;
+          sqe->off = request->offset;
+        }
+
+        // request cannot be removed from the table before completion
+        sqe->user_data = reinterpret_cast<std::uint64_t>(request.get());
+        request->inRing = true;
+        ++ringInFlight;
+        ringBatch.push_back(request);
+      }
+
+      if (!ringBatch.empty()) {
+        auto submitted = ring.submit();
+        if (submitted < 0) {
+          ORBIS_LOG_ERROR("aio: io_uring submit failed", errno);
+          submitted = 0;
+        }
+
+        if (static_cast<std::size_t>(submitted) < ringBatch.size()) {
+          // entries left in the ring are never completed, execute their
+          // requests on the pool
+          ring.discardPending();
+
+          for (auto &request : std::span(ringBatch).subspan(submitted)) {
+            request->inRing = false;
+            --ringInFlight;
+            request->queued = true;
+            poolQueue.push_back(request);
+            wakePool = true;
+            g_aioStats.poolRequests.fetch_add(1, std::memory_order::relaxed);
+          }
+        }
+
+        g_aioStats.ringRequests.fetch_add(submitted,
+                                          std::memory_order::relaxed);
+        g_aioStats.ringSubmits.fetch_add(1, std::memory_order::relaxed);
+      }
+
+      if (wakePool) {
+        poolCv.notify_all(mtx);
+      }
+    }
+
+    for (auto request : local) {
+      if (request->rejected) {
+        finish(*request, -1, ErrorCode::INVAL);
+        continue;
+      }
+
+      auto [result, error] = executeFileOps(thread, *request);
+      finish(*request, result, error);
+    }
+  }
+
+  void finish(AioRequest &request, ssize_t result, ErrorCode error) {
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       clock::now() - request.submitTime)
+                       .count();
+
+    g_aioStats.queueDepth.fetch_sub(1, std::memory_order::relaxed);
+    g_aioStats.bytesInFlight.fetch_sub(request.iov.iov_len,
+                                       std::memory_order::relaxed);
+    g_aioStats.completions.fetch_add(1, std::memory_order::relaxed);
+    g_aioStats.bytesTransferred.fetch_add(std::max<ssize_t>(result, 0),
+                                          std::memory_order::relaxed);
+    g_aioStats.latencyNs.fetch_add(latency, std::memory_order::relaxed);
+    updateMax(g_aioStats.maxLatencyNs, latency);
+
+    // request can be released by aio_return as soon as it is marked done,
+    // copy everything required for notification
+    auto ident = reinterpret_cast<uintptr_t>(request.guestCb);
+    auto pid = request.pid;
+    auto rejected = request.rejected;
+    auto event = request.event;
+    auto kq = request.kq;
+    std::shared_ptr<AioGroup> group;
+
+    {
+      std::lock_guard lock(mtx);
+      request.result = result;
+      request.error = error;
+      request.done = true;
+
+      if (std::exchange(request.inRing, false)) {
+        --ringInFlight;
+      }
+
+      if (request.group != nullptr && --request.group->pending == 0) {
+        group = request.group;
+      }
+    }
+
+    completionCv.notify_all(mtx);
+
+    if (!rejected) {
+      deliver(event, kq.get(), ident, kEvFiltAio, pid);
+    }
+
+    if (group != nullptr) {
+      deliver(group->event, group->kq.get(), group->ident, kEvFiltLio,
+              group->pid);
+    }
+  }
+
+  /// \brief Waits for predicate, caller must hold engine mutex.
+  template <typename T> bool waitFor(std::uint64_t usecTimeout, T &&pred) {
+    auto deadline = usecTimeout == ~std::uint64_t(0)
+                        ? clock::time_point::max()
+                        : clock::now() + std::chrono::microseconds(usecTimeout);
+
+    while (!pred()) {
+      std::uint64_t waitTimeout = -1;
+
+      if (deadline != clock::time_point::max()) {
+        auto now = clock::now();
+        if (now >= deadline) {
+          return false;
+        }
+
+        waitTimeout = std::chrono::duration_cast<std::chrono::microseconds>(
+                          deadline - now)
+                          .count() +
+                      1;
+      }
+
+      orbis::scoped_unblock unblock;
+      completionCv.wait(mtx, waitTimeout);
+    }
+
+    return true;
+  }
+
+  sint cancel(pid_t pid, sint fd, ptr<aiocb> guestCb) {
+    std::vector<std::shared_ptr<AioRequest>> canceled;
+    bool notCanceled = false;
+
+    {
+      std::lock_guard lock(mtx);
+
+      for (auto it = requests.lower_bound(Key(pid, nullptr));
+           it != requests.end() && it->first.first == pid; ++it) {
+        auto &request = it->second;
+
+        if (request->done || request->fd != fd ||
+            (guestCb != nullptr && request->guestCb != guestCb)) {
+          continue;
+        }
+
+        if (!request->queued) {
+          notCanceled = true;
+          continue;
+        }
+
+        request->queued = false;
+        std::erase(poolQueue, request);
+        canceled.push_back(request);
+      }
+    }
+
+    for (auto &request : canceled) {
+      finish(*request, -1, ErrorCode::CANCELED);
+    }
+
+    if (notCanceled) {
+      return kAioNotCanceled;
+    }
+
+    return canceled.empty() ? kAioAllDone : kAioCanceled;
+  }
+
+  void ringEntry() {
+    setupEngineThread("aio-ring");
+
+    auto reap = [this] {
+      ring.reap([this](const io_uring_cqe &cqe) {
+        auto request = reinterpret_cast<AioRequest *>(cqe.user_data);
+
+        if (cqe.res < 0) {
+          finish(*request, -1, toErrorCode(static_cast<std::errc>(-cqe.res)));
+        } else {
+          finish(*request, cqe.res, {});
+        }
+      });
+    };
+
+    while (true) {
+      if (ring.wait() < 0 && errno != EINTR) {
+        ORBIS_LOG_ERROR("aio: io_uring wait failed, using thread pool", errno);
+        break;
+      }
+
+      reap();
+    }
+
+    {
+      std::lock_guard lock(mtx);
+      hasRing = false;
+    }
+
+    // requests in flight still post completions to the ring
+    while (true) {
+      reap();
+
+      {
+        std::lock_guard lock(mtx);
+        if (ringInFlight == 0) {
+          break;
+        }
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void poolEntry() {
+    setupEngineThread("aio-pool");
+
+    while (true) {
+      std::shared_ptr<AioRequest> request;
+
+      {
+        std::lock_guard lock(mtx);
+
+        while (poolQueue.empty()) {
+          poolCv.wait(mtx);
+        }
+
+        request = std::move(poolQueue.front());
+        poolQueue.pop_front();
+        request->queued = false;
+      }
+
+      auto [result, error] = executeHost(*request);
+      finish(*request, result, error);
+    }
+  }
+};
+
+static std::mutex g_aioEngineMtx;
+static AioEngine *g_aioEngine = nullptr;
+static int g_aioEngineHostPid = -1;
+
+static AioEngine &getAioEngine() {
+  std::lock_guard lock(g_aioEngineMtx);
+
+  // threads and io_uring of the parent are not inherited by forked process,
+  // engine lives until the host process exits
+  if (g_aioEngine == nullptr || g_aioEngineHostPid != ::getpid()) {
+    g_aioEngine = new AioEngine();
+    g_aioEngineHostPid = ::getpid();
+  }
+
+  return *g_aioEngine;
+}
+
+static ErrorCode readTimeout(ptr<const timespec> timeout, std::uint64_t &usec) {
+  usec = -1;
+
+  if (timeout == nullptr) {
+    return {};
+  }
+
+  timespec ts;
+  ORBIS_RET_ON_ERROR(uread(ts, timeout));
+  if (ts.nsec >= 1'000'000'000) {
+    return ErrorCode::INVAL;
+  }
+
+  usec = ts.sec * 1'000'000 + ts.nsec / 1000;
+  return {};
+}
+
+static ErrorCode createRequest(Thread *thread, ptr<aiocb> guestCb, AioOp op,
+                               bool legacy,
+                               std::shared_ptr<AioRequest> &result) {
+  // legacy control block ends before sigevent
+  aiocb cb{};
+  ORBIS_RET_ON_ERROR(ureadRaw(
+      &cb, guestCb, legacy ? offsetof(aiocb, aio_sigevent) : sizeof(aiocb)));
+
+  auto file = thread->tproc->fileDescriptors.get(cb.aio_fildes);
+  if (file == nullptr) {
+    return ErrorCode::BADF;
+  }
+
+  if (op != AioOp::Sync && cb.aio_offset < 0) {
+    return ErrorCode::INVAL;
+  }
+
+  auto request = std::make_shared<AioRequest>();
+  request->pid = thread->tproc->pid;
+  request->guestCb = guestCb;
+  request->file = std::move(file);
+  request->fd = cb.aio_fildes;
+  request->op = op;
+  request->offset = cb.aio_offset;
+
+  if (op != AioOp::Sync) {
+    request->iov = {.iov_base = cb.aio_buf, .iov_len = cb.aio_nbytes};
+  }
+
+  if (legacy) {
+    request->event.sigev_notify = cb.aio_spare[0];
+    request->event.sigev_signo = cb.aio_spare[1];
+    request->event.sigev_value = cb.aio_spare2;
+  } else {
+    request->event = cb.aio_sigevent;
+  }
+
+  ORBIS_RET_ON_ERROR(registerNotify(thread, request->event,
+                                    reinterpret_cast<uintptr_t>(guestCb),
+                                    kEvFiltAio, request->kq));
+  result = std::move(request);
+  return {};
+}
+
+static SysResult submitOne(Thread *thread, ptr<aiocb> guestCb, AioOp op,
+                           bool legacy) {
+  std::shared_ptr<AioRequest> request;
+  ORBIS_RET_ON_ERROR(createRequest(thread, guestCb, op, legacy, request));
+  getAioEngine().submit(thread, std::span(&request, 1));
+
+  if (request->rejected) {
+    return ErrorCode::INVAL;
+  }
+
+  return {};
+}
+
+static SysResult listIo(Thread *thread, sint mode, ptr<cptr<aiocb>> list,
+                        sint nent, const sigevent *event, bool legacy) {
+  if (mode != kLioNoWait && mode != kLioWait) {
+    return ErrorCode::INVAL;
+  }
+
+  if (nent < 0 || nent > kAioListIoMax) {
+    return ErrorCode::INVAL;
+  }
+
+  std::vector<ptr<aiocb>> cbs(nent);
+  ORBIS_RET_ON_ERROR(uread(cbs.data(), list, nent));
+
+  std::shared_ptr<AioGroup> group;
+  if (mode == kLioNoWait && event != nullptr &&
+      event->sigev_notify != kSigEvNone) {
+    group = std::make_shared<AioGroup>();
+    group->ident = reinterpret_cast<uintptr_t>(list);
+    group->event = *event;
+    group->pid = thread->tproc->pid;
+    ORBIS_RET_ON_ERROR(registerNotify(thread, *event, group->ident,
+                                      kEvFiltLio, group->kq));
+  }
+
+  std::vector<std::shared_ptr<AioRequest>> requests;
+  requests.reserve(nent);
+  bool failed = false;
+
+  for (auto cb : cbs) {
+    if (cb == nullptr) {
+      continue;
+    }
+
+    sint opcode;
+    if (uread(opcode, &cb->aio_lio_opcode) != ErrorCode{}) {
+      failed = true;
+      continue;
+    }
+
+    if (opcode == kLioNop) {
+      continue;
+    }
+
+    if (opcode != kLioRead && opcode != kLioWrite) {
+      failed = true;
+      continue;
+    }
+
+    std::shared_ptr<AioRequest> request;
+    if (createRequest(thread, cb,
+                      opcode == kLioRead ? AioOp::Read : AioOp::Write, legacy,
+                      request) != ErrorCode{}) {
+      failed = true;
+      continue;
+    }
+
+    request->group = group;
+    requests.push_back(std::move(request));
+  }
+
+  if (group != nullptr) {
+    group->pending = requests.size();
+
+    if (requests.empty()) {
+      deliver(group->event, group->kq.get(), group->ident, kEvFiltLio,
+              group->pid);
+    }
+  }
+
+  auto &engine = getAioEngine();
+  engine.submit(thread, requests);
+
+  if (mode == kLioWait) {
+    std::lock_guard lock(engine.mtx);
+    engine.waitFor(-1, [&] {
+      return std::ranges::all_of(
+          requests, [](auto &request) { return request->done; });
+    });
+
+    for (auto &request : requests) {
+      failed |= request->error != ErrorCode{};
+    }
+  } else {
+    for (auto &request : requests) {
+      failed |= request->rejected;
+    }
+  }
+
+  if (failed) {
+    return ErrorCode::IO;
+  }
+
+  return {};
+}
+} // namespace
+} // namespace orbis
+
+orbis::AioStats &orbis::getAioStats() { return g_aioStats; }
+
+void orbis::printAioStats() {
+  auto completions = g_aioStats.completions.load();
+  if (completions == 0) {
+    return;
+  }
+
+  rx::println(stderr,
+              "aio: {} io_uring requests in {} submits, {} pool requests, max "
+              "queue depth {}",
+              g_aioStats.ringRequests.load(), g_aioStats.ringSubmits.load(),
+              g_aioStats.poolRequests.load(), g_aioStats.maxQueueDepth.load());
+  rx::println(stderr,
+              "aio: {} completed, {} bytes, avg latency {} us, max latency {} "
+              "us",
+              completions, g_aioStats.bytesTransferred.load(),
+              g_aioStats.latencyNs.load() / completions / 1000,
+              g_aioStats.maxLatencyNs.load() / 1000);
+}
 
 orbis::SysResult orbis::sys_aio_return(Thread *thread,
                                        ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  auto &engine = getAioEngine();
+  std::shared_ptr<AioRequest> request;
+
+  {
+    std::lock_guard lock(engine.mtx);
+    auto it = engine.requests.find(AioEngine::Key(thread->tproc->pid, aiocbp));
+    if (it == engine.requests.end() || !it->second->done) {
+      return ErrorCode::INVAL;
+    }
+
+    request = std::move(it->second);
+    engine.requests.erase(it);
+  }
+
+  if (request->error != ErrorCode{}) {
+    return request->error;
+  }
+
+  thread->retval[0] = request->result;
+  return {};
 }
 orbis::SysResult orbis::sys_aio_suspend(Thread *thread,
                                         ptr<struct aiocb> aiocbp, sint nent,
                                         ptr<const timespec> timeout) {
-  return ErrorCode::NOSYS;
+  if (nent <= 0 || nent > kAioListIoMax) {
+    return ErrorCode::INVAL;
+  }
+
+  // aiocbp is an array of control block pointers
+  std::vector<ptr<aiocb>> list(nent);
+  auto guestList = reinterpret_cast<ptr<const ptr<aiocb>>>(aiocbp);
+  ORBIS_RET_ON_ERROR(uread(list.data(), guestList, nent));
+
+  std::uint64_t usecTimeout;
+  ORBIS_RET_ON_ERROR(readTimeout(timeout, usecTimeout));
+
+  auto &engine = getAioEngine();
+  auto pid = thread->tproc->pid;
+
+  std::lock_guard lock(engine.mtx);
+  bool completed = engine.waitFor(usecTimeout, [&] {
+    return std::ranges::any_of(list, [&](ptr<aiocb> cb) {
+      auto it = engine.requests.find(AioEngine::Key(pid, cb));
+      return cb != nullptr && it != engine.requests.end() && it->second->done;
+    });
+  });
+
+  if (!completed) {
+    return ErrorCode::AGAIN;
+  }
+
+  return {};
 }
 orbis::SysResult orbis::sys_aio_cancel(Thread *thread, sint fd,
                                        ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  if (thread->tproc->fileDescriptors.get(fd) == nullptr) {
+    return ErrorCode::BADF;
+  }
+
+  if (aiocbp != nullptr) {
+    sint fildes;
+    ORBIS_RET_ON_ERROR(uread(fildes, &aiocbp->aio_fildes));
+
+    if (fildes != fd) {
+      return ErrorCode::BADF;
+    }
+  }
+
+  thread->retval[0] = getAioEngine().cancel(thread->tproc->pid, fd, aiocbp);
+  return {};
 }
 orbis::SysResult orbis::sys_aio_error(Thread *thread,
                                       ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  auto &engine = getAioEngine();
+  std::lock_guard lock(engine.mtx);
+
+  auto it = engine.requests.find(AioEngine::Key(thread->tproc->pid, aiocbp));
+  if (it == engine.requests.end()) {
+    return ErrorCode::INVAL;
+  }
+
+  auto error = it->second->done ? it->second->error : ErrorCode::INPROGRESS;
+  thread->retval[0] = static_cast<sint>(error);
+  return {};
 }
 orbis::SysResult orbis::sys_oaio_read(Thread *thread,
                                       ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  return submitOne(thread, aiocbp, AioOp::Read, true);
 }
 orbis::SysResult orbis::sys_aio_read(Thread *thread, ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  return submitOne(thread, aiocbp, AioOp::Read, false);
 }
 orbis::SysResult orbis::sys_oaio_write(Thread *thread,
                                        ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  return submitOne(thread, aiocbp, AioOp::Write, true);
 }
 orbis::SysResult orbis::sys_aio_write(Thread *thread,
                                       ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  return submitOne(thread, aiocbp, AioOp::Write, false);
 }
 orbis::SysResult orbis::sys_olio_listio(Thread *thread, sint mode,
                                         ptr<cptr<struct aiocb>> acb_list,
                                         sint nent, ptr<struct osigevent> sig) {
-  return ErrorCode::NOSYS;
+  if (sig == nullptr) {
+    return listIo(thread, mode, acb_list, nent, nullptr, true);
+  }
+
+  osigevent oldEvent;
+  ORBIS_RET_ON_ERROR(uread(oldEvent, sig));
+
+  sigevent event{
+      .sigev_notify = oldEvent.sigev_notify,
+      .sigev_signo = oldEvent.sigev_signo,
+      .sigev_value = oldEvent.sigev_value,
+  };
+
+  return listIo(thread, mode, acb_list, nent, &event, true);
 }
 orbis::SysResult orbis::sys_lio_listio(Thread *thread, sint mode,
                                        ptr<cptr<struct aiocb>> aiocbp,
                                        sint nent, ptr<struct sigevent> sig) {
-  return ErrorCode::NOSYS;
+  if (sig == nullptr) {
+    return listIo(thread, mode, aiocbp, nent, nullptr, false);
+  }
+
+  sigevent event;
+  ORBIS_RET_ON_ERROR(uread(event, sig));
+  return listIo(thread, mode, aiocbp, nent, &event, false);
 }
 orbis::SysResult orbis::sys_aio_waitcomplete(Thread *thread,
                                              ptr<ptr<struct aiocb>> aiocbp,
                                              ptr<timespec> timeout) {
-  return ErrorCode::NOSYS;
+  std::uint64_t usecTimeout;
+  ORBIS_RET_ON_ERROR(readTimeout(timeout, usecTimeout));
+
+  auto &engine = getAioEngine();
+  auto pid = thread->tproc->pid;
+  auto first = AioEngine::Key(pid, nullptr);
+  std::shared_ptr<AioRequest> request;
+
+  {
+    std::lock_guard lock(engine.mtx);
+
+    auto it = engine.requests.lower_bound(first);
+    if (it == engine.requests.end() || it->first.first != pid) {
+      return ErrorCode::AGAIN;
+    }
+
+    bool completed = engine.waitFor(usecTimeout, [&] {
+      for (it = engine.requests.lower_bound(first);
+           it != engine.requests.end() && it->first.first == pid; ++it) {
+        if (it->second->done) {
+          return true;
+        }
+      }
+
+      return false;
+    });
+
+    if (!completed) {
+      return ErrorCode::AGAIN;
+    }
+
+    request = std::move(it->second);
+    engine.requests.erase(it);
+  }
+
+  ORBIS_RET_ON_ERROR(uwrite(aiocbp, request->guestCb));
+
+  if (request->error != ErrorCode{}) {
+    return request->error;
+  }
+
+  thread->retval[0] = request->result;
+  return {};
 }
 orbis::SysResult orbis::sys_aio_fsync(Thread *thread, sint op,
                                       ptr<struct aiocb> aiocbp) {
-  return ErrorCode::NOSYS;
+  if (op != kOSync) {
+    return ErrorCode::INVAL;
+  }
+
+  return submitOne(thread, aiocbp, AioOp::Sync, false);
 }
@@ -9,32 +9,58 @@
 
 namespace orbis {
 struct UmtxKey {
-  // TODO: may contain a reference to a shared memory
+  // address for process private objects and offset in the backing object
+  // for process shared ones
   std::uintptr_t addr;
-  orbis::pid_t pid;
+
+  // pid of the owner for process private objects. For process shared ones,
+  // host device of the backing file, backing device or zero for anonymous
+  // memory
+  std::uint64_t object;
+
+  // host inode of the backing file of process shared objects, zero otherwise
+  std::uint64_t inode;
 
   auto operator<=>(const UmtxKey &) const = default;
 };
 
-struct UmtxCond {
-  Thread *thr;
+// sleep queue node, every thread owns one and waits on at most one umtx
+struct UmtxWaiter {
+  UmtxKey key{};
   rx::shared_cv cv;
+  UmtxWaiter *prev = nullptr;
+  UmtxWaiter *next = nullptr;
+
+  // cleared by the waker when the waiter is removed from the queue
+  bool queued = false;
 
-  UmtxCond(Thread *thr) : thr(thr) {}
+  void serialize(rx::Serializer &) const {}
+  void deserialize(rx::Deserializer &) {}
 };
 
+static auto umtxWaiter = createThreadLocalObject<UmtxWaiter>();
+
 struct UmtxChain {
   rx::shared_mutex mtx;
-  using queue_type = kmultimap<UmtxKey, UmtxCond>;
-  queue_type sleep_queue;
-  queue_type spare_queue;
+  UmtxWaiter *head = nullptr;
+  UmtxWaiter *tail = nullptr;
+
+  // count of queued waiters, wakers skip the chain lock if it is zero
+  std::atomic<uint> waiters{0};
 
-  std::pair<const UmtxKey, UmtxCond> *enqueue(UmtxKey &key, Thread *thr);
-  void erase(std::pair<const UmtxKey, UmtxCond> *obj);
-  queue_type::iterator erase(queue_type::iterator it);
+  UmtxWaiter *enqueue(const UmtxKey &key, Thread *thr);
+  void erase(UmtxWaiter *waiter);
+  std::size_t count(const UmtxKey &key) const;
   uint notify_one(const UmtxKey &key);
   uint notify_all(const UmtxKey &key);
   uint notify_n(const UmtxKey &key, sint count);
+
+  bool empty() const {
+    // pairs with the increment in enqueue, either the waker observes the
+    // waiter or the waiter observes the new value of the umtx
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    return waiters.load(std::memory_order::relaxed) == 0;
+  }
 };
 
 struct UmtxStorage {
@@ -46,22 +72,42 @@ struct UmtxStorage {
 
   UmtxChain m_umtx_chains[2][c_umtx_chains]{};
 
-  // Use getUmtxChain0 or getUmtxChain1
-  std::tuple<UmtxChain &, UmtxKey, std::unique_lock<rx::shared_mutex>>
-  getUmtxChainIndexed(int i, Thread *t, uint32_t flags, void *ptr) {
-    auto pid = t->tproc->pid;
+  std::pair<UmtxChain &, UmtxKey> findUmtxChain(int i, Thread *t,
+                                                uint32_t flags, void *ptr) {
     auto p = reinterpret_cast<std::uintptr_t>(ptr);
-    if (flags & 1) {
-      pid = 0; // Process shared (TODO)
-      ORBIS_LOG_WARNING("Using process-shared umtx", t->tid, ptr, (p % 0x4000));
-      t->where();
+    UmtxKey key{p, static_cast<std::uint64_t>(t->tproc->pid), 0};
+
+    if (flags & kUsyncProcessShared) {
+      // process shared objects are identified by the memory backing them,
+      // anonymous shared memory keeps the same address in forked processes.
+      // Private mappings are not shared, they keep the key of the process
+      std::uint64_t object = 0;
+      std::uint64_t inode = 0;
+      std::uint64_t offset = 0;
+      auto queryBacking = t->tproc->ops->query_memory_backing;
+
+      if (queryBacking == nullptr) {
+        key = {p, 0, 0};
+      } else if (!queryBacking(t, ptr, &object, &inode, &offset).isError()) {
+        if (object != 0 || inode != 0) {
+          key = {offset, object, inode};
+        } else {
+          key = {p, 0, 0};
+        }
+      }
     }
-    auto n = p + pid;
-    if (flags & 1)
-      n %= 0x4000;
+
+    auto n = key.addr + key.object + key.inode;
     n = ((n * c_golden_ratio_prime) >> c_umtx_shifts) % c_umtx_chains;
-    std::unique_lock lock(m_umtx_chains[i][n].mtx);
-    return {m_umtx_chains[i][n], UmtxKey{p, pid}, std::move(lock)};
+    return {m_umtx_chains[i][n], key};
+  }
+
+  // Use getUmtxChain0 or getUmtxChain1
+  std::tuple<UmtxChain &, UmtxKey, std::unique_lock<rx::shared_mutex>>
+  getUmtxChainIndexed(int i, Thread *t, uint32_t flags, void *ptr) {
+    auto [chain, key] = findUmtxChain(i, t, flags, ptr);
+    std::unique_lock lock(chain.mtx);
+    return {chain, key, std::move(lock)};
   }
 
   // Internal Umtx: Wait/Cv/Sem
@@ -80,51 +126,67 @@ struct UmtxStorage {
 
 static auto umtxStorage = createGlobalObject<UmtxStorage>();
 
-std::pair<const UmtxKey, UmtxCond> *UmtxChain::enqueue(UmtxKey &key,
-                                                       Thread *thr) {
-  if (!spare_queue.empty()) {
-    auto node = spare_queue.extract(spare_queue.begin());
-    node.key() = key;
-    node.mapped().thr = thr;
-    return &*sleep_queue.insert(std::move(node));
+UmtxWaiter *UmtxChain::enqueue(const UmtxKey &key, Thread *thr) {
+  auto waiter = thr->get(umtxWaiter);
+  waiter->key = key;
+  waiter->queued = true;
+  waiter->next = nullptr;
+  waiter->prev = tail;
+
+  if (tail != nullptr) {
+    tail->next = waiter;
+  } else {
+    head = waiter;
   }
-  return &*sleep_queue.emplace(key, thr);
+
+  tail = waiter;
+  waiters.fetch_add(1, std::memory_order::seq_cst);
+  return waiter;
 }
 
-void UmtxChain::erase(std::pair<const UmtxKey, UmtxCond> *obj) {
-  for (auto [it, e] = sleep_queue.equal_range(obj->first); it != e; it++) {
-    if (&*it == obj) {
-      erase(it);
-      return;
-    }
+void UmtxChain::erase(UmtxWaiter *waiter) {
+  if (waiter->prev != nullptr) {
+    waiter->prev->next = waiter->next;
+  } else {
+    head = waiter->next;
   }
+
+  if (waiter->next != nullptr) {
+    waiter->next->prev = waiter->prev;
+  } else {
+    tail = waiter->prev;
+  }
+
+  waiter->prev = nullptr;
+  waiter->next = nullptr;
+  waiter->queued = false;
+  waiters.fetch_sub(1, std::memory_order::relaxed);
 }
 
-UmtxChain::queue_type::iterator UmtxChain::erase(queue_type::iterator it) {
-  auto next = std::next(it);
-  auto node = sleep_queue.extract(it);
-  node.key() = {};
-  spare_queue.insert(spare_queue.begin(), std::move(node));
-  return next;
+std::size_t UmtxChain::count(const UmtxKey &key) const {
+  std::size_t result = 0;
+  for (auto waiter = head; waiter != nullptr; waiter = waiter->next) {
+    if (waiter->key == key) {
+      result++;
+    }
+  }
+
+  return result;
 }
 
 uint UmtxChain::notify_n(const UmtxKey &key, sint count) {
-  auto it = sleep_queue.find(key);
-  if (it == sleep_queue.end())
-    return 0;
-
   uint n = 0;
-  while (count > 0) {
-    it->second.thr = nullptr;
-    it->second.cv.notify_all(mtx);
-    it = erase(it);
-
-    n++;
-    count--;
-
-    if (it == sleep_queue.end() || it->first != key) {
-      break;
+  for (auto waiter = head; waiter != nullptr && count > 0;) {
+    auto next = waiter->next;
+
+    if (waiter->key == key) {
+      erase(waiter);
+      waiter->cv.notify_all(mtx);
+      n++;
+      count--;
     }
+
+    waiter = next;
   }
 
   return n;
@@ -155,7 +217,7 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
                                   std::uint64_t ut, bool is32, bool ipc) {
   ORBIS_LOG_NOTICE(__FUNCTION__, thread->tid, addr, id, ut, is32);
   auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, ipc, addr);
-  auto node = chain.enqueue(key, thread);
+  auto waiter = chain.enqueue(key, thread);
   ErrorCode result = {};
   ulong val = 0;
   if (is32)
@@ -166,8 +228,8 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
     if (ut + 1 == 0) {
       while (true) {
         orbis::scoped_unblock unblock;
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx));
-        if ((result != ErrorCode{}) || node->second.thr != thread)
+        result = orbis::toErrorCode(waiter->cv.wait(chain.mtx));
+        if ((result != ErrorCode{}) || !waiter->queued)
           break;
       }
     } else {
@@ -176,8 +238,8 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
       while (true) {
         orbis::scoped_unblock unblock;
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread)
+            orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut - udiff));
+        if (!waiter->queued)
           break;
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                     std::chrono::steady_clock::now() - start)
@@ -194,19 +256,19 @@ orbis::ErrorCode orbis::umtx_wait(Thread *thread, ptr<void> addr, ulong id,
   }
 
   ORBIS_LOG_NOTICE(__FUNCTION__, "wakeup", thread->tid, addr);
-  if (node->second.thr == thread)
-    chain.erase(node);
+  if (waiter->queued)
+    chain.erase(waiter);
   return result;
 }
 
 orbis::ErrorCode orbis::umtx_wake(Thread *thread, ptr<void> addr, sint n_wake) {
   ORBIS_LOG_NOTICE(__FUNCTION__, thread->tid, addr, n_wake);
-  auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, true, addr);
-  if (key.pid == 0) {
-    // IPC workaround (TODO)
-    chain.notify_all(key);
+  auto [chain, key] = umtxStorage->findUmtxChain(0, thread, true, addr);
+  if (chain.empty()) {
     return {};
   }
+
+  std::lock_guard lock(chain.mtx);
   chain.notify_n(key, n_wake);
   return {};
 }
@@ -236,6 +298,17 @@ static ErrorCode do_lock_normal(Thread *thread, ptr<umutex> m, uint flags,
                                 std::uint64_t ut, umutex_lock_mode mode) {
   ORBIS_LOG_TRACE(__FUNCTION__, thread->tid, m, flags, ut, mode);
 
+  // uncontended cases never touch the sleep queue
+  if (mode == umutex_lock_mode::wait) {
+    int owner = m->owner.load(std::memory_order::acquire);
+    if (owner == kUmutexUnowned || owner == kUmutexContested)
+      return {};
+  } else {
+    int owner = kUmutexUnowned;
+    if (m->owner.compare_exchange_strong(owner, thread->tid))
+      return {};
+  }
+
   auto [chain, key, lock] = umtxStorage->getUmtxChain1(thread, flags, m);
   ErrorCode error = {};
   while (true) {
@@ -265,19 +338,19 @@ static ErrorCode do_lock_normal(Thread *thread, ptr<umutex> m, uint flags,
     if (error != ErrorCode{})
       return error;
 
-    auto node = chain.enqueue(key, thread);
+    auto waiter = chain.enqueue(key, thread);
     if (m->owner.compare_exchange_strong(owner, owner | kUmutexContested)) {
       {
         orbis::scoped_unblock unblock;
-        error = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
+        error = orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut));
       }
-      if (error == ErrorCode{} && node->second.thr == thread &&
+      if (error == ErrorCode{} && waiter->queued &&
           m->owner.load() != 0) {
         error = ErrorCode::TIMEDOUT;
       }
     }
-    if (node->second.thr == thread)
-      chain.erase(node);
+    if (waiter->queued)
+      chain.erase(waiter);
   }
 }
 static ErrorCode do_lock_pi(Thread *thread, ptr<umutex> m, uint flags,
@@ -293,29 +366,23 @@ static ErrorCode do_lock_pp(Thread *thread, ptr<umutex> m, uint flags,
 static ErrorCode do_unlock_normal(Thread *thread, ptr<umutex> m, uint flags) {
   ORBIS_LOG_TRACE(__FUNCTION__, thread->tid, m, flags);
 
-  auto [chain, key, lock] = umtxStorage->getUmtxChain1(thread, flags, m);
-
   int owner = m->owner.load(std::memory_order_acquire);
   if ((owner & ~kUmutexContested) != thread->tid)
     return ErrorCode::PERM;
 
-  if ((owner & kUmtxContested) == 0) {
+  // nobody sleeps on the mutex unless it is marked contested
+  if ((owner & kUmutexContested) == 0) {
     if (m->owner.compare_exchange_strong(owner, kUmutexUnowned))
       return {};
   }
 
-  std::size_t count = chain.sleep_queue.count(key);
-  bool ok;
-  if (key.pid == 0) {
-    ok = m->owner.compare_exchange_strong(owner, kUmutexUnowned);
-    // IPC workaround (TODO)
-    chain.notify_all(key);
-    if (!ok)
-      return ErrorCode::INVAL;
-    return {};
-  }
+  auto [chain, key, lock] = umtxStorage->getUmtxChain1(thread, flags, m);
+  owner = m->owner.load(std::memory_order_acquire);
+  if ((owner & ~kUmutexContested) != thread->tid)
+    return ErrorCode::PERM;
 
-  ok = m->owner.compare_exchange_strong(owner, count <= 1 ? kUmutexUnowned
+  std::size_t count = chain.count(key);
+  bool ok = m->owner.compare_exchange_strong(owner, count <= 1 ? kUmutexUnowned
                                                           : kUmutexContested);
   chain.notify_one(key);
 
@@ -419,7 +486,7 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
   }
 
   auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, cv->flags, cv);
-  auto node = chain.enqueue(key, thread);
+  auto waiter = chain.enqueue(key, thread);
 
   if (!cv->has_waiters.load(std::memory_order::relaxed)) {
     cv->has_waiters.store(1, std::memory_order::relaxed);
@@ -430,9 +497,9 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
     orbis::scoped_unblock unblock;
     if (ut + 1 == 0) {
       while (true) {
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
+        result = orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut));
 
-        if (result != ErrorCode{} || node->second.thr != thread) {
+        if (result != ErrorCode{} || !waiter->queued) {
           break;
         }
       }
@@ -441,8 +508,8 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
       std::uint64_t udiff = 0;
       while (true) {
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread) {
+            orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut - udiff));
+        if (!waiter->queued) {
           break;
         }
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -460,11 +527,11 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
     }
   }
 
-  if (node->second.thr != thread) {
+  if (!waiter->queued) {
     result = {};
   } else {
-    chain.erase(node);
-    if (chain.sleep_queue.count(key) == 0)
+    chain.erase(waiter);
+    if (chain.count(key) == 0)
       cv->has_waiters.store(0, std::memory_order::relaxed);
   }
   return result;
@@ -472,14 +539,14 @@ orbis::ErrorCode orbis::umtx_cv_wait(Thread *thread, ptr<ucond> cv,
 
 orbis::ErrorCode orbis::umtx_cv_signal(Thread *thread, ptr<ucond> cv) {
   ORBIS_LOG_TRACE(__FUNCTION__, thread->tid, cv);
-  auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, cv->flags, cv);
-  if (key.pid == 0) {
-    // IPC workaround (TODO)
-    chain.notify_all(key);
-    cv->has_waiters = 0;
+  auto [chain, key] = umtxStorage->findUmtxChain(0, thread, cv->flags, cv);
+  if (chain.empty()) {
+    cv->has_waiters.store(0, std::memory_order::relaxed);
     return {};
   }
-  std::size_t count = chain.sleep_queue.count(key);
+
+  std::lock_guard lock(chain.mtx);
+  std::size_t count = chain.count(key);
   if (chain.notify_one(key) >= count)
     cv->has_waiters.store(0, std::memory_order::relaxed);
   return {};
@@ -487,8 +554,12 @@ orbis::ErrorCode orbis::umtx_cv_signal(Thread *thread, ptr<ucond> cv) {
 
 orbis::ErrorCode orbis::umtx_cv_broadcast(Thread *thread, ptr<ucond> cv) {
   ORBIS_LOG_TRACE(__FUNCTION__, thread->tid, cv);
-  auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, cv->flags, cv);
-  chain.notify_all(key);
+  auto [chain, key] = umtxStorage->findUmtxChain(0, thread, cv->flags, cv);
+  if (!chain.empty()) {
+    std::lock_guard lock(chain.mtx);
+    chain.notify_all(key);
+  }
+
   cv->has_waiters.store(0, std::memory_order::relaxed);
   return {};
 }
@@ -533,13 +604,13 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
     ErrorCode result{};
 
     while (state & wrflags) {
-      auto node = chain.enqueue(key, thread);
+      auto waiter = chain.enqueue(key, thread);
 
       if (ut + 1 == 0) {
         while (true) {
           orbis::scoped_unblock unblock;
-          result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-          if (result != ErrorCode{} || node->second.thr != thread) {
+          result = orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut));
+          if (result != ErrorCode{} || !waiter->queued) {
             break;
           }
         }
@@ -549,8 +620,8 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
         while (true) {
           orbis::scoped_unblock unblock;
           result =
-              orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-          if (node->second.thr != thread)
+              orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut - udiff));
+          if (!waiter->queued)
             break;
           udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                       std::chrono::steady_clock::now() - start)
@@ -566,10 +637,10 @@ orbis::ErrorCode orbis::umtx_rw_rdlock(Thread *thread, ptr<urwlock> rwlock,
         }
       }
 
-      if (node->second.thr != thread) {
+      if (!waiter->queued) {
         result = {};
       } else {
-        chain.erase(node);
+        chain.erase(waiter);
       }
 
       if (result != ErrorCode{}) {
@@ -637,13 +708,13 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
     ++rwlock->blocked_writers;
 
     while ((state & kUrwLockWriteOwner) || (state & kUrwLockMaxReaders) != 0) {
-      auto node = chain.enqueue(key, thread);
+      auto waiter = chain.enqueue(key, thread);
 
       if (ut + 1 == 0) {
         while (true) {
           orbis::scoped_unblock unblock;
-          error = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-          if ((error != ErrorCode{}) || node->second.thr != thread) {
+          error = orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut));
+          if ((error != ErrorCode{}) || !waiter->queued) {
             break;
           }
         }
@@ -653,8 +724,8 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
         while (true) {
           orbis::scoped_unblock unblock;
           error =
-              orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-          if (node->second.thr != thread)
+              orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut - udiff));
+          if (!waiter->queued)
             break;
           udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                       std::chrono::steady_clock::now() - start)
@@ -669,10 +740,10 @@ orbis::ErrorCode orbis::umtx_rw_wrlock(Thread *thread, ptr<urwlock> rwlock,
         }
       }
 
-      if (node->second.thr != thread) {
+      if (!waiter->queued) {
         error = {};
       } else {
-        chain.erase(node);
+        chain.erase(waiter);
       }
 
       if (error != ErrorCode{}) {
@@ -758,7 +829,12 @@ orbis::ErrorCode orbis::umtx_rw_unlock(Thread *thread, ptr<urwlock> rwlock) {
 orbis::ErrorCode orbis::umtx_wake_private(Thread *thread, ptr<void> addr,
                                           sint n_wake) {
   ORBIS_LOG_TRACE(__FUNCTION__, thread->tid, addr, n_wake);
-  auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, false, addr);
+  auto [chain, key] = umtxStorage->findUmtxChain(0, thread, false, addr);
+  if (chain.empty()) {
+    return {};
+  }
+
+  std::lock_guard lock(chain.mtx);
   chain.notify_n(key, n_wake);
   return {};
 }
@@ -794,7 +870,7 @@ orbis::ErrorCode orbis::umtx_wake_umutex(Thread *thread, ptr<umutex> m,
   if ((owner & ~kUmutexContested) != 0)
     return {};
 
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
   if (count <= 1) {
     owner = kUmutexContested;
     m->owner.compare_exchange_strong(owner, kUmutexUnowned);
@@ -814,7 +890,7 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
                                       std::uint64_t ut) {
   ORBIS_LOG_TRACE(__FUNCTION__, sem, ut);
   auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, sem->flags, sem);
-  auto node = chain.enqueue(key, thread);
+  auto waiter = chain.enqueue(key, thread);
 
   std::uint32_t has_waiters = sem->has_waiters;
   if (!has_waiters)
@@ -825,8 +901,8 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
     if (ut + 1 == 0) {
       while (true) {
         orbis::scoped_unblock unblock;
-        result = orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut));
-        if ((result != ErrorCode{}) || node->second.thr != thread)
+        result = orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut));
+        if ((result != ErrorCode{}) || !waiter->queued)
           break;
       }
     } else {
@@ -835,8 +911,8 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
       while (true) {
         orbis::scoped_unblock unblock;
         result =
-            orbis::toErrorCode(node->second.cv.wait(chain.mtx, ut - udiff));
-        if (node->second.thr != thread)
+            orbis::toErrorCode(waiter->cv.wait(chain.mtx, ut - udiff));
+        if (!waiter->queued)
           break;
         udiff = std::chrono::duration_cast<std::chrono::microseconds>(
                     std::chrono::steady_clock::now() - start)
@@ -852,24 +928,24 @@ orbis::ErrorCode orbis::umtx_sem_wait(Thread *thread, ptr<usem> sem,
     }
   }
 
-  if (node->second.thr != thread) {
+  if (!waiter->queued) {
     result = {};
   } else {
-    chain.erase(node);
+    chain.erase(waiter);
   }
   return result;
 }
 
 orbis::ErrorCode orbis::umtx_sem_wake(Thread *thread, ptr<usem> sem) {
   ORBIS_LOG_TRACE(__FUNCTION__, sem);
-  auto [chain, key, lock] = umtxStorage->getUmtxChain0(thread, sem->flags, sem);
-  if (key.pid == 0) {
-    // IPC workaround (TODO)
-    chain.notify_all(key);
-    sem->has_waiters = 0;
+  auto [chain, key] = umtxStorage->findUmtxChain(0, thread, sem->flags, sem);
+  if (chain.empty()) {
+    sem->has_waiters.store(0, std::memory_order::relaxed);
     return {};
   }
-  std::size_t count = chain.sleep_queue.count(key);
+
+  std::lock_guard lock(chain.mtx);
+  std::size_t count = chain.count(key);
   if (chain.notify_one(key) >= count)
     sem->has_waiters.store(0, std::memory_order::relaxed);
   return {};
@@ -901,7 +977,7 @@ orbis::ErrorCode orbis::umtx_wake2_umutex(Thread *thread, ptr<umutex> m,
 
   int owner = 0;
 
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
 
   if (count > 1) {
     owner = m->owner.load(std::memory_order::acquire);
@@ -942,7 +1018,7 @@ orbis::ErrorCode orbis::umtx_wake3_umutex(Thread *thread, ptr<umutex> m,
       umtxStorage->getUmtxChain1(thread, wakeFlags & 1, m);
 
   int owner = 0;
-  std::size_t count = chain.sleep_queue.count(key);
+  std::size_t count = chain.count(key);
 
   if (count > 1) {
     owner = m->owner.load(std::memory_order::acquire);
@@ -1,10 +1,22 @@
 #include "utils/Logs.hpp"
 #include "error/ErrorCode.hpp"
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <unistd.h>
 #include <vector>
 
@@ -461,28 +473,33 @@ void log_class_string<orbis::ErrorCode>::format(std::string &out,
   out += "<unknown " + std::to_string((int)errorCode) + ">";
 }
 
-void _orbis_log_print(LogLevel lvl, std::string_view msg,
-                      std::string_view names, const log_type_info *sup, ...) {
-  if (lvl > logs_level.load(std::memory_order::relaxed)) {
-    return;
+static const char *log_color(LogLevel lvl) {
+  switch (lvl) {
+  case LogLevel::Always:
+    return "\e[36;1m";
+  case LogLevel::Fatal:
+    return "\e[35;1m";
+  case LogLevel::Error:
+    return "\e[0;31m";
+  case LogLevel::Todo:
+    return "\e[1;33m";
+  case LogLevel::Success:
+    return "\e[1;32m";
+  case LogLevel::Warning:
+    return "\e[0;33m";
+  case LogLevel::Notice:
+    return "\e[0;36m";
+  case LogLevel::Trace:
+    return "";
   }
 
-  /*constinit thread_local*/ std::string text;
-  /*constinit thread_local*/ std::vector<const void *> args;
-
-  std::size_t args_count = 0;
-  for (auto v = sup; v && v->log_string; v++)
-    args_count++;
-
-  text.reserve(50000);
-  args.resize(args_count);
-
-  va_list c_args;
-  va_start(c_args, sup);
-  for (const void *&arg : args)
-    arg = va_arg(c_args, const void *);
-  va_end(c_args);
+  return "";
+}
 
+template <typename FormatArg>
+static void log_format(std::string &text, std::string_view msg,
+                       std::string_view names, std::size_t args_count,
+                       FormatArg &&format_arg) {
   text += msg;
   if (args_count)
     text += "(";
@@ -502,44 +519,539 @@ void _orbis_log_print(LogLevel lvl, std::string_view msg,
     }
 
     text += "=";
-    sup[i].log_string(text, args[i]);
+    format_arg(text, i);
   }
   if (args_count)
     text += ")";
+}
 
-  const char *color = "";
-  switch (lvl) {
-  case LogLevel::Always:
-    color = "\e[36;1m";
-    break;
-  case LogLevel::Fatal:
-    color = "\e[35;1m";
-    break;
-  case LogLevel::Error:
-    color = "\e[0;31m";
-    break;
-  case LogLevel::Todo:
-    color = "\e[1;33m";
-    break;
-  case LogLevel::Success:
-    color = "\e[1;32m";
-    break;
-  case LogLevel::Warning:
-    color = "\e[0;33m";
-    break;
-  case LogLevel::Notice:
-    color = "\e[0;36m";
-    break;
-  case LogLevel::Trace:
-    color = "";
-    break;
-  }
-
+static void log_append_line(std::string &out, LogLevel lvl,
+                            std::string_view text) {
   static const bool istty = isatty(fileno(stderr));
   if (istty) {
-    std::fprintf(stderr, "%s%s\e[0m\n", color, text.c_str());
+    out += log_color(lvl);
+    out += text;
+    out += "\e[0m\n";
   } else {
-    std::fprintf(stderr, "%s\n", text.c_str());
+    out += text;
+    out += '\n';
+  }
+}
+
+namespace {
+constexpr std::size_t kLogRingSize = 256 * 1024;
+constexpr std::uint32_t kLogPadding = ~std::uint32_t(0);
+
+// string arguments are truncated to this size by the deferred logger
+constexpr std::size_t kLogMaxString = 4096;
+
+constexpr char kLogMagic[8] = {'O', 'R', 'B', 'I', 'S', 'L', 'O', 'G'};
+constexpr std::uint32_t kLogVersion = 1;
+constexpr std::uint8_t kLogTagSite = 1;
+constexpr std::uint8_t kLogTagRecord = 2;
+constexpr std::uint8_t kLogTagDropped = 3;
+
+struct LogRecordHeader {
+  // aligned size of the record or kLogPadding if the rest of the ring is
+  // skipped
+  std::uint32_t size;
+  std::uint32_t payloadSize;
+  std::uint32_t msgSize;
+  std::uint32_t namesSize;
+  const char *msg;
+  const char *names;
+  const log_type_info *sup;
+  std::uint64_t timestamp;
+  LogLevel level;
+};
+
+// Written by the owning thread only, read by the thread holding drainMtx
+struct LogRing {
+  std::unique_ptr<std::byte[]> data{new std::byte[kLogRingSize]};
+  std::atomic<std::uint64_t> readPos{0};
+  std::atomic<std::uint64_t> writePos{0};
+  std::atomic<bool> alive{true};
+  std::uint32_t tid = 0;
+};
+
+struct LogState {
+  bool binary = false;
+  std::FILE *output = stderr;
+
+  std::mutex ringsMtx;
+  std::vector<std::shared_ptr<LogRing>> rings;
+
+  // serializes readers of the rings
+  std::mutex drainMtx;
+  std::string out;
+  std::string text;
+  std::map<std::tuple<const char *, const char *, const log_type_info *,
+                      LogLevel>,
+           std::uint32_t>
+      sites;
+  std::uint64_t reportedDrops = 0;
+
+  std::mutex wakeMtx;
+  std::condition_variable wakeCv;
+  std::atomic<bool> wakeRequested{false};
+  std::atomic<bool> stop{false};
+  std::thread thread;
+};
+
+struct LocalLogRing {
+  std::shared_ptr<LogRing> ring;
+  LogState *state = nullptr;
+  std::uint32_t generation = 0;
+
+  ~LocalLogRing() {
+    if (ring != nullptr) {
+      ring->alive.store(false, std::memory_order::release);
+    }
+  }
+};
+} // namespace
+
+static std::string g_logPath;
+static pid_t g_logMainPid = 0;
+static std::atomic<LogDropPolicy> g_logDropPolicy = LogDropPolicy::Drop;
+static std::atomic<std::uint64_t> g_logDropped{0};
+
+// incremented in forked child, rings and formatter thread of the parent are
+// not usable there
+static std::atomic<std::uint32_t> g_logGeneration{1};
+static std::atomic<LogState *> g_logState{nullptr};
+static std::mutex g_logStateMtx;
+
+static thread_local LocalLogRing t_logRing;
+
+template <typename T> static void log_put(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void log_put_string(std::string &out, std::string_view string) {
+  auto size = static_cast<std::uint16_t>(
+      std::min<std::size_t>(string.size(), UINT16_MAX));
+  log_put(out, size);
+  out.append(string.data(), size);
+}
+
+// called after the record is published. Formatter resets the request before
+// it drains, either it sees the record or the request wakes it again
+static void log_wake(LogState *state) {
+  if (!state->wakeRequested.exchange(true, std::memory_order::seq_cst)) {
+    std::lock_guard lock(state->wakeMtx);
+    state->wakeCv.notify_one();
+  }
+}
+
+static void log_write_text(LogState *state, const LogRecordHeader &header,
+                           const std::byte *payload) {
+  auto sup = header.sup;
+  std::size_t args_count = 0;
+  for (auto v = sup; v && v->log_string; v++)
+    args_count++;
+
+  std::vector<const std::byte *> args(args_count);
+  for (std::size_t i = 0; i < args_count; i++) {
+    args[i] = payload;
+
+    if (sup[i].raw_size != 0) {
+      payload += sup[i].raw_size;
+    } else {
+      std::uint32_t size;
+      std::memcpy(&size, payload, sizeof(size));
+      payload += sizeof(size) + size;
+    }
   }
+
+  state->text.clear();
+  log_format(state->text, {header.msg, header.msgSize},
+             {header.names, header.namesSize}, args_count,
+             [&](std::string &out, std::size_t i) {
+               if (sup[i].raw_size != 0) {
+                 alignas(16) std::byte value[16];
+                 std::memcpy(value, args[i], sup[i].raw_size);
+                 sup[i].log_string(out, value);
+                 return;
+               }
+
+               std::uint32_t size;
+               std::memcpy(&size, args[i], sizeof(size));
+               out.append(reinterpret_cast<const char *>(args[i]) +
+                              sizeof(size),
+                          size);
+             });
+
+  log_append_line(state->out, header.level, state->text);
+}
+
+static void log_write_binary(LogState *state, const LogRing &ring,
+                             const LogRecordHeader &header,
+                             const std::byte *payload) {
+  auto [it, inserted] = state->sites.emplace(
+      std::tuple(header.msg, header.names, header.sup, header.level),
+      static_cast<std::uint32_t>(state->sites.size()));
+
+  if (inserted) {
+    std::uint16_t args_count = 0;
+    for (auto v = header.sup; v && v->log_string; v++)
+      args_count++;
+
+    log_put(state->out, kLogTagSite);
+    log_put(state->out, it->second);
+    log_put(state->out, static_cast<std::uint8_t>(header.level));
+    log_put_string(state->out, {header.msg, header.msgSize});
+    log_put_string(state->out, {header.names, header.namesSize});
+    log_put(state->out, args_count);
+
+    for (std::uint16_t i = 0; i < args_count; i++) {
+      log_put(state->out, static_cast<std::uint8_t>(header.sup[i].kind));
+      log_put(state->out, header.sup[i].raw_size);
+    }
+  }
+
+  log_put(state->out, kLogTagRecord);
+  log_put(state->out, it->second);
+  log_put(state->out, ring.tid);
+  log_put(state->out, header.timestamp);
+  log_put(state->out, header.payloadSize);
+  state->out.append(reinterpret_cast<const char *>(payload),
+                    header.payloadSize);
+}
+
+static void log_drain_ring(LogState *state, LogRing &ring) {
+  auto readPos = ring.readPos.load(std::memory_order::relaxed);
+  auto writePos = ring.writePos.load(std::memory_order::acquire);
+
+  while (readPos != writePos) {
+    auto offset = readPos % kLogRingSize;
+    auto record = ring.data.get() + offset;
+
+    std::uint32_t size;
+    std::memcpy(&size, record, sizeof(size));
+    if (size == kLogPadding) {
+      readPos += kLogRingSize - offset;
+      continue;
+    }
+
+    LogRecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+
+    if (state->binary) {
+      log_write_binary(state, ring, header, record + sizeof(header));
+    } else {
+      log_write_text(state, header, record + sizeof(header));
+    }
+
+    readPos += header.size;
+  }
+
+  ring.readPos.store(readPos, std::memory_order::release);
+}
+
+// must be called with drainMtx locked
+static void log_drain(LogState *state) {
+  {
+    std::lock_guard lock(state->ringsMtx);
+
+    std::erase_if(state->rings, [&](const std::shared_ptr<LogRing> &ring) {
+      // owner publishes all records before it marks ring dead
+      bool dead = !ring->alive.load(std::memory_order::acquire);
+      log_drain_ring(state, *ring);
+      return dead;
+    });
+  }
+
+  if (state->binary) {
+    auto dropped = g_logDropped.load(std::memory_order::relaxed);
+    if (dropped != state->reportedDrops) {
+      log_put(state->out, kLogTagDropped);
+      log_put(state->out, dropped);
+      state->reportedDrops = dropped;
+    }
+  }
+
+  if (!state->out.empty()) {
+    std::fwrite(state->out.data(), 1, state->out.size(), state->output);
+    std::fflush(state->output);
+    state->out.clear();
+  }
+}
+
+static void log_formatter_entry(LogState *state) {
+  // process directed guest signals must be delivered to guest threads
+  sigset_t set;
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+  pthread_setname_np(pthread_self(), "orbis-log");
+
+  while (!state->stop.load(std::memory_order::relaxed)) {
+    {
+      std::unique_lock lock(state->wakeMtx);
+      state->wakeCv.wait(lock, [&] {
+        return state->wakeRequested.load(std::memory_order::relaxed) ||
+               state->stop.load(std::memory_order::relaxed);
+      });
+    }
+
+    state->wakeRequested.exchange(false, std::memory_order::seq_cst);
+
+    std::lock_guard lock(state->drainMtx);
+    log_drain(state);
+  }
+}
+
+static void log_shutdown() {
+  auto state = g_logState.load(std::memory_order::acquire);
+  if (state == nullptr) {
+    return;
+  }
+
+  logs_mode.store(LogMode::Sync, std::memory_order::relaxed);
+  {
+    std::lock_guard lock(state->wakeMtx);
+    state->stop.store(true, std::memory_order::relaxed);
+  }
+  state->wakeCv.notify_one();
+  if (state->thread.joinable()) {
+    state->thread.join();
+  }
+
+  log_flush();
+
+  if (auto dropped = log_dropped_count()) {
+    std::fprintf(stderr, "log: %llu records dropped\n",
+                 static_cast<unsigned long long>(dropped));
+  }
+
+  if (state->output != stderr) {
+    std::fclose(state->output);
+    state->output = stderr;
+  }
+}
+
+static LogState *log_state() {
+  if (auto state = g_logState.load(std::memory_order::acquire)) {
+    return state;
+  }
+
+  std::lock_guard lock(g_logStateMtx);
+  if (auto state = g_logState.load(std::memory_order::relaxed)) {
+    return state;
+  }
+
+  static const int forkHandlers = pthread_atfork(
+      [] { g_logStateMtx.lock(); }, [] { g_logStateMtx.unlock(); },
+      [] {
+        // state of the parent is leaked, its mutexes can be locked by threads
+        // which do not exist in the child
+        g_logState.store(nullptr, std::memory_order::relaxed);
+        g_logGeneration.fetch_add(1, std::memory_order::relaxed);
+        g_logStateMtx.unlock();
+      });
+  static const int exitHandler = std::atexit(log_shutdown);
+  (void)forkHandlers;
+  (void)exitHandler;
+
+  auto state = new LogState();
+
+  if (logs_mode.load(std::memory_order::relaxed) == LogMode::Binary) {
+    auto path = g_logPath.empty() ? std::string("orbis-log.bin") : g_logPath;
+    if (::getpid() != g_logMainPid) {
+      path += "." + std::to_string(::getpid());
+    }
+
+    if (auto file = std::fopen(path.c_str(), "wb")) {
+      state->binary = true;
+      state->output = file;
+      state->out.append(kLogMagic, sizeof(kLogMagic));
+      log_put(state->out, kLogVersion);
+    } else {
+      std::fprintf(stderr, "log: failed to open %s, using text log\n",
+                   path.c_str());
+    }
+  }
+
+  state->thread = std::thread(log_formatter_entry, state);
+  g_logState.store(state, std::memory_order::release);
+  return state;
+}
+
+static bool log_push(LogLevel lvl, std::string_view msg,
+                     std::string_view names, const log_type_info *sup,
+                     std::span<const void *const> args) {
+  thread_local std::string strings;
+  thread_local std::vector<std::uint32_t> stringEnds;
+
+  strings.clear();
+  stringEnds.clear();
+
+  std::size_t payloadSize = 0;
+  for (std::size_t i = 0; i < args.size(); i++) {
+    if (sup[i].raw_size != 0) {
+      payloadSize += sup[i].raw_size;
+      continue;
+    }
+
+    auto start = strings.size();
+    sup[i].log_string(strings, args[i]);
+    if (strings.size() - start > kLogMaxString) {
+      strings.resize(start + kLogMaxString);
+    }
+
+    stringEnds.push_back(strings.size());
+    payloadSize += sizeof(std::uint32_t) + (strings.size() - start);
+  }
+
+  auto size = (sizeof(LogRecordHeader) + payloadSize + 7) & ~std::size_t(7);
+  if (size > kLogRingSize / 4) {
+    return false;
+  }
+
+  auto &local = t_logRing;
+  auto generation = g_logGeneration.load(std::memory_order::relaxed);
+  if (local.ring == nullptr || local.generation != generation) {
+    local.state = log_state();
+    local.generation = generation;
+    local.ring = std::make_shared<LogRing>();
+    local.ring->tid = ::gettid();
+
+    std::lock_guard lock(local.state->ringsMtx);
+    local.state->rings.push_back(local.ring);
+  }
+
+  auto state = local.state;
+  auto &ring = *local.ring;
+  auto writePos = ring.writePos.load(std::memory_order::relaxed);
+  auto offset = writePos % kLogRingSize;
+  auto tail = kLogRingSize - offset;
+  auto required = tail < size ? tail + size : size;
+
+  auto readPos = ring.readPos.load(std::memory_order::acquire);
+  while (kLogRingSize - (writePos - readPos) < required) {
+    log_wake(state);
+
+    if (g_logDropPolicy.load(std::memory_order::relaxed) ==
+        LogDropPolicy::Drop) {
+      g_logDropped.fetch_add(1, std::memory_order::relaxed);
+      return true;
+    }
+
+    std::this_thread::yield();
+    readPos = ring.readPos.load(std::memory_order::acquire);
+  }
+
+  if (tail < size) {
+    std::memcpy(ring.data.get() + offset, &kLogPadding, sizeof(kLogPadding));
+    writePos += tail;
+    offset = 0;
+  }
+
+  LogRecordHeader header{
+      .size = static_cast<std::uint32_t>(size),
+      .payloadSize = static_cast<std::uint32_t>(payloadSize),
+      .msgSize = static_cast<std::uint32_t>(msg.size()),
+      .namesSize = static_cast<std::uint32_t>(names.size()),
+      .msg = msg.data(),
+      .names = names.data(),
+      .sup = sup,
+      .timestamp = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch())
+              .count()),
+      .level = lvl,
+  };
+
+  auto dst = ring.data.get() + offset;
+  std::memcpy(dst, &header, sizeof(header));
+  dst += sizeof(header);
+
+  std::size_t stringIndex = 0;
+  std::uint32_t stringStart = 0;
+  for (std::size_t i = 0; i < args.size(); i++) {
+    if (sup[i].raw_size != 0) {
+      std::memcpy(dst, args[i], sup[i].raw_size);
+      dst += sup[i].raw_size;
+      continue;
+    }
+
+    auto stringEnd = stringEnds[stringIndex++];
+    std::uint32_t stringSize = stringEnd - stringStart;
+    std::memcpy(dst, &stringSize, sizeof(stringSize));
+    std::memcpy(dst + sizeof(stringSize), strings.data() + stringStart,
+                stringSize);
+    dst += sizeof(stringSize) + stringSize;
+    stringStart = stringEnd;
+  }
+
+  writePos += size;
+  ring.writePos.store(writePos, std::memory_order::release);
+  log_wake(state);
+
+  return true;
+}
+
+void log_configure(LogMode mode, LogDropPolicy policy, std::string path) {
+  g_logPath = std::move(path);
+  g_logMainPid = ::getpid();
+  g_logDropPolicy.store(policy, std::memory_order::relaxed);
+  logs_mode.store(mode, std::memory_order::release);
+}
+
+void log_flush() {
+  auto state = g_logState.load(std::memory_order::acquire);
+  if (state == nullptr) {
+    return;
+  }
+
+  std::lock_guard lock(state->drainMtx);
+  log_drain(state);
+}
+
+std::uint64_t log_dropped_count() {
+  return g_logDropped.load(std::memory_order::relaxed);
+}
+
+void _orbis_log_print(LogLevel lvl, std::string_view msg,
+                      std::string_view names, const log_type_info *sup, ...) {
+  if (lvl > logs_level.load(std::memory_order::relaxed)) {
+    return;
+  }
+
+  thread_local std::vector<const void *> args;
+
+  std::size_t args_count = 0;
+  for (auto v = sup; v && v->log_string; v++)
+    args_count++;
+
+  args.resize(args_count);
+
+  va_list c_args;
+  va_start(c_args, sup);
+  for (const void *&arg : args)
+    arg = va_arg(c_args, const void *);
+  va_end(c_args);
+
+  if (logs_mode.load(std::memory_order::acquire) != LogMode::Sync) {
+    if (lvl > LogLevel::Fatal && log_push(lvl, msg, names, sup, args)) {
+      return;
+    }
+
+    // keep order with pending records
+    log_flush();
+  }
+
+  thread_local std::string text;
+  thread_local std::string line;
+  text.clear();
+  line.clear();
+
+  log_format(text, msg, names, args_count,
+             [&](std::string &out, std::size_t i) {
+               sup[i].log_string(out, args[i]);
+             });
+
+  log_append_line(line, lvl, text);
+  std::fwrite(line.data(), 1, line.size(), stderr);
 }
 } // namespace orbis::logs
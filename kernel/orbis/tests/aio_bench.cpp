@@ -0,0 +1,167 @@
+// Streaming read throughput of aio_read with 1 to 64 requests in flight,
+// compared with sequential pread of the same file
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/aio.hpp"
+#include "orbis/file.hpp"
+#include "orbis/sys/sysproto.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// control blocks and buffers must be in the guest address range
+constexpr std::uintptr_t kUserAddress = 0x10'0000'0000;
+constexpr std::size_t kMaxDepth = 64;
+constexpr std::size_t kChunkSize = 256 * 1024;
+constexpr std::size_t kDefaultFileSize = 256 * 1024 * 1024;
+
+struct UserState {
+  orbis::aiocb cbs[kMaxDepth];
+  orbis::ptr<orbis::aiocb> completed;
+  alignas(4096) std::byte buffers[kMaxDepth][kChunkSize];
+};
+
+double toMiBps(std::size_t bytes, std::chrono::steady_clock::duration time) {
+  return static_cast<double>(bytes) / (1024 * 1024) /
+         std::chrono::duration<double>(time).count();
+}
+
+double streamPread(int hostFd, std::size_t fileSize, UserState *state) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t offset = 0; offset < fileSize; offset += kChunkSize) {
+    if (::pread(hostFd, state->buffers[0], kChunkSize, offset) < 0) {
+      std::perror("pread");
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  return toMiBps(fileSize, std::chrono::steady_clock::now() - start);
+}
+
+double streamAio(orbis::Thread *thread, orbis::sint fd, std::size_t fileSize,
+                 std::size_t depth, UserState *state) {
+  std::size_t nextOffset = 0;
+  std::size_t inFlight = 0;
+  std::size_t transferred = 0;
+
+  auto submit = [&](orbis::aiocb *cb) {
+    *cb = {};
+    cb->aio_fildes = fd;
+    cb->aio_offset = nextOffset;
+    cb->aio_buf = state->buffers[cb - state->cbs];
+    cb->aio_nbytes = kChunkSize;
+    nextOffset += kChunkSize;
+
+    if (orbis::sys_aio_read(thread, cb).isError()) {
+      std::fprintf(stderr, "aio_read failed\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    inFlight++;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < depth && nextOffset < fileSize; ++i) {
+    submit(&state->cbs[i]);
+  }
+
+  while (inFlight != 0) {
+    if (orbis::sys_aio_waitcomplete(thread, &state->completed, nullptr)
+            .isError()) {
+      std::fprintf(stderr, "aio_waitcomplete failed\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    inFlight--;
+    transferred += thread->retval[0];
+
+    if (nextOffset < fileSize) {
+      submit(state->completed);
+    }
+  }
+
+  return toMiBps(transferred, std::chrono::steady_clock::now() - start);
+}
+
+int createFile(std::size_t size) {
+  char path[] = "/tmp/orbis-aio-bench-XXXXXX";
+  int hostFd = ::mkstemp(path);
+  if (hostFd < 0) {
+    std::perror("mkstemp");
+    std::exit(EXIT_FAILURE);
+  }
+
+  ::unlink(path);
+
+  std::vector<std::byte> chunk(kChunkSize, std::byte{0x5a});
+  for (std::size_t offset = 0; offset < size; offset += kChunkSize) {
+    if (::pwrite(hostFd, chunk.data(), kChunkSize, offset) < 0) {
+      std::perror("pwrite");
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  return hostFd;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  // optional path of the file to read, a cached temporary file by default
+  int hostFd;
+  std::size_t fileSize;
+
+  if (argc > 1) {
+    hostFd = ::open(argv[1], O_RDONLY);
+    if (hostFd < 0) {
+      std::perror("open");
+      return EXIT_FAILURE;
+    }
+
+    fileSize = ::lseek(hostFd, 0, SEEK_END) / kChunkSize * kChunkSize;
+  } else {
+    fileSize = kDefaultFileSize;
+    hostFd = createFile(fileSize);
+  }
+
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto user = ::mmap(reinterpret_cast<void *>(kUserAddress), sizeof(UserState),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (user != reinterpret_cast<void *>(kUserAddress)) {
+    std::perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto state = static_cast<UserState *>(user);
+  auto process = orbis::createProcess(nullptr, 10);
+  auto thread = orbis::createThread(process, "bench");
+  orbis::g_currentThread = thread;
+
+  auto file = orbis::knew<orbis::File>();
+  file->hostFd = hostFd;
+  auto fd = process->fileDescriptors.insert(file);
+
+  std::printf("%zu MiB in %zu KiB chunks\n", fileSize >> 20, kChunkSize >> 10);
+  std::printf("pread:          %10.1f MiB/s\n",
+              streamPread(hostFd, fileSize, state));
+
+  for (std::size_t depth = 1; depth <= kMaxDepth; depth *= 4) {
+    std::printf("aio depth %3zu:  %10.1f MiB/s\n", depth,
+                streamAio(thread, fd, fileSize, depth, state));
+  }
+
+  return EXIT_SUCCESS;
+}
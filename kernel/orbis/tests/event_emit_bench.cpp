@@ -0,0 +1,98 @@
+// Cost of an event emit that triggers one note while 16 to 65536 notes with
+// other identifiers are subscribed to the same filter. An emit for a single
+// identifier is compared to an emit which visits every subscribed note and
+// matches the identifier in the filter callback.
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/event.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+
+namespace {
+constexpr std::size_t kMaxNotes = 65536;
+constexpr std::size_t kIterations = 200'000;
+
+// receives the triggered note and makes it triggerable again
+void drain(orbis::KQueue *queue, std::uintptr_t ident) {
+  auto note = queue->popReady();
+
+  if (note == nullptr || note->event.ident != ident ||
+      queue->popReady() != nullptr) {
+    std::fprintf(stderr, "emit did not trigger exactly note %zu\n", ident);
+    std::exit(EXIT_FAILURE);
+  }
+
+  note->triggered = false;
+}
+
+template <typename F>
+double measure(orbis::KQueue *queue, std::size_t noteCount, F &&emit) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < kIterations; ++i) {
+    auto ident = (i * 7919) % noteCount;
+    emit(ident);
+    drain(queue, ident);
+  }
+
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         kIterations;
+}
+} // namespace
+
+int main() {
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  rx::Ref<orbis::KQueue> queue = orbis::knew<orbis::KQueue>();
+  rx::Ref<orbis::EventEmitter> emitter = orbis::knew<orbis::EventEmitter>();
+  auto notes = std::make_unique<orbis::KNote[]>(kMaxNotes);
+
+  std::printf("%zu emits, ns per emit\n", kIterations);
+  std::printf("%7s %12s %12s\n", "notes", "ident", "scan");
+
+  std::size_t subscribed = 0;
+
+  for (std::size_t noteCount = 16; noteCount <= kMaxNotes; noteCount *= 4) {
+    for (; subscribed < noteCount; ++subscribed) {
+      auto &note = notes[subscribed];
+      note.queue = queue.get();
+      note.event.ident = subscribed;
+      note.event.filter = orbis::kEvFiltDisplay;
+
+      if (emitter->subscribe(&note) != orbis::ErrorCode{}) {
+        std::fprintf(stderr, "failed to subscribe note %zu\n", subscribed);
+        return EXIT_FAILURE;
+      }
+    }
+
+    auto identTime =
+        measure(queue.get(), noteCount, [&](std::uintptr_t ident) {
+          emitter->emit(orbis::kEvFiltDisplay, 0, 1, ident);
+        });
+
+    auto scanTime = measure(
+        queue.get(), noteCount, [&](std::uintptr_t ident) {
+          emitter->emit(
+              orbis::kEvFiltDisplay,
+              [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
+                if (note->event.ident != ident) {
+                  return {};
+                }
+
+                return 1;
+              });
+        });
+
+    std::printf("%7zu %12.1f %12.1f\n", noteCount, identTime, scanTime);
+  }
+
+  return EXIT_SUCCESS;
+}
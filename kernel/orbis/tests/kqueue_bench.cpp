@@ -0,0 +1,140 @@
+// Cost of triggering and receiving one user event with kevent while 16 to
+// 65536 other user events are registered in the same queue
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/note.hpp"
+#include "orbis/sys/sysproto.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace {
+// change and event lists must be in the guest address range
+constexpr std::uintptr_t kUserAddress = 0x10'0000'0000;
+constexpr std::size_t kMaxNotes = 65536;
+constexpr std::size_t kChangeBatch = 1024;
+constexpr std::size_t kIterations = 200'000;
+
+struct UserState {
+  orbis::KEvent changes[kChangeBatch];
+  orbis::KEvent events[16];
+  orbis::timespec timeout;
+};
+
+bool kevent(orbis::Thread *thread, orbis::sint kq, UserState *state,
+            orbis::sint nchanges, orbis::sint nevents) {
+  return !orbis::sys_kevent(thread, kq, state->changes, nchanges,
+                            state->events, nevents, &state->timeout)
+              .isError();
+}
+
+orbis::KEvent userEvent(std::size_t ident, orbis::ushort flags,
+                        orbis::uint fflags = 0) {
+  return {.ident = ident,
+          .filter = orbis::kEvFiltUser,
+          .flags = flags,
+          .fflags = fflags,
+          .data = 0,
+          .udata = nullptr};
+}
+
+// registers notes [first, last) in batches of kChangeBatch
+bool addNotes(orbis::Thread *thread, orbis::sint kq, UserState *state,
+              std::size_t first, std::size_t last) {
+  while (first < last) {
+    std::size_t count = std::min(last - first, kChangeBatch);
+
+    for (std::size_t i = 0; i < count; ++i) {
+      state->changes[i] = userEvent(first + i, orbis::kEvAdd);
+    }
+
+    if (!kevent(thread, kq, state, static_cast<orbis::sint>(count), 0)) {
+      return false;
+    }
+
+    first += count;
+  }
+
+  return true;
+}
+
+// every iteration triggers one note, receives it and clears it again
+double run(orbis::Thread *thread, orbis::sint kq, UserState *state,
+           std::size_t noteCount) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < kIterations; ++i) {
+    auto ident = (i * 7919) % noteCount;
+    state->changes[0] = userEvent(ident, 0, orbis::kNoteTrigger);
+
+    if (!kevent(thread, kq, state, 1, 16) || thread->retval[0] != 1 ||
+        state->events[0].ident != ident) {
+      std::fprintf(stderr, "triggered event %zu was not received\n", ident);
+      std::exit(EXIT_FAILURE);
+    }
+
+    state->changes[0] = userEvent(ident, orbis::kEvClear);
+
+    if (!kevent(thread, kq, state, 1, 0)) {
+      std::fprintf(stderr, "failed to clear event %zu\n", ident);
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         kIterations;
+}
+} // namespace
+
+int main() {
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto user = ::mmap(reinterpret_cast<void *>(kUserAddress), sizeof(UserState),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (user != reinterpret_cast<void *>(kUserAddress)) {
+    std::perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto state = static_cast<UserState *>(user);
+  auto process = orbis::createProcess(nullptr, 10);
+  auto thread = orbis::createThread(process, "bench kevent");
+  orbis::g_currentThread = thread;
+
+  if (orbis::sys_kqueue(thread).isError()) {
+    std::fprintf(stderr, "kqueue failed\n");
+    return EXIT_FAILURE;
+  }
+
+  // zero timeout, triggered events are already in the queue
+  auto kq = static_cast<orbis::sint>(thread->retval[0]);
+  state->timeout = {};
+
+  std::printf("%zu trigger/receive/clear iterations, ns per iteration\n",
+              kIterations);
+
+  std::size_t registered = 0;
+
+  for (std::size_t noteCount = 16; noteCount <= kMaxNotes; noteCount *= 4) {
+    if (!addNotes(thread, kq, state, registered, noteCount)) {
+      std::fprintf(stderr, "failed to register %zu events\n", noteCount);
+      return EXIT_FAILURE;
+    }
+
+    registered = noteCount;
+    std::printf("%7zu notes: %10.1f\n", noteCount,
+                run(thread, kq, state, noteCount));
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+// Throughput of a pipe between a writer and a reader thread with 1 KiB to
+// 1 MiB transfers
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/sys/sysproto.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <thread>
+
+namespace {
+// transfer buffers must be in the guest address range
+constexpr std::uintptr_t kUserAddress = 0x10'0000'0000;
+constexpr std::size_t kMaxTransferSize = 1024 * 1024;
+constexpr std::size_t kTotalSize = 512 * 1024 * 1024;
+
+struct UserState {
+  alignas(4096) std::byte writeBuffer[kMaxTransferSize];
+  alignas(4096) std::byte readBuffer[kMaxTransferSize];
+};
+
+void writeAll(orbis::Thread *thread, orbis::sint fd, UserState *state,
+              std::size_t transferSize) {
+  for (std::size_t done = 0; done < kTotalSize;) {
+    if (orbis::sys_write(thread, fd, state->writeBuffer, transferSize)
+            .isError()) {
+      std::fprintf(stderr, "write failed\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    done += thread->retval[0];
+  }
+}
+
+void readAll(orbis::Thread *thread, orbis::sint fd, UserState *state,
+             std::size_t transferSize) {
+  for (std::size_t done = 0; done < kTotalSize;) {
+    if (orbis::sys_read(thread, fd, state->readBuffer, transferSize)
+            .isError() ||
+        thread->retval[0] == 0) {
+      std::fprintf(stderr, "read failed\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    done += thread->retval[0];
+  }
+}
+
+double run(orbis::Thread *reader, orbis::Thread *writer, orbis::sint readFd,
+           orbis::sint writeFd, UserState *state, std::size_t transferSize) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::thread writerThread([=] {
+    orbis::g_currentThread = writer;
+    writeAll(writer, writeFd, state, transferSize);
+  });
+
+  readAll(reader, readFd, state, transferSize);
+  writerThread.join();
+
+  return static_cast<double>(kTotalSize) / (1024 * 1024) /
+         std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+             .count();
+}
+} // namespace
+
+int main() {
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto user = ::mmap(reinterpret_cast<void *>(kUserAddress), sizeof(UserState),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (user != reinterpret_cast<void *>(kUserAddress)) {
+    std::perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto state = static_cast<UserState *>(user);
+  auto process = orbis::createProcess(nullptr, 10);
+  auto reader = orbis::createThread(process, "bench reader");
+  auto writer = orbis::createThread(process, "bench writer");
+  orbis::g_currentThread = reader;
+
+  if (orbis::sys_pipe(reader).isError()) {
+    std::fprintf(stderr, "pipe failed\n");
+    return EXIT_FAILURE;
+  }
+
+  // data written to one end is read from the other
+  auto readFd = static_cast<orbis::sint>(reader->retval[0]);
+  auto writeFd = static_cast<orbis::sint>(reader->retval[1]);
+
+  std::printf("%zu MiB per transfer size\n", kTotalSize >> 20);
+
+  for (std::size_t transferSize = 1024; transferSize <= kMaxTransferSize;
+       transferSize *= 4) {
+    std::printf("%7zu KiB: %10.1f MiB/s\n", transferSize >> 10,
+                run(reader, writer, readFd, writeFd, state, transferSize));
+  }
+
+  return EXIT_SUCCESS;
+}
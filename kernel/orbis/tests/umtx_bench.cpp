@@ -0,0 +1,150 @@
+// Lock and signal throughput of umutex and ucond with 1 to 64 contending
+// threads
+
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include "orbis/umtx.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+namespace {
+// umtx objects must be in the guest address range
+constexpr std::uintptr_t kUserAddress = 0x10'0000'0000;
+constexpr auto kRunTime = std::chrono::milliseconds(500);
+
+struct alignas(64) UserState {
+  orbis::umutex mutex;
+  orbis::ucond cond;
+  std::uint32_t tokens;
+};
+
+std::atomic<bool> g_stop;
+
+// the syscall retries the lock after a timed out wait the same way
+void lock(orbis::Thread *thread, orbis::umutex *mutex) {
+  while (orbis::umtx_lock_umutex(thread, mutex, -1) ==
+         orbis::ErrorCode::TIMEDOUT) {
+  }
+}
+
+std::uint64_t runMutex(orbis::Thread *thread, UserState *state) {
+  std::uint64_t ops = 0;
+
+  while (!g_stop.load(std::memory_order::relaxed)) {
+    lock(thread, &state->mutex);
+    state->tokens++;
+    orbis::umtx_unlock_umutex(thread, &state->mutex);
+    ops++;
+  }
+
+  return ops;
+}
+
+// half of the threads wait for a token while the others return one
+std::uint64_t runCond(orbis::Thread *thread, UserState *state) {
+  std::uint64_t ops = 0;
+
+  while (!g_stop.load(std::memory_order::relaxed)) {
+    lock(thread, &state->mutex);
+    while (state->tokens == 0 && !g_stop.load(std::memory_order::relaxed)) {
+      orbis::umtx_cv_wait(thread, &state->cond, &state->mutex, -1, 0);
+      lock(thread, &state->mutex);
+    }
+
+    if (state->tokens != 0) {
+      state->tokens--;
+    }
+    orbis::umtx_unlock_umutex(thread, &state->mutex);
+
+    lock(thread, &state->mutex);
+    state->tokens++;
+    orbis::umtx_cv_signal(thread, &state->cond);
+    orbis::umtx_unlock_umutex(thread, &state->mutex);
+    ops++;
+  }
+
+  return ops;
+}
+
+double run(orbis::Process *process, orbis::Thread *mainThread,
+           UserState *state, unsigned threadCount,
+           std::uint64_t (*body)(orbis::Thread *, UserState *)) {
+  std::destroy_at(state);
+  std::construct_at(state);
+  state->tokens = std::max(threadCount / 2, 1u);
+  g_stop = false;
+
+  std::vector<std::uint64_t> ops(threadCount);
+  std::vector<std::thread> threads;
+  std::atomic<unsigned> finished = 0;
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    auto thread = orbis::createThread(process, "bench");
+    threads.emplace_back([=, &ops, &finished] {
+      orbis::g_currentThread = thread;
+      ops[i] = body(thread, state);
+      finished++;
+    });
+  }
+
+  std::this_thread::sleep_for(kRunTime);
+  g_stop = true;
+
+  // a waiter can check the stop flag right before the broadcast, repeat it
+  // until every thread is out of cv_wait
+  while (finished != threadCount) {
+    orbis::umtx_cv_broadcast(mainThread, &state->cond);
+    std::this_thread::yield();
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::uint64_t total = 0;
+  for (auto count : ops) {
+    total += count;
+  }
+
+  return static_cast<double>(total) /
+         std::chrono::duration<double>(kRunTime).count();
+}
+} // namespace
+
+int main() {
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto user = ::mmap(reinterpret_cast<void *>(kUserAddress), sizeof(UserState),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (user != reinterpret_cast<void *>(kUserAddress)) {
+    std::perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto state = static_cast<UserState *>(user);
+  auto process = orbis::createProcess(nullptr, 10);
+  auto mainThread = orbis::createThread(process, "bench main");
+  orbis::g_currentThread = mainThread;
+
+  std::printf("threads  umutex ops/s    ucond ops/s\n");
+
+  for (unsigned threadCount = 1; threadCount <= 64; threadCount *= 2) {
+    auto mutexRate = run(process, mainThread, state, threadCount, runMutex);
+    auto condRate = run(process, mainThread, state, threadCount, runCond);
+    std::printf("%7u %14.0f %14.0f\n", threadCount, mutexRate, condRate);
+  }
+
+  return EXIT_SUCCESS;
+}
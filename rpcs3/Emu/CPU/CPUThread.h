@@ -3,6 +3,7 @@
 #include "util/Thread.h"
 #include "rx/EnumBitSet.hpp"
 #include "util/atomic_bit_set.h"
+#include "util/timer_wheel.hpp"
 
 #include <vector>
 #include <any>
@@ -70,6 +71,9 @@ public:
 	// Public thread state
 	atomic_bs_t<cpu_flag> state{cpu_flag::stop + cpu_flag::wait};
 
+	// Link in the lv2 timeout queue (protected by lv2_obj::g_mutex)
+	timer_wheel_link<cpu_thread> lv2_timeout;
+
 	// Process thread state, return true if the checker must return
 	bool check_state() noexcept;
 
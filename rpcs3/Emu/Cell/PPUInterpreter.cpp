@@ -9205,6 +9205,269 @@ void PPUInterpreter::interpret(PPUContext& context, std::uint32_t inst)
 	}
 }
 
+// Straight-line instructions decoded once, never crosses a page boundary
+struct ppu_block
+{
+	struct op_t
+	{
+		PPUInterpreter::isel_func_t fn;
+		rx::cell::ppu::Instruction inst;
+	};
+
+	std::vector<op_t> ops;
+
+	// Instruction words the block was decoded from, checked before every run
+	std::vector<be_t<u32>> source;
+
+	// Last instruction sets cia itself
+	bool is_branch = false;
+};
+
+// Pages containing pre-decoded code, tested on every guest store
+static std::array<atomic_t<u64>, 0x1'0000'0000 / 4096 / 64> s_ppu_code_pages{};
+
+// Pre-decoded blocks of the interpreter, keyed by the guest address
+struct ppu_block_cache
+{
+	// Upper limit of the block size, state is only checked between blocks
+	static constexpr usz max_block_size = 256;
+
+	shared_mutex mutex;
+	std::unordered_map<u32, std::shared_ptr<const ppu_block>> blocks;
+
+	// Page number -> addresses of blocks in the page
+	std::unordered_map<u32, std::vector<u32>> pages;
+
+	// Incremented by every invalidation, blocks decoded across it are dropped
+	u64 generation = 0;
+
+	ppu_block_cache()
+	{
+		for (auto& bits : s_ppu_code_pages)
+		{
+			bits.release(0);
+		}
+	}
+
+	ppu_block_cache(const ppu_block_cache&) = delete;
+
+	ppu_block_cache& operator=(const ppu_block_cache&) = delete;
+
+	~ppu_block_cache()
+	{
+		for (auto& bits : s_ppu_code_pages)
+		{
+			bits.release(0);
+		}
+	}
+
+	static bool is_block_end(rx::cell::ppu::Opcode op)
+	{
+		using enum rx::cell::ppu::Opcode;
+
+		switch (op)
+		{
+		case B:
+		case BC:
+		case BCLR:
+		case BCCTR:
+		case SC:
+		case TW:
+		case TWI:
+		case TD:
+		case TDI:
+		case Invalid:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	std::shared_ptr<const ppu_block> find(u32 addr)
+	{
+		reader_lock lock(mutex);
+
+		if (auto found = blocks.find(addr); found != blocks.end())
+		{
+			return found->second;
+		}
+
+		return nullptr;
+	}
+
+	std::shared_ptr<const ppu_block> build(const PPUInterpreter& interpreter, u32 addr)
+	{
+		auto block = std::make_shared<ppu_block>();
+
+		const u32 page_end = (addr | 4095) + 1;
+
+		// The page is marked before decoding, so stores made during it are not missed
+		u64 start_generation;
+		{
+			std::lock_guard lock(mutex);
+			s_ppu_code_pages[addr / 4096 / 64].fetch_or(u64{1} << (addr / 4096 % 64));
+			start_generation = generation;
+		}
+
+		for (u32 pos = addr; pos != page_end && block->ops.size() < max_block_size; pos += 4)
+		{
+			// HLE functions and registered handlers are left to interpret()
+			if (*reinterpret_cast<ppu_intrp_func_t*>(vm::g_exec_addr + u64{pos} * 2) || g_fxo->get<ppu_function_manager>().is_func(pos))
+			{
+				break;
+			}
+
+			const be_t<u32> word = *reinterpret_cast<be_t<u32>*>(vm::g_base_addr + pos);
+			const u32 inst = word;
+			const auto op = rx::cell::ppu::getOpcode(inst);
+
+			block->source.push_back(word);
+			block->ops.push_back({interpreter.impl[static_cast<int>(op)], std::bit_cast<rx::cell::ppu::Instruction>(inst)});
+
+			if (is_block_end(op))
+			{
+				block->is_branch = op == rx::cell::ppu::Opcode::B || op == rx::cell::ppu::Opcode::BC || op == rx::cell::ppu::Opcode::BCLR || op == rx::cell::ppu::Opcode::BCCTR;
+				break;
+			}
+		}
+
+		if (block->ops.empty())
+		{
+			return nullptr;
+		}
+
+		std::lock_guard lock(mutex);
+
+		if (generation != start_generation)
+		{
+			// Code may have changed while it was decoded
+			return nullptr;
+		}
+
+		const auto [found, inserted] = blocks.try_emplace(addr, std::move(block));
+
+		if (inserted)
+		{
+			pages[addr / 4096].push_back(addr);
+		}
+
+		return found->second;
+	}
+
+	// Removes a block whose source words no longer match the memory
+	void drop(u32 addr, const ppu_block* block)
+	{
+		std::lock_guard lock(mutex);
+
+		if (auto found = blocks.find(addr); found == blocks.end() || found->second.get() != block)
+		{
+			return;
+		}
+
+		blocks.erase(addr);
+
+		if (auto found = pages.find(addr / 4096); found != pages.end())
+		{
+			std::erase(found->second, addr);
+
+			if (found->second.empty())
+			{
+				pages.erase(found);
+			}
+		}
+	}
+
+	void invalidate(u32 addr, u32 size)
+	{
+		std::lock_guard lock(mutex);
+
+		generation++;
+
+		for (u64 page = addr / 4096; page <= (u64{addr} + size - 1) / 4096 && page < 0x10'0000; page++)
+		{
+			s_ppu_code_pages[page / 64].fetch_and(~(u64{1} << (page % 64)));
+
+			if (auto found = pages.find(static_cast<u32>(page)); found != pages.end())
+			{
+				for (u32 block_addr : found->second)
+				{
+					blocks.erase(block_addr);
+				}
+
+				pages.erase(found);
+			}
+		}
+	}
+};
+
+void PPUInterpreter::execute(PPUContext& context)
+{
+	auto& cache = g_fxo->get<ppu_block_cache>();
+
+	auto block = cache.find(context.cia);
+
+	// Code can be written by paths that don't invalidate (HLE and lv2 writes, SPU DMA,
+	// reservation stores), the block is only valid while its source words are unchanged
+	if (block && std::memcmp(block->source.data(), vm::g_base_addr + context.cia, block->source.size() * sizeof(u32)) != 0)
+	{
+		cache.drop(context.cia, block.get());
+		block = nullptr;
+	}
+
+	if (!block)
+	{
+		block = cache.build(*this, context.cia);
+
+		if (!block)
+		{
+			interpret(context, *reinterpret_cast<be_t<u32>*>(vm::g_base_addr + context.cia));
+			return;
+		}
+	}
+
+	// Dispatch without decoding, the last instruction is handled as in interpret()
+	const auto last = &block->ops.back();
+
+	for (auto op = block->ops.data(); op != last; op++)
+	{
+		op->fn(context, op->inst);
+		context.cia += 4;
+	}
+
+	const u32 last_addr = context.cia;
+
+	last->fn(context, last->inst);
+
+	if (context.cia == last_addr && !block->is_branch)
+	{
+		context.cia += 4;
+	}
+}
+
+void PPUInterpreter::invalidate(u32 addr, u32 size)
+{
+	if (!size)
+	{
+		return;
+	}
+
+	// Orders the store before the test of the page bits, see ppu_block_cache::build
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	for (u64 page = addr / 4096; page <= (u64{addr} + size - 1) / 4096 && page < 0x10'0000; page++)
+	{
+		if (s_ppu_code_pages[page / 64] & (u64{1} << (page % 64)))
+		{
+			if (auto cache = g_fxo->try_get<ppu_block_cache>())
+			{
+				cache->invalidate(addr, size);
+			}
+
+			return;
+		}
+	}
+}
+
 extern "C"
 {
 	[[noreturn]] void rpcsx_trap()
@@ -9227,6 +9490,7 @@ extern "C"
 	void rpcsx_vm_write(std::uint64_t vaddr, const void* src, std::size_t size)
 	{
 		std::memcpy(vm::g_base_addr + vaddr, src, size);
+		PPUInterpreter::invalidate(static_cast<u32>(vaddr), static_cast<u32>(size));
 	}
 
 	std::uint64_t rpcsx_get_tb()
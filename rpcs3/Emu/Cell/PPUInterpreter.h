@@ -52,7 +52,15 @@ struct PPUContext;
 
 struct PPUInterpreter
 {
-	std::array<void (*)(PPUContext& context, rx::cell::ppu::Instruction inst), rx::fieldCount<rx::cell::ppu::Opcode>> impl;
+	using isel_func_t = void (*)(PPUContext& context, rx::cell::ppu::Instruction inst);
+
+	std::array<isel_func_t, rx::fieldCount<rx::cell::ppu::Opcode>> impl;
 	PPUInterpreter();
 	void interpret(PPUContext& context, std::uint32_t inst);
+
+	// Execute the pre-decoded block at context.cia, instructions which can't be pre-decoded are interpreted
+	void execute(PPUContext& context);
+
+	// Drop pre-decoded blocks overlapping the range
+	static void invalidate(u32 addr, u32 size);
 };
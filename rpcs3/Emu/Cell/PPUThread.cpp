@@ -910,6 +910,9 @@ extern void ppu_register_function_at(u32 addr, u32 size, ppu_intrp_func_t ptr =
 	if (ptr)
 	{
 		write_to_ptr<uptr>(ppu_ptr(addr), (reinterpret_cast<uptr>(ptr) & 0xffff'ffff'ffffu) | (uptr(ppu_read(addr)) & ~0xffff'ffff'ffffu));
+
+		// Pre-decoded blocks of the interpreter skip instructions with handlers
+		PPUInterpreter::invalidate(addr, 4);
 		return;
 	}
 
@@ -1230,6 +1233,8 @@ bool ppu_form_branch_to_code(u32 entry, u32 target)
 
 void ppu_remove_hle_instructions(u32 addr, u32 size)
 {
+	PPUInterpreter::invalidate(addr, size);
+
 	if (Emu.IsStopped() || !g_fxo->is_init<ppu_far_jumps_t>())
 	{
 		return;
@@ -1333,6 +1338,9 @@ extern bool ppu_breakpoint(u32 addr, bool is_adding)
 		}
 
 		write_to_ptr<ppu_intrp_func_t>(ppu_ptr(addr), breakpoint);
+
+		// Pre-decoded blocks don't see the handler
+		PPUInterpreter::invalidate(addr, 4);
 		return true;
 	}
 
@@ -1342,6 +1350,7 @@ extern bool ppu_breakpoint(u32 addr, bool is_adding)
 	}
 
 	write_to_ptr<ppu_intrp_func_t>(ppu_ptr(addr), func_original);
+	PPUInterpreter::invalidate(addr, 4);
 	return true;
 }
 
@@ -2482,8 +2491,15 @@ void ppu_thread::exec_task()
 				return;
 			}
 
-			std::uint32_t inst = *reinterpret_cast<be_t<std::uint32_t>*>(mem_ + std::uint64_t{cia});
-			interpreter.interpret(*this, inst);
+			if (state)
+			{
+				// Step execution
+				std::uint32_t inst = *reinterpret_cast<be_t<std::uint32_t>*>(mem_ + std::uint64_t{cia});
+				interpreter.interpret(*this, inst);
+				continue;
+			}
+
+			interpreter.execute(*this);
 		}
 
 		return;
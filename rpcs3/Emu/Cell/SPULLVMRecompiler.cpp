@@ -10,6 +10,7 @@
 #include "Emu/RSX/Core/RSXReservationLock.hpp"
 #include "Crypto/sha1.h"
 #include "util/JIT.h"
+#include "rpcs3_version.h"
 
 #include "SPUThread.h"
 #include "SPUAnalyser.h"
@@ -64,6 +65,47 @@ const extern spu_decoder<spu_iflag> g_spu_iflag;
 #include "Emu/CPU/Backends/AArch64/AArch64JIT.h"
 #endif
 
+// Compiled SPU functions, shared by all recompiler threads
+struct spu_llvm_object_cache
+{
+	jit_object_pack pack;
+
+	// Settings and host properties which affect the generated code
+	static std::string fingerprint(const jit_compiler& jit)
+	{
+		// The translator itself changes between builds
+		std::string result = jit.fingerprint(jit_compiler::triple2());
+		fmt::append(result, ";%s", rpcs3::get_verbose_version());
+
+		for (const cfg::_base* node : std::initializer_list<const cfg::_base*>{
+				 &g_cfg.core.spu_xfloat_accuracy,
+				 &g_cfg.core.spu_block_size,
+				 &g_cfg.core.use_accurate_dfma,
+				 &g_cfg.core.spu_verification,
+				 &g_cfg.core.precise_spu_verification,
+				 &g_cfg.core.spu_prof,
+				 &g_cfg.core.spu_loop_detection,
+				 &g_cfg.core.spu_accurate_dma,
+				 &g_cfg.core.spu_accurate_reservations,
+				 &g_cfg.core.mfc_debug,
+				 &g_cfg.core.rsx_fifo_accuracy,
+				 &g_cfg.core.rsx_accurate_res_access,
+				 &g_cfg.core.clocks_scale,
+				 &g_cfg.savestate.compatible_mode,
+				 &g_cfg.video.strict_rendering_mode})
+		{
+			fmt::append(result, ";%s", node->to_string());
+		}
+
+		// Baked into SPU_RdDec
+		fmt::append(result, ";tsc=%u", utils::get_tsc_freq());
+
+		// Selects the MFC command path
+		fmt::append(result, ";rtm=%u", +g_use_rtm);
+		return result;
+	}
+};
+
 class spu_llvm_recompiler : public spu_recompiler_base, public cpu_translator
 {
 	// JIT Instance
@@ -84,6 +126,9 @@ class spu_llvm_recompiler : public spu_recompiler_base, public cpu_translator
 	// Module name
 	std::string m_hash;
 
+	// Objects compiled in previous sessions
+	jit_object_pack* m_objects = nullptr;
+
 	// Patchpoint unique id
 	u32 m_pp_id = 0;
 
@@ -1482,11 +1527,30 @@ public:
 				register_transform_pass(ghc_fixup_pass);
 			}
 #endif
+
+			// Debug mode writes separate object files instead
+			if (g_cfg.core.spu_cache && !g_cfg.core.spu_debug && !m_spurt->get_cache_path().empty())
+			{
+				auto& cache = g_fxo->get<spu_llvm_object_cache>();
+
+				if (cache.pack.open(m_spurt->get_cache_path() + "spu-llvm.pack", spu_llvm_object_cache::fingerprint(m_jit)))
+				{
+					m_objects = &cache.pack;
+				}
+			}
 		}
 
 		reset_transforms();
 	}
 
+	// Linked by name, so cached objects don't depend on the address of the variable
+	llvm::Value* get_timebase_offs()
+	{
+		const auto ptr = m_module->getOrInsertGlobal("spu_timebase_offs", get_type<u64>());
+		m_engine->updateGlobalMapping("spu_timebase_offs", reinterpret_cast<u64>(&g_timebase_offs));
+		return ptr;
+	}
+
 	void init_luts()
 	{
 		// LUTs for some instructions
@@ -2702,44 +2766,50 @@ public:
 			m_function_table->eraseFromParent();
 		}
 
-		// Create the analysis managers.
-		// These must be declared in this order so that they are destroyed in the
-		// correct order due to inter-analysis-manager references.
-		LoopAnalysisManager lam;
-		FunctionAnalysisManager fam;
-		CGSCCAnalysisManager cgam;
-		ModuleAnalysisManager mam;
-
-		// Create the new pass manager builder.
-		// Take a look at the PassBuilder constructor parameters for more
-		// customization, e.g. specifying a TargetMachine or various debugging
-		// options.
-		PassBuilder pb;
-
-		// Register all the basic analyses with the managers.
-		pb.registerModuleAnalyses(mam);
-		pb.registerCGSCCAnalyses(cgam);
-		pb.registerFunctionAnalyses(fam);
-		pb.registerLoopAnalyses(lam);
-		pb.crossRegisterProxies(lam, fam, cgam, mam);
-
-		FunctionPassManager fpm;
-		// Basic optimizations
-		fpm.addPass(EarlyCSEPass(true));
-		fpm.addPass(SimplifyCFGPass());
-		fpm.addPass(DSEPass());
-		fpm.addPass(createFunctionToLoopPassAdaptor(LICMPass(LICMOptions()), true));
-		fpm.addPass(ADCEPass());
-
-		for (auto& f : *m_module)
-		{
-			run_transforms(f);
-		}
+		// Object of the same function compiled earlier, optimizations can be skipped as the code is not generated
+		const bool is_cached = m_objects && m_objects->contains(m_module->getName().str());
 
-		for (const auto& func : m_functions)
+		if (!is_cached)
 		{
-			const auto f = func.second.fn ? func.second.fn : func.second.chunk;
-			fpm.run(*f, fam);
+			// Create the analysis managers.
+			// These must be declared in this order so that they are destroyed in the
+			// correct order due to inter-analysis-manager references.
+			LoopAnalysisManager lam;
+			FunctionAnalysisManager fam;
+			CGSCCAnalysisManager cgam;
+			ModuleAnalysisManager mam;
+
+			// Create the new pass manager builder.
+			// Take a look at the PassBuilder constructor parameters for more
+			// customization, e.g. specifying a TargetMachine or various debugging
+			// options.
+			PassBuilder pb;
+
+			// Register all the basic analyses with the managers.
+			pb.registerModuleAnalyses(mam);
+			pb.registerCGSCCAnalyses(cgam);
+			pb.registerFunctionAnalyses(fam);
+			pb.registerLoopAnalyses(lam);
+			pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+			FunctionPassManager fpm;
+			// Basic optimizations
+			fpm.addPass(EarlyCSEPass(true));
+			fpm.addPass(SimplifyCFGPass());
+			fpm.addPass(DSEPass());
+			fpm.addPass(createFunctionToLoopPassAdaptor(LICMPass(LICMOptions()), true));
+			fpm.addPass(ADCEPass());
+
+			for (auto& f : *m_module)
+			{
+				run_transforms(f);
+			}
+
+			for (const auto& func : m_functions)
+			{
+				const auto f = func.second.fn ? func.second.fn : func.second.chunk;
+				fpm.run(*f, fam);
+			}
 		}
 
 		// Clear context (TODO)
@@ -2790,6 +2860,10 @@ public:
 			// Testing only
 			m_jit.add(std::move(_module), m_spurt->get_cache_path() + "llvm/");
 		}
+		else if (m_objects)
+		{
+			m_jit.add(std::move(_module), *m_objects);
+		}
 		else
 		{
 			m_jit.add(std::move(_module));
@@ -3518,7 +3592,7 @@ public:
 #if defined(ARCH_X64)
 			if (utils::get_tsc_freq() && !(g_cfg.core.spu_loop_detection) && (g_cfg.core.clocks_scale == 100))
 			{
-				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), m_ir->CreateIntToPtr(m_ir->getInt64(reinterpret_cast<u64>(&g_timebase_offs)), get_type<u64*>()));
+				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), get_timebase_offs());
 				const auto timestamp = m_ir->CreateLoad(get_type<u64>(), spu_ptr<u64>(OFFSET_OF(spu_thread, ch_dec_start_timestamp)));
 				const auto dec_value = m_ir->CreateLoad(get_type<u32>(), spu_ptr<u32>(OFFSET_OF(spu_thread, ch_dec_value)));
 				const auto tsc = m_ir->CreateCall(get_intrinsic(llvm::Intrinsic::x86_rdtsc));
@@ -4340,7 +4414,7 @@ public:
 #if defined(ARCH_X64)
 			if (utils::get_tsc_freq() && !(g_cfg.core.spu_loop_detection) && (g_cfg.core.clocks_scale == 100))
 			{
-				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), m_ir->CreateIntToPtr(m_ir->getInt64(reinterpret_cast<u64>(&g_timebase_offs)), get_type<u64*>()));
+				const auto timebase_offs = m_ir->CreateLoad(get_type<u64>(), get_timebase_offs());
 				const auto tsc = m_ir->CreateCall(get_intrinsic(llvm::Intrinsic::x86_rdtsc));
 				const auto tscx = m_ir->CreateMul(m_ir->CreateUDiv(tsc, m_ir->getInt64(utils::get_tsc_freq())), m_ir->getInt64(80000000));
 				const auto tscm = m_ir->CreateUDiv(m_ir->CreateMul(m_ir->CreateURem(tsc, m_ir->getInt64(utils::get_tsc_freq())), m_ir->getInt64(80000000)), m_ir->getInt64(utils::get_tsc_freq()));
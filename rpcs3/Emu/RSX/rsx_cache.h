@@ -10,6 +10,7 @@
 #include "Emu/RSX/Program/RSXVertexProgram.h"
 #include "Emu/RSX/Program/RSXFragmentProgram.h"
 #include "Overlays/Shaders/shader_loading_dialog.h"
+#include "rsx_pipeline_archive.h"
 
 #include <atomic>
 #include <chrono>
@@ -71,6 +72,8 @@ namespace rsx
 			pipeline_storage_type pipeline_properties;
 		};
 
+		using record_type = pipeline_archive::record_type;
+
 		std::string version_prefix;
 		std::string root_path;
 		std::string pipeline_class_name;
@@ -78,6 +81,9 @@ namespace rsx
 
 		backend_storage& m_storage;
 
+		// Pipelines and the programs they use, programs shared by pipelines are stored once
+		pipeline_archive m_archive;
+
 		std::atomic<bool> m_shader_storage_exit{false};
 		std::condition_variable m_shader_storage_cv;
 		std::mutex m_shader_storage_mtx;
@@ -88,6 +94,7 @@ namespace rsx
 				while (!m_shader_storage_exit.load())
 				{
 					unpacked_shader item;
+					bool is_last = false;
 
 					{
 						std::unique_lock lock(m_shader_storage_mtx);
@@ -99,54 +106,60 @@ namespace rsx
 
 						item = std::move(m_shader_storage_worker_queue.back());
 						m_shader_storage_worker_queue.pop_back();
+						is_last = m_shader_storage_worker_queue.empty();
 					}
 
 					pipeline_data data = pack(item.props, item.vp, item.fp);
 
-					std::string fp_name = root_path + "/raw/" + fmt::format("%llX.fp", data.fragment_program_hash);
-					std::string vp_name = root_path + "/raw/" + fmt::format("%llX.vp", data.vertex_program_hash);
-
-					if (fs::stat_t s{}; !fs::get_stat(fp_name, s) || s.size != item.fp.ucode_length)
-					{
-						fs::write_pending_file(fp_name, item.fp.get_data(), item.fp.ucode_length);
-					}
+					m_archive.append(record_type::fragment_program, data.fragment_program_hash, item.fp.get_data(), item.fp.ucode_length);
+					m_archive.append(record_type::vertex_program, data.vertex_program_hash, item.vp.data.data(), item.vp.data.size() * sizeof(u32));
+					m_archive.append(record_type::pipeline, get_pipeline_key(data), &data, sizeof(data));
 
-					if (fs::stat_t s{}; !fs::get_stat(vp_name, s) || s.size != item.vp.data.size() * sizeof(u32))
+					// Sync once the queued pipelines are stored, so a crash doesn't lose them
+					if (is_last)
 					{
-						fs::write_pending_file(vp_name, item.vp.data);
+						m_archive.flush();
 					}
-
-					const u32 state_params[] =
-						{
-							data.vp_ctrl0,
-							data.vp_ctrl1,
-							data.fp_ctrl,
-							data.vp_texture_dimensions,
-							data.fp_texture_dimensions,
-							data.fp_texcoord_control,
-							data.fp_height,
-							data.fp_pixel_layout,
-							data.fp_lighting_flags,
-							data.fp_shadow_textures,
-							data.fp_redirected_textures,
-							data.vp_multisampled_textures,
-							data.fp_multisampled_textures,
-							data.fp_mrt_count,
-					};
-					const usz state_hash = rpcs3::hash_array(state_params);
-
-					const std::string pipeline_file_name = fmt::format("%llX+%llX+%llX+%llX.bin", data.vertex_program_hash, data.fragment_program_hash, data.pipeline_storage_hash, state_hash);
-					const std::string pipeline_path = root_path + "/pipelines/" + pipeline_class_name + "/" + version_prefix + "/" + pipeline_file_name;
-					fs::write_pending_file(pipeline_path, &data, sizeof(data));
 				}
 			});
 
+		static u64 get_pipeline_key(const pipeline_data& data)
+		{
+			const u32 state_params[] =
+				{
+					data.vp_ctrl0,
+					data.vp_ctrl1,
+					data.fp_ctrl,
+					data.vp_texture_dimensions,
+					data.fp_texture_dimensions,
+					data.fp_texcoord_control,
+					data.fp_height,
+					data.fp_pixel_layout,
+					data.fp_lighting_flags,
+					data.fp_shadow_textures,
+					data.fp_redirected_textures,
+					data.vp_multisampled_textures,
+					data.fp_multisampled_textures,
+					data.fp_mrt_count,
+			};
+
+			const u64 key_params[] =
+				{
+					data.vertex_program_hash,
+					data.fragment_program_hash,
+					data.pipeline_storage_hash,
+					rpcs3::hash_array(state_params),
+			};
+
+			return rpcs3::hash_array(key_params);
+		}
+
 		static std::string get_message(u32 index, u32 processed, u32 entry_count)
 		{
 			return fmt::format("%s pipeline object %u of %u", index == 0 ? "Loading" : "Compiling", processed, entry_count);
 		}
 
-		void load_shaders(uint nb_workers, unpacked_type& unpacked, std::string& directory_path, std::vector<fs::dir_entry>& entries, u32 entry_count,
+		void load_shaders(uint nb_workers, unpacked_type& unpacked, std::vector<u64>& entries, u32 entry_count,
 			shader_loading_dialog* dlg)
 		{
 			atomic_t<u32> processed(0);
@@ -166,29 +179,25 @@ namespace rsx
 					return !Emu.IsStopped();
 				};
 
+				std::vector<u8> record;
+
 				for (u32 pos = start_at; pos < stop_at; ++pos)
 				{
-					const fs::dir_entry& tmp = entries[pos];
 					thread_processed++;
 
-					const auto filename = directory_path + "/" + tmp.name;
-					fs::file f(filename);
-
-					if (!f)
+					if (!m_archive.read(record_type::pipeline, entries[pos], record))
 					{
-						fs::remove_file(filename);
 						continue;
 					}
 
-					if (f.size() != sizeof(pipeline_data))
+					if (record.size() != sizeof(pipeline_data))
 					{
-						rsx_log.error("Removing cached pipeline object %s since it's not binary compatible with the current shader cache", tmp.name.c_str());
-						fs::remove_file(filename);
+						rsx_log.error("Skipping cached pipeline object 0x%llx since it's not binary compatible with the current shader cache", entries[pos]);
 						continue;
 					}
 
 					pipeline_data pdata{};
-					f.read(&pdata, f.size());
+					std::memcpy(&pdata, record.data(), sizeof(pdata));
 
 					auto entry = unpack(pdata);
 
@@ -213,6 +222,59 @@ namespace rsx
 			await_workers(nb_workers, 0, shader_load_worker, processed, entry_count, dlg);
 		}
 
+		// Move pipelines of the cache layout with one file per object into the archive
+		void import_files(const std::string& directory_path)
+		{
+			fs::dir root(directory_path);
+
+			if (!root)
+			{
+				return;
+			}
+
+			u32 imported = 0;
+
+			for (auto&& entry : root)
+			{
+				if (entry.is_directory || !entry.name.ends_with(".bin"))
+				{
+					continue;
+				}
+
+				pipeline_data data{};
+
+				if (fs::file f(directory_path + "/" + entry.name); !f || f.size() != sizeof(data) || f.read(&data, sizeof(data)) != sizeof(data))
+				{
+					continue;
+				}
+
+				const fs::file vp_file(fmt::format("%s/raw/%llX.vp", root_path, data.vertex_program_hash));
+				const fs::file fp_file(fmt::format("%s/raw/%llX.fp", root_path, data.fragment_program_hash));
+
+				if (!vp_file || !fp_file)
+				{
+					continue;
+				}
+
+				const auto vp_data = vp_file.to_vector<u8>();
+				const auto fp_data = fp_file.to_vector<u8>();
+
+				m_archive.append(record_type::vertex_program, data.vertex_program_hash, vp_data.data(), vp_data.size());
+				m_archive.append(record_type::fragment_program, data.fragment_program_hash, fp_data.data(), fp_data.size());
+
+				if (m_archive.append(record_type::pipeline, get_pipeline_key(data), &data, sizeof(data)))
+				{
+					imported++;
+				}
+			}
+
+			if (imported)
+			{
+				m_archive.flush();
+				rsx_log.notice("shaders_cache: imported %u pipeline objects from %s", imported, directory_path);
+			}
+		}
+
 		template <typename... Args>
 		void compile_shaders(uint nb_workers, unpacked_type& unpacked, u32 entry_count, shader_loading_dialog* dlg, Args&&... args)
 		{
@@ -336,6 +398,13 @@ namespace rsx
 					root_path = std::move(cache_path) + "shaders_cache/";
 				}
 			}
+
+			if (!root_path.empty())
+			{
+				const std::string directory_path = root_path + "/pipelines/" + pipeline_class_name;
+				fs::create_path(directory_path);
+				m_archive.open(directory_path + "/" + version_prefix + ".pack");
+			}
 		}
 
 		~shaders_cache()
@@ -347,6 +416,7 @@ namespace rsx
 			}
 
 			m_shader_storage_worker_thread.join();
+			m_archive.flush();
 		}
 
 		template <typename... Args>
@@ -357,28 +427,23 @@ namespace rsx
 				return;
 			}
 
-			std::string directory_path = root_path + "/pipelines/" + pipeline_class_name + "/" + version_prefix;
-
-			fs::dir root = fs::dir(directory_path);
-
-			if (!root)
+			if (!m_archive)
 			{
-				fs::create_path(directory_path);
-				fs::create_path(root_path + "/raw");
 				return;
 			}
 
-			std::vector<fs::dir_entry> entries;
+			std::vector<u64> entries = m_archive.get_keys(record_type::pipeline);
 
-			for (auto&& entry : root)
+			if (entries.empty())
 			{
-				if (entry.is_directory)
-					continue;
+				import_files(root_path + "/pipelines/" + pipeline_class_name + "/" + version_prefix);
+			}
 
-				if (entry.name.ends_with(".bin"))
-				{
-					entries.push_back(std::move(entry));
-				}
+			// Nothing is rendered yet, so the archive can be rewritten without blocking readers
+			if (m_archive.needs_compaction())
+			{
+				m_archive.compact();
+				entries = m_archive.get_keys(record_type::pipeline);
 			}
 
 			u32 entry_count = ::size32(entries);
@@ -386,8 +451,6 @@ namespace rsx
 			if (!entry_count)
 				return;
 
-			root.rewind();
-
 			// Progress dialog
 			std::unique_ptr<shader_loading_dialog> fallback_dlg;
 			if (!dlg)
@@ -406,7 +469,7 @@ namespace rsx
 			unpacked_type unpacked;
 			uint nb_workers = g_cfg.video.renderer == video_renderer::vulkan ? utils::get_thread_count() * 2 : 1;
 
-			load_shaders(nb_workers, unpacked, directory_path, entries, entry_count, dlg);
+			load_shaders(nb_workers, unpacked, entries, entry_count, dlg);
 
 			// Account for any invalid entries
 			entry_count = unpacked.size();
@@ -457,29 +520,30 @@ namespace rsx
 		{
 			RSXVertexProgram vp = {};
 
-			fs::file f(fmt::format("%s/raw/%llX.vp", root_path, program_hash));
-			if (f)
-				f.read(vp.data, f.size() / sizeof(u32));
+			if (std::vector<u8> data; m_archive.read(record_type::vertex_program, program_hash, data))
+			{
+				vp.data.resize(data.size() / sizeof(u32));
+				std::memcpy(vp.data.data(), data.data(), vp.data.size() * sizeof(u32));
+			}
 
 			return vp;
 		}
 
 		RSXFragmentProgram load_fp_raw(u64 program_hash)
 		{
-			fs::file f(fmt::format("%s/raw/%llX.fp", root_path, program_hash));
-
 			RSXFragmentProgram fp = {};
 
-			const u32 size = fp.ucode_length = f ? ::size32(f) : 0;
-
-			if (!size)
+			std::vector<u8> data;
+			if (!m_archive.read(record_type::fragment_program, program_hash, data) || data.empty())
 			{
 				return fp;
 			}
 
+			const u32 size = fp.ucode_length = ::size32(data);
+
 			auto buf = std::make_unique<u8[]>(size);
 			fp.data = buf.get();
-			f.read(buf.get(), size);
+			std::memcpy(buf.get(), data.data(), size);
 			fragment_program_data[fragment_program_data.push_begin()] = std::move(buf);
 			return fp;
 		}
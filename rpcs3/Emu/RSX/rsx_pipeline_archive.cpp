@@ -0,0 +1,535 @@
+#include "stdafx.h"
+#include "rsx_pipeline_archive.h"
+
+#include <algorithm>
+#include <bit>
+
+#include <zlib.h>
+#include <zstd.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace rsx
+{
+	static constexpr u64 c_archive_magic = "RSXPIPES"_u64;
+	static constexpr u32 c_archive_version = 1;
+	static constexpr u32 c_record_magic = "PREC"_u32;
+	static constexpr u8 c_record_compressed = 1;
+	static constexpr u64 c_offset_mask = (u64{1} << 56) - 1;
+
+	static u64 get_table_index(u64 type, u64 key, u32 table_size)
+	{
+		// Fibonacci hashing, table size is a power of two
+		return ((key ^ (type << 56)) * 0x9e3779b97f4a7c15ull) >> (64 - std::countr_zero(table_size));
+	}
+
+	pipeline_archive::~pipeline_archive()
+	{
+		close();
+	}
+
+	bool pipeline_archive::open(const std::string& path)
+	{
+		std::lock_guard lock(m_mutex);
+		close_impl();
+		m_path = path;
+		return open_impl();
+	}
+
+	void pipeline_archive::close()
+	{
+		std::lock_guard lock(m_mutex);
+		close_impl();
+	}
+
+	bool pipeline_archive::open_impl()
+	{
+		if (!m_file.open(m_path, fs::read + fs::write + fs::create))
+		{
+			rsx_log.error("pipeline_archive: failed to open '%s' (%s)", m_path, fs::g_tls_error);
+			return false;
+		}
+
+		const u64 size = m_file.size();
+		archive_header header{};
+
+		const bool is_valid = size >= sizeof(header) &&
+			m_file.read_at(0, &header, sizeof(header)) == sizeof(header) &&
+			header.magic == c_archive_magic &&
+			header.version == c_archive_version &&
+			(header.table_size & (header.table_size - 1)) == 0 &&
+			sizeof(header) + u64{header.table_size} * sizeof(table_entry) <= header.indexed_end &&
+			header.indexed_end <= size;
+
+		if (!is_valid)
+		{
+			if (size)
+			{
+				// Keep the old archive for the user, it can't be opened while it is renamed on some platforms
+				const std::string backup_path = m_path + ".bak";
+				m_file.close();
+
+				if (!fs::rename(m_path, backup_path, true))
+				{
+					rsx_log.error("pipeline_archive: failed to move incompatible '%s' to '%s' (%s)", m_path, backup_path, fs::g_tls_error);
+					return false;
+				}
+
+				rsx_log.warning("pipeline_archive: '%s' is not compatible with the current shader cache, moved it to '%s'", m_path, backup_path);
+
+				if (!m_file.open(m_path, fs::read + fs::write + fs::create + fs::trunc))
+				{
+					rsx_log.error("pipeline_archive: failed to create '%s' (%s)", m_path, fs::g_tls_error);
+					return false;
+				}
+			}
+
+			header = {};
+			header.magic = c_archive_magic;
+			header.version = c_archive_version;
+			header.indexed_end = sizeof(header);
+
+			if (m_file.write_at(0, &header, sizeof(header)) != sizeof(header))
+			{
+				rsx_log.error("pipeline_archive: failed to write '%s' (%s)", m_path, fs::g_tls_error);
+				m_file.close();
+				return false;
+			}
+
+			m_end = sizeof(header);
+			return true;
+		}
+
+#ifdef _WIN32
+		m_mapping = ::CreateFileMappingW(m_file.get_handle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_view = m_mapping ? static_cast<const u8*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+		if (void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, m_file.get_handle(), 0); ptr != MAP_FAILED)
+		{
+			m_view = static_cast<const u8*>(ptr);
+		}
+#endif
+
+		if (!m_view)
+		{
+			rsx_log.error("pipeline_archive: failed to map '%s'", m_path);
+			close_impl();
+			return false;
+		}
+
+		m_view_size = size;
+		m_table = reinterpret_cast<const table_entry*>(m_view + sizeof(header));
+		m_table_size = header.table_size;
+
+		for (u32 i = 0; i < m_table_size; i++)
+		{
+			m_table_count += m_table[i].location != 0;
+		}
+
+		// Index records appended since the last compaction
+		u64 pos = header.indexed_end;
+		record_header record{};
+		std::vector<u8> scratch;
+
+		while (pos + sizeof(record_header) <= size)
+		{
+			if (!read_record(pos, record, scratch))
+			{
+				rsx_log.warning("pipeline_archive: damaged record at 0x%llx in '%s'", pos, m_path);
+				m_garbage++;
+				break;
+			}
+
+			const auto type = static_cast<record_type>(record.type);
+
+			if (find(type, record.key))
+			{
+				m_garbage++;
+			}
+			else
+			{
+				m_tail[record.type].emplace(record.key, pos);
+				m_tail_count++;
+			}
+
+			pos += sizeof(record_header) + record.size;
+		}
+
+		m_end = pos;
+		return true;
+	}
+
+	void pipeline_archive::close_impl()
+	{
+		if (m_file && m_unsynced)
+		{
+			m_file.sync();
+		}
+
+		m_unsynced = false;
+
+		if (m_view)
+		{
+#ifdef _WIN32
+			::UnmapViewOfFile(m_view);
+#else
+			::munmap(const_cast<u8*>(m_view), m_view_size);
+#endif
+		}
+
+#ifdef _WIN32
+		if (m_mapping)
+		{
+			::CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+#endif
+
+		m_view = nullptr;
+		m_view_size = 0;
+		m_table = nullptr;
+		m_table_size = 0;
+		m_table_count = 0;
+		m_tail_count = 0;
+		m_garbage = 0;
+		m_end = 0;
+
+		for (auto& tail : m_tail)
+		{
+			tail.clear();
+		}
+
+		m_file.close();
+	}
+
+	u64 pipeline_archive::find(record_type type, u64 key) const
+	{
+		if (m_table_size)
+		{
+			const u64 mask = m_table_size - 1;
+			u64 i = get_table_index(static_cast<u64>(type), key, m_table_size);
+
+			for (u32 probe = 0; probe < m_table_size; probe++, i = (i + 1) & mask)
+			{
+				const table_entry& entry = m_table[i];
+
+				if (!entry.location)
+				{
+					break;
+				}
+
+				if (entry.key == key && (entry.location >> 56) == static_cast<u64>(type))
+				{
+					return entry.location & c_offset_mask;
+				}
+			}
+		}
+
+		const auto& tail = m_tail[static_cast<usz>(type)];
+
+		if (const auto found = tail.find(key); found != tail.end())
+		{
+			return found->second;
+		}
+
+		return 0;
+	}
+
+	const u8* pipeline_archive::read_record(u64 offset, record_header& header, std::vector<u8>& scratch) const
+	{
+		if (offset + sizeof(header) <= m_view_size)
+		{
+			std::memcpy(&header, m_view + offset, sizeof(header));
+		}
+		else if (m_file.read_at(offset, &header, sizeof(header)) != sizeof(header))
+		{
+			return nullptr;
+		}
+
+		if (header.magic != c_record_magic || header.type >= static_cast<u8>(record_type::count) || offset + sizeof(header) + header.size > std::max(m_view_size, m_end))
+		{
+			return nullptr;
+		}
+
+		const u8* payload = nullptr;
+
+		if (offset + sizeof(header) + header.size <= m_view_size)
+		{
+			payload = m_view + offset + sizeof(header);
+		}
+		else
+		{
+			scratch.resize(header.size);
+
+			if (m_file.read_at(offset + sizeof(header), scratch.data(), header.size) != header.size)
+			{
+				return nullptr;
+			}
+
+			payload = scratch.data();
+		}
+
+		if (::crc32(0, payload, header.size) != header.crc)
+		{
+			return nullptr;
+		}
+
+		return payload;
+	}
+
+	bool pipeline_archive::append(record_type type, u64 key, const void* data, usz size)
+	{
+		// Compress without holding the lock, readers can use the archive meanwhile
+		if (contains(type, key))
+		{
+			return false;
+		}
+
+		std::vector<u8> compressed(::ZSTD_compressBound(size));
+		const usz compressed_size = ::ZSTD_compress(compressed.data(), compressed.size(), data, size, ZSTD_CLEVEL_DEFAULT);
+
+		record_header header{};
+		header.magic = c_record_magic;
+		header.type = static_cast<u8>(type);
+		header.raw_size = ::narrow<u32>(size);
+		header.key = key;
+
+		const u8* payload = static_cast<const u8*>(data);
+
+		if (!::ZSTD_isError(compressed_size) && compressed_size < size)
+		{
+			header.flags = c_record_compressed;
+			header.size = ::narrow<u32>(compressed_size);
+			payload = compressed.data();
+		}
+		else
+		{
+			header.size = header.raw_size;
+		}
+
+		header.crc = ::crc32(0, payload, header.size);
+
+		std::lock_guard lock(m_mutex);
+
+		if (!m_file || find(type, key))
+		{
+			return false;
+		}
+
+		if (m_file.write_at(m_end, &header, sizeof(header)) != sizeof(header) ||
+			m_file.write_at(m_end + sizeof(header), payload, header.size) != header.size)
+		{
+			rsx_log.error("pipeline_archive: failed to write '%s' (%s)", m_path, fs::g_tls_error);
+			return false;
+		}
+
+		m_tail[static_cast<usz>(type)].emplace(key, m_end);
+		m_tail_count++;
+		m_end += sizeof(header) + header.size;
+		m_unsynced = true;
+		return true;
+	}
+
+	void pipeline_archive::flush()
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (m_file && m_unsynced)
+		{
+			m_file.sync();
+			m_unsynced = false;
+		}
+	}
+
+	bool pipeline_archive::contains(record_type type, u64 key) const
+	{
+		reader_lock lock(m_mutex);
+		return find(type, key) != 0;
+	}
+
+	bool pipeline_archive::read(record_type type, u64 key, std::vector<u8>& data) const
+	{
+		reader_lock lock(m_mutex);
+
+		const u64 offset = find(type, key);
+
+		if (!offset)
+		{
+			return false;
+		}
+
+		record_header header{};
+		std::vector<u8> scratch;
+		const u8* payload = read_record(offset, header, scratch);
+
+		if (!payload)
+		{
+			rsx_log.error("pipeline_archive: damaged record 0x%llx in '%s'", key, m_path);
+			return false;
+		}
+
+		if (!(header.flags & c_record_compressed))
+		{
+			data.assign(payload, payload + header.size);
+			return true;
+		}
+
+		data.resize(header.raw_size);
+		const usz result = ::ZSTD_decompress(data.data(), data.size(), payload, header.size);
+
+		if (::ZSTD_isError(result) || result != header.raw_size)
+		{
+			rsx_log.error("pipeline_archive: failed to decompress record 0x%llx in '%s'", key, m_path);
+			return false;
+		}
+
+		return true;
+	}
+
+	std::vector<u64> pipeline_archive::get_keys(record_type type) const
+	{
+		reader_lock lock(m_mutex);
+
+		std::vector<u64> result;
+		const auto& tail = m_tail[static_cast<usz>(type)];
+		result.reserve(m_table_count + tail.size());
+
+		for (u32 i = 0; i < m_table_size; i++)
+		{
+			if (m_table[i].location && (m_table[i].location >> 56) == static_cast<u64>(type))
+			{
+				result.push_back(m_table[i].key);
+			}
+		}
+
+		for (const auto& [key, offset] : tail)
+		{
+			result.push_back(key);
+		}
+
+		return result;
+	}
+
+	bool pipeline_archive::needs_compaction() const
+	{
+		reader_lock lock(m_mutex);
+
+		// Keep the number of records indexed at load time small
+		return m_garbage || m_tail_count > m_table_count / 8;
+	}
+
+	bool pipeline_archive::compact()
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (!m_file)
+		{
+			return false;
+		}
+
+		std::vector<std::pair<u64, u64>> records; // offset, table location
+		records.reserve(m_table_count + m_tail_count);
+
+		for (u32 i = 0; i < m_table_size; i++)
+		{
+			if (m_table[i].location)
+			{
+				records.emplace_back(m_table[i].location & c_offset_mask, m_table[i].location);
+			}
+		}
+
+		for (usz type = 0; type < m_tail.size(); type++)
+		{
+			for (const auto& [key, offset] : m_tail[type])
+			{
+				records.emplace_back(offset, offset | (u64{type} << 56));
+			}
+		}
+
+		// Preserve the order of records in the file
+		std::sort(records.begin(), records.end());
+
+		u32 table_size = 16;
+		while (table_size < records.size() * 2)
+		{
+			table_size *= 2;
+		}
+
+		std::vector<table_entry> table(table_size);
+
+		fs::pending_file pending(m_path);
+
+		if (!pending.file)
+		{
+			rsx_log.error("pipeline_archive: failed to create '%s' (%s)", m_path, fs::g_tls_error);
+			return false;
+		}
+
+		u64 pos = sizeof(archive_header) + u64{table_size} * sizeof(table_entry);
+		record_header header{};
+		std::vector<u8> scratch;
+		u32 dropped = 0;
+
+		for (const auto& [offset, location] : records)
+		{
+			const u8* payload = read_record(offset, header, scratch);
+
+			if (!payload)
+			{
+				dropped++;
+				continue;
+			}
+
+			if (pending.file.write_at(pos, &header, sizeof(header)) != sizeof(header) ||
+				pending.file.write_at(pos + sizeof(header), payload, header.size) != header.size)
+			{
+				rsx_log.error("pipeline_archive: failed to write '%s' (%s)", pending.get_temp_path(), fs::g_tls_error);
+				return false;
+			}
+
+			for (u64 i = get_table_index(header.type, header.key, table_size);; i = (i + 1) & (table_size - 1))
+			{
+				if (!table[i].location)
+				{
+					table[i] = {header.key, pos | (u64{header.type} << 56)};
+					break;
+				}
+			}
+
+			pos += sizeof(header) + header.size;
+		}
+
+		archive_header archive{};
+		archive.magic = c_archive_magic;
+		archive.version = c_archive_version;
+		archive.table_size = table_size;
+		archive.indexed_end = pos;
+
+		if (pending.file.write_at(0, &archive, sizeof(archive)) != sizeof(archive) ||
+			pending.file.write_at(sizeof(archive), table.data(), table.size() * sizeof(table_entry)) != table.size() * sizeof(table_entry))
+		{
+			rsx_log.error("pipeline_archive: failed to write '%s' (%s)", pending.get_temp_path(), fs::g_tls_error);
+			return false;
+		}
+
+		// The file cannot be replaced while it is mapped on some platforms
+		close_impl();
+
+		const bool committed = pending.commit();
+
+		if (!committed)
+		{
+			rsx_log.error("pipeline_archive: failed to replace '%s' (%s)", m_path, fs::g_tls_error);
+		}
+		else
+		{
+			rsx_log.notice("pipeline_archive: compacted '%s', %u records, %u dropped", m_path, ::size32(records) - dropped, dropped);
+		}
+
+		return open_impl() && committed;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "util/types.hpp"
+#include "util/File.h"
+#include "util/mutex.h"
+#include "Common/unordered_map.hpp"
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace rsx
+{
+	// Single file storage of the pipeline cache.
+	// New records are appended to the end of the file. Compaction rewrites the file with a hash table of all
+	// records placed after the header, so the records can be looked up from the mapped file without parsing it.
+	// Records appended after the last compaction are indexed in memory when the archive is opened.
+	class pipeline_archive
+	{
+	public:
+		enum class record_type : u8
+		{
+			vertex_program,
+			fragment_program,
+			pipeline,
+
+			count
+		};
+
+	private:
+		struct archive_header
+		{
+			u64 magic;
+			u32 version;
+			u32 table_size;  // Number of hash table entries, zero or power of two
+			u64 indexed_end; // End of the records referenced by the hash table
+			u64 reserved[5];
+		};
+
+		struct table_entry
+		{
+			u64 key;
+			u64 location; // Record offset with the record type in the upper byte, zero if entry is empty
+		};
+
+		struct record_header
+		{
+			u32 magic;
+			u8 type;
+			u8 flags;
+			u16 reserved;
+			u32 size;     // Stored payload size
+			u32 raw_size; // Decompressed payload size
+			u32 crc;      // CRC32 of the stored payload
+			u32 reserved1;
+			u64 key;
+		};
+
+		std::string m_path;
+		fs::file m_file;
+
+		// Read-only view of the file, records appended after opening are not mapped
+		const u8* m_view = nullptr;
+		u64 m_view_size = 0;
+#ifdef _WIN32
+		void* m_mapping = nullptr;
+#endif
+
+		const table_entry* m_table = nullptr;
+		u32 m_table_size = 0;
+		u32 m_table_count = 0;
+
+		// Records which are not in the hash table
+		std::array<rsx::unordered_map<u64, u64>, static_cast<usz>(record_type::count)> m_tail;
+		u32 m_tail_count = 0;
+
+		// Duplicated or damaged records dropped by the next compaction
+		u32 m_garbage = 0;
+
+		// End of the last valid record
+		u64 m_end = 0;
+
+		// Records were appended after the last sync
+		bool m_unsynced = false;
+
+		mutable shared_mutex m_mutex;
+
+		bool open_impl();
+		void close_impl();
+		u64 find(record_type type, u64 key) const;
+		const u8* read_record(u64 offset, record_header& header, std::vector<u8>& scratch) const;
+
+	public:
+		pipeline_archive() = default;
+		pipeline_archive(const pipeline_archive&) = delete;
+		pipeline_archive& operator=(const pipeline_archive&) = delete;
+		~pipeline_archive();
+
+		bool open(const std::string& path);
+		void close();
+
+		explicit operator bool() const
+		{
+			return m_file.operator bool();
+		}
+
+		// Returns false if record with the same key is already stored.
+		// Appended records are synced to the disk by flush() or when the archive is closed.
+		bool append(record_type type, u64 key, const void* data, usz size);
+
+		void flush();
+
+		bool contains(record_type type, u64 key) const;
+
+		// Decompress the record, returns false if it is not found or damaged
+		bool read(record_type type, u64 key, std::vector<u8>& data) const;
+
+		std::vector<u64> get_keys(record_type type) const;
+
+		bool needs_compaction() const;
+
+		// Rewrite the archive, merging new records into the hash table and dropping damaged ones.
+		// Must not run concurrently with readers of mapped records.
+		bool compact();
+	};
+}
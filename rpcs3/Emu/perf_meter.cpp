@@ -6,9 +6,12 @@
 #include "rx/tsc.hpp"
 #include "util/Thread.h"
 #include "util/mutex.h"
+#include "util/StrUtil.h"
 
+#include <chrono>
 #include <map>
 #include <mutex>
+#include <set>
 
 void perf_stat_base::push(u64 ns[66]) noexcept
 {
@@ -100,6 +103,13 @@ static std::map<std::string, perf_stat_base> s_perf_acc;
 
 static std::multimap<std::string, u64*> s_perf_sources;
 
+// Meters enabled at runtime, empty set enables all
+static std::set<std::string, std::less<>> s_perf_filter;
+
+// Totals at the previous export, used to compute live rates
+static std::map<std::string, std::array<u64, 66>> s_perf_exported;
+static std::chrono::steady_clock::time_point s_perf_export_time{};
+
 void perf_stat_base::add(u64 ns[66], const char* name) noexcept
 {
 	// Don't attempt to register some foreign/unnamed threads
@@ -156,3 +166,157 @@ void perf_stat_base::report() noexcept
 
 	perf_log.notice("Performance report end.");
 }
+
+bool perf_stat_base::is_enabled(const char* name) noexcept
+{
+	std::lock_guard lock(s_perf_mutex);
+
+	return s_perf_filter.empty() || s_perf_filter.contains(std::string_view{name});
+}
+
+void perf_stat_base::set_filter(std::string_view meters) noexcept
+{
+	std::set<std::string, std::less<>> filter;
+
+	for (usz pos = 0; pos < meters.size();)
+	{
+		const usz end = std::min(meters.find(',', pos), meters.size());
+
+		if (const auto name = fmt::trim(std::string(meters.substr(pos, end - pos))); !name.empty())
+		{
+			filter.emplace(name);
+		}
+
+		pos = end + 1;
+	}
+
+	std::lock_guard lock(s_perf_mutex);
+
+	if (filter != s_perf_filter)
+	{
+		s_perf_filter = std::move(filter);
+		g_filter_generation++;
+	}
+}
+
+// Upper bound in microseconds of the log2 bucket which holds the given fraction of events
+// Bucket i holds events shorter than 2^i ns, zero length events are not bucketed
+static f64 perf_percentile(const std::array<u64, 66>& log, f64 fraction)
+{
+	u64 count = 0;
+
+	for (u32 i = 1; i < 65; i++)
+	{
+		count += log[i];
+	}
+
+	const u64 target = std::max<u64>(static_cast<u64>(std::ceil(count * fraction)), 1);
+
+	u64 sum = 0;
+
+	for (u32 i = 1; i < 65; i++)
+	{
+		sum += log[i];
+
+		if (sum >= target)
+		{
+			return std::pow(2., i) / 1000.;
+		}
+	}
+
+	return 0.;
+}
+
+void perf_stat_base::export_stats(const std::string& path) noexcept
+{
+	std::lock_guard lock(s_perf_mutex);
+
+	// Thread storage is only read, its owner increments it without atomics and a reset would lose events
+	std::map<std::string, std::array<u64, 66>> totals;
+
+	for (auto& [name, data] : s_perf_acc)
+	{
+		auto& total = totals[name];
+
+		for (u32 i = 0; i < 66; i++)
+		{
+			total[i] = data.m_log[i].load();
+		}
+	}
+
+	for (auto& [name, ns] : s_perf_sources)
+	{
+		auto& total = totals[name];
+
+		for (u32 i = 0; i < 66; i++)
+		{
+			total[i] += atomic_storage<u64>::load(ns[i]);
+		}
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	const f64 interval = s_perf_export_time == decltype(now){} ? 0. : std::chrono::duration<f64>(now - s_perf_export_time).count();
+	s_perf_export_time = now;
+
+	std::string out;
+	fmt::append(out, "%-12s %12s %12s %12s %12s %14s %12s\n", "meter", "events/s", "avg(us)", "p50(us)", "p99(us)", "events", "time(s)");
+
+	for (auto& [name, total] : totals)
+	{
+		// Histogram of events since the previous export, totals could be reset by report()
+		auto& last = s_perf_exported[name];
+
+		if (total[0] < last[0])
+		{
+			last = {};
+		}
+
+		std::array<u64, 66> delta{};
+
+		for (u32 i = 0; i < 66; i++)
+		{
+			delta[i] = total[i] - std::min(last[i], total[i]);
+		}
+
+		last = total;
+
+		// Live values are computed over the interval
+		const u64 count = delta[0];
+		const f64 rate = interval > 0. ? count / interval : 0.;
+		const f64 avg = count ? delta[65] / 1000. / count : 0.;
+		const f64 p50 = perf_percentile(delta, 0.5);
+		const f64 p99 = perf_percentile(delta, 0.99);
+
+		fmt::append(out, "%-12s %12.1f %12.3f %12.3f %12.3f %14u %12.4f\n", name, rate, avg, p50, p99, total[0], total[65] / 1000'000'000.);
+
+		if (!count)
+		{
+			continue;
+		}
+
+		out += "  histogram:";
+
+		for (u32 i = 1; i < 65; i++)
+		{
+			if (delta[i])
+			{
+				fmt::append(out, " <%.3fus:%u", std::pow(2., i) / 1000., delta[i]);
+			}
+		}
+
+		out += '\n';
+	}
+
+	// Replace the file atomically so readers never observe a partial snapshot
+	if (fs::pending_file file(path); !!file.file)
+	{
+		file.file.write(out);
+
+		if (file.commit())
+		{
+			return;
+		}
+	}
+
+	perf_log.error("Failed to export performance stats to '%s' (%s)", path, fs::g_tls_error);
+}
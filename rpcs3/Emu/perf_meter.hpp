@@ -6,6 +6,8 @@
 #include "system_config.h"
 #include <array>
 #include <cmath>
+#include <string>
+#include <string_view>
 
 LOG_CHANNEL(perf_log, "PERF");
 
@@ -39,6 +41,12 @@ protected:
 	// Unregister TLS storage and drain its data
 	static void remove(u64 ns[66], const char* name) noexcept;
 
+	// Incremented when the set of enabled meters changes
+	static inline atomic_t<u64> g_filter_generation{0};
+
+	// Check if the meter is enabled by the filter
+	static bool is_enabled(const char* name) noexcept;
+
 public:
 	perf_stat_base() noexcept = default;
 
@@ -50,6 +58,12 @@ public:
 
 	// Collect all data, report it, and clean
 	static void report() noexcept;
+
+	// Set comma-separated list of meters to record, empty list enables all
+	static void set_filter(std::string_view meters) noexcept;
+
+	// Read all data without draining it and write live stats of every meter to the file
+	static void export_stats(const std::string& path) noexcept;
 };
 
 // Object that prints event length stats at the end
@@ -61,6 +75,10 @@ class perf_stat final : public perf_stat_base
 		// Local non-atomic values for increments
 		u64 m_log[66]{};
 
+		// Cached filter state
+		u64 m_filter_generation = umax;
+		bool m_enabled = true;
+
 		perf_stat_local() noexcept
 		{
 			perf_stat_base::add(m_log, perf_name<ShortName>.data());
@@ -76,7 +94,20 @@ class perf_stat final : public perf_stat_base
 public:
 	static FORCE_INLINE SAFE_BUFFERS(void) push(u64 start_time) noexcept
 	{
-		perf_stat_base::push(g_tls_perf_stat.m_log, start_time, perf_name<ShortName>.data());
+		auto& local = g_tls_perf_stat;
+
+		if (const u64 gen = g_filter_generation.observe(); local.m_filter_generation != gen) [[unlikely]]
+		{
+			local.m_filter_generation = gen;
+			local.m_enabled = perf_stat_base::is_enabled(perf_name<ShortName>.data());
+		}
+
+		if (!local.m_enabled)
+		{
+			return;
+		}
+
+		perf_stat_base::push(local.m_log, start_time, perf_name<ShortName>.data());
 	}
 };
 
@@ -2,12 +2,12 @@
 #include "perf_monitor.hpp"
 
 #include "Emu/System.h"
+#include "Emu/system_config.h"
+#include "Emu/perf_meter.hpp"
 #include "Emu/Cell/timers.hpp"
 #include "util/cpu_stats.hpp"
 #include "util/Thread.h"
 
-LOG_CHANNEL(perf_log, "PERF");
-
 void perf_monitor::operator()()
 {
 	constexpr u64 update_interval_us = 1000000; // Update every second
@@ -33,6 +33,17 @@ void perf_monitor::operator()()
 			break;
 		}
 
+		// Apply meter selection changed at runtime and publish live stats
+		perf_stat_base::set_filter(g_cfg.core.perf_report_meters.to_string());
+
+		if (g_cfg.core.perf_report)
+		{
+			if (const std::string path = g_cfg.core.perf_export_path.to_string(); !path.empty())
+			{
+				perf_stat_base::export_stats(path);
+			}
+		}
+
 		double total_usage = 0.0;
 
 		stats.get_per_core_usage(per_core_usage, total_usage);
@@ -121,6 +121,8 @@ struct cfg_root : cfg::node
 
 		cfg::uint64 perf_report_threshold{this, "Performance Report Threshold", 500, true}; // In µs, 0.5ms = default, 0 = everything
 		cfg::_bool perf_report{this, "Enable Performance Report", false, true};             // Show certain perf-related logs
+		cfg::string perf_report_meters{this, "Performance Report Meters", "", true};         // Comma-separated meters to record, empty = all
+		cfg::string perf_export_path{this, "Performance Export Path", "", true};             // File rewritten every second with live meter stats
 		cfg::_bool external_debugger{this, "Assume External Debugger"};
 	} core{this};
 
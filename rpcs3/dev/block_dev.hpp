@@ -1,8 +1,12 @@
 #pragma once
 
 #include "util/File.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <utility>
+#include <vector>
 
 class block_dev
 {
@@ -31,6 +35,32 @@ public:
 	virtual std::size_t write(std::size_t blockIndex, const void* data,
 		std::size_t blockCount) = 0;
 
+	// Positional read of bytes, must be safe to call from multiple threads
+	virtual std::size_t read_at(std::uint64_t offset, void* data, std::size_t size)
+	{
+		const std::size_t bs = block_size();
+		std::vector<std::byte> block(bs);
+		auto out = static_cast<std::byte*>(data);
+		std::size_t done = 0;
+
+		while (done < size)
+		{
+			const std::uint64_t pos = offset + done;
+			const std::size_t block_offset = pos % bs;
+			const std::size_t count = std::min(bs - block_offset, size - done);
+
+			if (read(pos / bs, block.data(), 1) != 1)
+			{
+				break;
+			}
+
+			std::memcpy(out + done, block.data() + block_offset, count);
+			done += count;
+		}
+
+		return done;
+	}
+
 protected:
 	void set_block_info(std::size_t size, std::size_t count)
 	{
@@ -66,6 +96,11 @@ public:
 		return result / block_size();
 	}
 
+	std::size_t read_at(std::uint64_t offset, void* data, std::size_t size) override
+	{
+		return m_file.read_at(offset, data, size);
+	}
+
 	fs::file& file()
 	{
 		return m_file;
@@ -103,4 +138,9 @@ public:
 			blockCount * block_size());
 		return result / block_size();
 	}
+
+	std::size_t read_at(std::uint64_t offset, void* data, std::size_t size) override
+	{
+		return m_file->read_at(offset, data, size);
+	}
 };
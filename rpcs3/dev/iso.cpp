@@ -1,144 +1,166 @@
-
 #include "iso.hpp"
 #include "util/File.h"
 #include "util/types.hpp"
-#include <bit>
-#include <cctype>
-#include <codecvt>
 #include <cstddef>
-#include <cstdint>
-#include <cstdio>
-#include <ctime>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
-static std::string u16_ne_to_string(const char16_t* bytes, std::size_t count)
+namespace
 {
-	std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-	return convert.to_bytes(bytes, bytes + count);
-}
-
-static std::string u16_se_to_string(const char16_t* bytes, std::size_t count)
-{
-	auto seBytes = reinterpret_cast<const se_t<char16_t, true, alignof(char16_t)>*>(bytes);
-
-	std::vector<char16_t> neBytes(count);
-	for (std::size_t i = 0; i < count; ++i)
+	fs::stat_t to_fs_stat(const rx::DiscImage::Entry& entry)
 	{
-		neBytes[i] = seBytes[i];
+		fs::stat_t result{};
+		result.is_directory = entry.isDirectory;
+		result.size = entry.size;
+		result.ctime = entry.mtime;
+		result.mtime = entry.mtime;
+		result.atime = entry.mtime;
+		return result;
 	}
 
-	return u16_ne_to_string(neBytes.data(), neBytes.size());
-}
-
-static std::string u16_be_to_string(const char16_t* bytes, std::size_t count)
-{
-	if constexpr (std::endian::native == std::endian::big)
-	{
-		return u16_ne_to_string(bytes, count);
-	}
-	else
+	class iso_file final : public fs::file_base
 	{
-		return u16_se_to_string(bytes, count);
-	}
-}
+		std::shared_ptr<const rx::DiscImage> m_image;
+		const rx::DiscImage::Entry& m_entry;
+		u64 m_pos = 0;
 
-static std::string decodeString(std::string_view data,
-	iso::StringEncoding encoding)
-{
-	switch (encoding)
-	{
-	case iso::StringEncoding::ascii:
-		break;
+		// Read-ahead is skipped by concurrent readers instead of waiting for the buffer
+		std::mutex m_mutex;
+		rx::DiscImage::ReadAhead<std::vector<std::byte>> m_read_ahead;
 
-	case iso::StringEncoding::utf16_be:
-		return u16_be_to_string(reinterpret_cast<const char16_t*>(data.data()), data.size() / 2);
-	}
-
-	return std::string(data);
-}
-
-bool iso_dev::initialize()
-{
-	constexpr std::size_t primaryVolumeDescOffset = 16;
-	ensure(m_dev->block_size() >= sizeof(iso::VolumeHeader));
-	std::vector<std::byte> block(m_dev->block_size());
+	public:
+		iso_file(std::shared_ptr<const rx::DiscImage> image, const rx::DiscImage::Entry& entry)
+			: m_image(std::move(image)), m_entry(entry)
+		{
+		}
 
-	std::optional<iso::PrimaryVolumeDescriptor> primaryVolume;
-	std::optional<iso::PrimaryVolumeDescriptor> supplementaryVolume;
+		fs::stat_t get_stat() override
+		{
+			return to_fs_stat(m_entry);
+		}
 
-	for (std::size_t i = 0; i < 256; ++i)
-	{
-		if (m_dev->read(primaryVolumeDescOffset + i, block.data(), 1) != 1)
+		bool trunc(u64) override
 		{
-			break;
+			fs::g_tls_error = fs::error::acces;
+			return false;
 		}
 
-		auto header = reinterpret_cast<iso::VolumeHeader*>(block.data());
+		u64 read(void* buffer, u64 size) override
+		{
+			const u64 result = read_at(m_pos, buffer, size);
+			m_pos += result;
+			return result;
+		}
 
-		if (header->type == 255)
+		u64 read_at(u64 offset, void* buffer, u64 size) override
 		{
-			break;
+			std::unique_lock lock(m_mutex, std::try_to_lock);
+
+			if (!lock)
+			{
+				return m_image->read(m_entry, offset, buffer, size);
+			}
+
+			return m_image->read(m_entry, m_read_ahead, offset, buffer, size);
 		}
 
-		if (std::memcmp(header->standard_id, "CD001", 5) != 0)
+		u64 write(const void*, u64) override
 		{
-			continue;
+			return 0;
 		}
 
-		if (header->type == 1)
+		u64 seek(s64 offset, fs::seek_mode whence) override
 		{
-			primaryVolume =
-				*reinterpret_cast<iso::PrimaryVolumeDescriptor*>(block.data());
-			continue;
+			const s64 new_pos =
+				whence == fs::seek_set ? offset :
+				whence == fs::seek_cur ? offset + m_pos :
+				whence == fs::seek_end ? offset + size() :
+										 -1;
+
+			if (new_pos < 0)
+			{
+				fs::g_tls_error = fs::error::inval;
+				return -1;
+			}
+
+			m_pos = new_pos;
+			return m_pos;
 		}
 
-		if (header->type == 2)
+		u64 size() override
 		{
-			std::printf("found supplementary volume\n");
-			supplementaryVolume =
-				*reinterpret_cast<iso::PrimaryVolumeDescriptor*>(block.data());
-			continue;
+			return m_entry.size;
 		}
-	}
+	};
+} // namespace
 
-	if (!primaryVolume)
+bool iso_dev::probe(block_dev& device)
+{
+	return rx::DiscImage::probe([&](u64 offset, void* data, usz size)
+		{
+			return device.read_at(offset, data, size);
+		},
+		device.size());
+}
+
+std::optional<iso_dev> iso_dev::open(std::unique_ptr<block_dev> device)
+{
+	const u64 size = device->size();
+	std::shared_ptr<block_dev> dev = std::move(device);
+
+	auto image = rx::DiscImage::open([dev](u64 offset, void* data, usz size)
+		{
+			return dev->read_at(offset, data, size);
+		},
+		size);
+
+	if (!image)
 	{
-		return false;
+		return {};
 	}
 
-	auto& pvd = supplementaryVolume ? *supplementaryVolume : *primaryVolume;
-	m_encoding = supplementaryVolume ? iso::StringEncoding::utf16_be : iso::StringEncoding::ascii;
-	m_root_dir = pvd.root;
+	iso_dev result;
+	result.m_image = std::move(image);
+	return result;
+}
 
-	return true;
+const rx::DiscImage::Entry* iso_dev::find_entry(std::string_view path) const
+{
+	const u32 index = m_image->find(path);
+
+	if (index == rx::DiscImage::kNoEntry)
+	{
+		fs::g_tls_error = fs::error::noent;
+		return nullptr;
+	}
+
+	return &m_image->entry(index);
 }
 
 bool iso_dev::stat(const std::string& path, fs::stat_t& info)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	const auto entry = find_entry(path);
+	if (!entry)
 	{
-		fs::g_tls_error = fs::error::noent;
 		return false;
 	}
 
-	info = optEntry->to_fs_stat();
+	info = to_fs_stat(*entry);
 	return true;
 }
 
 bool iso_dev::statfs(const std::string& path, fs::device_stat& info)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	if (!find_entry(path))
 	{
-		fs::g_tls_error = fs::error::noent;
 		return false;
 	}
 
 	info = {
-		.block_size = m_dev->block_size(),
-		.total_size = m_dev->size(),
+		.block_size = rx::DiscImage::kSectorSize,
+		.total_size = m_image->imageSize(),
 		.total_free = 0,
 		.avail_free = 0,
 	};
@@ -154,240 +176,51 @@ std::unique_ptr<fs::file_base> iso_dev::open(const std::string& path, rx::EnumBi
 		return {};
 	}
 
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	const auto entry = find_entry(path);
+	if (!entry)
 	{
-		fs::g_tls_error = fs::error::noent;
 		return {};
 	}
 
-	if ((optEntry->flags & iso::DirEntryFlags::Directory) == iso::DirEntryFlags::Directory)
+	if (entry->isDirectory)
 	{
 		fs::g_tls_error = fs::error::isdir;
 		return {};
 	}
 
-	return read_file(*optEntry).release();
+	return std::make_unique<iso_file>(m_image, *entry);
 }
 
 std::unique_ptr<fs::dir_base> iso_dev::open_dir(const std::string& path)
 {
-	auto optEntry = open_entry(path);
-	if (!optEntry)
+	const auto entry = find_entry(path);
+	if (!entry)
 	{
-		fs::g_tls_error = fs::error::noent;
 		return {};
 	}
 
-	if ((optEntry->flags & iso::DirEntryFlags::Directory) != iso::DirEntryFlags::Directory)
+	if (!entry->isDirectory)
 	{
 		fs::g_tls_error = fs::error::exist;
 		return {};
 	}
 
-	auto items = read_dir(*optEntry);
-	std::vector<fs::dir_entry> result_items(items.first.size());
-
-	for (std::size_t i = 0; i < result_items.size(); ++i)
-	{
-		result_items[i] = items.first[i].to_fs_entry(items.second[i]);
-	}
-
-	return std::make_unique<fs::virtual_dir>(std::move(result_items));
-}
-
-std::optional<iso::DirEntry>
-iso_dev::open_entry(std::string_view path)
-{
-	if (path == "/" || path == "\\" || path.empty())
-	{
-		return m_root_dir;
-	}
-
-	auto item = m_root_dir;
-
-	auto isStringEqNoCase = [](std::string_view lhs, std::string_view rhs)
-	{
-		if (lhs.size() != rhs.size())
-		{
-			return false;
-		}
-
-		for (std::size_t i = 0; i < lhs.size(); ++i)
-		{
-			if (std::tolower(lhs[i]) != std::tolower(rhs[i]))
-			{
-				return false;
-			}
-		}
-
-		return true;
-	};
-
-	while (!path.empty())
-	{
-		auto sepPos = path.find_first_of("/\\");
-		if (sepPos == 0)
-		{
-			path.remove_prefix(1);
-			continue;
-		}
-
-		if ((item.flags & iso::DirEntryFlags::Directory) !=
-			iso::DirEntryFlags::Directory)
-		{
-			return {};
-		}
-
-		auto dirName = path.substr(0, sepPos);
-		if (sepPos == std::string_view::npos)
-		{
-			path = {};
-		}
-		else
-		{
-			path.remove_prefix(sepPos);
-		}
-
-		auto items = read_dir(item);
-
-		bool found = false;
-		for (std::size_t i = 0; i < items.first.size(); ++i)
-		{
-			if (!isStringEqNoCase(items.second[i], dirName))
-			{
-				continue;
-			}
-
-			item = items.first[i];
-			found = true;
-			break;
-		}
-
-		if (!found)
-		{
-			return {};
-		}
-	}
-
-	return item;
-}
-
-std::pair<std::vector<iso::DirEntry>, std::vector<std::string>>
-iso_dev::read_dir(const iso::DirEntry& entry)
-{
-	if ((entry.flags & iso::DirEntryFlags::Directory) !=
-		iso::DirEntryFlags::Directory)
-	{
-		return {};
-	}
-
-	auto block_size = m_dev->block_size();
-	auto total_block_count = (entry.length.value() + block_size - 1) / block_size;
-	auto total_buffer_block_count = std::min<std::size_t>(total_block_count, 10);
-
-	std::vector<std::byte> buffer(total_buffer_block_count * block_size);
-	auto first_block = entry.lba.value();
-
-	std::vector<iso::DirEntry> isoEntries;
-	std::vector<std::string> names;
+	std::vector<fs::dir_entry> items;
+	items.reserve(entry->childCount + 2);
 
-	for (std::size_t block = first_block, end = first_block + total_block_count;
-		block < end;)
+	for (std::string_view name : {".", ".."})
 	{
-		auto block_count =
-			m_dev->read(block, buffer.data(), total_buffer_block_count);
-		block += block_count;
-
-		std::size_t buffer_offset = 0;
-		std::size_t buffer_size = block_count * block_size;
-
-		while (buffer_offset < buffer_size)
-		{
-			auto item = reinterpret_cast<const iso::DirEntry*>(buffer.data() +
-															   buffer_offset);
-			if (item->entry_length == 0)
-			{
-				buffer_offset += block_size;
-				buffer_offset &= ~(block_size - 1);
-				continue;
-			}
-
-			auto filename_end =
-				sizeof(iso::DirEntry) +
-				((item->filename_length + 1) & ~static_cast<std::size_t>(1));
-
-			if (item->entry_length < filename_end)
-			{
-				buffer_offset += item->entry_length;
-				continue;
-			}
-
-			buffer_offset += item->entry_length;
-
-			if (item->filename_length == 0 ||
-				item->filename_length + sizeof(iso::DirEntry) > item->entry_length)
-			{
-				continue;
-			}
-
-			auto filename =
-				item->filename_length > 1 ? decodeString({reinterpret_cast<const char*>(item + 1),
-															 item->filename_length},
-												m_encoding) :
-											std::string{};
-
-			if (item->filename_length == 1)
-			{
-				char c = *reinterpret_cast<const char*>(item + 1);
-				// can be special name
-				if (c == 0)
-				{
-					filename = ".";
-				}
-				else if (c == 1)
-				{
-					filename = "..";
-				}
-			}
-
-			filename = filename.substr(0, filename.find(';'));
-			if (filename.empty())
-			{
-				continue;
-			}
-
-			isoEntries.push_back(*item);
-			names.emplace_back(filename);
-		}
-	}
-
-	return {std::move(isoEntries), std::move(names)};
-}
-
-fs::file iso_dev::read_file(const iso::DirEntry& entry)
-{
-	if ((entry.flags & iso::DirEntryFlags::Directory) ==
-		iso::DirEntryFlags::Directory)
-	{
-		return {};
+		fs::dir_entry& item = items.emplace_back();
+		static_cast<fs::stat_t&>(item) = to_fs_stat(*entry);
+		item.name = name;
 	}
 
-	if (entry.length.value() == 0)
+	for (const auto& child : m_image->children(*entry))
 	{
-		return fs::make_stream<std::vector<std::uint8_t>>();
-	}
-
-	auto block_size = m_dev->block_size();
-	auto block_count = (entry.length.value() + block_size - 1) / block_size;
-
-	std::vector<std::uint8_t> data;
-	data.resize(block_count * block_size);
-	if (!m_dev->read(entry.lba.value(), data.data(), block_count))
-	{
-		return {};
+		fs::dir_entry& item = items.emplace_back();
+		static_cast<fs::stat_t&>(item) = to_fs_stat(child);
+		item.name = child.name;
 	}
 
-	data.resize(entry.length.value());
-	return fs::make_stream(std::move(data), entry.to_fs_stat());
+	return std::make_unique<fs::virtual_dir>(std::move(items));
 }
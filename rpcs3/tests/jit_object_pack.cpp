@@ -0,0 +1,107 @@
+// Round trip of the objects stored in jit_object_pack
+
+#include "util/JIT.h"
+#include "util/File.h"
+#include "util/types.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+	int g_failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::fprintf(stderr, "jit_object_pack: %s\n", what);
+			g_failures++;
+		}
+	}
+
+	std::vector<u8> make_object(u8 seed, usz size)
+	{
+		std::vector<u8> result(size);
+
+		for (usz i = 0; i < size; i++)
+		{
+			result[i] = static_cast<u8>(seed + i * 7);
+		}
+
+		return result;
+	}
+
+	bool read_equals(jit_object_pack& pack, std::string_view name, const std::vector<u8>& expected)
+	{
+		std::vector<u8> data;
+		return pack.read(name, data) && data == expected;
+	}
+} // namespace
+
+int main()
+{
+	const std::string path = fs::get_temp_dir() + "rpcs3_test_jit_object_pack.pack";
+	fs::remove_file(path);
+
+	const auto first = make_object(1, 100);
+	const auto second = make_object(2, 4096 + 3);
+	const auto third = make_object(3, 17);
+
+	{
+		jit_object_pack pack;
+		check(pack.open(path, "fingerprint-a"), "failed to create the pack");
+		check(!pack.contains("first"), "new pack is not empty");
+		check(pack.append("first", first.data(), first.size()), "failed to append the first object");
+		check(pack.append("second", second.data(), second.size()), "failed to append the second object");
+		check(!pack.append("first", third.data(), third.size()), "duplicate object was appended");
+		check(read_equals(pack, "first", first), "first object differs before reopening");
+	}
+
+	{
+		jit_object_pack pack;
+		check(pack.open(path, "fingerprint-a"), "failed to reopen the pack");
+		check(read_equals(pack, "first", first), "first object differs after reopening");
+		check(read_equals(pack, "second", second), "second object differs after reopening");
+	}
+
+	// Damaged tail is dropped, appended records must stay reachable
+	{
+		fs::file file(path, fs::write + fs::append);
+		check(!!file, "failed to open the pack for damaging");
+		file.write("garbage", 7);
+	}
+
+	{
+		jit_object_pack pack;
+		check(pack.open(path, "fingerprint-a"), "failed to open the damaged pack");
+		check(read_equals(pack, "second", second), "record before the damaged tail is lost");
+		check(pack.append("third", third.data(), third.size()), "failed to append after the damaged tail");
+	}
+
+	{
+		jit_object_pack pack;
+		check(pack.open(path, "fingerprint-a"), "failed to reopen the repaired pack");
+		check(read_equals(pack, "first", first), "first object differs after repair");
+		check(read_equals(pack, "third", third), "object appended over the damaged tail is lost");
+	}
+
+	// Objects of another code generator are discarded
+	{
+		jit_object_pack pack;
+		check(pack.open(path, "fingerprint-b"), "failed to open the pack with another fingerprint");
+		check(!pack.contains("first"), "objects survived the fingerprint change");
+	}
+
+	fs::remove_file(path);
+
+	if (g_failures)
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::puts("jit_object_pack: ok");
+	return EXIT_SUCCESS;
+}
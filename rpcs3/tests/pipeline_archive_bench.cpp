@@ -0,0 +1,222 @@
+// Load time of a pipeline cache stored as one file per object, as a pipeline archive with
+// records appended in the last session and as a compacted pipeline archive
+
+#include "Emu/RSX/rsx_pipeline_archive.h"
+#include "util/File.h"
+#include "util/StrFmt.h"
+#include "util/types.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using record_type = rsx::pipeline_archive::record_type;
+
+	constexpr usz c_pipeline_size = 256;
+	constexpr usz c_vertex_program_size = 2048;
+	constexpr usz c_fragment_program_size = 1024;
+
+	// Programs are shared between pipelines like in real caches
+	constexpr u32 c_pipelines_per_program = 4;
+
+	std::vector<u8> make_data(u64 seed, usz size)
+	{
+		std::vector<u8> result(size);
+		u64 state = seed * 0x9e3779b97f4a7c15ull + 1;
+
+		for (auto& byte : result)
+		{
+			// Shader ucode has few distinct words, keep the data compressible
+			state = state * 6364136223846793005ull + 1442695040888963407ull;
+			byte = static_cast<u8>((state >> 60) * 17);
+		}
+
+		return result;
+	}
+
+	u64 vertex_program_key(u32 pipeline)
+	{
+		return 0x1000'0000ull + pipeline / c_pipelines_per_program;
+	}
+
+	u64 fragment_program_key(u32 pipeline)
+	{
+		return 0x2000'0000ull + pipeline / c_pipelines_per_program;
+	}
+
+	template <typename F>
+	double measure_ms(F&& func)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		func();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void write_files(const std::string& dir, u32 count)
+	{
+		fs::create_path(dir + "raw");
+
+		for (u32 i = 0; i < count; i++)
+		{
+			fs::write_file(fmt::format("%s%08X.bin", dir, i), fs::rewrite, make_data(i, c_pipeline_size));
+
+			if (i % c_pipelines_per_program == 0)
+			{
+				fs::write_file(fmt::format("%sraw/%llX.vp", dir, vertex_program_key(i)), fs::rewrite, make_data(vertex_program_key(i), c_vertex_program_size));
+				fs::write_file(fmt::format("%sraw/%llX.fp", dir, fragment_program_key(i)), fs::rewrite, make_data(fragment_program_key(i), c_fragment_program_size));
+			}
+		}
+	}
+
+	// Same lookups as the loader of the per-file cache: every pipeline reads its programs
+	usz load_files(const std::string& dir, u32 count)
+	{
+		usz total = 0;
+
+		for (u32 i = 0; i < count; i++)
+		{
+			const fs::file pipeline(fmt::format("%s%08X.bin", dir, i));
+			const fs::file vp(fmt::format("%sraw/%llX.vp", dir, vertex_program_key(i)));
+			const fs::file fp(fmt::format("%sraw/%llX.fp", dir, fragment_program_key(i)));
+
+			if (!pipeline || !vp || !fp)
+			{
+				return 0;
+			}
+
+			total += pipeline.to_vector<u8>().size() + vp.to_vector<u8>().size() + fp.to_vector<u8>().size();
+		}
+
+		return total;
+	}
+
+	bool write_archive(const std::string& path, u32 count)
+	{
+		rsx::pipeline_archive archive;
+
+		if (!archive.open(path))
+		{
+			return false;
+		}
+
+		for (u32 i = 0; i < count; i++)
+		{
+			const auto vp = make_data(vertex_program_key(i), c_vertex_program_size);
+			const auto fp = make_data(fragment_program_key(i), c_fragment_program_size);
+			const auto pipeline = make_data(i, c_pipeline_size);
+
+			archive.append(record_type::vertex_program, vertex_program_key(i), vp.data(), vp.size());
+			archive.append(record_type::fragment_program, fragment_program_key(i), fp.data(), fp.size());
+			archive.append(record_type::pipeline, i, pipeline.data(), pipeline.size());
+		}
+
+		archive.flush();
+		return true;
+	}
+
+	usz load_archive(const std::string& path)
+	{
+		rsx::pipeline_archive archive;
+
+		if (!archive.open(path))
+		{
+			return 0;
+		}
+
+		usz total = 0;
+		std::vector<u8> data;
+
+		for (u64 key : archive.get_keys(record_type::pipeline))
+		{
+			const u32 i = static_cast<u32>(key);
+
+			if (!archive.read(record_type::pipeline, key, data))
+			{
+				return 0;
+			}
+
+			total += data.size();
+
+			if (!archive.read(record_type::vertex_program, vertex_program_key(i), data))
+			{
+				return 0;
+			}
+
+			total += data.size();
+
+			if (!archive.read(record_type::fragment_program, fragment_program_key(i), data))
+			{
+				return 0;
+			}
+
+			total += data.size();
+		}
+
+		return total;
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	const u32 count = argc > 1 ? static_cast<u32>(std::strtoul(argv[1], nullptr, 10)) : 20000;
+	const std::string root = fs::get_temp_dir() + "rpcs3_bench_pipeline_archive/";
+	const std::string archive_path = root + "v1.pack";
+	const usz expected = usz{count} * (c_pipeline_size + c_vertex_program_size + c_fragment_program_size);
+
+	fs::remove_all(root, true, true);
+	fs::create_path(root);
+
+	write_files(root + "files/", count);
+
+	if (!write_archive(archive_path, count))
+	{
+		std::fprintf(stderr, "failed to create '%s'\n", archive_path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	std::printf("%u pipelines, %u pipelines per program, warm file cache\n", count, c_pipelines_per_program);
+
+	usz loaded = 0;
+	double time = measure_ms([&] { loaded = load_files(root + "files/", count); });
+	std::printf("%-24s %10.1f ms\n", "files", time);
+
+	if (loaded != expected)
+	{
+		std::fprintf(stderr, "files: loaded %zu bytes instead of %zu\n", loaded, expected);
+		return EXIT_FAILURE;
+	}
+
+	time = measure_ms([&] { loaded = load_archive(archive_path); });
+	std::printf("%-24s %10.1f ms\n", "archive (appended)", time);
+
+	if (loaded != expected)
+	{
+		std::fprintf(stderr, "appended archive: loaded %zu bytes instead of %zu\n", loaded, expected);
+		return EXIT_FAILURE;
+	}
+
+	{
+		rsx::pipeline_archive archive;
+
+		if (!archive.open(archive_path) || !archive.compact())
+		{
+			std::fprintf(stderr, "failed to compact '%s'\n", archive_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	time = measure_ms([&] { loaded = load_archive(archive_path); });
+	std::printf("%-24s %10.1f ms\n", "archive (compacted)", time);
+
+	if (loaded != expected)
+	{
+		std::fprintf(stderr, "compacted archive: loaded %zu bytes instead of %zu\n", loaded, expected);
+		return EXIT_FAILURE;
+	}
+
+	fs::remove_all(root);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+// Function compiled by the SPU JIT into jit_object_pack must be linked from the pack
+// in the next session and produce the same code
+
+#include "util/JIT.h"
+#include "util/File.h"
+#include "util/types.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push, 0)
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wall"
+#pragma GCC diagnostic ignored "-Wextra"
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wstrict-aliasing"
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#pragma GCC diagnostic ignored "-Weffc++"
+#pragma GCC diagnostic ignored "-Wmissing-noreturn"
+#endif
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#ifdef _MSC_VER
+#pragma warning(pop)
+#else
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+	int g_failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::fprintf(stderr, "spu_object_cache: %s\n", what);
+			g_failures++;
+		}
+	}
+
+	constexpr auto s_module_name = "spu-test-0123456789abcdef.obj";
+	constexpr auto s_function_name = "spu-test-0123456789abcdef";
+
+	using test_function_t = void (*)(u8* ls, u32 value);
+
+	// Same shape as a compiled SPU chunk: loads from and stores to the local storage
+	llvm::Function* build_module(jit_compiler& jit, u32 imm, std::unique_ptr<llvm::Module>& result)
+	{
+		auto& context = jit.get_context();
+		result = std::make_unique<llvm::Module>(s_module_name, context);
+		result->setTargetTriple(jit_compiler::triple2());
+		result->setDataLayout(jit.get_engine().getTargetMachine()->createDataLayout());
+
+		const auto i8_ptr = llvm::PointerType::get(context, 0);
+		const auto i32 = llvm::Type::getInt32Ty(context);
+		const auto type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), {i8_ptr, i32}, false);
+		const auto func = llvm::Function::Create(type, llvm::GlobalValue::ExternalLinkage, s_function_name, *result);
+
+		llvm::IRBuilder<> irb(llvm::BasicBlock::Create(context, "", func));
+		const auto ls = func->getArg(0);
+		const auto value = func->getArg(1);
+
+		const auto src = irb.CreateLoad(i32, irb.CreateGEP(irb.getInt8Ty(), ls, irb.getInt64(0x40)));
+		const auto mul = irb.CreateMul(src, value);
+		const auto rot = irb.CreateOr(irb.CreateShl(mul, 7), irb.CreateLShr(mul, 25));
+		irb.CreateStore(irb.CreateXor(rot, irb.getInt32(imm)), irb.CreateGEP(irb.getInt8Ty(), ls, irb.getInt64(0x80)));
+		irb.CreateRetVoid();
+		return func;
+	}
+
+	u32 run(test_function_t func, u32 src, u32 value)
+	{
+		alignas(16) u8 ls[0x100]{};
+		std::memcpy(ls + 0x40, &src, sizeof(src));
+		func(ls, value);
+
+		u32 result;
+		std::memcpy(&result, ls + 0x80, sizeof(result));
+		return result;
+	}
+
+	u32 reference(u32 src, u32 value, u32 imm)
+	{
+		const u32 mul = src * value;
+		return ((mul << 7) | (mul >> 25)) ^ imm;
+	}
+
+	// Size of the function in the object, 0 if it's not found
+	u64 function_size(const std::vector<u8>& object)
+	{
+		const llvm::MemoryBufferRef buffer({reinterpret_cast<const char*>(object.data()), object.size()}, s_module_name);
+		auto file = llvm::object::ObjectFile::createObjectFile(buffer);
+
+		if (!file)
+		{
+			llvm::consumeError(file.takeError());
+			return 0;
+		}
+
+		for (const auto& [symbol, size] : llvm::object::computeSymbolSizes(**file))
+		{
+			auto name = symbol.getName();
+
+			if (!name)
+			{
+				llvm::consumeError(name.takeError());
+				continue;
+			}
+
+			if (*name == s_function_name)
+			{
+				return size;
+			}
+		}
+
+		return 0;
+	}
+} // namespace
+
+int main()
+{
+	const std::string path = fs::get_temp_dir() + "rpcs3_test_spu_object_cache.pack";
+	fs::remove_file(path);
+
+	// Empty link table selects the SPU code generator
+	jit_compiler first_jit({}, jit_compiler::cpu(""));
+	jit_compiler second_jit({}, jit_compiler::cpu(""));
+	const std::string fingerprint = first_jit.fingerprint(jit_compiler::triple2());
+
+	jit_object_pack pack;
+	check(pack.open(path, fingerprint), "failed to create the pack");
+
+	// First session compiles and stores the function
+	std::unique_ptr<llvm::Module> first_module;
+	const auto first_func = build_module(first_jit, 0x1234, first_module);
+	check(!pack.contains(s_module_name), "function is cached before compilation");
+
+	first_jit.add(std::move(first_module), pack);
+	first_jit.fin();
+
+	const auto first_ptr = reinterpret_cast<test_function_t>(first_jit.get_engine().getPointerToFunction(first_func));
+	check(first_ptr != nullptr, "failed to compile the function");
+
+	std::vector<u8> stored;
+	check(pack.read(s_module_name, stored), "compiled object is not stored");
+
+	const u64 code_size = function_size(stored);
+	check(code_size != 0, "function is missing in the stored object");
+
+	// Next session links the stored object. The IR differs, so a recompilation would change the result
+	pack.close();
+	check(pack.open(path, fingerprint), "failed to reopen the pack");
+	check(pack.contains(s_module_name), "function is not cached after reopening");
+
+	std::unique_ptr<llvm::Module> second_module;
+	const auto second_func = build_module(second_jit, 0x5678, second_module);
+
+	second_jit.add(std::move(second_module), pack);
+	second_jit.fin();
+
+	const auto second_ptr = reinterpret_cast<test_function_t>(second_jit.get_engine().getPointerToFunction(second_func));
+	check(second_ptr != nullptr, "failed to link the cached function");
+
+	std::vector<u8> restored;
+	check(pack.read(s_module_name, restored) && restored == stored, "cached object changed after loading");
+
+	if (first_ptr && second_ptr && code_size)
+	{
+		check(first_ptr != second_ptr, "both sessions share the code");
+		check(std::memcmp(reinterpret_cast<const void*>(first_ptr), reinterpret_cast<const void*>(second_ptr), code_size) == 0, "linked code differs from the compiled code");
+
+		for (u32 src : {0u, 1u, 0x80000001u, 0xdeadbeefu})
+		{
+			const u32 expected = reference(src, 0x9e3779b9u, 0x1234);
+			check(run(first_ptr, src, 0x9e3779b9u) == expected, "compiled function returned a wrong result");
+			check(run(second_ptr, src, 0x9e3779b9u) == expected, "cached function was recompiled");
+		}
+	}
+
+	pack.close();
+	fs::remove_file(path);
+
+	if (g_failures)
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::printf("spu_object_cache: %llu bytes of code match\n", static_cast<unsigned long long>(code_size));
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+// timer_wheel must expire the same timeouts as a sorted list with random registrations,
+// cancellations and time jumps of all scales
+
+#include "util/timer_wheel.hpp"
+#include "util/types.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+	int g_failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			std::fprintf(stderr, "timer_wheel: %s\n", what);
+			g_failures++;
+		}
+	}
+
+	struct waiter
+	{
+		u32 id = 0;
+		timer_wheel_link<waiter> timeout;
+	};
+
+	using wheel_t = timer_wheel<waiter, &waiter::timeout>;
+
+	// Sorted reference: (until, id) of every registered timeout
+	using reference_t = std::multimap<u64, u32>;
+
+	void reference_erase(reference_t& reference, const waiter& w)
+	{
+		for (auto it = reference.begin(); it != reference.end(); it++)
+		{
+			if (it->second == w.id)
+			{
+				reference.erase(it);
+				return;
+			}
+		}
+	}
+
+	// Timeouts which were due at the previous check expire first in any order, the rest by time
+	void expire(wheel_t& wheel, reference_t& reference, u64 last_now, u64 now)
+	{
+		std::vector<u32> expired;
+		u64 last_until = 0;
+		bool sorted = true;
+
+		wheel.expire(now, [&](waiter* w)
+		{
+			check(!w->timeout.is_linked(), "expired waiter is still linked");
+			check(w->timeout.until <= now, "timeout expired early");
+			if (w->timeout.until > last_now)
+			{
+				sorted = sorted && w->timeout.until >= last_until;
+				last_until = w->timeout.until;
+			}
+			expired.push_back(w->id);
+		});
+
+		std::vector<u32> expected;
+
+		while (!reference.empty() && reference.begin()->first <= now)
+		{
+			expected.push_back(reference.begin()->second);
+			reference.erase(reference.begin());
+		}
+
+		check(sorted, "timeouts expired out of order");
+
+		std::sort(expired.begin(), expired.end());
+		std::sort(expected.begin(), expected.end());
+		check(expired == expected, "expired timeouts differ from the reference");
+		check(wheel.size() == reference.size(), "timeout count differs from the reference");
+	}
+
+	// Random time step, mostly small with occasional jumps over the levels and the whole wheel
+	u64 random_step(std::mt19937_64& rng)
+	{
+		switch (rng() % 8)
+		{
+		case 0: return 0;
+		case 1: return rng() % 64;
+		case 2: return rng() % 4096;
+		case 3: return rng() % (1u << 18);
+		case 4: return rng() % (1u << 24);
+		case 5: return rng() % (u64{1} << 28);
+		default: return rng() % 16;
+		}
+	}
+
+	void run_random(u64 seed, u64 start_time)
+	{
+		std::mt19937_64 rng(seed);
+		std::vector<waiter> waiters(256);
+
+		for (u32 i = 0; i < waiters.size(); i++)
+		{
+			waiters[i].id = i;
+		}
+
+		wheel_t wheel;
+		reference_t reference;
+		u64 now = start_time;
+
+		for (u32 step = 0; step < 100'000; step++)
+		{
+			auto& w = waiters[rng() % waiters.size()];
+
+			switch (rng() % 4)
+			{
+			case 0:
+			case 1:
+			{
+				// New or moved timeout, sometimes already due
+				const u64 until = rng() % 16 == 0 ? now - std::min<u64>(now, rng() % 100) : now + random_step(rng);
+				reference_erase(reference, w);
+				reference.emplace(until, w.id);
+				wheel.insert(w, until);
+				break;
+			}
+			case 2:
+			{
+				reference_erase(reference, w);
+				wheel.erase(w);
+				check(!w.timeout.is_linked(), "erased waiter is still linked");
+				break;
+			}
+			default:
+			{
+				const u64 last_now = now;
+				now += random_step(rng);
+				expire(wheel, reference, last_now, now);
+				break;
+			}
+			}
+		}
+
+		// Drain everything including the far list
+		expire(wheel, reference, now, umax);
+		check(wheel.empty(), "wheel is not empty after draining");
+	}
+} // namespace
+
+int main()
+{
+	// Timeouts of the same microsecond and registrations in the expiry callback
+	{
+		waiter a{1, {}}, b{2, {}}, c{3, {}};
+		wheel_t wheel;
+
+		wheel.insert(a, 100);
+		wheel.insert(b, 100);
+		wheel.insert(c, 5000);
+		wheel.insert(c, 50);
+		check(wheel.size() == 3, "moved timeout is counted twice");
+
+		std::vector<u32> order;
+		wheel.expire(100, [&](waiter* w)
+		{
+			order.push_back(w->id);
+
+			if (w == &a)
+			{
+				// Registered after its time, must expire on the next check
+				wheel.insert(*w, 100);
+			}
+		});
+
+		check(order == std::vector<u32>{3, 1, 2}, "unexpected expiry order");
+		check(wheel.size() == 1 && a.timeout.is_linked(), "timeout registered in the callback is lost");
+
+		order.clear();
+		wheel.expire(100, [&](waiter* w) { order.push_back(w->id); });
+		check(order == std::vector<u32>{1}, "overdue timeout did not expire");
+
+		wheel.insert(b, umax);
+		wheel.clear();
+		check(wheel.empty(), "wheel is not empty after clear");
+	}
+
+	run_random(1, 0);
+	run_random(2, 12345);
+
+	// Start near the wrap of the whole wheel
+	run_random(3, (u64{1} << 24) - 1000);
+	run_random(4, u64{1} << 40);
+
+	if (g_failures)
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::printf("timer_wheel: all timeouts match\n");
+	return EXIT_SUCCESS;
+}
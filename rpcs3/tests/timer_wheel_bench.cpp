@@ -0,0 +1,146 @@
+// Cost of a timed sleep and wake-up of lv2 threads with timer_wheel and with the sorted
+// deque used before it, for 16 to 4096 threads with registered timeouts
+
+#include "util/timer_wheel.hpp"
+#include "util/types.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	constexpr u32 c_operations = 1'000'000;
+
+	struct waiter
+	{
+		timer_wheel_link<waiter> timeout;
+	};
+
+	// Timeouts from 100 us to 100 ms, the clock advances by 1 us per operation
+	struct workload
+	{
+		std::vector<u32> targets;
+		std::vector<u64> timeouts;
+
+		explicit workload(usz threads)
+		{
+			std::mt19937_64 rng(threads);
+			targets.resize(c_operations);
+			timeouts.resize(c_operations);
+
+			for (u32 i = 0; i < c_operations; i++)
+			{
+				targets[i] = static_cast<u32>(rng() % threads);
+				timeouts[i] = 100 + rng() % 100'000;
+			}
+		}
+	};
+
+	// Every operation wakes a thread early and puts it to sleep again, expiry runs on each one
+	double run_wheel(const workload& work, usz threads, usz& expired)
+	{
+		std::vector<waiter> waiters(threads);
+		timer_wheel<waiter, &waiter::timeout> wheel;
+
+		for (auto& w : waiters)
+		{
+			wheel.insert(w, 100'000);
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (u32 i = 0; i < c_operations; i++)
+		{
+			auto& w = waiters[work.targets[i]];
+			wheel.erase(w);
+			wheel.insert(w, i + work.timeouts[i]);
+			wheel.expire(i, [&](waiter* target)
+			{
+				wheel.insert(*target, i + 100'000);
+				expired++;
+			});
+		}
+
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / c_operations;
+	}
+
+	double run_deque(const workload& work, usz threads, usz& expired)
+	{
+		std::vector<waiter> waiters(threads);
+		std::deque<std::pair<u64, waiter*>> queue;
+
+		const auto insert = [&](u64 until, waiter* target)
+		{
+			for (auto it = queue.cbegin(), end = queue.cend();; it++)
+			{
+				if (it == end || it->first > until)
+				{
+					queue.emplace(it, until, target);
+					break;
+				}
+			}
+		};
+
+		for (auto& w : waiters)
+		{
+			insert(100'000, &w);
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (u32 i = 0; i < c_operations; i++)
+		{
+			const auto target = &waiters[work.targets[i]];
+
+			for (auto it = queue.cbegin(), end = queue.cend(); it != end; it++)
+			{
+				if (it->second == target)
+				{
+					queue.erase(it);
+					break;
+				}
+			}
+
+			insert(i + work.timeouts[i], target);
+
+			while (!queue.empty() && queue.front().first <= i)
+			{
+				const auto due = queue.front().second;
+				queue.pop_front();
+				insert(i + 100'000, due);
+				expired++;
+			}
+		}
+
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / c_operations;
+	}
+} // namespace
+
+int main()
+{
+	std::printf("%u sleep/wake operations, ns per operation\n", c_operations);
+	std::printf("%8s %12s %12s\n", "threads", "wheel", "deque");
+
+	for (usz threads = 16; threads <= 4096; threads *= 4)
+	{
+		const workload work(threads);
+		usz wheel_expired = 0;
+		usz deque_expired = 0;
+		const double wheel = run_wheel(work, threads, wheel_expired);
+		const double deque = run_deque(work, threads, deque_expired);
+
+		if (wheel_expired != deque_expired)
+		{
+			std::fprintf(stderr, "expired timeouts differ: %zu and %zu\n", wheel_expired, deque_expired);
+			return EXIT_FAILURE;
+		}
+
+		std::printf("%8zu %12.1f %12.1f\n", threads, wheel, deque);
+	}
+
+	return EXIT_SUCCESS;
+}
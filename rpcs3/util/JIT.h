@@ -2,6 +2,8 @@
 
 #include "util/types.hpp"
 #include "util/atomic.hpp"
+#include "util/File.h"
+#include "util/mutex.h"
 
 // Include asmjit with warnings ignored
 #define ASMJIT_EMBED
@@ -43,6 +45,7 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 #include <util/v128.hpp>
 
 #if defined(ARCH_X64)
@@ -505,6 +508,75 @@ namespace llvm
 
 enum class thread_state : u32;
 
+// Packed storage of compiled objects, one file per JIT client.
+// Objects are appended to the end of the file and looked up by module name. The file is mapped and indexed
+// on first use, objects appended afterwards are only visible after reopening.
+// The file is discarded when its fingerprint (code generator and settings the objects depend on) doesn't match.
+class jit_object_pack
+{
+	struct pack_header
+	{
+		u64 magic;
+		u32 version;
+		u32 fingerprint; // Fingerprint size, the string follows the header
+	};
+
+	struct record_header
+	{
+		u32 magic;
+		u32 name_size; // Module name follows the header
+		u32 size;      // Object size, the object follows the name aligned to 16 bytes
+		u32 crc;       // CRC32 of the name and the object
+	};
+
+	std::string m_path;
+	std::string m_fingerprint;
+	fs::file m_file;
+
+	// Read-only view of the file, created on first use
+	const u8* m_view = nullptr;
+	u64 m_view_size = 0;
+#ifdef _WIN32
+	void* m_mapping = nullptr;
+#endif
+	bool m_indexed = false;
+
+	// Module name -> object offset in the view, zero for objects appended after indexing
+	std::unordered_map<std::string, u64> m_objects;
+
+	// End of the last valid record
+	u64 m_end = 0;
+
+	shared_mutex m_mutex;
+
+	bool index();
+	void close_impl();
+	const u8* find(std::string_view name, u32& size);
+
+public:
+	jit_object_pack() = default;
+	jit_object_pack(const jit_object_pack&) = delete;
+	jit_object_pack& operator=(const jit_object_pack&) = delete;
+	~jit_object_pack();
+
+	// Open or reset the file, does nothing if it's already open with the same path
+	bool open(const std::string& path, std::string_view fingerprint);
+	void close();
+
+	explicit operator bool() const
+	{
+		return m_file.operator bool();
+	}
+
+	// Copy the object, returns false if it is not found or damaged
+	bool read(std::string_view name, std::vector<u8>& data);
+
+	bool contains(std::string_view name);
+
+	// Returns false if the object is already stored
+	bool append(std::string_view name, const void* data, usz size);
+};
+
 // Temporary compiler interface
 class jit_compiler final
 {
@@ -542,6 +614,9 @@ public:
 	// Add module (not cached)
 	void add(std::unique_ptr<llvm::Module> _module);
 
+	// Add module (cached in the object pack)
+	void add(std::unique_ptr<llvm::Module> _module, jit_object_pack& pack);
+
 	// Add object (path to obj file)
 	bool add(const std::string& path);
 
@@ -566,6 +641,9 @@ public:
 	// Get system triple (SPU)
 	static std::string triple2();
 
+	// Get description of the code generator (CPU, triple and LLVM version) for the object cache
+	std::string fingerprint(const std::string& triple) const;
+
 	bool add_sub_disk_space(ssz space);
 };
 
@@ -33,6 +33,7 @@ LOG_CHANNEL(jit_log, "JIT");
 #pragma GCC diagnostic ignored "-Wmissing-noreturn"
 #endif
 #include <llvm/Support/CodeGen.h>
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/TargetParser/Host.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
@@ -51,6 +52,14 @@ LOG_CHANNEL(jit_log, "JIT");
 #include "Emu/CPU/Backends/AArch64/AArch64Common.h"
 #endif
 
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 const bool jit_initialize = []() -> bool
 {
 	llvm::InitializeAllTargetInfos();
@@ -511,6 +520,320 @@ public:
 	}
 };
 
+static constexpr u64 c_pack_magic = "LLVMOBJS"_u64;
+static constexpr u32 c_pack_version = 1;
+static constexpr u32 c_pack_record_magic = "OBJR"_u32;
+
+jit_object_pack::~jit_object_pack()
+{
+	close();
+}
+
+bool jit_object_pack::open(const std::string& path, std::string_view fingerprint)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (m_file && m_path == path && m_fingerprint == fingerprint)
+	{
+		return true;
+	}
+
+	close_impl();
+
+	if (!m_file.open(path, fs::read + fs::write + fs::create))
+	{
+		jit_log.error("jit_object_pack: failed to open '%s' (%s)", path, fs::g_tls_error);
+		return false;
+	}
+
+	m_path = path;
+	m_fingerprint = fingerprint;
+
+	const u64 size = m_file.size();
+	const u64 data_start = rx::alignUp(sizeof(pack_header) + m_fingerprint.size(), 16);
+	pack_header header{};
+	std::string stored;
+
+	if (size >= data_start && m_file.read_at(0, &header, sizeof(header)) == sizeof(header) &&
+		header.magic == c_pack_magic && header.version == c_pack_version && header.fingerprint == m_fingerprint.size())
+	{
+		stored.resize(header.fingerprint);
+		m_file.read_at(sizeof(header), stored.data(), stored.size());
+	}
+
+	if (stored.empty() || stored != m_fingerprint)
+	{
+		if (size)
+		{
+			jit_log.notice("jit_object_pack: '%s' was built by another code generator, discarding it", m_path);
+		}
+
+		header.magic = c_pack_magic;
+		header.version = c_pack_version;
+		header.fingerprint = ::size32(m_fingerprint);
+
+		std::vector<u8> data(data_start);
+		std::memcpy(data.data(), &header, sizeof(header));
+		std::memcpy(data.data() + sizeof(header), m_fingerprint.data(), m_fingerprint.size());
+
+		m_file.trunc(0);
+
+		if (m_file.write_at(0, data.data(), data.size()) != data.size())
+		{
+			jit_log.error("jit_object_pack: failed to write '%s' (%s)", m_path, fs::g_tls_error);
+			m_file.close();
+			return false;
+		}
+	}
+
+	m_end = data_start;
+	return true;
+}
+
+void jit_object_pack::close()
+{
+	std::lock_guard lock(m_mutex);
+	close_impl();
+}
+
+void jit_object_pack::close_impl()
+{
+	if (m_view)
+	{
+#ifdef _WIN32
+		::UnmapViewOfFile(m_view);
+#else
+		::munmap(const_cast<u8*>(m_view), m_view_size);
+#endif
+	}
+
+#ifdef _WIN32
+	if (m_mapping)
+	{
+		::CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+#endif
+
+	m_view = nullptr;
+	m_view_size = 0;
+	m_indexed = false;
+	m_objects.clear();
+	m_end = 0;
+	m_file.close();
+}
+
+bool jit_object_pack::index()
+{
+	if (m_indexed)
+	{
+		return true;
+	}
+
+	if (!m_file)
+	{
+		return false;
+	}
+
+	m_indexed = true;
+
+	const u64 size = m_file.size();
+
+	if (size <= m_end)
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+	m_mapping = ::CreateFileMappingW(m_file.get_handle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_view = m_mapping ? static_cast<const u8*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	if (void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, m_file.get_handle(), 0); ptr != MAP_FAILED)
+	{
+		m_view = static_cast<const u8*>(ptr);
+	}
+#endif
+
+	if (!m_view)
+	{
+		jit_log.error("jit_object_pack: failed to map '%s'", m_path);
+		close_impl();
+		return false;
+	}
+
+	m_view_size = size;
+
+	// Only the record headers are touched here, objects are checked when they are read
+	u64 pos = m_end;
+
+	while (pos + sizeof(record_header) <= size)
+	{
+		record_header record;
+		std::memcpy(&record, m_view + pos, sizeof(record));
+
+		const u64 obj_pos = rx::alignUp(pos + sizeof(record) + record.name_size, 16);
+		const u64 next = rx::alignUp(obj_pos + record.size, 16);
+
+		if (record.magic != c_pack_record_magic || !record.size || next > size)
+		{
+			break;
+		}
+
+		m_objects.try_emplace(std::string(reinterpret_cast<const char*>(m_view + pos + sizeof(record)), record.name_size), pos);
+		pos = next;
+	}
+
+	if (pos != size)
+	{
+		// The records after it can't be reached, new records will overwrite the damaged tail
+		jit_log.warning("jit_object_pack: damaged record at 0x%llx in '%s'", pos, m_path);
+	}
+
+	m_end = pos;
+	return true;
+}
+
+const u8* jit_object_pack::find(std::string_view name, u32& size)
+{
+	if (!index())
+	{
+		return nullptr;
+	}
+
+	const auto found = m_objects.find(std::string(name));
+
+	if (found == m_objects.end() || !found->second)
+	{
+		return nullptr;
+	}
+
+	record_header record;
+	std::memcpy(&record, m_view + found->second, sizeof(record));
+
+	const u8* name_ptr = m_view + found->second + sizeof(record);
+	const u8* obj_ptr = m_view + rx::alignUp(found->second + sizeof(record) + record.name_size, 16);
+
+	uLong crc = crc32(0, name_ptr, record.name_size);
+	crc = crc32(crc, obj_ptr, record.size);
+
+	if (crc != record.crc)
+	{
+		// Excluded from this session, the record is not dropped from the file
+		jit_log.error("jit_object_pack: damaged object '%s' in '%s'", name, m_path);
+		found->second = 0;
+		return nullptr;
+	}
+
+	size = record.size;
+	return obj_ptr;
+}
+
+bool jit_object_pack::read(std::string_view name, std::vector<u8>& data)
+{
+	std::lock_guard lock(m_mutex);
+
+	u32 size = 0;
+
+	if (const u8* obj = find(name, size))
+	{
+		data.assign(obj, obj + size);
+		return true;
+	}
+
+	return false;
+}
+
+bool jit_object_pack::contains(std::string_view name)
+{
+	std::lock_guard lock(m_mutex);
+
+	u32 size = 0;
+	return find(name, size) != nullptr;
+}
+
+bool jit_object_pack::append(std::string_view name, const void* data, usz size)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (!index() || !size)
+	{
+		return false;
+	}
+
+	if (!m_objects.try_emplace(std::string(name), 0).second)
+	{
+		return false;
+	}
+
+	record_header record{};
+	record.magic = c_pack_record_magic;
+	record.name_size = ::size32(name);
+	record.size = ::narrow<u32>(size);
+
+	uLong crc = crc32(0, reinterpret_cast<const u8*>(name.data()), record.name_size);
+	record.crc = static_cast<u32>(crc32(crc, static_cast<const u8*>(data), record.size));
+
+	const u64 obj_pos = rx::alignUp(m_end + sizeof(record) + name.size(), 16);
+	const u64 next = rx::alignUp(obj_pos + size, 16);
+
+	std::vector<u8> buf(next - m_end);
+	std::memcpy(buf.data(), &record, sizeof(record));
+	std::memcpy(buf.data() + sizeof(record), name.data(), name.size());
+	std::memcpy(buf.data() + (obj_pos - m_end), data, size);
+
+	if (m_file.write_at(m_end, buf.data(), buf.size()) != buf.size())
+	{
+		// Partially written record is overwritten by the next one
+		jit_log.error("jit_object_pack: failed to write '%s' (%s)", m_path, fs::g_tls_error);
+		return false;
+	}
+
+	m_end = next;
+	return true;
+}
+
+// Object cache storing objects in jit_object_pack
+class PackObjectCache final : public llvm::ObjectCache
+{
+	jit_object_pack& m_pack;
+
+public:
+	PackObjectCache(jit_object_pack& pack)
+		: m_pack(pack)
+	{
+	}
+
+	~PackObjectCache() override = default;
+
+	void notifyObjectCompiled(const llvm::Module* _module, llvm::MemoryBufferRef obj) override
+	{
+		const auto name = _module->getName();
+
+		if (m_pack.append({name.data(), name.size()}, obj.getBufferStart(), obj.getBufferSize()))
+		{
+			jit_log.trace("LLVM: Packed module: %s", std::string(name));
+		}
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* _module) override
+	{
+		const auto name = _module->getName();
+
+		std::vector<u8> data;
+
+		if (!m_pack.read({name.data(), name.size()}, data))
+		{
+			return nullptr;
+		}
+
+		auto buf = llvm::WritableMemoryBuffer::getNewUninitMemBuffer(data.size());
+		std::memcpy(buf->getBufferStart(), data.data(), data.size());
+
+		jit_log.trace("LLVM: Loaded packed module: %s", std::string(name));
+		return buf;
+	}
+};
+
 std::string jit_compiler::cpu(const std::string& _cpu)
 {
 	std::string m_cpu = _cpu;
@@ -621,6 +944,15 @@ std::string jit_compiler::triple2()
 #endif
 }
 
+std::string jit_compiler::fingerprint(const std::string& triple) const
+{
+#ifdef LLVM_VERSION_STRING
+	return fmt::format("%s;%s;LLVM %s", m_cpu, triple, LLVM_VERSION_STRING);
+#else
+	return fmt::format("%s;%s;LLVM %u.%u", m_cpu, triple, LLVM_VERSION_MAJOR, LLVM_VERSION_MINOR);
+#endif
+}
+
 bool jit_compiler::add_sub_disk_space(ssz space)
 {
 	if (space >= 0)
@@ -784,6 +1116,23 @@ void jit_compiler::add(std::unique_ptr<llvm::Module> _module)
 	}
 }
 
+void jit_compiler::add(std::unique_ptr<llvm::Module> _module, jit_object_pack& pack)
+{
+	PackObjectCache cache{pack};
+	m_engine->setObjectCache(&cache);
+
+	const auto ptr = _module.get();
+	m_engine->addModule(std::move(_module));
+	m_engine->generateCodeForModule(ptr);
+	m_engine->setObjectCache(nullptr);
+
+	for (auto& func : ptr->functions())
+	{
+		// Delete IR to lower memory consumption
+		func.deleteBody();
+	}
+}
+
 bool jit_compiler::add(const std::string& path)
 {
 	auto cache = ObjectCache::load(path);
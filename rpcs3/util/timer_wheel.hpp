@@ -0,0 +1,288 @@
+#pragma once
+
+#include "util/types.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <utility>
+
+// Intrusive link of an object registered in timer_wheel
+template <typename T>
+struct timer_wheel_link
+{
+	u64 until = 0;
+	T* prev = nullptr;
+	T* next = nullptr;
+	u32 slot = umax;
+
+	bool is_linked() const
+	{
+		return slot != umax;
+	}
+};
+
+// Hierarchical timer wheel of objects with a timer_wheel_link member (time in microseconds)
+// Every level has 64 slots, a slot of level N covers 64^N microseconds.
+// Timeouts beyond the range of the wheel wait in the far list and are
+// placed again when the time of the last level wraps. Registration and
+// cancellation are constant time and never allocate, expiry skips empty slots with bitmaps.
+template <typename T, timer_wheel_link<T> T::*Link>
+class timer_wheel
+{
+	static constexpr u32 c_slot_bits = 6;
+	static constexpr u32 c_slots = 1u << c_slot_bits;
+	static constexpr u32 c_levels = 4;
+	static constexpr u32 c_far_slot = c_levels * c_slots;
+
+	// Timeouts registered after their time was already passed
+	static constexpr u32 c_overdue_slot = c_far_slot + 1;
+
+	struct slot_list
+	{
+		T* head = nullptr;
+		T* tail = nullptr;
+	};
+
+	slot_list m_slots[c_overdue_slot + 1]{};
+	u64 m_occupied[c_levels]{};
+
+	// Timeouts before this point are already expired
+	u64 m_time = 0;
+	usz m_count = 0;
+
+	static timer_wheel_link<T>& link_of(T& obj)
+	{
+		return obj.*Link;
+	}
+
+	void link(T& obj, u32 slot)
+	{
+		auto& e = link_of(obj);
+		auto& list = m_slots[slot];
+		e.slot = slot;
+		e.next = nullptr;
+		e.prev = list.tail;
+		(list.tail ? link_of(*list.tail).next : list.head) = &obj;
+		list.tail = &obj;
+
+		if (slot < c_far_slot)
+		{
+			m_occupied[slot / c_slots] |= u64{1} << (slot % c_slots);
+		}
+	}
+
+	void unlink(T& obj)
+	{
+		auto& e = link_of(obj);
+		auto& list = m_slots[e.slot];
+		(e.prev ? link_of(*e.prev).next : list.head) = e.next;
+		(e.next ? link_of(*e.next).prev : list.tail) = e.prev;
+
+		if (!list.head && e.slot < c_far_slot)
+		{
+			m_occupied[e.slot / c_slots] &= ~(u64{1} << (e.slot % c_slots));
+		}
+
+		e.slot = umax;
+		e.prev = nullptr;
+		e.next = nullptr;
+	}
+
+	// Use the lowest level which has the timeout in the current parent slot
+	void place(T& obj)
+	{
+		const u64 until = link_of(obj).until;
+
+		if (until < m_time)
+		{
+			link(obj, c_overdue_slot);
+			return;
+		}
+
+		for (u32 level = 0; level < c_levels; level++)
+		{
+			const u32 parent_shift = (level + 1) * c_slot_bits;
+
+			if ((until >> parent_shift) == (m_time >> parent_shift))
+			{
+				const u32 index = (until >> (level * c_slot_bits)) % c_slots;
+				link(obj, level * c_slots + index);
+				return;
+			}
+		}
+
+		link(obj, c_far_slot);
+	}
+
+	void replace_slot(u32 slot)
+	{
+		const slot_list list = std::exchange(m_slots[slot], slot_list{});
+
+		if (slot < c_far_slot)
+		{
+			m_occupied[slot / c_slots] &= ~(u64{1} << (slot % c_slots));
+		}
+
+		for (T* obj = list.head; obj;)
+		{
+			const auto next = link_of(*obj).next;
+			place(*obj);
+			obj = next;
+		}
+	}
+
+	template <typename F>
+	void expire_slot(u32 slot, F& func)
+	{
+		const slot_list list = std::exchange(m_slots[slot], slot_list{});
+
+		if (slot < c_far_slot)
+		{
+			m_occupied[slot / c_slots] &= ~(u64{1} << (slot % c_slots));
+		}
+
+		for (T* obj = list.head; obj;)
+		{
+			auto& e = link_of(*obj);
+			const auto next = e.next;
+			e.slot = umax;
+			e.prev = nullptr;
+			e.next = nullptr;
+			m_count--;
+			func(obj);
+			obj = next;
+		}
+	}
+
+	// Start of the first slot which has to be cascaded or expired
+	u64 next_event() const
+	{
+		u64 result = umax;
+
+		for (u32 level = 0; level < c_levels; level++)
+		{
+			const u32 shift = level * c_slot_bits;
+			const u32 current = (m_time >> shift) % c_slots;
+
+			// The current slot is pending only if the time is at its start,
+			// otherwise it was already cascaded
+			const bool at_start = m_time % (u64{1} << shift) == 0;
+			const u32 first = at_start ? current : current + 1;
+			const u64 mask = first < c_slots ? m_occupied[level] & (~u64{0} << first) : 0;
+
+			if (mask)
+			{
+				const u32 parent_shift = shift + c_slot_bits;
+				const u64 base = m_time >> parent_shift << parent_shift;
+				const u64 start = base | (u64(std::countr_zero(mask)) << shift);
+				result = std::min(result, start);
+			}
+		}
+
+		if (m_slots[c_far_slot].head)
+		{
+			// Same for the far list at the start of the wheel
+			constexpr u32 wheel_shift = c_levels * c_slot_bits;
+			const bool at_start = m_time % (u64{1} << wheel_shift) == 0;
+			result = std::min(result, at_start ? m_time : ((m_time >> wheel_shift) + 1) << wheel_shift);
+		}
+
+		return result;
+	}
+
+public:
+	timer_wheel() = default;
+	timer_wheel(const timer_wheel&) = delete;
+	timer_wheel& operator=(const timer_wheel&) = delete;
+
+	bool empty() const
+	{
+		return m_count == 0;
+	}
+
+	usz size() const
+	{
+		return m_count;
+	}
+
+	// Register the timeout, moves the object if it's already registered
+	void insert(T& obj, u64 until)
+	{
+		if (link_of(obj).is_linked())
+		{
+			unlink(obj);
+		}
+		else
+		{
+			m_count++;
+		}
+
+		link_of(obj).until = until;
+		place(obj);
+	}
+
+	// Unregister the timeout if the object is registered
+	void erase(T& obj)
+	{
+		if (link_of(obj).is_linked())
+		{
+			unlink(obj);
+			m_count--;
+		}
+	}
+
+	// Forget all timeouts without accessing the objects (which may be already destroyed)
+	void clear()
+	{
+		std::fill(std::begin(m_slots), std::end(m_slots), slot_list{});
+		std::fill(std::begin(m_occupied), std::end(m_occupied), 0);
+		m_time = 0;
+		m_count = 0;
+	}
+
+	// Call func for every object whose timeout is not later than now
+	template <typename F>
+	void expire(u64 now, F&& func)
+	{
+		if (m_slots[c_overdue_slot].head)
+		{
+			expire_slot(c_overdue_slot, func);
+		}
+
+		while (m_count)
+		{
+			const u64 event = next_event();
+
+			if (event > now || event == umax)
+			{
+				// Nothing is due before the event, skip time without cascading but
+				// stay before the event slot so it is still found on the next call
+				m_time = std::max(m_time, std::min(now + 1, event - 1));
+				return;
+			}
+
+			m_time = event;
+
+			// Move due slots of upper levels down, the last level goes first
+			if (event % (u64{1} << (c_levels * c_slot_bits)) == 0)
+			{
+				replace_slot(c_far_slot);
+			}
+
+			for (u32 level = c_levels - 1; level > 0; level--)
+			{
+				const u32 shift = level * c_slot_bits;
+
+				if (event % (u64{1} << shift) == 0)
+				{
+					replace_slot(level * c_slots + (event >> shift) % c_slots);
+				}
+			}
+
+			// Timeouts registered by func for this time are overdue
+			m_time = event + 1;
+			expire_slot(event % c_slots, func);
+		}
+	}
+};
@@ -1,200 +1,344 @@
 #include "AudioOut.hpp"
+#include "audio/AlsaDevice.hpp"
 #include "rx/format.hpp"
 #include "rx/mem.hpp"
 #include "rx/watchdog.hpp"
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <fcntl.h>
 #include <mutex>
+#include <orbis/KernelAllocator.hpp>
 #include <orbis/evf.hpp>
 #include <orbis/utils/Logs.hpp>
-#include <sox.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
 #include <vector>
 
-AudioOut::AudioOut() {
-  if (sox_init() != SOX_SUCCESS) {
-    ORBIS_LOG_FATAL("Failed to initialize sox");
-    std::abort();
-  }
-}
-
-AudioOut::~AudioOut() {
-  exit = true;
-  for (auto &thread : threads) {
-    thread.join();
-  }
-  sox_quit();
-}
-
-void AudioOut::start() {
-  std::lock_guard lock(thrMtx);
-  threads.emplace_back(
-      [this, channelInfo = channelInfo] { channelEntry(channelInfo); });
-}
-
-void AudioOut::channelEntry(AudioOutChannelInfo info) {
-  char control_shm_name[128];
-  char audio_shm_name[128];
+// time to sleep while no port has queued samples, guest waiting on the mix
+// flag wakes the mixer earlier
+static constexpr auto kIdleWait = std::chrono::milliseconds(2);
 
-  std::format_to(
-      control_shm_name, "{}",
-      rx::getShmGuestPath(rx::format("shm_{}_C", info.idControl)).string());
-  std::format_to(
-      audio_shm_name, "{}",
-      rx::getShmGuestPath(rx::format("shm_{}_{}_A", info.channel, info.port))
-          .string());
-
-  int controlFd = ::open(control_shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-  if (controlFd == -1) {
+static void *mapShm(const char *name, int &fd, std::size_t &size) {
+  fd = ::open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
     perror("shm_open");
     std::abort();
   }
 
-  struct stat controlStat;
-  if (::fstat(controlFd, &controlStat)) {
+  struct stat stat;
+  if (::fstat(fd, &stat)) {
     perror("fstat");
     std::abort();
   }
 
-  auto controlPtr = reinterpret_cast<std::uint8_t *>(
-      rx::mem::map(nullptr, controlStat.st_size, PROT_READ | PROT_WRITE,
-                   MAP_SHARED, controlFd));
-  if (controlPtr == MAP_FAILED) {
+  size = stat.st_size;
+  auto result = rx::mem::map(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd);
+  if (result == MAP_FAILED) {
     perror("mmap");
     std::abort();
   }
 
-  int bufferFd = ::open(audio_shm_name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-  if (bufferFd == -1) {
-    perror("open");
-    std::abort();
-  }
-
-  struct stat bufferStat;
-  if (::fstat(bufferFd, &bufferStat)) {
-    perror("fstat");
-    std::abort();
-  }
-
-  auto audioBuffer = ::mmap(NULL, bufferStat.st_size, PROT_READ | PROT_WRITE,
-                            MAP_SHARED, bufferFd, 0);
-  auto bitPattern = 1u << info.port;
-
-  auto portOffset = 32 + 0x94 * info.port * 4;
-
-  auto *params = reinterpret_cast<AudioOutParams *>(controlPtr + portOffset);
+  return result;
+}
 
-  // samples length will be inited after some time, so we wait for it
-  while (params->sampleLength == 0) {
-  }
+static void configurePort(AudioOutPort &port) {
+  auto params = port.params;
 
   ORBIS_LOG_NOTICE("AudioOut: params", params->port, params->control,
                    params->formatChannels, params->formatIsFloat,
                    params->formatIsStd, params->freq, params->sampleLength);
 
-  unsigned inChannels = 2;
-  unsigned inSamples = params->sampleLength;
-  sox_rate_t sampleRate = 48000; // probably there is no point to parse
-                                 // frequency, because it's always 48000
+  // probably there is no point to parse frequency, because it's always 48000
+  port.isFloat = params->formatIsFloat != 0;
+  port.inChannels = 2;
+
   if (params->formatChannels == 2 && !params->formatIsFloat) {
-    inChannels = 1;
+    port.inChannels = 1;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_S16_MONO");
   } else if (params->formatChannels == 4 && !params->formatIsFloat) {
-    inChannels = 2;
+    port.inChannels = 2;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_S16_STEREO");
   } else if (params->formatChannels == 16 && !params->formatIsFloat &&
              !params->formatIsStd) {
-    inChannels = 8;
+    port.inChannels = 8;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_S16_8CH");
   } else if (params->formatChannels == 16 && !params->formatIsFloat &&
              params->formatIsStd) {
-    inChannels = 8;
+    port.inChannels = 8;
     ORBIS_LOG_NOTICE(
         "AudioOut: outputParam is ORBIS_AUDIO_OUT_PARAM_FORMAT_S16_8CH_STD");
   } else if (params->formatChannels == 4 && params->formatIsFloat) {
-    inChannels = 1;
+    port.inChannels = 1;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_FLOAT_MONO");
   } else if (params->formatChannels == 8 && params->formatIsFloat) {
-    inChannels = 2;
+    port.inChannels = 2;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_FLOAT_STEREO");
   } else if (params->formatChannels == 32 && params->formatIsFloat &&
              !params->formatIsStd) {
-    inChannels = 8;
+    port.inChannels = 8;
     ORBIS_LOG_NOTICE(
         "AudioOut: format is ORBIS_AUDIO_OUT_PARAM_FORMAT_FLOAT_8CH");
   } else if (params->formatChannels == 32 && params->formatIsFloat &&
              params->formatIsStd) {
-    inChannels = 8;
+    port.inChannels = 8;
     ORBIS_LOG_NOTICE("AudioOut: format is "
                      "ORBIS_AUDIO_OUT_PARAM_FORMAT_FLOAT_8CH_STD");
   } else {
     ORBIS_LOG_ERROR("AudioOut: unknown format type");
   }
 
-  sox_signalinfo_t out_si = {
-      .rate = sampleRate,
-      .channels = inChannels,
-      .precision = SOX_SAMPLE_PRECISION,
-  };
+  port.sampleLength = params->sampleLength;
+
+  // one buffer can be accepted while less than one buffer is queued
+  port.queue.samples.assign(port.sampleLength * 2 * 2, 0.f);
+  port.queue.head = 0;
+  port.queue.frames = 0;
+}
 
-  // need to be locked because libsox doesn't like simultaneous opening of the
-  // output
-  std::unique_lock lock(soxMtx);
-  sox_format_t *output =
-      sox_open_write("default", &out_si, NULL, "alsa", nullptr, nullptr);
-  soxMtx.unlock();
+static float toFloat(float sample) { return sample; }
+static float toFloat(std::int16_t sample) { return sample * (1.f / 32768.f); }
 
-  if (!output) {
-    std::abort();
+// loops have no branches so compiler can vectorize them
+template <typename T>
+static void convertFrames(float *out, const T *data, std::size_t frames,
+                          std::uint32_t channels) {
+  if (channels == 1) {
+    for (std::size_t i = 0; i < frames; ++i) {
+      auto sample = toFloat(data[i]);
+      out[i * 2] = sample;
+      out[i * 2 + 1] = sample;
+    }
+    return;
   }
 
-  std::vector<sox_sample_t> samples(inSamples * inChannels);
+  if (channels == 2) {
+    for (std::size_t i = 0; i < frames * 2; ++i) {
+      out[i] = toFloat(data[i]);
+    }
+    return;
+  }
 
-  std::size_t clips = 0;
-  SOX_SAMPLE_LOCALS;
+  // 7.1 downmix: front, center and both surround pairs, LFE is dropped
+  constexpr float kSideGain = 0.7071f;
+  for (std::size_t i = 0; i < frames; ++i) {
+    auto frame = data + i * channels;
+    auto center = toFloat(frame[2]) * kSideGain;
+    out[i * 2] = toFloat(frame[0]) + center +
+                 (toFloat(frame[4]) + toFloat(frame[6])) * kSideGain;
+    out[i * 2 + 1] = toFloat(frame[1]) + center +
+                     (toFloat(frame[5]) + toFloat(frame[7])) * kSideGain;
+  }
+}
 
-  while (!exit.load(std::memory_order::relaxed)) {
-    if (params->control == 0) {
-      std::this_thread::sleep_for(std::chrono::microseconds(10));
-      continue;
+// appends frames of the port buffer to the stereo queue, the caller keeps
+// the queue from overflowing
+template <typename T>
+static void convertToStereo(AudioOutQueue &queue, const T *data,
+                            std::size_t frames, std::uint32_t channels) {
+  auto capacity = queue.capacity();
+  auto tail = (queue.head + queue.frames) % capacity;
+  auto first = std::min(frames, capacity - tail);
+
+  convertFrames(queue.samples.data() + tail * 2, data, first, channels);
+  convertFrames(queue.samples.data(), data + first * channels, frames - first,
+                channels);
+  queue.frames += frames;
+}
+
+// adds up to mix.size() / 2 frames of the queue to the mix and removes them
+static std::size_t mixFrom(AudioOutQueue &queue, std::vector<float> &mix) {
+  auto count = std::min(queue.frames, mix.size() / 2);
+  auto first = std::min(count, queue.capacity() - queue.head);
+  auto src = queue.samples.data() + queue.head * 2;
+
+  for (std::size_t i = 0; i < first * 2; ++i) {
+    mix[i] += src[i];
+  }
+
+  src = queue.samples.data();
+  for (std::size_t i = first * 2; i < count * 2; ++i) {
+    mix[i] += src[i - first * 2];
+  }
+
+  queue.head = (queue.head + count) % queue.capacity();
+  queue.frames -= count;
+  return count;
+}
+
+static void updateMax(std::atomic<std::uint64_t> &max, std::uint64_t value) {
+  auto current = max.load(std::memory_order::relaxed);
+  while (current < value && !max.compare_exchange_weak(
+                                current, value, std::memory_order::relaxed)) {
+  }
+}
+
+AudioOut::AudioOut() = default;
+
+AudioOut::~AudioOut() {
+  exit = true;
+  if (mixerThread.joinable()) {
+    mixerThread.join();
+  }
+
+  for (auto &port : ports) {
+    ORBIS_LOG_NOTICE("AudioOut: port stats", port->info.port,
+                     port->stats.buffers.load(),
+                     port->stats.underruns.load(),
+                     port->stats.latencyUs.load() /
+                         std::max<std::uint64_t>(port->stats.buffers, 1),
+                     port->stats.maxLatencyUs.load());
+
+    if (port->info.evf != nullptr) {
+      port->info.evf->setWaitWatcher(nullptr);
     }
 
-    if (!params->formatIsFloat) {
-      auto data = reinterpret_cast<const std::int16_t *>(audioBuffer);
-      for (std::size_t i = 0; i < samples.size(); i++) {
-        samples[i] = SOX_SIGNED_16BIT_TO_SAMPLE(data[i], clips);
+    ::munmap(port->buffer, port->bufferSize);
+    ::munmap(port->control, port->controlSize);
+    ::close(port->controlFd);
+    ::close(port->bufferFd);
+  }
+}
+
+void AudioOut::start() {
+  auto port = std::make_unique<AudioOutPort>();
+  port->info = channelInfo;
+
+  auto controlName =
+      rx::getShmGuestPath(rx::format("shm_{}_C", port->info.idControl))
+          .string();
+  auto bufferName =
+      rx::getShmGuestPath(
+          rx::format("shm_{}_{}_A", port->info.channel, port->info.port))
+          .string();
+
+  port->control = static_cast<std::uint8_t *>(
+      mapShm(controlName.c_str(), port->controlFd, port->controlSize));
+  port->buffer = mapShm(bufferName.c_str(), port->bufferFd, port->bufferSize);
+
+  auto portOffset = 32 + 0x94 * port->info.port * 4;
+  port->params = reinterpret_cast<AudioOutParams *>(port->control + portOffset);
+
+  if (port->info.evf != nullptr) {
+    port->info.evf->setWaitWatcher(&submitSeq);
+  }
+
+  std::lock_guard lock(thrMtx);
+  ports.push_back(std::move(port));
+
+  if (!mixerThread.joinable()) {
+    mixerThread = std::thread([this] { mixerEntry(); });
+  }
+}
+
+bool AudioOut::acceptBuffer(AudioOutPort &port) {
+  if (port.sampleLength == 0) {
+    // samples length will be inited after some time
+    if (std::atomic_ref(port.params->sampleLength).load() == 0) {
+      return false;
+    }
+
+    configurePort(port);
+  }
+
+  auto control = std::atomic_ref(port.params->control);
+  if (control.load(std::memory_order::acquire) == 0) {
+    return false;
+  }
+
+  // keep at most one guest buffer queued, guest is blocked on the mix flag
+  // until the mixer consumes it
+  auto queuedFrames = port.queue.frames;
+  if (queuedFrames >= port.sampleLength) {
+    return false;
+  }
+
+  if (port.isFloat) {
+    convertToStereo(port.queue, static_cast<const float *>(port.buffer),
+                    port.sampleLength, port.inChannels);
+  } else {
+    convertToStereo(port.queue, static_cast<const std::int16_t *>(port.buffer),
+                    port.sampleLength, port.inChannels);
+  }
+
+  // set zero to freeing audiooutput
+  control.store(0, std::memory_order::release);
+
+  // skip sceAudioOutMix%x event
+  if (port.info.evf != nullptr) {
+    port.info.evf->set(1u << port.info.port);
+  }
+
+  auto latencyUs = queuedFrames * 1'000'000 / kSampleRate;
+  port.stats.buffers.fetch_add(1, std::memory_order::relaxed);
+  port.stats.latencyUs.fetch_add(latencyUs, std::memory_order::relaxed);
+  updateMax(port.stats.maxLatencyUs, latencyUs);
+  port.playing = true;
+  return true;
+}
+
+void AudioOut::mixerEntry() {
+  pthread_setname_np(pthread_self(), "AudioOut");
+
+  rx::Ref<AudioDevice> device = orbis::knew<AlsaDevice>();
+  device->setFormat(AudioFormat::S16_LE);
+  device->setFrequency(kSampleRate);
+  device->setChannels(2);
+  device->setSampleSize(kPeriodFrames * 2 * sizeof(std::int16_t), 4);
+  device->start();
+
+  std::vector<float> mix(kPeriodFrames * 2);
+  std::vector<std::int16_t> output(kPeriodFrames * 2);
+
+  while (!exit.load(std::memory_order::relaxed)) {
+    // sample sequence before the controls to not miss a submission
+    auto lastSubmitSeq = submitSeq.load(std::memory_order::acquire);
+    bool hasSamples = false;
+
+    {
+      std::lock_guard lock(thrMtx);
+
+      for (auto &port : ports) {
+        acceptBuffer(*port);
+        hasSamples |= !port->queue.empty();
       }
-    } else {
-      auto data = reinterpret_cast<const float *>(audioBuffer);
-      for (std::size_t i = 0; i < samples.size(); i++) {
-        samples[i] = SOX_FLOAT_32BIT_TO_SAMPLE(data[i], clips);
+
+      if (hasSamples) {
+        std::fill(mix.begin(), mix.end(), 0.f);
+
+        for (auto &port : ports) {
+          auto count = port->queue.empty() ? 0 : mixFrom(port->queue, mix);
+
+          if (count < kPeriodFrames && port->playing) {
+            port->stats.underruns.fetch_add(1, std::memory_order::relaxed);
+            port->playing = false;
+          }
+        }
       }
     }
 
-    if (sox_write(output, samples.data(), samples.size()) != samples.size()) {
-      ORBIS_LOG_ERROR("AudioOut: sox_write failed");
+    if (!hasSamples) {
+      (void)submitSeq.wait(lastSubmitSeq, kIdleWait);
+      continue;
     }
 
-    // set zero to freeing audiooutput
-    params->control = 0;
+    for (std::size_t i = 0; i < mix.size(); ++i) {
+      output[i] = static_cast<std::int16_t>(
+          std::clamp(mix[i], -1.f, 1.f) * 32767.f);
+    }
 
-    // skip sceAudioOutMix%x event
-    info.evf->set(bitPattern);
+    // blocks until device has space for the period
+    device->write(output.data(), output.size() * sizeof(std::int16_t));
   }
 
-  sox_close(output);
-
-  ::munmap(audioBuffer, bufferStat.st_size);
-  ::munmap(controlPtr, controlStat.st_size);
-
-  ::close(controlFd);
-  ::close(bufferFd);
+  device->stop();
 }
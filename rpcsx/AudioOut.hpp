@@ -1,10 +1,13 @@
 #pragma once
 
+#include "audio/AudioDevice.hpp"
 #include <atomic>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <orbis/evf.hpp>
 #include <rx/Rc.hpp>
+#include <rx/SharedAtomic.hpp>
 #include <thread>
 #include <vector>
 
@@ -38,18 +41,77 @@ struct AudioOutParams {
   std::uint32_t sampleLength{};
 };
 
+struct AudioOutPortStats {
+  std::atomic<std::uint64_t> buffers{0};
+
+  // periods mixed while the port had not enough queued samples
+  std::atomic<std::uint64_t> underruns{0};
+
+  // duration of samples queued ahead of the submitted buffer
+  std::atomic<std::uint64_t> latencyUs{0};
+  std::atomic<std::uint64_t> maxLatencyUs{0};
+};
+
+// ring of stereo float frames, sized on port configuration to hold the
+// largest amount the mixer lets a port queue
+struct AudioOutQueue {
+  std::vector<float> samples;
+  std::size_t head = 0; // first queued frame
+  std::size_t frames = 0;
+
+  std::size_t capacity() const { return samples.size() / 2; }
+  bool empty() const { return frames == 0; }
+};
+
+struct AudioOutPort {
+  AudioOutChannelInfo info;
+  int controlFd = -1;
+  int bufferFd = -1;
+  std::size_t controlSize = 0;
+  std::size_t bufferSize = 0;
+  std::uint8_t *control = nullptr;
+  void *buffer = nullptr;
+  AudioOutParams *params = nullptr;
+
+  // zero until the guest initializes the port parameters
+  std::uint32_t sampleLength = 0;
+  std::uint32_t inChannels = 2;
+  bool isFloat = false;
+
+  // samples converted to the stereo float format of the mixer
+  AudioOutQueue queue;
+  bool playing = false;
+
+  AudioOutPortStats stats;
+};
+
+///
+/// \brief Mixes all opened audio output ports into a single device stream.
+///
+/// One mixer thread serves every port. While no port has queued samples it
+/// sleeps on a sequence which the mix event flags of all ports bump when the
+/// guest waits on them. While playing it is paced by the blocking device
+/// writes.
+///
 struct AudioOut : rx::RcBase {
+  static constexpr std::uint32_t kSampleRate = 48000;
+  static constexpr std::uint32_t kPeriodFrames = 256;
+
   std::mutex thrMtx;
-  std::mutex soxMtx;
-  std::vector<std::thread> threads;
+  std::thread mixerThread;
+  std::vector<std::unique_ptr<AudioOutPort>> ports;
   AudioOutChannelInfo channelInfo;
   std::atomic<bool> exit{false};
 
+  // wait watcher of the mix event flags of all ports
+  rx::shared_atomic32 submitSeq{0};
+
   AudioOut();
   ~AudioOut();
 
   void start();
 
 private:
-  void channelEntry(AudioOutChannelInfo info);
+  void mixerEntry();
+  bool acceptBuffer(AudioOutPort &port);
 };
@@ -0,0 +1,170 @@
+#include "SyscallTrampoline.hpp"
+#include <cpuid.h>
+#include <csignal>
+#include <rx/align.hpp>
+#include <sys/syscall.h>
+
+std::uint32_t rx::thread::SyscallTrampoline::getXsaveSize() {
+  unsigned eax, ebx, ecx, edx;
+  __get_cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx);
+  return ebx; // xsave area size of enabled features
+}
+
+std::uint64_t rx::thread::SyscallTrampoline::getCsGsFs() {
+  std::uint16_t cs, gs, fs;
+  asm("mov %%cs, %0; mov %%gs, %1; mov %%fs, %2"
+      : "=r"(cs), "=r"(gs), "=r"(fs));
+  return cs | (static_cast<std::uint64_t>(gs) << 16) |
+         (static_cast<std::uint64_t>(fs) << 32);
+}
+
+rx::thread::SyscallTrampoline::SyscallTrampoline(std::int32_t stackTlsOffset,
+                                                 Handler handler) {
+  auto xsaveSize = getXsaveSize();
+  auto csGsFs = getCsGsFs();
+
+  auto greg = [](int reg) {
+    return static_cast<std::uint32_t>(offsetof(ucontext_t, uc_mcontext) +
+                                      offsetof(mcontext_t, gregs) +
+                                      reg * sizeof(greg_t));
+  };
+
+  auto fpregsOffset = static_cast<std::uint32_t>(
+      offsetof(ucontext_t, uc_mcontext) + offsetof(mcontext_t, fpregs));
+  auto sigmaskOffset =
+      static_cast<std::uint32_t>(offsetof(ucontext_t, uc_sigmask));
+  auto altStackOffset =
+      static_cast<std::uint32_t>(offsetof(ucontext_t, uc_stack));
+  auto xsaveOffset =
+      rx::alignUp(static_cast<std::uint32_t>(sizeof(ucontext_t)), 64u);
+  auto scratchOffset = xsaveOffset + rx::alignUp(xsaveSize, 64u);
+  auto frameSize = scratchOffset + 64;
+
+  Xbyak::Label mxcsrLabel;
+  Xbyak::Label blockedSetLabel;
+
+  // guest state is intact except rcx and r11, [rsp] is the return address.
+  // Switch to the host stack and save guest registers in ucontext_t layout
+  rdgsbase(r11);
+  mov(rcx, qword[r11 + stackTlsOffset]);
+  sub(rcx, frameSize);
+  and_(rcx, -64);
+
+  mov(qword[rcx + greg(REG_RAX)], rax);
+  mov(qword[rcx + greg(REG_RBX)], rbx);
+  mov(qword[rcx + greg(REG_RDX)], rdx);
+  mov(qword[rcx + greg(REG_RSI)], rsi);
+  mov(qword[rcx + greg(REG_RDI)], rdi);
+  mov(qword[rcx + greg(REG_RBP)], rbp);
+  mov(qword[rcx + greg(REG_R8)], r8);
+  mov(qword[rcx + greg(REG_R9)], r9);
+  mov(qword[rcx + greg(REG_R10)], r10);
+  mov(qword[rcx + greg(REG_R12)], r12);
+  mov(qword[rcx + greg(REG_R13)], r13);
+  mov(qword[rcx + greg(REG_R14)], r14);
+  mov(qword[rcx + greg(REG_R15)], r15);
+
+  // syscall instruction stores return address to rcx and flags to r11
+  mov(rax, qword[rsp]);
+  mov(qword[rcx + greg(REG_RIP)], rax);
+  mov(qword[rcx + greg(REG_RCX)], rax);
+  lea(rax, ptr[rsp + 8]);
+  mov(qword[rcx + greg(REG_RSP)], rax);
+  pushf();
+  pop(rax);
+  mov(qword[rcx + greg(REG_EFL)], rax);
+  mov(qword[rcx + greg(REG_R11)], rax);
+  mov(rax, csGsFs);
+  mov(qword[rcx + greg(REG_CSGSFS)], rax);
+  xor_(eax, eax);
+  mov(qword[rcx + greg(REG_ERR)], rax);
+  mov(qword[rcx + greg(REG_TRAPNO)], rax);
+
+  lea(rbx, ptr[rcx + xsaveOffset]);
+  mov(qword[rcx + fpregsOffset], rbx);
+  for (std::uint32_t offset = 512; offset < 576; offset += 8) {
+    mov(qword[rbx + offset], rax); // xsave header
+  }
+  mov(eax, -1);
+  mov(edx, -1);
+  xsave64(ptr[rbx]);
+
+  wrfsbase(r11);
+  mov(rsp, rcx);
+  cld();
+  ldmxcsr(ptr[rip + mxcsrLabel]);
+  fninit();
+
+  // block SIGUSR1 and SIGSYS as sa_mask of the SIGSYS handler does, block()
+  // and unblock() rely on it. Previous mask and alternate signal stack are
+  // saved to the frame and restored on exit, as sigreturn does. Signals
+  // before this point are deferred
+  mov(eax, SYS_rt_sigprocmask);
+  mov(edi, SIG_BLOCK);
+  lea(rsi, ptr[rip + blockedSetLabel]);
+  lea(rdx, ptr[rsp + sigmaskOffset]);
+  mov(r10d, sizeof(std::uint64_t));
+  syscall();
+  mov(eax, SYS_sigaltstack);
+  xor_(edi, edi);
+  lea(rsi, ptr[rsp + altStackOffset]);
+  syscall();
+
+  mov(rdi, rsp);
+  mov(rax, reinterpret_cast<std::uintptr_t>(handler));
+  call(rax);
+
+  mov(eax, SYS_sigaltstack);
+  lea(rdi, ptr[rsp + altStackOffset]);
+  xor_(esi, esi);
+  syscall();
+  mov(eax, SYS_rt_sigprocmask);
+  mov(edi, SIG_SETMASK);
+  lea(rsi, ptr[rsp + sigmaskOffset]);
+  xor_(edx, edx);
+  mov(r10d, sizeof(std::uint64_t));
+  syscall();
+
+  // context can be modified by syscall or signal delivery, restore all
+  // registers from the frame. rip and rflags are pushed below red zone of
+  // the target stack
+  mov(rbx, qword[rsp + fpregsOffset]);
+  mov(eax, -1);
+  mov(edx, -1);
+  xrstor64(ptr[rbx]);
+
+  mov(rax, qword[rsp + greg(REG_RSP)]);
+  sub(rax, kRedZoneSize + 16);
+  mov(qword[rsp + scratchOffset], rax);
+  mov(rcx, qword[rsp + greg(REG_RIP)]);
+  mov(qword[rax + 8], rcx);
+  mov(rcx, qword[rsp + greg(REG_EFL)]);
+  mov(qword[rax], rcx);
+
+  mov(rax, qword[rsp + greg(REG_RAX)]);
+  mov(rbx, qword[rsp + greg(REG_RBX)]);
+  mov(rcx, qword[rsp + greg(REG_RCX)]);
+  mov(rdx, qword[rsp + greg(REG_RDX)]);
+  mov(rsi, qword[rsp + greg(REG_RSI)]);
+  mov(rdi, qword[rsp + greg(REG_RDI)]);
+  mov(rbp, qword[rsp + greg(REG_RBP)]);
+  mov(r8, qword[rsp + greg(REG_R8)]);
+  mov(r9, qword[rsp + greg(REG_R9)]);
+  mov(r10, qword[rsp + greg(REG_R10)]);
+  mov(r11, qword[rsp + greg(REG_R11)]);
+  mov(r12, qword[rsp + greg(REG_R12)]);
+  mov(r13, qword[rsp + greg(REG_R13)]);
+  mov(r14, qword[rsp + greg(REG_R14)]);
+  mov(r15, qword[rsp + greg(REG_R15)]);
+  mov(rsp, qword[rsp + scratchOffset]);
+  popf();
+  ret(kRedZoneSize);
+
+  align(4);
+  L(mxcsrLabel);
+  dd(0x1f80);
+
+  align(8);
+  L(blockedSetLabel);
+  dq((1ull << (SIGUSR1 - 1)) | (1ull << (SIGSYS - 1)));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ucontext.h>
+#include <xbyak/xbyak.h>
+
+namespace rx::thread {
+///
+/// \brief Host entry of patched guest syscall sites.
+///
+/// Saves guest registers and xsave state in ucontext_t layout on the host
+/// stack, blocks SIGUSR1 and SIGSYS and invokes the handler with the frame.
+/// Registers, signal mask and alternate signal stack are restored from the
+/// frame on return, the handler can modify the saved context.
+///
+/// Host stack top is read from a thread local variable at stackTlsOffset from
+/// gs base, gs base must hold host fs base.
+///
+struct SyscallTrampoline : Xbyak::CodeGenerator {
+  using Handler = void (*)(ucontext_t *context);
+
+  static constexpr std::size_t kRedZoneSize = 128;
+
+  SyscallTrampoline(std::int32_t stackTlsOffset, Handler handler);
+
+private:
+  static std::uint32_t getXsaveSize();
+  static std::uint64_t getCsGsFs();
+};
+} // namespace rx::thread
@@ -253,6 +253,8 @@ long AlsaDevice::write(void *buf, long len) {
     }
 
     if (r == 0 || r == -EAGAIN) {
+      // stream is in nonblocking mode, sleep until device has space
+      snd_pcm_wait(mPCMHandle, 100);
       continue;
     }
 
@@ -1,12 +1,36 @@
 #pragma once
 
+#include <string>
+
 namespace rx {
+enum class AsyncShaderMode {
+  // translate shaders on the command processing thread
+  Off,
+  // translate on worker pool, wait up to asyncShaderWaitMs before drawing
+  // without the shader
+  Wait,
+  // translate on worker pool, skip draws until translation finished
+  Skip,
+};
+
 // FIXME: serialization
 struct Config {
   int gpuIndex = 0;
   bool validateGpu = false;
   bool disableGpuCache = false;
   bool debugGpu = false;
+  std::string shaderCachePath;
+  AsyncShaderMode asyncShaderMode = AsyncShaderMode::Off;
+  int asyncShaderWaitMs = 2;
+  int shaderWorkerCount = 0;
+
+  // count of threads processing gpu pipes including presenter thread, pipes
+  // sharing a vulkan queue always use the same thread. 0 - thread per queue,
+  // 1 - process all pipes on presenter thread
+  int gpuPipeWorkerCount = 0;
+
+  // rewrite guest syscall stubs to call host trampoline instead of SIGSYS
+  bool fastSyscalls = true;
 };
 
 extern Config g_config;
@@ -13,6 +13,7 @@
 #include "shader/glsl.hpp"
 #include "shader/spv.hpp"
 #include "vk.hpp"
+#include <chrono>
 #include <cstddef>
 #include <cstring>
 #include <memory>
@@ -147,20 +148,34 @@ static ConverterFn *getPrimConverterFn(gnm::PrimitiveType primType,
             static_cast<unsigned>(primType));
   }
 }
-shader::eval::Value Cache::ShaderResources::eval(shader::ir::Value op) {
-  if (op == ir::sop2::ADD_U32 || op == ir::sop2::ADDC_U32) {
-    return eval(op.getOperand(1)) + eval(op.getOperand(2));
-  }
-
-  return Evaluator::eval(op);
-}
-
 void Cache::ShaderResources::loadResources(
     gcn::Resources &res, std::span<const std::uint32_t> userSgprs) {
   this->userSgprs = userSgprs;
+
+  auto &program = res.fetch;
+  if (program.valid) {
+    program.run(fetchRegisters, userSgprs,
+                [this](void *dst, std::uint64_t address, std::size_t size) {
+                  cacheTag->readMemory(
+                      dst, rx::AddressRange::fromBeginSize(address, size));
+                });
+  }
+
+  // words are taken from the fetch program if shader has one, IR is
+  // evaluated only for the expressions the program does not support
+  std::size_t outputIndex = 0;
+  auto fetch = [&](ir::Value word) -> std::optional<std::uint64_t> {
+    auto index = outputIndex++;
+    if (!program.valid) {
+      return eval(word).zExtScalar();
+    }
+
+    return fetchRegisters[program.outputs[index]].zExtScalar();
+  };
+
   for (auto &pointer : res.pointers) {
-    auto pointerBase = eval(pointer.base).zExtScalar();
-    auto pointerOffset = eval(pointer.offset).zExtScalar();
+    auto pointerBase = fetch(pointer.base);
+    auto pointerOffset = fetch(pointer.offset);
 
     if (!pointerBase || !pointerOffset) {
       res.dump();
@@ -175,10 +190,10 @@ void Cache::ShaderResources::loadResources(
   }
 
   for (auto &bufferRes : res.buffers) {
-    auto word0 = eval(bufferRes.words[0]).zExtScalar();
-    auto word1 = eval(bufferRes.words[1]).zExtScalar();
-    auto word2 = eval(bufferRes.words[2]).zExtScalar();
-    auto word3 = eval(bufferRes.words[3]).zExtScalar();
+    auto word0 = fetch(bufferRes.words[0]);
+    auto word1 = fetch(bufferRes.words[1]);
+    auto word2 = fetch(bufferRes.words[2]);
+    auto word3 = fetch(bufferRes.words[3]);
 
     if (!word0 || !word1 || !word2 || !word3) {
       res.dump();
@@ -208,10 +223,10 @@ void Cache::ShaderResources::loadResources(
   }
 
   for (auto &imageBuffer : res.imageBuffers) {
-    auto word0 = eval(imageBuffer.words[0]).zExtScalar();
-    auto word1 = eval(imageBuffer.words[1]).zExtScalar();
-    auto word2 = eval(imageBuffer.words[2]).zExtScalar();
-    auto word3 = eval(imageBuffer.words[3]).zExtScalar();
+    auto word0 = fetch(imageBuffer.words[0]);
+    auto word1 = fetch(imageBuffer.words[1]);
+    auto word2 = fetch(imageBuffer.words[2]);
+    auto word3 = fetch(imageBuffer.words[3]);
 
     if (!word0 || !word1 || !word2 || !word3) {
       res.dump();
@@ -229,10 +244,10 @@ void Cache::ShaderResources::loadResources(
                 sizeof(std::uint32_t));
 
     if (imageBuffer.words[4] != nullptr) {
-      auto word4 = eval(imageBuffer.words[4]).zExtScalar();
-      auto word5 = eval(imageBuffer.words[5]).zExtScalar();
-      auto word6 = eval(imageBuffer.words[6]).zExtScalar();
-      auto word7 = eval(imageBuffer.words[7]).zExtScalar();
+      auto word4 = fetch(imageBuffer.words[4]);
+      auto word5 = fetch(imageBuffer.words[5]);
+      auto word6 = fetch(imageBuffer.words[6]);
+      auto word7 = fetch(imageBuffer.words[7]);
 
       if (!word4 || !word5 || !word6 || !word7) {
         res.dump();
@@ -247,6 +262,9 @@ void Cache::ShaderResources::loadResources(
                   sizeof(std::uint32_t));
       std::memcpy(reinterpret_cast<std::uint32_t *>(&tbuffer) + 7, &*word7,
                   sizeof(std::uint32_t));
+    } else {
+      // 128 bit T#, skip outputs of the upper words
+      outputIndex += 4;
     }
 
     auto info = computeSurfaceInfo(
@@ -270,10 +288,10 @@ void Cache::ShaderResources::loadResources(
   }
 
   for (auto &texture : res.textures) {
-    auto word0 = eval(texture.words[0]).zExtScalar();
-    auto word1 = eval(texture.words[1]).zExtScalar();
-    auto word2 = eval(texture.words[2]).zExtScalar();
-    auto word3 = eval(texture.words[3]).zExtScalar();
+    auto word0 = fetch(texture.words[0]);
+    auto word1 = fetch(texture.words[1]);
+    auto word2 = fetch(texture.words[2]);
+    auto word3 = fetch(texture.words[3]);
 
     if (!word0 || !word1 || !word2 || !word3) {
       res.dump();
@@ -291,10 +309,10 @@ void Cache::ShaderResources::loadResources(
                 sizeof(std::uint32_t));
 
     if (texture.words[4] != nullptr) {
-      auto word4 = eval(texture.words[4]).zExtScalar();
-      auto word5 = eval(texture.words[5]).zExtScalar();
-      auto word6 = eval(texture.words[6]).zExtScalar();
-      auto word7 = eval(texture.words[7]).zExtScalar();
+      auto word4 = fetch(texture.words[4]);
+      auto word5 = fetch(texture.words[5]);
+      auto word6 = fetch(texture.words[6]);
+      auto word7 = fetch(texture.words[7]);
 
       if (!word4 || !word5 || !word6 || !word7) {
         res.dump();
@@ -309,6 +327,9 @@ void Cache::ShaderResources::loadResources(
                   sizeof(std::uint32_t));
       std::memcpy(reinterpret_cast<std::uint32_t *>(&tbuffer) + 7, &*word7,
                   sizeof(std::uint32_t));
+    } else {
+      // 128 bit T#, skip outputs of the upper words
+      outputIndex += 4;
     }
 
     std::vector<amdgpu::Cache::ImageView> *resources = nullptr;
@@ -340,10 +361,10 @@ void Cache::ShaderResources::loadResources(
   }
 
   for (auto &sampler : res.samplers) {
-    auto word0 = eval(sampler.words[0]).zExtScalar();
-    auto word1 = eval(sampler.words[1]).zExtScalar();
-    auto word2 = eval(sampler.words[2]).zExtScalar();
-    auto word3 = eval(sampler.words[3]).zExtScalar();
+    auto word0 = fetch(sampler.words[0]);
+    auto word1 = fetch(sampler.words[1]);
+    auto word2 = fetch(sampler.words[2]);
+    auto word3 = fetch(sampler.words[3]);
 
     if (!word0 || !word1 || !word2 || !word3) {
       res.dump();
@@ -422,86 +443,9 @@ std::uint32_t Cache::ShaderResources::getResourceSlot(std::uint32_t id) {
   return -1;
 }
 
-eval::Value
-Cache::ShaderResources::eval(ir::InstructionId instId,
-                             std::span<const ir::Operand> operands) {
-  if (instId == ir::amdgpu::POINTER) {
-    auto type = operands[0].getAsValue();
-    auto loadSize = *operands[1].getAsInt32();
-    auto base = eval(operands[2]).zExtScalar();
-    auto offset = eval(operands[3]).zExtScalar();
-
-    if (!base || !offset) {
-      rx::die("failed to evaluate pointer dependency");
-    }
-
-    eval::Value result;
-    auto address = *base + *offset;
-
-    switch (loadSize) {
-    case 1:
-      result = readPointer<std::uint8_t>(address);
-      break;
-    case 2:
-      result = readPointer<std::uint16_t>(address);
-      break;
-    case 4:
-      result = readPointer<std::uint32_t>(address);
-      break;
-    case 8:
-      result = readPointer<std::uint64_t>(address);
-      break;
-    case 12:
-      result = readPointer<u32vec3>(address);
-      break;
-    case 16:
-      result = readPointer<u32vec4>(address);
-      break;
-    case 32:
-      result = readPointer<std::array<std::uint32_t, 8>>(address);
-      break;
-    case 64:
-      result = readPointer<std::array<std::uint32_t, 16>>(address);
-      break;
-    default:
-      rx::die("unexpected pointer load size {}", loadSize);
-    }
-
-    return result;
-  }
-
-  if (instId == ir::amdgpu::VBUFFER) {
-    rx::die("resource depends on buffer value");
-  }
-
-  if (instId == ir::amdgpu::TBUFFER) {
-    rx::die("resource depends on texture value");
-  }
-
-  if (instId == ir::amdgpu::IMAGE_BUFFER) {
-    rx::die("resource depends on image buffer value");
-  }
-
-  if (instId == ir::amdgpu::SAMPLER) {
-    rx::die("resource depends on sampler value");
-  }
-
-  if (instId == ir::amdgpu::USER_SGPR) {
-    auto index = static_cast<std::uint32_t>(*operands[1].getAsInt32());
-    rx::dieIf(index >= userSgprs.size(), "out of user sgprs");
-    return userSgprs[index];
-  }
-
-  if (instId == ir::amdgpu::IMM) {
-    auto address = static_cast<std::uint64_t>(*operands[1].getAsInt64());
-
-    std::uint32_t result;
-    cacheTag->readMemory(
-        &result, rx::AddressRange::fromBeginSize(address, sizeof(result)));
-    return result;
-  }
-
-  return Evaluator::eval(instId, operands);
+void Cache::ShaderResources::readMemory(void *dst, std::uint64_t address,
+                                         std::size_t size) {
+  cacheTag->readMemory(dst, rx::AddressRange::fromBeginSize(address, size));
 }
 
 static VkShaderStageFlagBits shaderStageToVk(gcn::Stage stage) {
@@ -1321,48 +1265,81 @@ Cache::Shader Cache::Tag::getShader(const ShaderKey &key,
   }
 
   auto vmId = mParent->mVmId;
+  auto device = mParent->mDevice;
 
-  std::optional<gcn::ConvertedShader> converted;
+  auto env = key.env;
+  env.supportsBarycentric = vk::context->supportsBarycentric;
+  env.supportsInt8 = vk::context->supportsInt8;
+  env.supportsInt64Atomics = vk::context->supportsInt64Atomics;
+  env.supportsNonSemanticInfo = vk::context->supportsNonSemanticInfo;
 
-  {
-    auto env = key.env;
-    env.supportsBarycentric = vk::context->supportsBarycentric;
-    env.supportsInt8 = vk::context->supportsInt8;
-    env.supportsInt64Atomics = vk::context->supportsInt64Atomics;
-    env.supportsNonSemanticInfo = vk::context->supportsNonSemanticInfo;
-
-    gcn::Context context;
-    auto deserialized = gcn::deserialize(
-        context, env, mParent->mDevice->gcnSemantic, key.address,
-        [vmId](std::uint64_t address) -> std::uint32_t {
-          return *RemoteMemory{vmId}.getPointer<std::uint32_t>(address);
-        });
-
-    // deserialized.print(std::cerr, context.ns);
-
-    converted = gcn::convertToSpv(
-        context, deserialized, mParent->mDevice->gcnSemantic,
-        mParent->mDevice->gcnSemanticModuleInfo, key.stage, env);
-    if (!converted) {
+  std::optional<TranslatedShader> translated;
+
+  if (rx::g_config.asyncShaderMode != rx::AsyncShaderMode::Off) {
+    auto &translator = device->shaderTranslator;
+    auto job = translator.enqueue(vmId, key.address, key.stage, env);
+
+    // compute results can be read back by the guest, never skip dispatches
+    auto deadline = ShaderTranslator::clock::now();
+    if (key.stage == gcn::Stage::Cs) {
+      deadline = ShaderTranslator::clock::time_point::max();
+    } else if (rx::g_config.asyncShaderMode == rx::AsyncShaderMode::Wait) {
+      deadline += std::chrono::milliseconds(rx::g_config.asyncShaderWaitMs);
+    }
+
+    if (!translator.wait(*job, deadline)) {
+      return {.stage = stage, .pending = true};
+    }
+
+    translator.release(job);
+
+    if (!job->result) {
       return {};
     }
 
-    converted->info.resources.dump();
-    if (!shader::spv::validate(converted->spv)) {
-      shader::spv::dump(converted->spv, true);
+    // worker reads guest memory without flushing gpu caches, result is usable
+    // only if memory is still the same
+    bool isStale = false;
+    for (auto &usedMemory : job->result->usedMemory) {
+      auto usedRange = rx::AddressRange::fromBeginSize(
+          usedMemory.first, usedMemory.second.size());
+      if (compareMemory(usedMemory.second.data(), usedRange) != 0) {
+        isStale = true;
+        break;
+      }
+    }
+
+    if (isStale) {
+      translator.getStats().staleResults.fetch_add(1,
+                                                   std::memory_order::relaxed);
+    } else {
+      translated = std::move(job->result);
+    }
+  }
+
+  if (!translated) {
+    translated =
+        translateShader(device, device->gcnSemantic,
+                        device->gcnSemanticModuleInfo, vmId, key.address,
+                        key.stage, env);
+
+    if (!translated) {
       return {};
     }
 
-    rx::print(stderr, "{}", shader::glsl::decompile(converted->spv));
-    // if (auto opt = shader::spv::optimize(converted->spv)) {
-    //   converted->spv = std::move(*opt);
-    //   std::fprintf(stderr, "opt: %s",
-    //              shader::glsl::decompile(converted->spv).c_str());
-    // } else {
-    //   std::printf("optimization failed\n");
-    // }
+    readMemory(&translated->magic,
+               rx::AddressRange::fromBeginSize(key.address,
+                                               sizeof(translated->magic)));
+
+    for (auto &usedMemory : translated->usedMemory) {
+      readMemory(usedMemory.second.data(),
+                 rx::AddressRange::fromBeginSize(usedMemory.first,
+                                                 usedMemory.second.size()));
+    }
   }
 
+  auto converted = &translated->converted;
+
   VkShaderCreateInfoEXT createInfo{
       .sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
       .flags = 0,
@@ -1389,17 +1366,8 @@ Cache::Shader Cache::Tag::getShader(const ShaderKey &key,
   result->tagId = getReadId();
   result->handle = handle;
   result->info = std::move(converted->info);
-  readMemory(&result->magic, rx::AddressRange::fromBeginSize(
-                                 key.address, sizeof(result->magic)));
-
-  for (auto entry : result->info.memoryMap) {
-    auto entryRange =
-        rx::AddressRange::fromBeginEnd(entry.beginAddress, entry.endAddress);
-    auto &inserted = result->usedMemory.emplace_back();
-    inserted.first = entryRange.beginAddress();
-    inserted.second.resize(entryRange.size());
-    readMemory(inserted.second.data(), entryRange);
-  }
+  result->magic = translated->magic;
+  result->usedMemory = std::move(translated->usedMemory);
 
   auto &info = result->info;
 
@@ -174,6 +174,10 @@ struct Cache {
     VkShaderEXT handle = VK_NULL_HANDLE;
     shader::gcn::ShaderInfo *info;
     VkShaderStageFlagBits stage;
+
+    // translation is still running on the shader translator, draw should be
+    // skipped
+    bool pending = false;
   };
 
   struct Sampler {
@@ -238,9 +242,8 @@ private:
     MemoryTableSlot slots[];
   };
 
-  struct ShaderResources : shader::eval::Evaluator {
+  struct ShaderResources : shader::gcn::ResourceEvaluator {
     std::map<std::uint32_t, std::uint32_t> slotResources;
-    std::span<const std::uint32_t> userSgprs;
     Tag *cacheTag = nullptr;
 
     std::uint32_t slotOffset = 0;
@@ -251,9 +254,8 @@ private:
     std::vector<Cache::Sampler> samplerResources;
     std::vector<Cache::ImageView> imageResources[3];
 
-    using Evaluator::eval;
-
-    shader::eval::Value eval(shader::ir::Value op) override;
+    // register file of the resource fetch programs
+    std::vector<shader::eval::Value> fetchRegisters;
 
     void clear() {
       slotResources.clear();
@@ -277,16 +279,9 @@ private:
     void buildImageMemoryTable(MemoryTable &memoryTable);
     std::uint32_t getResourceSlot(std::uint32_t id);
 
-    template <typename T> T readPointer(std::uint64_t address) {
-      T result{};
-      cacheTag->readMemory(
-          &result, rx::AddressRange::fromBeginSize(address, sizeof(result)));
-      return result;
-    }
-
-    shader::eval::Value
-    eval(shader::ir::InstructionId instId,
-         std::span<const shader::ir::Operand> operands) override;
+  protected:
+    void readMemory(void *dst, std::uint64_t address,
+                    std::size_t size) override;
   };
 
   struct TagStorage {
@@ -356,7 +351,11 @@ public:
     Buffer getInternalHostVisibleBuffer(std::uint64_t size);
     Buffer getInternalDeviceLocalBuffer(std::uint64_t size);
 
-    void unlock() { mResourcesLock.unlock(); }
+    void unlock() {
+      if (mResourcesLock.owns_lock()) {
+        mResourcesLock.unlock();
+      }
+    }
 
     void buildDescriptors(VkDescriptorSet descriptorSet);
 
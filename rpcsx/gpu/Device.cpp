@@ -18,6 +18,7 @@
 #include "shader/spv.hpp"
 #include "shaders/rdna-semantic-spirv.hpp"
 #include "vk.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <fcntl.h>
@@ -61,6 +62,17 @@ makeDisplayEvent(DisplayEvent id, std::uint16_t unk0 = 0,
   return result;
 }
 
+// triggers display notes subscribed to the event, the event id is stored in
+// the top bits of the note identifier
+static void emitDisplayEvent(DisplayEvent id, orbis::intptr_t data) {
+  auto firstIdent = static_cast<std::uint64_t>(id) << 48;
+  auto lastIdent = firstIdent | ((std::uint64_t(1) << 48) - 1);
+
+  orbis::g_context->deviceEventEmitter->emit(
+      orbis::kEvFiltDisplay, firstIdent, lastIdent,
+      [=](orbis::KNote *) -> std::optional<orbis::intptr_t> { return data; });
+}
+
 static vk::Context createVkContext(Device *device) {
   std::vector<const char *> optionalLayers;
   bool enableValidation = rx::g_config.validateGpu;
@@ -207,6 +219,10 @@ Device::Device() : vkContext(createVkContext(this)) {
     rx::die("failed to deserialize builtin semantics\n");
   }
 
+  if (!rx::g_config.shaderCachePath.empty()) {
+    shaderCache.open(rx::g_config.shaderCachePath, g_rdna_semantic_spirv);
+  }
+
   for (auto &pipe : graphicsPipes) {
     pipe.device = this;
   }
@@ -217,50 +233,6 @@ Device::Device() : vkContext(createVkContext(this)) {
     std::memset(cachePage, 0, kCachePageSize);
   }
 
-  cacheUpdateThread = std::jthread([this](const std::stop_token &stopToken) {
-    auto &sched = graphicsPipes[0].scheduler;
-    std::uint32_t prevIdleValue = 0;
-    while (!stopToken.stop_requested()) {
-      if (gpuCacheCommandIdle.wait(prevIdleValue) != std::errc{}) {
-        continue;
-      }
-
-      prevIdleValue = gpuCacheCommandIdle.load(std::memory_order::acquire);
-
-      for (int vmId = 0; vmId < kMaxProcessCount; ++vmId) {
-        auto page = gpuCacheCommand[vmId].load(std::memory_order::relaxed);
-        if (page == 0) {
-          continue;
-        }
-
-        gpuCacheCommand[vmId].store(0, std::memory_order::relaxed);
-        auto address = static_cast<std::uint64_t>(page) * rx::mem::pageSize;
-
-        auto range =
-            rx::AddressRange::fromBeginSize(address, rx::mem::pageSize);
-        auto tag = getCacheTag(vmId, sched);
-
-        auto flushedRange = tag.getCache()->flushImages(tag, range);
-        flushedRange =
-            flushedRange.merge(tag.getCache()->flushImageBuffers(tag, range));
-
-        if (flushedRange) {
-          sched.submit();
-          sched.wait();
-        }
-
-        flushedRange = tag.getCache()->flushBuffers(flushedRange);
-
-        if (flushedRange) {
-          unlockReadWrite(vmId, flushedRange.beginAddress(),
-                          flushedRange.size());
-        } else {
-          unlockReadWrite(vmId, range.beginAddress(), range.size());
-        }
-      }
-    }
-  });
-
   commandPipe.device = this;
   commandPipe.ring = {
       .base = std::data(cmdRing),
@@ -286,8 +258,52 @@ Device::Device() : vkContext(createVkContext(this)) {
 }
 
 Device::~Device() {
+  stopPipeWorkers();
   vkDeviceWaitIdle(vk::context->device);
 
+  if (shaderCache.isOpen()) {
+    auto &stats = shaderCache.getStats();
+    rx::println(stderr,
+                "shader cache: {} hits, {} misses, {} stores, {} rejected",
+                stats.hits.load(), stats.misses.load(), stats.stores.load(),
+                stats.rejected.load());
+  }
+
+  shaderTranslator.printStats();
+
+  if (auto batches = cacheUpdateStats.batches.load()) {
+    rx::println(stderr,
+                "cache update: {} pages in {} batches, average flush {} us",
+                cacheUpdateStats.pages.load(), batches,
+                cacheUpdateStats.flushNs.load() / batches / 1000);
+  }
+
+  auto printPipeStats = [](const char *name, int index, PipeStats &stats,
+                           Scheduler &scheduler) {
+    auto &schedStats = scheduler.getStats();
+    if (schedStats.submits.load() == 0) {
+      return;
+    }
+
+    rx::println(stderr,
+                "{} pipe {}: busy {} ms, idle {} ms, {} submits, cpu stall {} "
+                "ms, gpu idle {} ms",
+                name, index, stats.busyNs.load() / 1'000'000,
+                stats.idleNs.load() / 1'000'000, schedStats.submits.load(),
+                schedStats.cpuStallNs.load() / 1'000'000,
+                schedStats.gpuIdleNs.load() / 1'000'000);
+  };
+
+  for (int i = 0; i < kGfxPipeCount; ++i) {
+    printPipeStats("graphics", i, graphicsPipes[i].stats,
+                   graphicsPipes[i].scheduler);
+  }
+
+  for (int i = 0; i < kComputePipeCount; ++i) {
+    printPipeStats("compute", i, computePipes[i].stats,
+                   computePipes[i].scheduler);
+  }
+
   if (debugMessenger != VK_NULL_HANDLE) {
     vk::DestroyDebugUtilsMessengerEXT(vk::context->instance, debugMessenger,
                                       vk::context->allocator);
@@ -344,15 +360,7 @@ void Device::start() {
   }
 
   std::jthread vblankThread([](const std::stop_token &stopToken) {
-    orbis::g_context->deviceEventEmitter->emit(
-        orbis::kEvFiltDisplay,
-        [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
-          if (DisplayEvent(note->event.ident >> 48) ==
-              DisplayEvent::PreVBlankStart) {
-            return 0;
-          }
-          return {};
-        });
+    emitDisplayEvent(DisplayEvent::PreVBlankStart, 0);
 
     auto prevVBlank = std::chrono::steady_clock::now();
     auto period = std::chrono::seconds(1) / 59.94;
@@ -362,17 +370,13 @@ void Device::start() {
           std::chrono::duration_cast<std::chrono::nanoseconds>(period);
       std::this_thread::sleep_until(prevVBlank);
 
-      orbis::g_context->deviceEventEmitter->emit(
-          orbis::kEvFiltDisplay,
-          [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
-            if (DisplayEvent(note->event.ident >> 48) == DisplayEvent::VBlank) {
-              return 0;
-            }
-            return {};
-          });
+      emitDisplayEvent(DisplayEvent::VBlank, 0);
     }
   });
 
+  presenterThreadId = std::this_thread::get_id();
+  startPipeWorkers();
+
   uint32_t gpIndex = -1;
   GLFWgamepadstate gpState;
 
@@ -533,7 +537,99 @@ void Device::start() {
       break;
     }
 
-    processPipes();
+    processCacheUpdates();
+
+    if (processPipes()) {
+      // pipes are idle, retire finished flips without waiting for next submit
+      graphicsPipes[0].scheduler.poll();
+    }
+  }
+}
+
+void Device::processCacheUpdates() {
+  using clock = std::chrono::steady_clock;
+
+  // cache tags are created on the presenter pipe scheduler, it can be used
+  // only by the owner thread
+  auto idleValue = gpuCacheCommandIdle.load(std::memory_order::acquire);
+  if (idleValue == cacheUpdateIdleValue) {
+    return;
+  }
+
+  cacheUpdateIdleValue = idleValue;
+  auto &sched = graphicsPipes[0].scheduler;
+
+  for (int vmId = 0; vmId < kMaxProcessCount; ++vmId) {
+    auto &pages = cacheUpdatePages;
+    auto &batch = cacheUpdateBatch;
+    pages.clear();
+
+    for (auto &command : gpuCacheCommands[vmId]) {
+      if (command.load(std::memory_order::relaxed) == 0) {
+        continue;
+      }
+
+      if (auto page = command.exchange(0, std::memory_order::acquire)) {
+        pages.push_back(page);
+      }
+    }
+
+    if (pages.empty()) {
+      continue;
+    }
+
+    auto batchStart = clock::now();
+
+    // several threads can fault on the same page, merge duplicates and
+    // adjacent pages into ranges
+    std::ranges::sort(pages);
+    batch.clear();
+
+    for (auto page : pages) {
+      auto address = static_cast<std::uint64_t>(page) * rx::mem::pageSize;
+
+      if (!batch.empty() && batch.back().range.endAddress() >= address) {
+        batch.back().range = batch.back().range.merge(
+            rx::AddressRange::fromBeginSize(address, rx::mem::pageSize));
+        continue;
+      }
+
+      batch.push_back({
+          .range = rx::AddressRange::fromBeginSize(address, rx::mem::pageSize),
+      });
+    }
+
+    auto tag = getCacheTag(vmId, sched);
+    bool hasFlushes = false;
+
+    for (auto &pending : batch) {
+      pending.flushedRange = tag.getCache()->flushImages(tag, pending.range);
+      pending.flushedRange = pending.flushedRange.merge(
+          tag.getCache()->flushImageBuffers(tag, pending.range));
+
+      if (pending.flushedRange) {
+        hasFlushes = true;
+      }
+    }
+
+    if (hasFlushes) {
+      sched.submit();
+      sched.wait();
+    }
+
+    for (auto &pending : batch) {
+      auto flushedRange = tag.getCache()->flushBuffers(pending.flushedRange);
+      auto unlockRange = pending.range.merge(flushedRange);
+      unlockReadWrite(vmId, unlockRange.beginAddress(), unlockRange.size());
+    }
+
+    cacheUpdateStats.pages.fetch_add(pages.size(), std::memory_order::relaxed);
+    cacheUpdateStats.batches.fetch_add(1, std::memory_order::relaxed);
+    cacheUpdateStats.flushNs.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                             batchStart)
+            .count(),
+        std::memory_order::relaxed);
   }
 }
 
@@ -565,6 +661,7 @@ void Device::submitGfxCommand(int gfxPipe,
                               std::span<const std::uint32_t> command) {
   auto &ring = graphicsPipes[gfxPipe].deQueues[2];
   submitCommand(ring, command);
+  graphicsPipes[gfxPipe].wakeUp();
 }
 
 void Device::mapProcess(std::uint32_t pid, int vmId) {
@@ -684,26 +781,149 @@ void Device::onCommandBuffer(std::uint32_t pid, int cmdHeader,
   } else {
     rx::die("unimplemented command buffer {:x}", cmdHeader);
   }
+
+  graphicsPipes[0].wakeUp();
 }
 
-bool Device::processPipes() {
+static bool processPipeGroup(PipeWorker &worker) {
+  using clock = std::chrono::steady_clock;
   bool allProcessed = true;
 
-  commandPipe.processAllRings();
+  auto process = [&](auto *pipe) {
+    auto start = clock::now();
 
-  for (auto &pipe : computePipes) {
-    if (!pipe.processAllRings()) {
+    if (!pipe->processAllRings()) {
       allProcessed = false;
     }
+
+    pipe->stats.busyNs.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                             start)
+            .count(),
+        std::memory_order::relaxed);
+  };
+
+  for (auto pipe : worker.computePipes) {
+    process(pipe);
   }
 
+  for (auto pipe : worker.graphicsPipes) {
+    process(pipe);
+  }
+
+  return allProcessed;
+}
+
+static void pipeWorkerEntry(PipeWorker &worker,
+                            const std::stop_token &stopToken) {
+  using clock = std::chrono::steady_clock;
+
+  while (!stopToken.stop_requested()) {
+    auto wakeupValue = worker.wakeupCounter.load(std::memory_order::acquire);
+    bool allProcessed = processPipeGroup(worker);
+
+    if (stopToken.stop_requested()) {
+      break;
+    }
+
+    if (!allProcessed) {
+      // ring is blocked on memory written by CPU or by another pipe, poll it
+      // again after short delay or on the next ring update
+      (void)worker.wakeupCounter.wait(wakeupValue,
+                                      std::chrono::microseconds(10));
+      continue;
+    }
+
+    auto start = clock::now();
+    (void)worker.wakeupCounter.wait(wakeupValue);
+    auto idleNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      clock::now() - start)
+                      .count();
+
+    for (auto pipe : worker.computePipes) {
+      pipe->stats.idleNs.fetch_add(idleNs, std::memory_order::relaxed);
+    }
+
+    for (auto pipe : worker.graphicsPipes) {
+      pipe->stats.idleNs.fetch_add(idleNs, std::memory_order::relaxed);
+    }
+  }
+}
+
+bool Device::processPipes() {
+  commandPipe.processAllRings();
+  return processPipeGroup(presenterPipes);
+}
+
+void Device::startPipeWorkers() {
+  // Vulkan queues are externally synchronized, pipes sharing a queue are
+  // processed by the same thread. Pipes on the present queue stay on the
+  // presenter thread together with command pipe and flips.
+  auto presentQueue = graphicsPipes[0].scheduler.getQueue();
+  auto workerLimit = static_cast<std::size_t>(
+      std::max(rx::g_config.gpuPipeWorkerCount, 0));
+  std::vector<std::pair<VkQueue, PipeWorker *>> queueWorkers;
+
+  auto getWorker = [&](VkQueue queue) -> PipeWorker & {
+    if (workerLimit == 1 || queue == presentQueue) {
+      return presenterPipes;
+    }
+
+    for (auto [otherQueue, worker] : queueWorkers) {
+      if (otherQueue == queue) {
+        return *worker;
+      }
+    }
+
+    PipeWorker *worker;
+    if (workerLimit > 1 && pipeWorkers.size() + 1 >= workerLimit) {
+      worker = pipeWorkers[queueWorkers.size() % pipeWorkers.size()].get();
+    } else {
+      worker = pipeWorkers.emplace_back(std::make_unique<PipeWorker>()).get();
+    }
+
+    queueWorkers.emplace_back(queue, worker);
+    return *worker;
+  };
+
   for (auto &pipe : graphicsPipes) {
-    if (!pipe.processAllRings()) {
-      allProcessed = false;
+    getWorker(pipe.scheduler.getQueue()).graphicsPipes.push_back(&pipe);
+  }
+
+  for (auto &pipe : computePipes) {
+    getWorker(pipe.scheduler.getQueue()).computePipes.push_back(&pipe);
+  }
+
+  for (auto &worker : pipeWorkers) {
+    for (auto pipe : worker->graphicsPipes) {
+      pipe->wakeupCounter = &worker->wakeupCounter;
+    }
+
+    for (auto pipe : worker->computePipes) {
+      pipe->wakeupCounter = &worker->wakeupCounter;
     }
+
+    worker->thread = std::jthread(
+        [worker = worker.get()](const std::stop_token &stopToken) {
+          pipeWorkerEntry(*worker, stopToken);
+        });
   }
 
-  return allProcessed;
+  rx::println(stderr, "gpu: {} pipe worker threads", pipeWorkers.size());
+}
+
+void Device::stopPipeWorkers() {
+  for (auto &worker : pipeWorkers) {
+    worker->thread.request_stop();
+    worker->wakeupCounter.fetch_add(1, std::memory_order::release);
+    worker->wakeupCounter.notify_all();
+  }
+
+  for (auto &worker : pipeWorkers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
 }
 
 static void
@@ -765,6 +985,14 @@ transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
                        nullptr, 0, nullptr, 1, &barrier);
 }
 
+void Device::publishFlip(int vmId, int bufferIndex, std::uint64_t arg) {
+  // flip status is polled by guest threads, count must be updated last
+  flipBuffer[vmId] = bufferIndex;
+  flipArg[vmId] = arg;
+  std::atomic_thread_fence(std::memory_order::release);
+  flipCount[vmId] = flipCount[vmId] + 1;
+}
+
 bool Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg,
                   VkImage swapchainImage, VkImageView swapchainImageView) {
   auto &pipe = graphicsPipes[0];
@@ -775,9 +1003,7 @@ bool Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg,
   }
 
   if (bufferIndex < 0) {
-    flipBuffer[process.vmId] = bufferIndex;
-    flipArg[process.vmId] = arg;
-    flipCount[process.vmId] = flipCount[process.vmId] + 1;
+    publishFlip(process.vmId, bufferIndex, arg);
     return false;
   }
 
@@ -893,18 +1119,21 @@ bool Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg,
     vkQueueSubmit2(vk::context->presentQueue, 1, &submitInfo, VK_NULL_HANDLE);
   }
 
-  scheduler.then([=, this, vmId = process.vmId,
-                  cacheTag = std::move(cacheTag)] {
-    flipBuffer[vmId] = bufferIndex;
-    flipArg[vmId] = arg;
-    flipCount[vmId] = flipCount[vmId] + 1;
-
-    auto mem = RemoteMemory{vmId};
-    auto bufferInUse = mem.getPointer<std::uint64_t>(bufferInUseAddress[vmId]);
-    if (bufferInUse != nullptr) {
-      bufferInUse[bufferIndex] = 0;
-    }
-  });
+  // cache tag and flip status are owned by presenter thread, publish them when
+  // the external submit retires
+  cacheTag.unlock();
+  scheduler.afterExternalSubmit(
+      submitCompleteTask,
+      [=, this, vmId = process.vmId, cacheTag = std::move(cacheTag)] {
+        publishFlip(vmId, bufferIndex, arg);
+
+        auto mem = RemoteMemory{vmId};
+        auto bufferInUse =
+            mem.getPointer<std::uint64_t>(bufferInUseAddress[vmId]);
+        if (bufferInUse != nullptr) {
+          bufferInUse[bufferIndex] = 0;
+        }
+      });
 
   return true;
 }
@@ -941,14 +1170,7 @@ void Device::flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg) {
       flip(pid, bufferIndex, arg, vk::context->swapchainImages[imageIndex],
            vk::context->swapchainImageViews[imageIndex]);
 
-  orbis::g_context->deviceEventEmitter->emit(
-      orbis::kEvFiltDisplay,
-      [=](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
-        if (DisplayEvent(note->event.ident >> 48) == DisplayEvent::Flip) {
-          return arg;
-        }
-        return {};
-      });
+  emitDisplayEvent(DisplayEvent::Flip, arg);
 
   if (!flipComplete) {
     isImageAcquired = true;
@@ -3,16 +3,21 @@
 #include "DeviceContext.hpp"
 #include "FlipPipeline.hpp"
 #include "Pipe.hpp"
+#include "ShaderTranslator.hpp"
 #include "amdgpu/tiler_vulkan.hpp"
 #include "orbis/KernelAllocator.hpp"
 #include "rx/MemoryTable.hpp"
 #include "rx/Rc.hpp"
+#include "rx/SharedAtomic.hpp"
 #include "rx/SharedMutex.hpp"
 #include "shader/SemanticInfo.hpp"
+#include "shader/ShaderCache.hpp"
 #include "shader/SpvConverter.hpp"
 #include "shader/gcn.hpp"
 #include <array>
+#include <memory>
 #include <thread>
+#include <vector>
 #include <vulkan/vulkan_core.h>
 
 struct GLFWwindow;
@@ -63,6 +68,18 @@ struct RemoteMemory {
   }
 };
 
+///
+/// \brief Thread processing rings of a group of pipes.
+///
+/// Worker sleeps on wakeupCounter while all its rings are empty.
+///
+struct PipeWorker {
+  rx::shared_atomic32 wakeupCounter{0};
+  std::vector<GraphicsPipe *> graphicsPipes;
+  std::vector<ComputePipe *> computePipes;
+  std::jthread thread;
+};
+
 struct Device : rx::RcBase, DeviceContext {
   static constexpr auto kComputePipeCount = 8;
   static constexpr auto kGfxPipeCount = 2;
@@ -70,6 +87,8 @@ struct Device : rx::RcBase, DeviceContext {
   shader::SemanticInfo gcnSemantic;
   shader::spv::Context shaderSemanticContext;
   shader::gcn::SemanticModuleInfo gcnSemanticModuleInfo;
+  shader::gcn::ShaderCache shaderCache;
+  ShaderTranslator shaderTranslator{this};
   Registers::Config config;
   GLFWwindow *window = nullptr;
   VkSurfaceKHR surface = VK_NULL_HANDLE;
@@ -82,11 +101,31 @@ struct Device : rx::RcBase, DeviceContext {
   CommandPipe commandPipe;
   FlipPipeline flipPipeline;
 
+  // pipes processed by presenter thread together with command pipe
+  PipeWorker presenterPipes;
+  std::vector<std::unique_ptr<PipeWorker>> pipeWorkers;
+  std::thread::id presenterThreadId;
+
   rx::shared_mutex writeCommandMtx;
   uint32_t imageIndex = 0;
   bool isImageAcquired = false;
 
-  std::jthread cacheUpdateThread;
+  struct CacheUpdateStats {
+    std::atomic<std::uint64_t> pages{0};
+    std::atomic<std::uint64_t> batches{0};
+    std::atomic<std::uint64_t> flushNs{0};
+  };
+
+  struct PendingCacheFlush {
+    rx::AddressRange range;
+    rx::AddressRange flushedRange;
+  };
+
+  // faulted pages are flushed by presenter thread, see processCacheUpdates()
+  CacheUpdateStats cacheUpdateStats;
+  std::uint32_t cacheUpdateIdleValue = 0;
+  std::vector<std::uint32_t> cacheUpdatePages;
+  std::vector<PendingCacheFlush> cacheUpdateBatch;
 
   int dmemFd[3] = {-1, -1, -1};
   orbis::kmap<std::int32_t, ProcessInfo> processInfo;
@@ -125,6 +164,13 @@ struct Device : rx::RcBase, DeviceContext {
   void onCommandBuffer(std::uint32_t pid, int cmdHeader, std::uint64_t address,
                        std::uint64_t size);
   bool processPipes();
+  void processCacheUpdates();
+  void startPipeWorkers();
+  void stopPipeWorkers();
+  bool isPresenterThread() const {
+    return std::this_thread::get_id() == presenterThreadId;
+  }
+  void publishFlip(int vmId, int bufferIndex, std::uint64_t arg);
   bool flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg,
             VkImage swapchainImage, VkImageView swapchainImageView);
   void flip(std::uint32_t pid, int bufferIndex, std::uint64_t arg);
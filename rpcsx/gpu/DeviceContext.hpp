@@ -66,11 +66,15 @@ enum {
 
 struct DeviceContext {
   static constexpr auto kMaxProcessCount = 6;
+  static constexpr auto kGpuCacheCommandCount = 64;
 
   PadState kbPadState{};
   std::atomic<std::uint64_t> cpuCacheCommands[kMaxProcessCount][4]{};
   rx::shared_atomic32 cpuCacheCommandsIdle[kMaxProcessCount]{};
-  rx::shared_atomic32 gpuCacheCommand[kMaxProcessCount]{};
+
+  // pages waiting for gpu cache flush, 0 is a free slot
+  std::atomic<std::uint32_t> gpuCacheCommands[kMaxProcessCount]
+                                             [kGpuCacheCommandCount]{};
   rx::shared_atomic32 gpuCacheCommandIdle{};
   std::atomic<std::uint8_t> *cachePages[kMaxProcessCount]{};
 
@@ -213,6 +213,7 @@ void ComputePipe::mapQueue(int queueId, Ring ring,
                (void *)ring.wptr, ring.size, (void *)ring.doorbell);
 
   queues[1 - ring.indirectLevel][queueId] = ring;
+  wakeUp();
 }
 
 void ComputePipe::waitForIdle(int queueId,
@@ -237,6 +238,14 @@ void ComputePipe::waitForIdle(int queueId,
 void ComputePipe::submit(int queueId, std::uint32_t offset) {
   auto &ring = queues[1][queueId];
   ring.wptr = ring.base + offset;
+  wakeUp();
+}
+
+void ComputePipe::wakeUp() {
+  if (wakeupCounter != nullptr) {
+    wakeupCounter->fetch_add(1, std::memory_order::release);
+    wakeupCounter->notify_one();
+  }
 }
 
 bool ComputePipe::setShReg(Ring &ring) {
@@ -345,14 +354,11 @@ bool ComputePipe::releaseMem(Ring &ring) {
   }
 
   if (intSel) {
+    auto ident = kGcEventCompute0RelMem + index;
     orbis::g_context->deviceEventEmitter->emit(
-        orbis::kEvFiltGraphicsCore,
-        [=, this](orbis::KNote *note) -> std::optional<std::int64_t> {
-          if (note->event.ident == kGcEventCompute0RelMem + index) {
-            return dataLo | (static_cast<std::uint64_t>(dataHi) << 32);
-          }
-
-          return {};
+        orbis::kEvFiltGraphicsCore, ident, ident,
+        [=](orbis::KNote *) -> std::optional<std::int64_t> {
+          return dataLo | (static_cast<std::uint64_t>(dataHi) << 32);
         });
   }
 
@@ -728,6 +734,13 @@ void GraphicsPipe::setDeQueue(Ring ring, int indirectLevel) {
   deQueues[2 - indirectLevel] = ring;
 }
 
+void GraphicsPipe::wakeUp() {
+  if (wakeupCounter != nullptr) {
+    wakeupCounter->fetch_add(1, std::memory_order::release);
+    wakeupCounter->notify_one();
+  }
+}
+
 std::uint32_t *GraphicsPipe::getMmRegister(std::uint32_t dwAddress) {
   // if (dwAddress >= Registers::Config::kMmioOffset &&
   //     dwAddress < Registers::Config::kMmioOffset +
@@ -1375,18 +1388,11 @@ bool GraphicsPipe::eventWriteEop(Ring &ring) {
   }
 
   if (intSel != 0) {
+    // kGcEventGfxEop + 1 is hp3d
     orbis::g_context->deviceEventEmitter->emit(
-        orbis::kEvFiltGraphicsCore,
-        [=](orbis::KNote *note) -> std::optional<std::int64_t> {
-          if (note->event.ident == kGcEventGfxEop) {
-            return dataLo | (static_cast<std::uint64_t>(dataHi) << 32);
-          }
-
-          if (note->event.ident == kGcEventGfxEop + 1) { // hp3d
-            return dataLo | (static_cast<std::uint64_t>(dataHi) << 32);
-          }
-
-          return {};
+        orbis::kEvFiltGraphicsCore, kGcEventGfxEop, kGcEventGfxEop + 1,
+        [=](orbis::KNote *) -> std::optional<std::int64_t> {
+          return dataLo | (static_cast<std::uint64_t>(dataHi) << 32);
         });
   }
 
@@ -1417,7 +1423,16 @@ bool GraphicsPipe::eventWriteEop(Ring &ring) {
     }
 
     if (request) {
-      device->flip(request->pid, request->bufferIndex, request->arg);
+      if (device->isPresenterThread()) {
+        device->flip(request->pid, request->bufferIndex, request->arg);
+      } else {
+        // swapchain and present queue are owned by presenter thread
+        device->submitCommand(
+            device->commandPipe.ring,
+            createPm4Packet(IT_FLIP, request->bufferIndex,
+                            request->arg & 0xffff'ffff, request->arg >> 32,
+                            request->pid));
+      }
     }
   }
 
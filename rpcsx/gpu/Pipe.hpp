@@ -1,8 +1,10 @@
 #pragma once
 #include "Registers.hpp"
 #include "Scheduler.hpp"
+#include "rx/SharedAtomic.hpp"
 #include "rx/SharedMutex.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <vulkan/vulkan_core.h>
 
@@ -34,11 +36,24 @@ struct Ring {
   }
 };
 
+struct PipeStats {
+  // time spent in ring processing
+  std::atomic<std::uint64_t> busyNs{0};
+
+  // time the pipe worker slept without pending work
+  std::atomic<std::uint64_t> idleNs{0};
+};
+
 struct ComputePipe {
   static constexpr auto kRingsPerQueue = 2;
   static constexpr auto kQueueCount = 8;
   Device *device;
   Scheduler scheduler;
+  PipeStats stats;
+
+  // incremented on every ring update to wake up pipe worker, nullptr if pipe
+  // is processed by the presenter thread
+  rx::shared_atomic32 *wakeupCounter = nullptr;
 
   using CommandHandler = bool (ComputePipe::*)(Ring &);
   CommandHandler commandHandlers[255];
@@ -57,6 +72,7 @@ struct ComputePipe {
                 std::unique_lock<rx::shared_mutex> &lock);
   void waitForIdle(int queueId, std::unique_lock<rx::shared_mutex> &lock);
   void submit(int queueId, std::uint32_t offset);
+  void wakeUp();
 
   std::unique_lock<rx::shared_mutex> lockQueue(int queueId) {
     return std::unique_lock<rx::shared_mutex>(queueMtx[queueId]);
@@ -88,6 +104,8 @@ struct GraphicsPipe {
   static constexpr auto kEopFlipRequestMax = 0x10;
   Device *device;
   Scheduler scheduler;
+  PipeStats stats;
+  rx::shared_atomic32 *wakeupCounter = nullptr;
 
   std::uint64_t ceCounter = 0;
   std::uint64_t deCounter = 0;
@@ -120,6 +138,7 @@ struct GraphicsPipe {
 
   void setCeQueue(Ring ring);
   void setDeQueue(Ring ring, int indirectLevel);
+  void wakeUp();
 
   bool processAllRings();
   void processRing(Ring &ring);
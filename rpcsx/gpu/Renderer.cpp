@@ -470,10 +470,29 @@ void amdgpu::draw(GraphicsPipe &pipe, int vmId, std::uint32_t firstVertex,
   shaders[Cache::getStageIndex(VK_SHADER_STAGE_VERTEX_BIT)] =
       vertexShader.handle;
 
+  // render targets are already acquired, submit their transfers before
+  // releasing the tag like the other early returns do
+  auto skipDraw = [&] {
+    pipe.device->shaderTranslator.getStats().skippedDraws.fetch_add(
+        1, std::memory_order::relaxed);
+    pipe.scheduler.submit();
+    pipe.scheduler.wait();
+  };
+
+  if (vertexShader.pending) {
+    skipDraw();
+    return;
+  }
+
   if (pipe.sh.spiShaderPgmPs.address != 0) {
     auto pixelShader = cacheTag.getPixelShader(pipe.sh.spiShaderPgmPs,
                                                pipe.context, viewPorts);
 
+    if (pixelShader.pending) {
+      skipDraw();
+      return;
+    }
+
     shaders[Cache::getStageIndex(VK_SHADER_STAGE_FRAGMENT_BIT)] =
         pixelShader.handle != nullptr
             ? pixelShader.handle
@@ -0,0 +1,336 @@
+#include "ShaderTranslator.hpp"
+#include "Device.hpp"
+#include "rx/Config.hpp"
+#include "rx/die.hpp"
+#include "rx/print.hpp"
+#include "shader/ShaderCache.hpp"
+#include "shader/glsl.hpp"
+#include "shader/spv.hpp"
+#include "shaders/rdna-semantic-spirv.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace amdgpu;
+
+ShaderTranslationContext::ShaderTranslationContext() {
+  if (auto sem = shader::spv::deserialize(
+          semanticContext, g_rdna_semantic_spirv,
+          semanticContext.getUnknownLocation())) {
+    auto shaderSemantic = *sem;
+    shader::gcn::canonicalizeSemantic(semanticContext, shaderSemantic);
+    shader::gcn::collectSemanticModuleInfo(semanticModuleInfo, shaderSemantic);
+    semantic = shader::gcn::collectSemanticInfo(semanticModuleInfo);
+  } else {
+    rx::die("failed to deserialize builtin semantics\n");
+  }
+}
+
+std::optional<TranslatedShader> amdgpu::translateShader(
+    Device *device, const shader::SemanticInfo &semantic,
+    const shader::gcn::SemanticModuleInfo &semanticModuleInfo, int vmId,
+    std::uint64_t address, shader::gcn::Stage stage,
+    const shader::gcn::Environment &env) {
+  auto readShaderMemory = [vmId](std::uint64_t address) -> std::uint32_t {
+    return *RemoteMemory{vmId}.getPointer<std::uint32_t>(address);
+  };
+
+  auto &diskCache = device->shaderCache;
+
+  std::optional<shader::gcn::ConvertedShader> converted =
+      diskCache.find(stage, env, address, readShaderMemory);
+
+  if (!converted) {
+    shader::gcn::Context context;
+    auto deserialized = shader::gcn::deserialize(context, env, semantic,
+                                                 address, readShaderMemory);
+
+    // deserialized.print(std::cerr, context.ns);
+
+    converted = shader::gcn::convertToSpv(context, deserialized, semantic,
+                                          semanticModuleInfo, stage, env);
+    if (!converted) {
+      return {};
+    }
+
+    converted->info.resources.dump();
+    if (!shader::spv::validate(converted->spv)) {
+      shader::spv::dump(converted->spv, true);
+      return {};
+    }
+
+    rx::print(stderr, "{}", shader::glsl::decompile(converted->spv));
+    // if (auto opt = shader::spv::optimize(converted->spv)) {
+    //   converted->spv = std::move(*opt);
+    //   std::fprintf(stderr, "opt: %s",
+    //              shader::glsl::decompile(converted->spv).c_str());
+    // } else {
+    //   std::printf("optimization failed\n");
+    // }
+
+    diskCache.store(stage, env, address, *converted, readShaderMemory);
+  }
+
+  TranslatedShader result;
+  std::memcpy(&result.magic, RemoteMemory{vmId}.getPointer(address),
+              sizeof(result.magic));
+
+  for (auto entry : converted->info.memoryMap) {
+    auto &inserted = result.usedMemory.emplace_back();
+    inserted.first = entry.beginAddress;
+    inserted.second.resize(entry.endAddress - entry.beginAddress);
+    std::memcpy(inserted.second.data(),
+                RemoteMemory{vmId}.getPointer(entry.beginAddress),
+                inserted.second.size());
+  }
+
+  result.converted = std::move(*converted);
+  return result;
+}
+
+std::chrono::microseconds
+ShaderTranslator::Stats::getLatencyPercentile(double percentile) const {
+  std::uint64_t total = 0;
+  for (auto &bucket : latency) {
+    total += bucket.load(std::memory_order::relaxed);
+  }
+
+  if (total == 0) {
+    return {};
+  }
+
+  auto threshold = static_cast<std::uint64_t>(total * percentile);
+  std::uint64_t count = 0;
+
+  for (std::size_t index = 0; index < latency.size(); ++index) {
+    count += latency[index].load(std::memory_order::relaxed);
+
+    if (count > threshold) {
+      return std::chrono::microseconds(std::uint64_t(1) << index);
+    }
+  }
+
+  return std::chrono::microseconds(std::uint64_t(1) << (latency.size() - 1));
+}
+
+ShaderTranslator::~ShaderTranslator() {
+  for (auto &worker : mWorkers) {
+    worker->thread.request_stop();
+  }
+
+  mWakeCv.notify_all();
+
+  // workers can steal from each other, join all of them before destroying
+  // queues
+  for (auto &worker : mWorkers) {
+    worker->thread.join();
+  }
+}
+
+void ShaderTranslator::start() {
+  std::size_t workerCount = rx::g_config.shaderWorkerCount;
+
+  if (workerCount == 0) {
+    workerCount =
+        std::clamp<std::size_t>(std::thread::hardware_concurrency() / 2, 1, 8);
+  }
+
+  mWorkers.reserve(workerCount);
+  for (std::size_t index = 0; index < workerCount; ++index) {
+    mWorkers.push_back(std::make_unique<Worker>());
+  }
+
+  for (std::size_t index = 0; index < workerCount; ++index) {
+    mWorkers[index]->thread =
+        std::jthread([this, index](const std::stop_token &stopToken) {
+          workerEntry(index, stopToken);
+        });
+  }
+}
+
+std::shared_ptr<ShaderTranslator::Job>
+ShaderTranslator::enqueue(int vmId, std::uint64_t address,
+                          shader::gcn::Stage stage,
+                          const shader::gcn::Environment &env) {
+  std::call_once(mStartFlag, [this] { start(); });
+
+  ShaderTranslationKey key{
+      .vmId = vmId,
+      .address = address,
+      .stage = stage,
+      .envKey = shader::gcn::ShaderCache::getEnvironmentKey(env),
+      .userSgprs = {env.userSgprs.begin(), env.userSgprs.end()},
+  };
+
+  std::shared_ptr<Job> job;
+  auto now = clock::now();
+
+  {
+    std::lock_guard lock(mJobsMtx);
+    reapExpiredJobs(now);
+
+    auto [it, inserted] = mJobs.try_emplace(std::move(key));
+
+    if (!inserted) {
+      mStats.deduplicated.fetch_add(1, std::memory_order::relaxed);
+      it->second->expireTime = now + kUnclaimedJobLifetime;
+      return it->second;
+    }
+
+    job = std::make_shared<Job>();
+    job->key = it->first;
+    job->env = env;
+    job->env.userSgprs = job->key.userSgprs;
+    job->enqueueTime = now;
+    job->expireTime = now + kUnclaimedJobLifetime;
+    it->second = job;
+  }
+
+  auto &worker =
+      *mWorkers[mNextWorker.fetch_add(1, std::memory_order::relaxed) %
+                mWorkers.size()];
+
+  {
+    std::lock_guard lock(worker.mtx);
+    worker.queue.push_back(job);
+  }
+
+  mStats.queued.fetch_add(1, std::memory_order::relaxed);
+
+  {
+    std::lock_guard lock(mWakeMtx);
+    ++mPendingCount;
+  }
+
+  mWakeCv.notify_one();
+  return job;
+}
+
+bool ShaderTranslator::wait(Job &job, clock::time_point deadline) {
+  if (job.done.load(std::memory_order::acquire)) {
+    return true;
+  }
+
+  std::unique_lock lock(mDoneMtx);
+  return mDoneCv.wait_until(lock, deadline, [&] {
+    return job.done.load(std::memory_order::acquire);
+  });
+}
+
+void ShaderTranslator::release(const std::shared_ptr<Job> &job) {
+  std::lock_guard lock(mJobsMtx);
+
+  if (auto it = mJobs.find(job->key); it != mJobs.end() && it->second == job) {
+    mJobs.erase(it);
+  }
+}
+
+// callers release jobs they got a result from, finished jobs left here
+// belong to skipped draws which did not request the shader again
+void ShaderTranslator::reapExpiredJobs(clock::time_point now) {
+  std::erase_if(mJobs, [&](const auto &entry) {
+    auto &job = *entry.second;
+
+    if (job.expireTime > now || !job.done.load(std::memory_order::acquire)) {
+      return false;
+    }
+
+    mStats.expiredJobs.fetch_add(1, std::memory_order::relaxed);
+    return true;
+  });
+}
+
+void ShaderTranslator::printStats() {
+  if (mWorkers.empty()) {
+    return;
+  }
+
+  rx::println(stderr,
+              "shader translator: {} translated, {} deduplicated, {} stolen, "
+              "{} skipped draws, {} stale results, {} expired jobs, latency "
+              "p50 {}us, p90 {}us, p99 {}us",
+              mStats.translated.load(), mStats.deduplicated.load(),
+              mStats.stolen.load(), mStats.skippedDraws.load(),
+              mStats.staleResults.load(), mStats.expiredJobs.load(),
+              mStats.getLatencyPercentile(0.5).count(),
+              mStats.getLatencyPercentile(0.9).count(),
+              mStats.getLatencyPercentile(0.99).count());
+}
+
+void ShaderTranslator::workerEntry(std::size_t index,
+                                   const std::stop_token &stopToken) {
+  ShaderTranslationContext context;
+
+  while (true) {
+    {
+      std::unique_lock lock(mWakeMtx);
+      if (!mWakeCv.wait(lock, stopToken, [&] { return mPendingCount > 0; })) {
+        return;
+      }
+
+      --mPendingCount;
+    }
+
+    // every pending count decrement matches exactly one queued job, it can be
+    // only temporary invisible while other worker holds queue lock
+    std::shared_ptr<Job> job;
+    while ((job = popJob(index)) == nullptr) {
+      std::this_thread::yield();
+    }
+
+    execute(context, *job);
+  }
+}
+
+std::shared_ptr<ShaderTranslator::Job>
+ShaderTranslator::popJob(std::size_t index) {
+  {
+    auto &worker = *mWorkers[index];
+    std::lock_guard lock(worker.mtx);
+    if (!worker.queue.empty()) {
+      auto job = std::move(worker.queue.front());
+      worker.queue.pop_front();
+      return job;
+    }
+  }
+
+  for (std::size_t offset = 1; offset < mWorkers.size(); ++offset) {
+    auto &victim = *mWorkers[(index + offset) % mWorkers.size()];
+    std::lock_guard lock(victim.mtx);
+
+    if (!victim.queue.empty()) {
+      auto job = std::move(victim.queue.back());
+      victim.queue.pop_back();
+      mStats.stolen.fetch_add(1, std::memory_order::relaxed);
+      return job;
+    }
+  }
+
+  return {};
+}
+
+void ShaderTranslator::execute(ShaderTranslationContext &context, Job &job) {
+  mStats.queued.fetch_sub(1, std::memory_order::relaxed);
+  mStats.inFlight.fetch_add(1, std::memory_order::relaxed);
+
+  job.result = translateShader(mDevice, context.semantic,
+                               context.semanticModuleInfo, job.key.vmId,
+                               job.key.address, job.key.stage, job.env);
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                     clock::now() - job.enqueueTime)
+                     .count();
+  auto bucket = std::min<std::size_t>(
+      std::bit_width(static_cast<std::uint64_t>(elapsed)),
+      kLatencyBucketCount - 1);
+  mStats.latency[bucket].fetch_add(1, std::memory_order::relaxed);
+  mStats.translated.fetch_add(1, std::memory_order::relaxed);
+  mStats.inFlight.fetch_sub(1, std::memory_order::relaxed);
+
+  {
+    std::lock_guard lock(mDoneMtx);
+    job.done.store(true, std::memory_order::release);
+  }
+
+  mDoneCv.notify_all();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "shader/GcnConverter.hpp"
+#include "shader/SemanticInfo.hpp"
+#include "shader/SpvConverter.hpp"
+#include "shader/gcn.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace amdgpu {
+struct Device;
+
+struct TranslatedShader {
+  shader::gcn::ConvertedShader converted;
+  std::uint64_t magic = 0;
+  std::vector<std::pair<std::uint64_t, std::vector<std::byte>>> usedMemory;
+};
+
+struct ShaderTranslationKey {
+  int vmId;
+  std::uint64_t address;
+  shader::gcn::Stage stage;
+  std::uint64_t envKey;
+  std::vector<std::uint32_t> userSgprs;
+
+  auto operator<=>(const ShaderTranslationKey &) const = default;
+};
+
+// Owns a private copy of the builtin semantic, translation is safe to run on
+// any number of threads as long as every thread uses its own context
+struct ShaderTranslationContext {
+  shader::SemanticInfo semantic;
+  shader::spv::Context semanticContext;
+  shader::gcn::SemanticModuleInfo semanticModuleInfo;
+
+  ShaderTranslationContext();
+  ShaderTranslationContext(const ShaderTranslationContext &) = delete;
+};
+
+std::optional<TranslatedShader>
+translateShader(Device *device, const shader::SemanticInfo &semantic,
+                const shader::gcn::SemanticModuleInfo &semanticModuleInfo,
+                int vmId, std::uint64_t address, shader::gcn::Stage stage,
+                const shader::gcn::Environment &env);
+
+class ShaderTranslator {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Job {
+    ShaderTranslationKey key;
+    shader::gcn::Environment env;
+    clock::time_point enqueueTime;
+
+    // finished job is dropped if it is not requested again until this point,
+    // guarded by mJobsMtx
+    clock::time_point expireTime;
+
+    std::optional<TranslatedShader> result;
+    std::atomic<bool> done{false};
+  };
+
+  static constexpr std::size_t kLatencyBucketCount = 32;
+
+  // time a finished job waits for the caller which skipped it
+  static constexpr auto kUnclaimedJobLifetime = std::chrono::seconds(1);
+
+  struct Stats {
+    std::atomic<std::uint64_t> queued{0};
+    std::atomic<std::uint64_t> inFlight{0};
+    std::atomic<std::uint64_t> translated{0};
+    std::atomic<std::uint64_t> deduplicated{0};
+    std::atomic<std::uint64_t> stolen{0};
+    std::atomic<std::uint64_t> skippedDraws{0};
+    std::atomic<std::uint64_t> staleResults{0};
+    std::atomic<std::uint64_t> expiredJobs{0};
+
+    // log2 histogram of enqueue to completion time in microseconds
+    std::array<std::atomic<std::uint64_t>, kLatencyBucketCount> latency{};
+
+    std::chrono::microseconds getLatencyPercentile(double percentile) const;
+  };
+
+  explicit ShaderTranslator(Device *device) : mDevice(device) {}
+  ShaderTranslator(const ShaderTranslator &) = delete;
+  ~ShaderTranslator();
+
+  ///
+  /// \brief Returns pending or finished translation job for the shader.
+  ///
+  /// Requests with the same key share a single job.
+  ///
+  std::shared_ptr<Job> enqueue(int vmId, std::uint64_t address,
+                               shader::gcn::Stage stage,
+                               const shader::gcn::Environment &env);
+
+  ///
+  /// \brief Waits for job completion until deadline.
+  ///
+  /// \returns true if job is finished
+  ///
+  bool wait(Job &job, clock::time_point deadline);
+
+  ///
+  /// \brief Forget finished job, next enqueue with the same key starts a new
+  /// translation.
+  ///
+  void release(const std::shared_ptr<Job> &job);
+
+  Stats &getStats() { return mStats; }
+  void printStats();
+
+private:
+  struct Worker {
+    std::mutex mtx;
+    std::deque<std::shared_ptr<Job>> queue;
+    std::jthread thread;
+  };
+
+  void start();
+  void workerEntry(std::size_t index, const std::stop_token &stopToken);
+  std::shared_ptr<Job> popJob(std::size_t index);
+  void reapExpiredJobs(clock::time_point now);
+  void execute(ShaderTranslationContext &context, Job &job);
+
+  Device *mDevice;
+  std::once_flag mStartFlag;
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  std::atomic<std::size_t> mNextWorker{0};
+
+  std::mutex mJobsMtx;
+  std::map<ShaderTranslationKey, std::shared_ptr<Job>> mJobs;
+
+  std::mutex mWakeMtx;
+  std::condition_variable_any mWakeCv;
+  std::uint64_t mPendingCount = 0;
+
+  std::mutex mDoneMtx;
+  std::condition_variable mDoneCv;
+
+  Stats mStats;
+};
+} // namespace amdgpu
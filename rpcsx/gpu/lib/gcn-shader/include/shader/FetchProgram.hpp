@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Evaluator.hpp"
+#include "eval.hpp"
+#include "ir/Value.hpp"
+#include "rx/FunctionRef.hpp"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace shader::gcn {
+struct Resources;
+
+///
+/// \brief Flat form of the expressions of resource descriptors.
+///
+/// Expression trees of the resource words are compiled once, when shader is
+/// translated. Every draw executes the steps in order on a register file,
+/// without walking the IR and without memoization of values.
+///
+struct FetchProgram {
+  static constexpr std::uint32_t kNoRegister = ~static_cast<std::uint32_t>(0);
+
+  enum class Op : std::uint8_t {
+    UserSgpr,
+    Imm,
+    Pointer,
+    Add,
+    Sub,
+    And,
+    Or,
+    Xor,
+    Shl,
+    Shr,
+    Bitcast,
+    IConvert,
+    Select,
+    CompositeConstruct,
+    CompositeExtract,
+  };
+
+  struct Step {
+    Op op;
+    bool isSigned = false;
+    std::uint32_t result = 0;
+    std::uint32_t firstArg = 0;
+    std::uint32_t argCount = 0;
+    std::uint64_t imm = 0;
+    ir::Value type;
+  };
+
+  using ReadMemory = rx::FunctionRef<void(void *, std::uint64_t, std::size_t)>;
+
+  // initial register file, registers of steps are empty
+  std::vector<eval::Value> constants;
+  std::vector<Step> steps;
+  std::vector<std::uint32_t> args;
+
+  // registers of the descriptor words in order of the resource lists: base and
+  // offset of each pointer, 4 words of each buffer, 8 words of each image
+  // buffer and texture, 4 words of each sampler
+  std::vector<std::uint32_t> outputs;
+
+  // false if some expression is not supported, resources should be evaluated
+  // from the IR
+  bool valid = false;
+
+  static FetchProgram compile(const Resources &resources);
+
+  void run(std::vector<eval::Value> &registers,
+           std::span<const std::uint32_t> userSgprs,
+           ReadMemory readMemory) const;
+};
+
+///
+/// \brief Evaluates the expressions of resource descriptors from the IR.
+///
+/// Used for shaders without a valid fetch program, results of both must be
+/// equal.
+///
+struct ResourceEvaluator : eval::Evaluator {
+  std::span<const std::uint32_t> userSgprs;
+
+  using Evaluator::eval;
+
+  eval::Value eval(ir::Value op) override;
+  eval::Value eval(ir::InstructionId instId,
+                   std::span<const ir::Operand> operands) override;
+
+protected:
+  virtual void readMemory(void *dst, std::uint64_t address,
+                          std::size_t size) = 0;
+
+private:
+  template <typename T> eval::Value readPointer(std::uint64_t address) {
+    T result{};
+    readMemory(&result, address, sizeof(result));
+    return result;
+  }
+};
+} // namespace shader::gcn
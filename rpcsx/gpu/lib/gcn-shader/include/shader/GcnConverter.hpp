@@ -1,5 +1,6 @@
 #pragma once
 
+#include "FetchProgram.hpp"
 #include "gcn.hpp"
 #include "rx/MemoryTable.hpp"
 #include <cstdint>
@@ -176,6 +177,9 @@ struct Resources {
   std::vector<ImageBuffer> imageBuffers;
   std::vector<Sampler> samplers;
 
+  // compiled expressions of the descriptor words above
+  FetchProgram fetch;
+
   void print(std::ostream &os, ir::NameStorage &ns) const;
   void dump();
 };
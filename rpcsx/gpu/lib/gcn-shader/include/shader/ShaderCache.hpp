@@ -0,0 +1,137 @@
+#pragma once
+
+#include "GcnConverter.hpp"
+#include "gcn.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace shader::gcn {
+///
+/// \brief Serialize shader info into a flat byte stream.
+///
+/// Resource descriptor expressions are stored as a flat list of IR values.
+///
+/// \returns serialized data, or std::nullopt if the resources reference IR
+/// that cannot be persisted (blocks, memory SSA nodes)
+///
+std::optional<std::vector<std::byte>>
+serializeShaderInfo(const ShaderInfo &info);
+
+///
+/// \brief Deserialize shader info produced by serializeShaderInfo.
+///
+/// \returns the restored shader info, or std::nullopt if data is malformed
+///
+std::optional<ShaderInfo> deserializeShaderInfo(std::span<const std::byte> data);
+
+///
+/// \brief Persistent content-addressed cache of translated GCN shaders.
+///
+/// Entries are grouped into bucket files by stage, environment, address and
+/// the first code qword. Every entry stores a copy of all guest memory that
+/// was read during translation, entry is reused only if that memory and the
+/// required user SGPRs are still identical.
+///
+class ShaderCache {
+public:
+  static constexpr std::uint32_t kMagic = 0x43535852; // RXSC
+
+  // fingerprint covers only this version and the semantic module, it must be
+  // bumped on every change of the converter output or of the record format
+  static constexpr std::uint32_t kVersion = 1;
+
+  using ReadMemoryFn = std::function<std::uint32_t(std::uint64_t)>;
+
+  struct Record {
+    Stage stage = Stage::Invalid;
+    std::uint64_t address = 0;
+    std::uint64_t envKey = 0;
+    std::vector<std::pair<int, std::uint32_t>> requiredSgprs;
+    std::vector<std::pair<std::uint64_t, std::vector<std::uint32_t>>> memory;
+    std::vector<std::uint32_t> spv;
+    std::vector<std::byte> info;
+  };
+
+  struct Stats {
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> stores{0};
+    std::atomic<std::uint64_t> rejected{0};
+  };
+
+  ShaderCache() = default;
+  ShaderCache(const ShaderCache &) = delete;
+  ShaderCache &operator=(const ShaderCache &) = delete;
+
+  ///
+  /// \brief Open cache directory.
+  ///
+  /// \param root directory with cache bucket files, created if missing
+  /// \param semantic builtin semantic module, part of the cache fingerprint
+  ///
+  bool open(const std::filesystem::path &root,
+            std::span<const std::uint32_t> semantic);
+  [[nodiscard]] bool isOpen() const { return !mRoot.empty(); }
+  [[nodiscard]] const std::filesystem::path &getRoot() const { return mRoot; }
+  [[nodiscard]] std::uint64_t getFingerprint() const { return mFingerprint; }
+
+  std::optional<ConvertedShader> find(Stage stage, const Environment &env,
+                                      std::uint64_t address,
+                                      const ReadMemoryFn &readMemory);
+
+  void store(Stage stage, const Environment &env, std::uint64_t address,
+             const ConvertedShader &shader, const ReadMemoryFn &readMemory);
+
+  [[nodiscard]] const Stats &getStats() const { return mStats; }
+
+  static std::uint64_t getEnvironmentKey(const Environment &env);
+
+  ///
+  /// \brief Read all records of bucket file.
+  ///
+  /// Records with broken checksum are skipped and counted in brokenCount.
+  /// validSize receives the end of the last complete record, data after it
+  /// is a truncated tail and must be dropped before appending.
+  ///
+  /// \returns std::nullopt if file cannot be read or was produced by a
+  /// different cache version/fingerprint
+  ///
+  static std::optional<std::vector<Record>>
+  readBucket(const std::filesystem::path &path, std::uint64_t fingerprint,
+             std::size_t *brokenCount = nullptr,
+             std::uint64_t *validSize = nullptr);
+
+  static bool writeBucket(const std::filesystem::path &path,
+                          std::uint64_t fingerprint,
+                          std::span<const Record> records);
+
+private:
+  struct Bucket {
+    std::vector<Record> records;
+
+    // size of the valid part of the file, zero if file has no valid header
+    std::uint64_t fileSize = 0;
+  };
+
+  std::uint64_t getBucketId(Stage stage, std::uint64_t envKey,
+                            std::uint64_t address,
+                            const ReadMemoryFn &readMemory) const;
+  std::filesystem::path getBucketPath(std::uint64_t bucketId) const;
+  Bucket &getBucket(std::uint64_t bucketId);
+
+  std::filesystem::path mRoot;
+  std::uint64_t mFingerprint = 0;
+  std::mutex mMtx;
+  std::map<std::uint64_t, Bucket> mBuckets;
+  Stats mStats;
+};
+} // namespace shader::gcn
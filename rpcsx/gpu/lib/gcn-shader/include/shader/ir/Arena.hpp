@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace shader::ir {
+///
+/// \brief Bump allocator for IR objects.
+///
+/// Memory is released only when the arena is destroyed, owner is responsible
+/// for calling destructors of the constructed objects.
+///
+class Arena {
+  static constexpr std::size_t kMinChunkSize = 16 * 1024;
+  static constexpr std::size_t kMaxChunkSize = 1024 * 1024;
+
+  std::vector<std::unique_ptr<std::byte[]>> mChunks;
+  std::byte *mCurrent = nullptr;
+  std::byte *mEnd = nullptr;
+  std::size_t mNextChunkSize = kMinChunkSize;
+  std::size_t mAllocatedBytes = 0;
+  std::size_t mReservedBytes = 0;
+
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena(Arena &&other) noexcept
+      : mChunks(std::move(other.mChunks)),
+        mCurrent(std::exchange(other.mCurrent, nullptr)),
+        mEnd(std::exchange(other.mEnd, nullptr)),
+        mNextChunkSize(std::exchange(other.mNextChunkSize, kMinChunkSize)),
+        mAllocatedBytes(std::exchange(other.mAllocatedBytes, 0)),
+        mReservedBytes(std::exchange(other.mReservedBytes, 0)) {
+    other.mChunks.clear();
+  }
+
+  Arena &operator=(Arena &&other) noexcept {
+    if (this != &other) {
+      mChunks = std::move(other.mChunks);
+      other.mChunks.clear();
+      mCurrent = std::exchange(other.mCurrent, nullptr);
+      mEnd = std::exchange(other.mEnd, nullptr);
+      mNextChunkSize = std::exchange(other.mNextChunkSize, kMinChunkSize);
+      mAllocatedBytes = std::exchange(other.mAllocatedBytes, 0);
+      mReservedBytes = std::exchange(other.mReservedBytes, 0);
+    }
+
+    return *this;
+  }
+
+  void *allocate(std::size_t size, std::size_t alignment) {
+    auto space = static_cast<std::size_t>(mEnd - mCurrent);
+    void *result = mCurrent;
+
+    if (mCurrent == nullptr ||
+        std::align(alignment, size, result, space) == nullptr) {
+      result = allocateChunk(size, alignment);
+    }
+
+    mCurrent = static_cast<std::byte *>(result) + size;
+    mAllocatedBytes += size;
+    return result;
+  }
+
+  template <typename T, typename... ArgsT> T *construct(ArgsT &&...args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<ArgsT>(args)...);
+  }
+
+  [[nodiscard]] std::size_t getAllocatedBytes() const {
+    return mAllocatedBytes;
+  }
+
+  [[nodiscard]] std::size_t getReservedBytes() const {
+    return mReservedBytes;
+  }
+
+private:
+  void *allocateChunk(std::size_t size, std::size_t alignment) {
+    auto chunkSize = std::max(mNextChunkSize, size + alignment);
+    auto &chunk = mChunks.emplace_back(new std::byte[chunkSize]);
+    mNextChunkSize = std::min(mNextChunkSize * 2, kMaxChunkSize);
+    mReservedBytes += chunkSize;
+
+    void *result = chunk.get();
+    auto space = chunkSize;
+    std::align(alignment, size, result, space);
+    mEnd = chunk.get() + chunkSize;
+    return result;
+  }
+};
+} // namespace shader::ir
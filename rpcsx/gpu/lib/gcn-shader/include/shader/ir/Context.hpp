@@ -1,14 +1,15 @@
 #pragma once
 
+#include "Arena.hpp"
 #include "Location.hpp"
 #include "NodeImpl.hpp"
 #include "Operand.hpp"
 
-#include <forward_list>
-#include <memory>
+#include <cstddef>
 #include <set>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace shader::ir {
 struct UniqPtrCompare {
@@ -19,16 +20,53 @@ struct UniqPtrCompare {
   }
 };
 
+struct InstructionImpl;
+struct ValueImpl;
+
 class Context {
-  std::forward_list<std::unique_ptr<NodeImpl>> mNodes;
-  std::set<std::unique_ptr<LocationImpl>, UniqPtrCompare> mLocations;
-  std::unique_ptr<UnknownLocationImpl> mUnknownLocation;
+  // nodes are allocated in typed slabs, values and instructions are walked
+  // much more often than other nodes
+  Arena mValueArena;
+  Arena mInstructionArena;
+  Arena mNodeArena;
+  Arena mLocationArena;
+  std::vector<NodeImpl *> mNodes;
+  std::set<LocationImpl *, UniqPtrCompare> mLocations;
+  UnknownLocationImpl *mUnknownLocation = nullptr;
 
 public:
   Context() = default;
   Context(const Context &) = delete;
-  Context(Context &&) = default;
-  Context &operator=(Context &&) = default;
+  Context(Context &&other) noexcept
+      : mValueArena(std::move(other.mValueArena)),
+        mInstructionArena(std::move(other.mInstructionArena)),
+        mNodeArena(std::move(other.mNodeArena)),
+        mLocationArena(std::move(other.mLocationArena)),
+        mNodes(std::move(other.mNodes)),
+        mLocations(std::move(other.mLocations)),
+        mUnknownLocation(std::exchange(other.mUnknownLocation, nullptr)) {
+    other.mNodes.clear();
+    other.mLocations.clear();
+  }
+
+  Context &operator=(Context &&other) noexcept {
+    if (this != &other) {
+      clear();
+      mValueArena = std::move(other.mValueArena);
+      mInstructionArena = std::move(other.mInstructionArena);
+      mNodeArena = std::move(other.mNodeArena);
+      mLocationArena = std::move(other.mLocationArena);
+      mNodes = std::move(other.mNodes);
+      mLocations = std::move(other.mLocations);
+      mUnknownLocation = std::exchange(other.mUnknownLocation, nullptr);
+      other.mNodes.clear();
+      other.mLocations.clear();
+    }
+
+    return *this;
+  }
+
+  ~Context() { clear(); }
 
   template <typename T, typename... ArgsT>
     requires requires {
@@ -37,8 +75,11 @@ public:
       requires std::is_base_of_v<NodeImpl, typename T::underlying_type>;
     }
   T create(ArgsT &&...args) {
-    auto result = new typename T::underlying_type(std::forward<ArgsT>(args)...);
-    mNodes.emplace_front(std::unique_ptr<NodeImpl>{result});
+    using ImplT = typename T::underlying_type;
+    auto result =
+        getNodeArena<ImplT>().template construct<ImplT>(
+            std::forward<ArgsT>(args)...);
+    mNodes.push_back(result);
     return T(result);
   }
 
@@ -49,10 +90,25 @@ public:
       requires std::is_base_of_v<LocationImpl, typename T::underlying_type>;
     }
   T getLocation(ArgsT &&...args) {
-    auto result = std::make_unique<typename T::underlying_type>(
-        std::forward<ArgsT>(args)...);
-    auto ptr = mLocations.insert(std::move(result)).first->get();
-    return T(static_cast<typename T::underlying_type *>(ptr));
+    using ImplT = typename T::underlying_type;
+    ImplT location(std::forward<ArgsT>(args)...);
+
+    if (auto it = mLocations.find(&location); it != mLocations.end()) {
+      return T(static_cast<ImplT *>(*it));
+    }
+
+    auto result = mLocationArena.construct<ImplT>(std::move(location));
+    mLocations.insert(result);
+    return T(result);
+  }
+
+  ///
+  /// \brief Returns count of bytes used by nodes and locations.
+  ///
+  [[nodiscard]] std::size_t getAllocatedBytes() const {
+    return mValueArena.getAllocatedBytes() +
+           mInstructionArena.getAllocatedBytes() +
+           mNodeArena.getAllocatedBytes() + mLocationArena.getAllocatedBytes();
   }
 
   PathLocation getPathLocation(std::string path) {
@@ -76,9 +132,39 @@ public:
   }
   UnknownLocation getUnknownLocation() {
     if (mUnknownLocation == nullptr) {
-      mUnknownLocation = std::make_unique<UnknownLocationImpl>();
+      mUnknownLocation = mLocationArena.construct<UnknownLocationImpl>();
+    }
+    return mUnknownLocation;
+  }
+
+private:
+  template <typename ImplT> Arena &getNodeArena() {
+    if constexpr (std::is_base_of_v<ValueImpl, ImplT>) {
+      return mValueArena;
+    } else if constexpr (std::is_base_of_v<InstructionImpl, ImplT>) {
+      return mInstructionArena;
+    } else {
+      return mNodeArena;
+    }
+  }
+
+  void clear() {
+    // destroy in reverse order of creation, memory is released by arenas
+    for (auto it = mNodes.rbegin(); it != mNodes.rend(); ++it) {
+      (*it)->~NodeImpl();
+    }
+
+    for (auto location : mLocations) {
+      location->~LocationImpl();
     }
-    return mUnknownLocation.get();
+
+    if (mUnknownLocation != nullptr) {
+      mUnknownLocation->~UnknownLocationImpl();
+    }
+
+    mNodes.clear();
+    mLocations.clear();
+    mUnknownLocation = nullptr;
   }
 };
 } // namespace shader::ir
@@ -0,0 +1,466 @@
+#include "FetchProgram.hpp"
+#include "Evaluator.hpp"
+#include "GcnConverter.hpp"
+#include "dialect.hpp"
+#include "rx/die.hpp"
+#include <array>
+#include <map>
+
+using namespace shader;
+
+namespace {
+// largest composite of the evaluator values
+constexpr std::size_t kMaxCompositeSize = 16;
+
+struct FetchCompiler {
+  gcn::FetchProgram &program;
+  std::map<ir::Value, std::uint32_t> registers;
+  eval::Evaluator constEvaluator;
+
+  std::uint32_t createRegister(eval::Value value = {}) {
+    program.constants.push_back(std::move(value));
+    return program.constants.size() - 1;
+  }
+
+  std::uint32_t createConstant(eval::Value value) {
+    if (value.empty()) {
+      return gcn::FetchProgram::kNoRegister;
+    }
+
+    return createRegister(std::move(value));
+  }
+
+  std::uint32_t createStep(gcn::FetchProgram::Step step,
+                           std::span<const std::uint32_t> args) {
+    for (auto arg : args) {
+      if (arg == gcn::FetchProgram::kNoRegister) {
+        return gcn::FetchProgram::kNoRegister;
+      }
+    }
+
+    step.result = createRegister();
+    step.firstArg = program.args.size();
+    step.argCount = args.size();
+    program.args.insert(program.args.end(), args.begin(), args.end());
+    program.steps.push_back(step);
+    return step.result;
+  }
+
+  std::uint32_t compile(const ir::Operand &op) {
+    if (auto value = op.getAsValue()) {
+      return compile(value);
+    }
+
+    return createConstant(constEvaluator.eval(op));
+  }
+
+  std::uint32_t compile(ir::Value value) {
+    if (value == nullptr) {
+      return gcn::FetchProgram::kNoRegister;
+    }
+
+    if (auto it = registers.find(value); it != registers.end()) {
+      return it->second;
+    }
+
+    auto result = compileImpl(value);
+    registers.emplace(value, result);
+    return result;
+  }
+
+  std::uint32_t compileBinary(gcn::FetchProgram::Op op, ir::Value value) {
+    std::array args{compile(value.getOperand(1)),
+                    compile(value.getOperand(2))};
+    return createStep({.op = op}, args);
+  }
+
+  std::uint32_t compileImpl(ir::Value value) {
+    using Op = gcn::FetchProgram::Op;
+    auto instId = value.getInstId();
+
+    if (instId == ir::amdgpu::USER_SGPR) {
+      return createStep({.op = Op::UserSgpr,
+                         .imm = static_cast<std::uint32_t>(
+                             *value.getOperand(1).getAsInt32())},
+                        {});
+    }
+
+    if (instId == ir::amdgpu::IMM) {
+      return createStep({.op = Op::Imm,
+                         .imm = static_cast<std::uint64_t>(
+                             *value.getOperand(1).getAsInt64())},
+                        {});
+    }
+
+    if (instId == ir::amdgpu::POINTER) {
+      auto loadSize = *value.getOperand(1).getAsInt32();
+
+      switch (loadSize) {
+      case 1:
+      case 2:
+      case 4:
+      case 8:
+      case 12:
+      case 16:
+      case 32:
+      case 64:
+        break;
+
+      default:
+        return gcn::FetchProgram::kNoRegister;
+      }
+
+      std::array args{compile(value.getOperand(2)),
+                      compile(value.getOperand(3))};
+      return createStep(
+          {.op = Op::Pointer, .imm = static_cast<std::uint64_t>(loadSize)},
+          args);
+    }
+
+    if (instId == ir::spv::OpConstant) {
+      return createConstant(constEvaluator.eval(value));
+    }
+
+    if (instId == ir::sop2::ADD_U32 || instId == ir::sop2::ADDC_U32 ||
+        instId == ir::spv::OpIAdd) {
+      return compileBinary(Op::Add, value);
+    }
+
+    if (instId == ir::spv::OpISub) {
+      return compileBinary(Op::Sub, value);
+    }
+
+    if (instId == ir::spv::OpBitwiseAnd) {
+      return compileBinary(Op::And, value);
+    }
+
+    if (instId == ir::spv::OpBitwiseOr) {
+      return compileBinary(Op::Or, value);
+    }
+
+    if (instId == ir::spv::OpBitwiseXor) {
+      return compileBinary(Op::Xor, value);
+    }
+
+    if (instId == ir::spv::OpShiftLeftLogical) {
+      return compileBinary(Op::Shl, value);
+    }
+
+    if (instId == ir::spv::OpShiftRightLogical ||
+        instId == ir::spv::OpShiftRightArithmetic) {
+      return compileBinary(Op::Shr, value);
+    }
+
+    if (instId == ir::spv::OpBitcast) {
+      std::array args{compile(value.getOperand(1))};
+      return createStep(
+          {.op = Op::Bitcast, .type = value.getOperand(0).getAsValue()}, args);
+    }
+
+    if (instId == ir::spv::OpSConvert || instId == ir::spv::OpUConvert) {
+      std::array args{compile(value.getOperand(1))};
+      return createStep({.op = Op::IConvert,
+                         .isSigned = instId == ir::spv::OpSConvert,
+                         .type = value.getOperand(0).getAsValue()},
+                        args);
+    }
+
+    if (instId == ir::spv::OpSelect) {
+      std::array args{compile(value.getOperand(1)),
+                      compile(value.getOperand(2)),
+                      compile(value.getOperand(3))};
+      return createStep({.op = Op::Select}, args);
+    }
+
+    if (instId == ir::spv::OpCompositeConstruct) {
+      if (value.getOperandCount() - 1 > kMaxCompositeSize) {
+        return gcn::FetchProgram::kNoRegister;
+      }
+
+      std::vector<std::uint32_t> args;
+      args.reserve(value.getOperandCount() - 1);
+      for (auto &op : value.getOperands().subspan(1)) {
+        args.push_back(compile(op));
+      }
+
+      return createStep({.op = Op::CompositeConstruct,
+                         .type = value.getOperand(0).getAsValue()},
+                        args);
+    }
+
+    if (instId == ir::spv::OpCompositeExtract) {
+      if (value.getOperandCount() != 3) {
+        return gcn::FetchProgram::kNoRegister;
+      }
+
+      std::array args{compile(value.getOperand(1)),
+                      compile(value.getOperand(2))};
+      return createStep({.op = Op::CompositeExtract}, args);
+    }
+
+    return gcn::FetchProgram::kNoRegister;
+  }
+
+  void addOutput(ir::Value value, bool optional = false) {
+    if (value == nullptr && optional) {
+      program.outputs.push_back(gcn::FetchProgram::kNoRegister);
+      return;
+    }
+
+    auto reg = compile(value);
+    if (reg == gcn::FetchProgram::kNoRegister) {
+      program.valid = false;
+    }
+
+    program.outputs.push_back(reg);
+  }
+};
+
+template <typename T>
+eval::Value load(gcn::FetchProgram::ReadMemory readMemory,
+                 std::uint64_t address) {
+  T result{};
+  readMemory(&result, address, sizeof(result));
+  return result;
+}
+} // namespace
+
+gcn::FetchProgram gcn::FetchProgram::compile(const Resources &resources) {
+  FetchProgram result;
+  result.valid = true;
+
+  FetchCompiler compiler{.program = result};
+
+  for (auto &pointer : resources.pointers) {
+    compiler.addOutput(pointer.base);
+    compiler.addOutput(pointer.offset);
+  }
+
+  for (auto &buffer : resources.buffers) {
+    for (auto word : buffer.words) {
+      compiler.addOutput(word);
+    }
+  }
+
+  for (auto &imageBuffer : resources.imageBuffers) {
+    for (std::size_t i = 0; auto word : imageBuffer.words) {
+      compiler.addOutput(word, i++ >= 4);
+    }
+  }
+
+  for (auto &texture : resources.textures) {
+    for (std::size_t i = 0; auto word : texture.words) {
+      compiler.addOutput(word, i++ >= 4);
+    }
+  }
+
+  for (auto &sampler : resources.samplers) {
+    for (auto word : sampler.words) {
+      compiler.addOutput(word);
+    }
+  }
+
+  if (!result.valid) {
+    return {};
+  }
+
+  return result;
+}
+
+void gcn::FetchProgram::run(std::vector<eval::Value> &registers,
+                            std::span<const std::uint32_t> userSgprs,
+                            ReadMemory readMemory) const {
+  registers.assign(constants.begin(), constants.end());
+
+  for (auto &step : steps) {
+    auto args = std::span(this->args).subspan(step.firstArg, step.argCount);
+    auto &result = registers[step.result];
+
+    switch (step.op) {
+    case Op::UserSgpr:
+      rx::dieIf(step.imm >= userSgprs.size(), "out of user sgprs");
+      result = userSgprs[step.imm];
+      break;
+
+    case Op::Imm: {
+      std::uint32_t value;
+      readMemory(&value, step.imm, sizeof(value));
+      result = value;
+      break;
+    }
+
+    case Op::Pointer: {
+      auto base = registers[args[0]].zExtScalar();
+      auto offset = registers[args[1]].zExtScalar();
+
+      if (!base || !offset) {
+        rx::die("failed to evaluate pointer dependency");
+      }
+
+      auto address = *base + *offset;
+
+      switch (step.imm) {
+      case 1:
+        result = load<std::uint8_t>(readMemory, address);
+        break;
+      case 2:
+        result = load<std::uint16_t>(readMemory, address);
+        break;
+      case 4:
+        result = load<std::uint32_t>(readMemory, address);
+        break;
+      case 8:
+        result = load<std::uint64_t>(readMemory, address);
+        break;
+      case 12:
+        result = load<u32vec3>(readMemory, address);
+        break;
+      case 16:
+        result = load<u32vec4>(readMemory, address);
+        break;
+      case 32:
+        result = load<std::array<std::uint32_t, 8>>(readMemory, address);
+        break;
+      case 64:
+        result = load<std::array<std::uint32_t, 16>>(readMemory, address);
+        break;
+      }
+      break;
+    }
+
+    case Op::Add:
+      result = registers[args[0]] + registers[args[1]];
+      break;
+    case Op::Sub:
+      result = registers[args[0]] - registers[args[1]];
+      break;
+    case Op::And:
+      result = registers[args[0]] & registers[args[1]];
+      break;
+    case Op::Or:
+      result = registers[args[0]] | registers[args[1]];
+      break;
+    case Op::Xor:
+      result = registers[args[0]] ^ registers[args[1]];
+      break;
+    case Op::Shl:
+      result = registers[args[0]] << registers[args[1]];
+      break;
+    case Op::Shr:
+      result = registers[args[0]] >> registers[args[1]];
+      break;
+
+    case Op::Bitcast:
+      result = registers[args[0]].bitcast(step.type);
+      break;
+
+    case Op::IConvert:
+      if (registers[args[0]]) {
+        result = registers[args[0]].iConvert(step.type, step.isSigned);
+      } else {
+        result = {};
+      }
+      break;
+
+    case Op::Select:
+      result = registers[args[0]].select(registers[args[1]],
+                                         registers[args[2]]);
+      break;
+
+    case Op::CompositeConstruct: {
+      eval::Value constituents[kMaxCompositeSize];
+      for (std::size_t i = 0; i < args.size(); ++i) {
+        constituents[i] = registers[args[i]];
+      }
+      result = eval::Value::compositeConstruct(
+          step.type, std::span(constituents, args.size()));
+      break;
+    }
+
+    case Op::CompositeExtract:
+      if (registers[args[0]].empty()) {
+        result = {};
+      } else {
+        result = registers[args[0]].compositeExtract(registers[args[1]]);
+      }
+      break;
+    }
+  }
+}
+
+eval::Value gcn::ResourceEvaluator::eval(ir::Value op) {
+  if (op == ir::sop2::ADD_U32 || op == ir::sop2::ADDC_U32) {
+    return eval(op.getOperand(1)) + eval(op.getOperand(2));
+  }
+
+  return Evaluator::eval(op);
+}
+
+eval::Value
+gcn::ResourceEvaluator::eval(ir::InstructionId instId,
+                             std::span<const ir::Operand> operands) {
+  if (instId == ir::amdgpu::POINTER) {
+    auto loadSize = *operands[1].getAsInt32();
+    auto base = eval(operands[2]).zExtScalar();
+    auto offset = eval(operands[3]).zExtScalar();
+
+    if (!base || !offset) {
+      rx::die("failed to evaluate pointer dependency");
+    }
+
+    auto address = *base + *offset;
+
+    switch (loadSize) {
+    case 1:
+      return readPointer<std::uint8_t>(address);
+    case 2:
+      return readPointer<std::uint16_t>(address);
+    case 4:
+      return readPointer<std::uint32_t>(address);
+    case 8:
+      return readPointer<std::uint64_t>(address);
+    case 12:
+      return readPointer<u32vec3>(address);
+    case 16:
+      return readPointer<u32vec4>(address);
+    case 32:
+      return readPointer<std::array<std::uint32_t, 8>>(address);
+    case 64:
+      return readPointer<std::array<std::uint32_t, 16>>(address);
+    default:
+      rx::die("unexpected pointer load size {}", loadSize);
+    }
+  }
+
+  if (instId == ir::amdgpu::VBUFFER) {
+    rx::die("resource depends on buffer value");
+  }
+
+  if (instId == ir::amdgpu::TBUFFER) {
+    rx::die("resource depends on texture value");
+  }
+
+  if (instId == ir::amdgpu::IMAGE_BUFFER) {
+    rx::die("resource depends on image buffer value");
+  }
+
+  if (instId == ir::amdgpu::SAMPLER) {
+    rx::die("resource depends on sampler value");
+  }
+
+  if (instId == ir::amdgpu::USER_SGPR) {
+    auto index = static_cast<std::uint32_t>(*operands[1].getAsInt32());
+    rx::dieIf(index >= userSgprs.size(), "out of user sgprs");
+    return userSgprs[index];
+  }
+
+  if (instId == ir::amdgpu::IMM) {
+    auto address = static_cast<std::uint64_t>(*operands[1].getAsInt64());
+
+    std::uint32_t result;
+    readMemory(&result, address, sizeof(result));
+    return result;
+  }
+
+  return Evaluator::eval(instId, operands);
+}
@@ -1270,6 +1270,7 @@ static void instructionsToSpv(GcnConverter &converter, gcn::Import &importer,
     }
 
     info.resources = std::move(resourcesBuilder.resources);
+    info.resources.fetch = gcn::FetchProgram::compile(info.resources);
   }
 
   for (auto inst : body.children()) {
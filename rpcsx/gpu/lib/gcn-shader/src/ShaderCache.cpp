@@ -0,0 +1,832 @@
+#include "ShaderCache.hpp"
+#include "dialect.hpp"
+#include "ir.hpp"
+#include "rx/Serializer.hpp"
+#include "rx/format.hpp"
+#include "rx/hash.hpp"
+#include "rx/print.hpp"
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <unordered_map>
+
+using namespace shader;
+
+namespace {
+struct ByteSerializer : rx::Serializer {
+  std::vector<std::byte> data;
+
+  void write(std::span<const std::byte> bytes) override {
+    data.insert(data.end(), bytes.begin(), bytes.end());
+  }
+};
+
+struct ByteDeserializer : rx::Deserializer {
+  std::span<const std::byte> data;
+
+  explicit ByteDeserializer(std::span<const std::byte> data) : data(data) {}
+
+  void read(std::span<std::byte> bytes) override {
+    if (failure() || bytes.size() > data.size()) {
+      setFailure();
+      std::memset(bytes.data(), 0, bytes.size());
+      return;
+    }
+
+    std::memcpy(bytes.data(), data.data(), bytes.size());
+    data = data.subspan(bytes.size());
+  }
+};
+
+enum class OperandTag : std::uint8_t {
+  Null,
+  Value,
+  Int64,
+  Int32,
+  Double,
+  Float,
+  Bool,
+  String,
+};
+
+constexpr std::uint32_t kNullValue = ~static_cast<std::uint32_t>(0);
+
+// Flattens resource expressions into an index addressable list of values
+struct ValueTableWriter {
+  std::vector<ir::Value> values;
+  std::unordered_map<ir::ValueImpl *, std::uint32_t> ids;
+  bool failed = false;
+
+  std::uint32_t add(ir::Value root) {
+    if (root == nullptr) {
+      return kNullValue;
+    }
+
+    if (auto it = ids.find(root.impl); it != ids.end()) {
+      return it->second;
+    }
+
+    std::vector<ir::Value> workList;
+    workList.push_back(root);
+
+    while (!workList.empty()) {
+      auto value = workList.back();
+      workList.pop_back();
+
+      if (ids.contains(value.impl)) {
+        continue;
+      }
+
+      if (value.isa<ir::Block>() || value.getKind() == ir::Kind::MemSSA) {
+        failed = true;
+        return kNullValue;
+      }
+
+      ids.emplace(value.impl, values.size());
+      values.push_back(value);
+
+      for (auto &operand : value.getOperands()) {
+        if (auto operandValue = operand.getAsValue()) {
+          workList.push_back(operandValue);
+        }
+      }
+    }
+
+    return ids.at(root.impl);
+  }
+
+  void serialize(rx::Serializer &s) const {
+    s.serialize(static_cast<std::uint32_t>(values.size()));
+
+    for (auto value : values) {
+      s.serialize(static_cast<std::uint32_t>(value.getKind()));
+      s.serialize(static_cast<std::uint32_t>(value.getOp()));
+      s.serialize(static_cast<std::uint32_t>(value.getOperandCount()));
+
+      for (auto &operand : value.getOperands()) {
+        serializeOperand(s, operand);
+      }
+    }
+  }
+
+  void serializeOperand(rx::Serializer &s, const ir::Operand &operand) const {
+    if (auto value = operand.getAsValue()) {
+      s.serialize(OperandTag::Value);
+      s.serialize(ids.at(value.impl));
+    } else if (auto value = operand.getAsInt64()) {
+      s.serialize(OperandTag::Int64);
+      s.serialize(*value);
+    } else if (auto value = operand.getAsInt32()) {
+      s.serialize(OperandTag::Int32);
+      s.serialize(*value);
+    } else if (auto value = operand.getAsDouble()) {
+      s.serialize(OperandTag::Double);
+      s.serialize(*value);
+    } else if (auto value = operand.getAsFloat()) {
+      s.serialize(OperandTag::Float);
+      s.serialize(*value);
+    } else if (auto value = operand.getAsBool()) {
+      s.serialize(OperandTag::Bool);
+      s.serialize(*value);
+    } else if (auto value = operand.getAsString()) {
+      s.serialize(OperandTag::String);
+      s.serialize(static_cast<std::uint32_t>(value->size()));
+      s.write({reinterpret_cast<const std::byte *>(value->data()),
+               value->size()});
+    } else {
+      s.serialize(OperandTag::Null);
+    }
+  }
+};
+
+struct ValueTableReader {
+  std::vector<ir::Value> values;
+
+  bool deserialize(rx::Deserializer &d, ir::Context &context) {
+    auto count = d.deserialize<std::uint32_t>();
+    if (d.failure()) {
+      return false;
+    }
+
+    struct PendingOperand {
+      std::uint32_t valueIndex;
+      ir::Operand operand;
+      std::uint32_t ref;
+    };
+
+    std::vector<PendingOperand> operands;
+    auto loc = context.getUnknownLocation();
+
+    values.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+      auto kind = d.deserialize<std::uint32_t>();
+      auto op = d.deserialize<std::uint32_t>();
+      auto operandCount = d.deserialize<std::uint32_t>();
+
+      if (d.failure() || kind >= static_cast<std::uint32_t>(ir::Kind::Count)) {
+        return false;
+      }
+
+      values.push_back(context.create<ir::Value>(
+          loc, static_cast<ir::Kind>(kind), static_cast<unsigned>(op)));
+
+      for (std::uint32_t j = 0; j < operandCount; ++j) {
+        auto &pending = operands.emplace_back(i, ir::Operand{}, kNullValue);
+
+        switch (d.deserialize<OperandTag>()) {
+        case OperandTag::Null:
+          break;
+        case OperandTag::Value:
+          pending.ref = d.deserialize<std::uint32_t>();
+          break;
+        case OperandTag::Int64:
+          pending.operand = d.deserialize<std::int64_t>();
+          break;
+        case OperandTag::Int32:
+          pending.operand = d.deserialize<std::int32_t>();
+          break;
+        case OperandTag::Double:
+          pending.operand = d.deserialize<double>();
+          break;
+        case OperandTag::Float:
+          pending.operand = d.deserialize<float>();
+          break;
+        case OperandTag::Bool:
+          pending.operand = d.deserialize<bool>();
+          break;
+        case OperandTag::String: {
+          auto size = d.deserialize<std::uint32_t>();
+          std::string string(size, '\0');
+          d.read({reinterpret_cast<std::byte *>(string.data()), size});
+          pending.operand = std::move(string);
+          break;
+        }
+        default:
+          return false;
+        }
+
+        if (d.failure()) {
+          return false;
+        }
+      }
+    }
+
+    // operands are attached after all values are created, references can point
+    // forward
+    for (auto &pending : operands) {
+      if (pending.ref != kNullValue) {
+        if (pending.ref >= values.size()) {
+          return false;
+        }
+
+        values[pending.valueIndex].addOperand(values[pending.ref]);
+      } else {
+        values[pending.valueIndex].addOperand(std::move(pending.operand));
+      }
+    }
+
+    return true;
+  }
+
+  std::optional<ir::Value> get(std::uint32_t index) const {
+    if (index == kNullValue) {
+      return ir::Value{};
+    }
+
+    if (index >= values.size()) {
+      return {};
+    }
+
+    return values[index];
+  }
+};
+
+template <std::size_t N>
+void serializeWords(rx::Serializer &s, ValueTableWriter &table,
+                    const ir::Value (&words)[N]) {
+  for (auto word : words) {
+    s.serialize(table.add(word));
+  }
+}
+
+template <std::size_t N>
+bool deserializeWords(rx::Deserializer &d, const ValueTableReader &table,
+                      ir::Value (&words)[N]) {
+  for (auto &word : words) {
+    auto value = table.get(d.deserialize<std::uint32_t>());
+    if (!value) {
+      return false;
+    }
+    word = *value;
+  }
+
+  return !d.failure();
+}
+
+void serializeRecord(rx::Serializer &s, const gcn::ShaderCache::Record &record) {
+  s.serialize(static_cast<std::uint32_t>(record.stage));
+  s.serialize(record.address);
+  s.serialize(record.envKey);
+
+  s.serialize(static_cast<std::uint32_t>(record.requiredSgprs.size()));
+  for (auto [index, value] : record.requiredSgprs) {
+    s.serialize(static_cast<std::int32_t>(index));
+    s.serialize(value);
+  }
+
+  s.serialize(static_cast<std::uint32_t>(record.memory.size()));
+  for (auto &[address, words] : record.memory) {
+    s.serialize(address);
+    s.serialize(words);
+  }
+
+  s.serialize(record.spv);
+  s.serialize(record.info);
+}
+
+gcn::ShaderCache::Record deserializeRecord(rx::Deserializer &d) {
+  gcn::ShaderCache::Record record;
+  record.stage = static_cast<gcn::Stage>(d.deserialize<std::uint32_t>());
+  record.address = d.deserialize<std::uint64_t>();
+  record.envKey = d.deserialize<std::uint64_t>();
+
+  auto sgprCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < sgprCount && !d.failure(); ++i) {
+    auto index = d.deserialize<std::int32_t>();
+    auto value = d.deserialize<std::uint32_t>();
+    record.requiredSgprs.emplace_back(index, value);
+  }
+
+  auto memoryCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < memoryCount && !d.failure(); ++i) {
+    auto address = d.deserialize<std::uint64_t>();
+    auto words = d.deserialize<std::vector<std::uint32_t>>();
+    record.memory.emplace_back(address, std::move(words));
+  }
+
+  record.spv = d.deserialize<std::vector<std::uint32_t>>();
+  record.info = d.deserialize<std::vector<std::byte>>();
+  return record;
+}
+
+struct FileHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t fingerprint;
+};
+
+struct RecordHeader {
+  std::uint32_t size;
+  std::uint32_t checksum;
+};
+
+std::uint32_t computeChecksum(std::span<const std::byte> data) {
+  auto hash = rx::fnv1a64(data);
+  return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+}
+
+bool appendRecord(std::ostream &out, const gcn::ShaderCache::Record &record) {
+  ByteSerializer s;
+  serializeRecord(s, record);
+
+  RecordHeader header{
+      .size = static_cast<std::uint32_t>(s.data.size()),
+      .checksum = computeChecksum(s.data),
+  };
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(s.data.data()), s.data.size());
+  return static_cast<bool>(out);
+}
+} // namespace
+
+std::optional<std::vector<std::byte>>
+gcn::serializeShaderInfo(const ShaderInfo &info) {
+  ByteSerializer s;
+  ValueTableWriter table;
+  ByteSerializer resources;
+
+  auto &res = info.resources;
+  if (res.hasUnknown) {
+    return {};
+  }
+
+  resources.serialize(res.slots);
+
+  resources.serialize(static_cast<std::uint32_t>(res.pointers.size()));
+  for (auto &pointer : res.pointers) {
+    resources.serialize(pointer.resourceSlot);
+    resources.serialize(pointer.size);
+    resources.serialize(table.add(pointer.base));
+    resources.serialize(table.add(pointer.offset));
+  }
+
+  resources.serialize(static_cast<std::uint32_t>(res.buffers.size()));
+  for (auto &buffer : res.buffers) {
+    resources.serialize(buffer.resourceSlot);
+    resources.serialize(buffer.access);
+    serializeWords(resources, table, buffer.words);
+  }
+
+  resources.serialize(static_cast<std::uint32_t>(res.textures.size()));
+  for (auto &texture : res.textures) {
+    resources.serialize(texture.resourceSlot);
+    resources.serialize(texture.access);
+    serializeWords(resources, table, texture.words);
+  }
+
+  resources.serialize(static_cast<std::uint32_t>(res.imageBuffers.size()));
+  for (auto &imageBuffer : res.imageBuffers) {
+    resources.serialize(imageBuffer.resourceSlot);
+    resources.serialize(imageBuffer.access);
+    serializeWords(resources, table, imageBuffer.words);
+  }
+
+  resources.serialize(static_cast<std::uint32_t>(res.samplers.size()));
+  for (auto &sampler : res.samplers) {
+    resources.serialize(sampler.resourceSlot);
+    resources.serialize(sampler.unorm);
+    serializeWords(resources, table, sampler.words);
+  }
+
+  if (table.failed) {
+    return {};
+  }
+
+  s.serialize(static_cast<std::uint32_t>(info.configSlots.size()));
+  for (auto slot : info.configSlots) {
+    s.serialize(slot.type);
+    s.serialize(slot.data);
+  }
+
+  std::uint32_t memoryAreaCount = 0;
+  for (auto area : info.memoryMap) {
+    static_cast<void>(area);
+    memoryAreaCount++;
+  }
+
+  s.serialize(memoryAreaCount);
+  for (auto area : info.memoryMap) {
+    s.serialize(area.beginAddress);
+    s.serialize(area.endAddress);
+  }
+
+  s.serialize(static_cast<std::uint32_t>(info.requiredSgprs.size()));
+  for (auto [index, value] : info.requiredSgprs) {
+    s.serialize(static_cast<std::int32_t>(index));
+    s.serialize(value);
+  }
+
+  table.serialize(s);
+  s.write(resources.data);
+  return std::move(s.data);
+}
+
+std::optional<gcn::ShaderInfo>
+gcn::deserializeShaderInfo(std::span<const std::byte> data) {
+  ByteDeserializer d(data);
+  ShaderInfo info;
+
+  auto configSlotCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < configSlotCount && !d.failure(); ++i) {
+    auto type = d.deserialize<ConfigType>();
+    auto slotData = d.deserialize<std::uint64_t>();
+    info.configSlots.push_back({.type = type, .data = slotData});
+  }
+
+  auto memoryAreaCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < memoryAreaCount && !d.failure(); ++i) {
+    auto beginAddress = d.deserialize<std::uint64_t>();
+    auto endAddress = d.deserialize<std::uint64_t>();
+    info.memoryMap.map(beginAddress, endAddress);
+  }
+
+  auto sgprCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < sgprCount && !d.failure(); ++i) {
+    auto index = d.deserialize<std::int32_t>();
+    auto value = d.deserialize<std::uint32_t>();
+    info.requiredSgprs.emplace_back(index, value);
+  }
+
+  auto &res = info.resources;
+  ValueTableReader table;
+  if (d.failure() || !table.deserialize(d, res.context)) {
+    return {};
+  }
+
+  res.slots = d.deserialize<std::uint32_t>();
+
+  auto pointerCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < pointerCount && !d.failure(); ++i) {
+    auto &pointer = res.pointers.emplace_back();
+    pointer.resourceSlot = d.deserialize<std::uint32_t>();
+    pointer.size = d.deserialize<std::uint32_t>();
+    auto base = table.get(d.deserialize<std::uint32_t>());
+    auto offset = table.get(d.deserialize<std::uint32_t>());
+    if (!base || !offset) {
+      return {};
+    }
+    pointer.base = *base;
+    pointer.offset = *offset;
+  }
+
+  auto bufferCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < bufferCount && !d.failure(); ++i) {
+    auto &buffer = res.buffers.emplace_back();
+    buffer.resourceSlot = d.deserialize<std::uint32_t>();
+    buffer.access = d.deserialize<Access>();
+    if (!deserializeWords(d, table, buffer.words)) {
+      return {};
+    }
+  }
+
+  auto textureCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < textureCount && !d.failure(); ++i) {
+    auto &texture = res.textures.emplace_back();
+    texture.resourceSlot = d.deserialize<std::uint32_t>();
+    texture.access = d.deserialize<Access>();
+    if (!deserializeWords(d, table, texture.words)) {
+      return {};
+    }
+  }
+
+  auto imageBufferCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < imageBufferCount && !d.failure(); ++i) {
+    auto &imageBuffer = res.imageBuffers.emplace_back();
+    imageBuffer.resourceSlot = d.deserialize<std::uint32_t>();
+    imageBuffer.access = d.deserialize<Access>();
+    if (!deserializeWords(d, table, imageBuffer.words)) {
+      return {};
+    }
+  }
+
+  auto samplerCount = d.deserialize<std::uint32_t>();
+  for (std::uint32_t i = 0; i < samplerCount && !d.failure(); ++i) {
+    auto &sampler = res.samplers.emplace_back();
+    sampler.resourceSlot = d.deserialize<std::uint32_t>();
+    sampler.unorm = d.deserialize<bool>();
+    if (!deserializeWords(d, table, sampler.words)) {
+      return {};
+    }
+  }
+
+  if (d.failure() || !d.data.empty()) {
+    return {};
+  }
+
+  // fetch program is derived from the resources and is not stored
+  res.fetch = FetchProgram::compile(res);
+  return std::move(info);
+}
+
+bool gcn::ShaderCache::open(const std::filesystem::path &root,
+                            std::span<const std::uint32_t> semantic) {
+  std::error_code ec;
+  std::filesystem::create_directories(root, ec);
+
+  if (!std::filesystem::is_directory(root, ec)) {
+    rx::println(stderr, "shader cache: failed to open '{}'", root.string());
+    return false;
+  }
+
+  std::lock_guard lock(mMtx);
+  mRoot = root;
+  mFingerprint = rx::fnv1a64Value(kVersion);
+  mFingerprint = rx::fnv1a64(std::as_bytes(semantic), mFingerprint);
+  mBuckets.clear();
+  return true;
+}
+
+std::uint64_t gcn::ShaderCache::getEnvironmentKey(const Environment &env) {
+  std::uint64_t result = 0;
+  result |= static_cast<std::uint64_t>(env.vgprCount);
+  result |= static_cast<std::uint64_t>(env.sgprCount) << 8;
+  result |= static_cast<std::uint64_t>(env.numThreadX) << 16;
+  result |= static_cast<std::uint64_t>(env.numThreadY) << 24;
+  result |= static_cast<std::uint64_t>(env.numThreadZ) << 32;
+  result |= static_cast<std::uint64_t>(env.supportsBarycentric) << 40;
+  result |= static_cast<std::uint64_t>(env.supportsInt8) << 41;
+  result |= static_cast<std::uint64_t>(env.supportsInt64Atomics) << 42;
+  result |= static_cast<std::uint64_t>(env.supportsNonSemanticInfo) << 43;
+  return result;
+}
+
+std::uint64_t
+gcn::ShaderCache::getBucketId(Stage stage, std::uint64_t envKey,
+                              std::uint64_t address,
+                              const ReadMemoryFn &readMemory) const {
+  std::uint32_t magic[2] = {readMemory(address), readMemory(address + 4)};
+
+  auto hash = rx::fnv1a64Value(stage, mFingerprint);
+  hash = rx::fnv1a64Value(envKey, hash);
+  hash = rx::fnv1a64Value(address, hash);
+  hash = rx::fnv1a64Value(magic, hash);
+  return hash;
+}
+
+std::filesystem::path
+gcn::ShaderCache::getBucketPath(std::uint64_t bucketId) const {
+  return mRoot / rx::format("{:016x}.bin", bucketId);
+}
+
+gcn::ShaderCache::Bucket &gcn::ShaderCache::getBucket(std::uint64_t bucketId) {
+  auto [it, inserted] = mBuckets.try_emplace(bucketId);
+
+  if (inserted) {
+    std::size_t brokenCount = 0;
+    std::uint64_t validSize = 0;
+    if (auto records = readBucket(getBucketPath(bucketId), mFingerprint,
+                                  &brokenCount, &validSize)) {
+      it->second.records = std::move(*records);
+      it->second.fileSize = validSize;
+    }
+
+    mStats.rejected.fetch_add(brokenCount, std::memory_order::relaxed);
+  }
+
+  return it->second;
+}
+
+std::optional<gcn::ConvertedShader>
+gcn::ShaderCache::find(Stage stage, const Environment &env,
+                       std::uint64_t address, const ReadMemoryFn &readMemory) {
+  if (!isOpen()) {
+    return {};
+  }
+
+  auto envKey = getEnvironmentKey(env);
+  auto bucketId = getBucketId(stage, envKey, address, readMemory);
+
+  std::lock_guard lock(mMtx);
+  auto &bucket = getBucket(bucketId);
+
+  auto isMatches = [&](const Record &record) {
+    if (record.stage != stage || record.envKey != envKey ||
+        record.address != address) {
+      return false;
+    }
+
+    for (auto [index, sgpr] : record.requiredSgprs) {
+      if (index >= env.userSgprs.size() || env.userSgprs[index] != sgpr) {
+        return false;
+      }
+    }
+
+    for (auto &[beginAddress, words] : record.memory) {
+      for (std::size_t i = 0; i < words.size(); ++i) {
+        if (readMemory(beginAddress + i * sizeof(std::uint32_t)) != words[i]) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  };
+
+  for (auto &record : bucket.records) {
+    if (!isMatches(record)) {
+      continue;
+    }
+
+    auto info = deserializeShaderInfo(record.info);
+    if (!info) {
+      mStats.rejected.fetch_add(1, std::memory_order::relaxed);
+      continue;
+    }
+
+    mStats.hits.fetch_add(1, std::memory_order::relaxed);
+    return ConvertedShader{
+        .spv = record.spv,
+        .info = std::move(*info),
+    };
+  }
+
+  mStats.misses.fetch_add(1, std::memory_order::relaxed);
+  return {};
+}
+
+void gcn::ShaderCache::store(Stage stage, const Environment &env,
+                             std::uint64_t address,
+                             const ConvertedShader &shader,
+                             const ReadMemoryFn &readMemory) {
+  if (!isOpen()) {
+    return;
+  }
+
+  auto info = serializeShaderInfo(shader.info);
+  if (!info) {
+    return;
+  }
+
+  Record record{
+      .stage = stage,
+      .address = address,
+      .envKey = getEnvironmentKey(env),
+      .requiredSgprs = shader.info.requiredSgprs,
+      .spv = shader.spv,
+      .info = std::move(*info),
+  };
+
+  for (auto area : shader.info.memoryMap) {
+    auto &[beginAddress, words] = record.memory.emplace_back();
+    beginAddress = area.beginAddress;
+    words.resize((area.endAddress - area.beginAddress) /
+                 sizeof(std::uint32_t));
+
+    for (std::size_t i = 0; i < words.size(); ++i) {
+      words[i] = readMemory(beginAddress + i * sizeof(std::uint32_t));
+    }
+  }
+
+  auto bucketId = getBucketId(stage, record.envKey, address, readMemory);
+
+  std::lock_guard lock(mMtx);
+  auto &bucket = getBucket(bucketId);
+  auto path = getBucketPath(bucketId);
+
+  bool isNewFile = bucket.fileSize == 0;
+
+  if (!isNewFile) {
+    // records appended after a truncated tail could not be read back
+    std::error_code ec;
+    if (std::filesystem::file_size(path, ec) != bucket.fileSize || ec) {
+      std::filesystem::resize_file(path, bucket.fileSize, ec);
+      if (ec) {
+        rx::println(stderr, "shader cache: failed to truncate '{}'",
+                    path.string());
+        return;
+      }
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary |
+                              (isNewFile ? std::ios::trunc : std::ios::app));
+
+  if (isNewFile) {
+    FileHeader header{
+        .magic = kMagic,
+        .version = kVersion,
+        .fingerprint = mFingerprint,
+    };
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  if (!appendRecord(out, record) || !out.flush()) {
+    rx::println(stderr, "shader cache: failed to write '{}'", path.string());
+    return;
+  }
+
+  bucket.fileSize = static_cast<std::uint64_t>(out.tellp());
+  bucket.records.push_back(std::move(record));
+  mStats.stores.fetch_add(1, std::memory_order::relaxed);
+}
+
+std::optional<std::vector<gcn::ShaderCache::Record>>
+gcn::ShaderCache::readBucket(const std::filesystem::path &path,
+                             std::uint64_t fingerprint,
+                             std::size_t *brokenCount,
+                             std::uint64_t *validSize) {
+  std::error_code ec;
+  auto fileSize = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return {};
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return {};
+  }
+
+  FileHeader header{};
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != kMagic || header.version != kVersion ||
+      header.fingerprint != fingerprint) {
+    return {};
+  }
+
+  std::vector<Record> result;
+  std::vector<std::byte> payload;
+  std::uint64_t end = sizeof(header);
+
+  while (true) {
+    RecordHeader recordHeader{};
+    if (!in.read(reinterpret_cast<char *>(&recordHeader),
+                 sizeof(recordHeader))) {
+      if (in.gcount() != 0 && brokenCount != nullptr) {
+        ++*brokenCount;
+      }
+      break;
+    }
+
+    if (recordHeader.size > fileSize - end - sizeof(recordHeader)) {
+      // truncated tail, likely interrupted write
+      if (brokenCount != nullptr) {
+        ++*brokenCount;
+      }
+      break;
+    }
+
+    payload.resize(recordHeader.size);
+    if (!in.read(reinterpret_cast<char *>(payload.data()), payload.size())) {
+      if (brokenCount != nullptr) {
+        ++*brokenCount;
+      }
+      break;
+    }
+
+    end += sizeof(recordHeader) + payload.size();
+
+    if (computeChecksum(payload) != recordHeader.checksum) {
+      if (brokenCount != nullptr) {
+        ++*brokenCount;
+      }
+      continue;
+    }
+
+    ByteDeserializer d(payload);
+    auto record = deserializeRecord(d);
+    if (d.failure()) {
+      if (brokenCount != nullptr) {
+        ++*brokenCount;
+      }
+      continue;
+    }
+
+    result.push_back(std::move(record));
+  }
+
+  if (validSize != nullptr) {
+    *validSize = end;
+  }
+
+  return result;
+}
+
+bool gcn::ShaderCache::writeBucket(const std::filesystem::path &path,
+                                   std::uint64_t fingerprint,
+                                   std::span<const Record> records) {
+  auto tmpPath = path;
+  tmpPath += ".tmp";
+
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    FileHeader header{
+        .magic = kMagic,
+        .version = kVersion,
+        .fingerprint = fingerprint,
+    };
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (auto &record : records) {
+      if (!appendRecord(out, record)) {
+        return false;
+      }
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  return !ec;
+}
@@ -0,0 +1,265 @@
+// FetchProgram::run must produce the same descriptor words as the IR
+// evaluation of the resource expressions
+
+#include "shader/FetchProgram.hpp"
+#include "shader/GcnConverter.hpp"
+#include "shader/dialect.hpp"
+#include "shader/gcn.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <vector>
+
+using namespace shader;
+
+namespace {
+int g_failures = 0;
+
+void check(bool condition, const char *what, std::size_t set,
+           std::size_t output) {
+  if (!condition) {
+    std::fprintf(stderr, "fetch_program: %s (set %zu, output %zu)\n", what,
+                 set, output);
+    g_failures++;
+  }
+}
+
+struct MemoryBlock {
+  std::uint64_t address;
+  std::vector<std::uint32_t> words;
+};
+
+// user data and guest memory captured at draw time
+struct DescriptorSet {
+  std::vector<std::uint32_t> userSgprs;
+  std::vector<MemoryBlock> memory;
+};
+
+void readRecordedMemory(const DescriptorSet &set, void *dst,
+                        std::uint64_t address, std::size_t size) {
+  auto bytes = static_cast<std::byte *>(dst);
+  std::memset(bytes, 0, size);
+
+  for (auto &block : set.memory) {
+    auto blockSize = block.words.size() * sizeof(std::uint32_t);
+    auto begin = std::max(address, block.address);
+    auto end = std::min(address + size, block.address + blockSize);
+
+    if (begin < end) {
+      std::memcpy(bytes + (begin - address),
+                  reinterpret_cast<const std::byte *>(block.words.data()) +
+                      (begin - block.address),
+                  end - begin);
+    }
+  }
+}
+
+struct RecordedEvaluator : gcn::ResourceEvaluator {
+  const DescriptorSet *set = nullptr;
+
+protected:
+  void readMemory(void *dst, std::uint64_t address, std::size_t size) override {
+    readRecordedMemory(*set, dst, address, size);
+  }
+};
+
+std::vector<std::uint32_t> makeWords(std::uint32_t seed, std::size_t count) {
+  std::vector<std::uint32_t> result(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    result[i] = seed * 0x9e3779b9u + static_cast<std::uint32_t>(i) * 0x1001u;
+  }
+  return result;
+}
+
+DescriptorSet makeSet(std::uint64_t tableAddress, std::uint32_t seed) {
+  DescriptorSet result;
+  result.userSgprs = {
+      static_cast<std::uint32_t>(tableAddress),
+      static_cast<std::uint32_t>(tableAddress >> 32),
+      seed * 0x10u + 0x123,
+      seed + 7,
+  };
+
+  result.memory.push_back({tableAddress, makeWords(seed, 0x40)});
+  result.memory.push_back({0x1000 + seed * 0x100, makeWords(seed + 100, 4)});
+  return result;
+}
+
+// resource expressions in the shapes produced by the converter: descriptors
+// loaded from a table referenced by a pair of user SGPRs, and words computed
+// from user SGPRs and immediates
+void buildResources(gcn::Resources &res, std::uint64_t immAddress) {
+  auto &context = res.context;
+  auto loc = context.getUnknownLocation();
+  auto region = context.createRegion(loc);
+  auto builder = gcn::Builder::createAppend(context, region);
+
+  auto u32 = context.getTypeUInt32();
+  auto u64 = context.getTypeUInt64();
+  auto u32vec2 = context.getTypeVector(u32, 2);
+  auto u32vec4 = context.getTypeVector(u32, 4);
+  auto u32x8 = context.getTypeArray(u32, context.imm32(8));
+
+  auto userSgpr = [&](int index) {
+    return builder.createValue(loc, ir::Kind::AmdGpu, ir::amdgpu::USER_SGPR,
+                               u32, index);
+  };
+
+  auto tableBase = builder.createSpvBitcast(
+      loc, u64,
+      builder.createSpvCompositeConstruct(loc, u32vec2,
+                                          {{userSgpr(0), userSgpr(1)}}));
+
+  auto load = [&](ir::Value type, std::int32_t size, std::int32_t offset) {
+    return builder.createValue(loc, ir::amdgpu::POINTER, type, size, tableBase,
+                               context.simm32(offset));
+  };
+
+  auto extract = [&](ir::Value composite, std::int32_t index) {
+    return builder.createSpvCompositeExtract(loc, u32, composite, {{index}});
+  };
+
+  res.pointers.push_back({
+      {.resourceSlot = res.slots++},
+      16,
+      tableBase,
+      context.simm32(0x10),
+  });
+
+  {
+    gcn::Resources::Buffer buffer{{.resourceSlot = res.slots++}};
+    buffer.access = Access::Read;
+    auto vbuffer = load(u32vec4, 16, 0x20);
+    for (int i = 0; i < 4; ++i) {
+      buffer.words[i] = extract(vbuffer, i);
+    }
+    res.buffers.push_back(buffer);
+  }
+
+  {
+    gcn::Resources::Texture texture{{.resourceSlot = res.slots++}};
+    texture.access = Access::Read;
+    auto tbuffer = load(u32x8, 32, 0x40);
+    for (int i = 0; i < 8; ++i) {
+      texture.words[i] = extract(tbuffer, i);
+    }
+    res.textures.push_back(texture);
+  }
+
+  {
+    gcn::Resources::ImageBuffer imageBuffer{{.resourceSlot = res.slots++}};
+    imageBuffer.access = Access::Read;
+    auto vbuffer = load(u32vec4, 16, 0x60);
+    for (int i = 0; i < 4; ++i) {
+      imageBuffer.words[i] = extract(vbuffer, i);
+    }
+    res.imageBuffers.push_back(imageBuffer);
+  }
+
+  {
+    gcn::Resources::Sampler sampler{{.resourceSlot = res.slots++}};
+    sampler.unorm = false;
+    sampler.words[0] = builder.createSpvBitwiseAnd(loc, u32, userSgpr(2),
+                                                   context.imm32(0xfff));
+    sampler.words[1] = builder.createValue(loc, ir::sop2::ADD_U32, u32,
+                                           userSgpr(2), userSgpr(3));
+    sampler.words[2] = builder.createSpvShiftLeftLogical(
+        loc, u32,
+        builder.createSpvIAdd(loc, u32, userSgpr(3), context.imm32(4)),
+        context.imm32(3));
+    sampler.words[3] =
+        builder.createValue(loc, ir::amdgpu::IMM, u32,
+                            static_cast<std::int64_t>(immAddress));
+    res.samplers.push_back(sampler);
+  }
+}
+
+std::vector<ir::Value> collectWords(const gcn::Resources &res) {
+  std::vector<ir::Value> result;
+
+  for (auto &pointer : res.pointers) {
+    result.push_back(pointer.base);
+    result.push_back(pointer.offset);
+  }
+  for (auto &buffer : res.buffers) {
+    result.insert(result.end(), std::begin(buffer.words),
+                  std::end(buffer.words));
+  }
+  for (auto &imageBuffer : res.imageBuffers) {
+    result.insert(result.end(), std::begin(imageBuffer.words),
+                  std::end(imageBuffer.words));
+  }
+  for (auto &texture : res.textures) {
+    result.insert(result.end(), std::begin(texture.words),
+                  std::end(texture.words));
+  }
+  for (auto &sampler : res.samplers) {
+    result.insert(result.end(), std::begin(sampler.words),
+                  std::end(sampler.words));
+  }
+
+  return result;
+}
+} // namespace
+
+int main() {
+  std::vector<DescriptorSet> sets;
+  sets.push_back(makeSet(0x2'0000'1000, 1));
+  sets.push_back(makeSet(0x8'1234'5000, 2));
+  sets.push_back(makeSet(0xfe'0000'0040, 3));
+
+  for (std::size_t setIndex = 0; setIndex < sets.size(); ++setIndex) {
+    auto &set = sets[setIndex];
+
+    // immediate is read from the second recorded block of the set
+    gcn::Resources res;
+    buildResources(res, set.memory[1].address + 8);
+    auto words = collectWords(res);
+
+    auto program = gcn::FetchProgram::compile(res);
+    check(program.valid, "program is not valid", setIndex, 0);
+    check(program.outputs.size() == words.size(), "unexpected output count",
+          setIndex, 0);
+
+    if (!program.valid || program.outputs.size() != words.size()) {
+      continue;
+    }
+
+    std::vector<eval::Value> registers;
+    program.run(registers, set.userSgprs,
+                [&](void *dst, std::uint64_t address, std::size_t size) {
+                  readRecordedMemory(set, dst, address, size);
+                });
+
+    RecordedEvaluator evaluator;
+    evaluator.set = &set;
+    evaluator.userSgprs = set.userSgprs;
+
+    for (std::size_t i = 0; i < words.size(); ++i) {
+      if (words[i] == nullptr) {
+        check(program.outputs[i] == gcn::FetchProgram::kNoRegister,
+              "missing word has register", setIndex, i);
+        continue;
+      }
+
+      auto expected = evaluator.eval(words[i]).zExtScalar();
+      auto actual = registers[program.outputs[i]].zExtScalar();
+
+      check(expected.has_value(), "IR evaluation failed", setIndex, i);
+      check(expected == actual, "word differs from IR evaluation", setIndex,
+            i);
+    }
+  }
+
+  if (g_failures != 0) {
+    return EXIT_FAILURE;
+  }
+
+  std::printf("fetch_program: %zu descriptor sets match\n", sets.size());
+  return EXIT_SUCCESS;
+}
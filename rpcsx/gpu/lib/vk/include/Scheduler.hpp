@@ -1,58 +1,123 @@
 #pragma once
 
 #include "vk.hpp"
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <mutex>
+#include <optional>
 #include <stop_token>
 #include <thread>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+///
+/// \brief Records and submits command buffers to a single queue.
+///
+/// Submissions are ordered by a timeline semaphore, submit() does not wait
+/// for the previous submission on the CPU. Up to kInFlightCount command
+/// buffers can be executed by GPU while the next one is recorded.
+///
+/// All methods except then() must be called from the owner thread.
+///
 class Scheduler {
+public:
+  static constexpr std::size_t kInFlightCount = 4;
+
+  struct Stats {
+    std::atomic<std::uint64_t> submits{0};
+
+    // time spent by owner thread waiting for GPU
+    std::atomic<std::uint64_t> cpuStallNs{0};
+
+    // time between observed queue completion and next submit
+    std::atomic<std::uint64_t> gpuIdleNs{0};
+  };
+
+private:
+  using clock = std::chrono::steady_clock;
+  using Task = std::move_only_function<void()>;
+
+  struct Frame {
+    vk::CommandBuffer commandBuffer;
+    std::uint64_t signalValue = 0;
+    std::vector<Task> afterSubmitTasks;
+  };
+
   vk::Semaphore mSemaphore = vk::Semaphore::Create();
   VkQueue mQueue;
   unsigned mQueueFamily;
   vk::CommandPool mCommandPool;
-  vk::CommandBuffer mCommandBuffer;
+  std::array<Frame, kInFlightCount> mFrames;
+  std::size_t mCurrentFrame = 0;
   bool mIsEmpty = false;
 
   std::uint64_t mNextSignal = 1;
-  std::mutex mTaskMutex;
-  std::condition_variable mTaskCv;
-  std::map<std::uint64_t, std::vector<std::move_only_function<void()>>> mTasks;
-  std::vector<std::move_only_function<void()>> mAfterSubmitTasks;
+  std::uint64_t mRetiredSignal = 0;
+  std::optional<clock::time_point> mIdleSince;
+  std::vector<Task> mAfterSubmitTasks;
+  std::vector<std::pair<std::uint64_t, Task>> mExternalSubmitTasks;
+  Stats mStats;
 
-  // std::jthread mThread = std::jthread{
-  //     [this](std::stop_token stopToken) { schedulerEntry(stopToken); }};
+  std::mutex mTaskMutex;
+  std::condition_variable_any mTaskCv;
+  std::map<std::uint64_t, std::vector<Task>> mTasks;
+  std::jthread mThread;
 
 public:
   Scheduler(VkQueue queue, unsigned queueFamilyIndex)
       : mQueue(queue), mQueueFamily(queueFamilyIndex) {
-    mCommandPool = vk::CommandPool::Create(queueFamilyIndex);
-    mCommandBuffer = mCommandPool.createOneTimeSubmitBuffer();
+    mCommandPool = vk::CommandPool::Create(
+        queueFamilyIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+    for (auto &frame : mFrames) {
+      frame.commandBuffer = mCommandPool.createOneTimeSubmitBuffer();
+    }
+
+    mThread = std::jthread(
+        [this](std::stop_token stopToken) { completionEntry(stopToken); });
   }
 
+  Scheduler(const Scheduler &) = delete;
+
   ~Scheduler() {
-    // mThread.request_stop();
-    // mTaskCv.notify_one();
+    mThread.request_stop();
+    mTaskCv.notify_all();
+    mThread.join();
+
+    wait();
+
+    for (auto &[value, tasks] : mTasks) {
+      for (auto &task : tasks) {
+        std::move(task)();
+      }
+    }
   }
 
   unsigned getQueueFamily() const { return mQueueFamily; }
   VkQueue getQueue() const { return mQueue; }
   VkCommandBuffer getCommandBuffer() {
     mIsEmpty = false;
-    return mCommandBuffer;
+    return mFrames[mCurrentFrame].commandBuffer;
   }
 
+  Stats &getStats() { return mStats; }
+
   Scheduler &submit() {
     if (mIsEmpty) {
+      poll();
       return *this;
     }
     mIsEmpty = true;
 
-    mCommandBuffer.end();
+    auto &frame = mFrames[mCurrentFrame];
+    frame.commandBuffer.end();
 
     VkSemaphoreSubmitInfo waitSemSubmitInfo = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
@@ -70,7 +135,7 @@ public:
 
     VkCommandBufferSubmitInfo cmdBufferSubmitInfo{
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-        .commandBuffer = mCommandBuffer,
+        .commandBuffer = frame.commandBuffer,
     };
 
     VkSubmitInfo2 submitInfo{
@@ -83,112 +148,198 @@ public:
         .pSignalSemaphoreInfos = &signalSemSubmitInfo,
     };
 
-    mCommandBuffer = mCommandPool.createOneTimeSubmitBuffer();
-
-    wait();
+    if (mIdleSince) {
+      mStats.gpuIdleNs.fetch_add(elapsedNs(*mIdleSince),
+                                 std::memory_order::relaxed);
+      mIdleSince.reset();
+    }
 
     VK_VERIFY(vkQueueSubmit2(mQueue, 1, &submitInfo, VK_NULL_HANDLE));
+    mStats.submits.fetch_add(1, std::memory_order::relaxed);
 
-    ++mNextSignal;
-
-    // then([afterSubmit = std::move(mAfterSubmitTasks)] mutable {
-    //   for (auto &&fn : afterSubmit) {
-    //     std::move(fn)();
-    //   }
-    // });
-
-    // mAfterSubmitTasks.clear();
-
-    auto endIt = mTasks.upper_bound(mNextSignal - 1);
-
-    if (mAfterSubmitTasks.empty() && endIt == mTasks.end()) {
-      return *this;
+    frame.signalValue = mNextSignal++;
+    for (auto &task : mAfterSubmitTasks) {
+      frame.afterSubmitTasks.push_back(std::move(task));
     }
-
-    auto afterSubmit = std::move(mAfterSubmitTasks);
     mAfterSubmitTasks.clear();
 
-    wait();
+    mCurrentFrame = (mCurrentFrame + 1) % kInFlightCount;
+    auto &nextFrame = mFrames[mCurrentFrame];
 
-    while (!afterSubmit.empty()) {
-      auto task = std::move(afterSubmit.back());
-      afterSubmit.pop_back();
-      std::move(task)();
-    }
+    // all command buffers can be in flight, wait for the oldest one. Retired
+    // tasks are executed later by poll()
+    waitFor(nextFrame.signalValue);
 
-    std::vector<std::move_only_function<void()>> taskList;
+    VK_VERIFY(vkResetCommandBuffer(nextFrame.commandBuffer, 0));
 
-    for (auto it = mTasks.begin(); it != mTasks.end(); it = mTasks.erase(it)) {
-      taskList.reserve(taskList.size() + it->second.size());
-      for (auto &&fn : it->second) {
-        taskList.push_back(std::move(fn));
-      }
-    }
-
-    for (auto &&task : taskList) {
-      std::move(task)();
-    }
+    VkCommandBufferBeginInfo beginInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VK_VERIFY(vkBeginCommandBuffer(nextFrame.commandBuffer, &beginInfo));
 
+    // tasks can submit again, next command buffer must be ready at this point
+    poll();
     return *this;
   }
 
+  ///
+  /// \brief Schedules task to run on the owner thread after completion of the
+  /// next submit.
+  ///
   Scheduler &afterSubmit(std::move_only_function<void()> fn) {
     mAfterSubmitTasks.push_back(std::move(fn));
     return *this;
   }
 
+  ///
+  /// \brief Schedules task to run after completion of all previous submits.
+  ///
+  /// Task is invoked and destroyed by the completion thread, it must not
+  /// record or submit commands to this scheduler.
+  ///
   Scheduler &then(std::move_only_function<void()> fn) {
-    // auto signalValue = mNextSignal++;
-    // onComplete([this, signalValue, fn = std::move(fn)] mutable {
-    //   mSemaphore.wait(signalValue - 1, UINT64_MAX);
-    //   std::move(fn)();
-    //   mSemaphore.signal(signalValue);
-    // });
-    wait();
-    fn();
+    {
+      std::lock_guard lock(mTaskMutex);
+      mTasks[mNextSignal - 1].push_back(std::move(fn));
+    }
+
+    mTaskCv.notify_one();
     return *this;
   }
 
-  // Scheduler &onComplete(std::move_only_function<void()> fn) {
-  //   std::unique_lock lock(mTaskMutex);
-  //   mTasks[mNextSignal - 1].push_back(std::move(fn));
-  //   mTaskCv.notify_one();
-  //   return *this;
-  // }
-
   std::uint64_t createExternalSubmit() { return mNextSignal++; }
-  void wait() const { mSemaphore.wait(mNextSignal - 1, UINT64_MAX); }
+
+  ///
+  /// \brief Schedules task to run on the owner thread after completion of the
+  /// external submit \p value.
+  ///
+  Scheduler &afterExternalSubmit(std::uint64_t value,
+                                 std::move_only_function<void()> fn) {
+    mExternalSubmitTasks.emplace_back(value, std::move(fn));
+    return *this;
+  }
+
+  ///
+  /// \brief Runs afterSubmit tasks of the completed submits without waiting.
+  ///
+  /// Owner thread must call it while idle, otherwise tasks are retired only by
+  /// the next submit or wait.
+  ///
+  void poll() {
+    if (mRetiredSignal + 1 < mNextSignal) {
+      retire(mSemaphore.getCounterValue());
+    } else {
+      retire(mRetiredSignal);
+    }
+  }
+
+  ///
+  /// \brief Waits for completion of all previous submits.
+  ///
+  /// Required only if CPU accesses results of the submitted commands.
+  ///
+  void wait() {
+    waitFor(mNextSignal - 1);
+    retire(mRetiredSignal);
+  }
 
   VkSemaphore getSemaphoreHandle() const { return mSemaphore.getHandle(); }
 
 private:
-  void schedulerEntry(std::stop_token stopToken) {
-    std::vector<std::move_only_function<void()>> taskList;
-    while (!stopToken.stop_requested()) {
-      std::this_thread::sleep_for(std::chrono::microseconds(10));
+  static std::uint64_t elapsedNs(clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                                since)
+        .count();
+  }
+
+  void waitFor(std::uint64_t value) {
+    if (value <= mRetiredSignal) {
+      return;
+    }
+
+    auto start = clock::now();
+    VK_VERIFY(mSemaphore.wait(value, UINT64_MAX));
+    mStats.cpuStallNs.fetch_add(elapsedNs(start), std::memory_order::relaxed);
+    mRetiredSignal = value;
+  }
+
+  void retire(std::uint64_t completedValue) {
+    if (completedValue > mRetiredSignal) {
+      mRetiredSignal = completedValue;
+    }
+
+    if (mRetiredSignal + 1 >= mNextSignal && !mIdleSince) {
+      mIdleSince = clock::now();
+    }
+
+    // tasks can submit again, move them out first. Iterate from the oldest
+    // frame to preserve submission order
+    std::vector<Task> tasks;
+    for (std::size_t i = 0; i < kInFlightCount; ++i) {
+      auto &frame = mFrames[(mCurrentFrame + i) % kInFlightCount];
+
+      if (frame.signalValue == 0 || frame.signalValue > mRetiredSignal) {
+        continue;
+      }
+
+      for (auto &task : frame.afterSubmitTasks) {
+        tasks.push_back(std::move(task));
+      }
+
+      frame.afterSubmitTasks.clear();
+    }
+
+    std::erase_if(mExternalSubmitTasks, [&](auto &entry) {
+      if (entry.first > mRetiredSignal) {
+        return false;
+      }
+
+      tasks.push_back(std::move(entry.second));
+      return true;
+    });
+
+    for (auto &task : tasks) {
+      std::move(task)();
+    }
+  }
+
+  void completionEntry(std::stop_token stopToken) {
+    std::vector<Task> taskList;
+
+    while (true) {
+      std::uint64_t value;
 
       {
         std::unique_lock lock(mTaskMutex);
-        while (mTasks.empty()) {
-          mTaskCv.wait(lock);
+        if (!mTaskCv.wait(lock, stopToken, [this] { return !mTasks.empty(); })) {
+          return;
+        }
 
-          if (stopToken.stop_requested()) {
-            return;
-          }
+        value = mTasks.begin()->first;
+      }
+
+      // use timeout to observe stop requests
+      while (mSemaphore.wait(value, 1'000'000) == VK_TIMEOUT) {
+        if (stopToken.stop_requested()) {
+          return;
         }
+      }
 
-        auto value = mSemaphore.getCounterValue();
-        auto endIt = mTasks.upper_bound(value);
+      auto completedValue = mSemaphore.getCounterValue();
+
+      {
+        std::lock_guard lock(mTaskMutex);
+        auto endIt = mTasks.upper_bound(completedValue);
 
         for (auto it = mTasks.begin(); it != endIt; it = mTasks.erase(it)) {
-          taskList.reserve(taskList.size() + it->second.size());
-          for (auto &&fn : it->second) {
+          for (auto &fn : it->second) {
             taskList.push_back(std::move(fn));
           }
         }
       }
 
-      for (auto &&task : taskList) {
+      for (auto &task : taskList) {
         std::move(task)();
       }
 
@@ -9,14 +9,18 @@
 #include "orbis/utils/Logs.hpp"
 #include "vfs.hpp"
 #include "vm.hpp"
+#include <cctype>
 #include <cerrno>
 #include <dirent.h>
 #include <fcntl.h>
 #include <filesystem>
 #include <netinet/in.h>
+#include <memory>
 #include <optional>
+#include <rx/DiscImage.hpp>
 #include <rx/align.hpp>
 #include <rx/mem.hpp>
+#include <shared_mutex>
 #include <span>
 #include <string>
 #include <sys/mman.h>
@@ -365,6 +369,14 @@ static orbis::ErrorCode host_mmap(orbis::File *file, void **address,
 
   struct stat stat;
   fstat(hostFile->hostFd, &stat);
+
+  if ((flags & vm::kMapFlagPrivate) == 0) {
+    // files of a mount share its device, process shared objects in them are
+    // identified by the host file
+    vm::setBackingFile(reinterpret_cast<std::uint64_t>(result), size,
+                       stat.st_dev, stat.st_ino);
+  }
+
   if (stat.st_size < offset + size) {
     std::size_t rest = std::min(offset + size - stat.st_size, vm::kPageSize);
 
@@ -734,39 +746,212 @@ orbis::ErrorCode createSocket(rx::Ref<orbis::File> *file, orbis::kstring name,
   return {};
 }
 
-static std::optional<std::string>
-findFileInDir(const std::filesystem::path &dir, const char *name) {
-  for (auto entry : std::filesystem::directory_iterator(dir)) {
-    auto entryName = entry.path().filename();
-    if (strcasecmp(entryName.c_str(), name) == 0) {
-      return entryName;
+static std::string foldCase(std::string_view name) {
+  std::string result(name);
+  for (auto &c : result) {
+    c = std::tolower(static_cast<unsigned char>(c));
+  }
+  return result;
+}
+
+// splits device path to components, resolves '.' and '..' lexically
+static std::vector<std::string_view> splitPath(std::string_view path) {
+  std::vector<std::string_view> result;
+
+  while (!path.empty()) {
+    auto pos = path.find('/');
+    auto elem = path.substr(0, pos);
+    path = pos == std::string_view::npos ? std::string_view{}
+                                         : path.substr(pos + 1);
+
+    if (elem.empty() || elem == ".") {
+      continue;
+    }
+
+    if (elem == "..") {
+      if (!result.empty()) {
+        result.pop_back();
+      }
+      continue;
+    }
+
+    result.push_back(elem);
+  }
+
+  return result;
+}
+
+static std::string joinPath(std::span<const std::string_view> elems) {
+  std::string result;
+  for (auto elem : elems) {
+    if (!result.empty()) {
+      result += '/';
     }
+    result += elem;
   }
-  return {};
+  return result;
 }
 
-static std::optional<std::filesystem::path>
-toRealPath(const std::filesystem::path &inp) {
-  if (inp.empty()) {
+static std::optional<std::string_view>
+findInDirIndex(const HostFsDevice::DirIndex &index, std::string_view name) {
+  auto it = index.find(std::string_view(foldCase(name)));
+  if (it == index.end()) {
     return {};
   }
 
-  std::filesystem::path result;
-  for (auto elem : inp) {
-    if (result.empty() || std::filesystem::exists(result / elem)) {
-      result /= elem;
-      continue;
+  // directory can contain names that differ only in case
+  for (auto &realName : it->second) {
+    if (realName == name) {
+      return realName;
     }
+  }
+
+  return it->second.front();
+}
+
+// modification time of the host directory, -1 if it is not a directory
+static std::int64_t getDirMtime(const std::string &path) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return -1;
+  }
+
+  return st.st_mtim.tv_sec * 1'000'000'000ll + st.st_mtim.tv_nsec;
+}
+
+// modifications within the file system timestamp granularity keep the
+// directory mtime, recently modified directories are not cached
+static bool isDirMtimeSettled(std::int64_t mtime) {
+  static constexpr std::int64_t kSettleTime = 1'000'000'000;
+
+  if (mtime < 0) {
+    return false;
+  }
+
+  ::timespec now;
+  ::clock_gettime(CLOCK_REALTIME, &now);
+  return mtime + kSettleTime < now.tv_sec * 1'000'000'000ll + now.tv_nsec;
+}
+
+std::optional<std::string>
+HostFsDevice::resolvePath(std::string_view path) {
+  auto elems = splitPath(path);
+  auto key = joinPath(elems);
+
+  {
+    std::shared_lock lock(pathCacheMtx);
+    if (auto it = missingPaths.find(std::string_view(key));
+        it != missingPaths.end()) {
+      auto missing = it->second;
+      lock.unlock();
+
+      auto missingDir = std::string(hostPath) + "/";
+      missingDir += missing.dir;
 
-    auto icaseElem = findFileInDir(result, elem.c_str());
-    if (!icaseElem) {
+      if (getDirMtime(missingDir) == missing.mtime) {
+        pathCacheStats.misses.fetch_add(1, std::memory_order::relaxed);
+        return {};
+      }
+
+      std::lock_guard missingLock(pathCacheMtx);
+      if (auto stale = missingPaths.find(std::string_view(key));
+          stale != missingPaths.end() &&
+          stale->second.mtime == missing.mtime) {
+        missingPaths.erase(stale);
+      }
+    }
+  }
+
+  std::string dir;
+  for (auto elem : elems) {
+    auto mtime = getDirMtime(std::string(hostPath) + "/" + dir);
+    std::optional<std::string> realName;
+    bool indexed = false;
+
+    {
+      std::shared_lock lock(pathCacheMtx);
+      if (auto it = dirIndexes.find(std::string_view(dir));
+          it != dirIndexes.end() && it->second.mtime == mtime) {
+        realName = findInDirIndex(it->second.index, elem);
+        indexed = true;
+      }
+    }
+
+    if (!indexed) {
+      DirIndex index;
+      std::error_code ec;
+      for (auto &entry : std::filesystem::directory_iterator(
+               std::string(hostPath) + "/" + dir, ec)) {
+        auto name = entry.path().filename().string();
+        index[orbis::kstring(foldCase(name))].emplace_back(name);
+      }
+
+      pathCacheStats.dirScans.fetch_add(1, std::memory_order::relaxed);
+      realName = findInDirIndex(index, elem);
+
+      std::lock_guard lock(pathCacheMtx);
+      if (isDirMtimeSettled(mtime)) {
+        dirIndexes.insert_or_assign(orbis::kstring(dir),
+                                    CachedDir{mtime, std::move(index)});
+      } else if (auto it = dirIndexes.find(std::string_view(dir));
+                 it != dirIndexes.end()) {
+        dirIndexes.erase(it);
+      }
+    }
+
+    if (!realName) {
+      if (isDirMtimeSettled(mtime)) {
+        std::lock_guard lock(pathCacheMtx);
+        if (missingPaths.size() >= kMaxMissingPaths) {
+          missingPaths.clear();
+        }
+
+        missingPaths.insert_or_assign(orbis::kstring(key),
+                                      MissingPath{orbis::kstring(dir), mtime});
+      }
+
+      pathCacheStats.misses.fetch_add(1, std::memory_order::relaxed);
       return {};
     }
 
-    result /= *icaseElem;
+    if (!dir.empty()) {
+      dir += '/';
+    }
+    dir += *realName;
   }
 
-  return result;
+  pathCacheStats.hits.fetch_add(1, std::memory_order::relaxed);
+  return std::string(hostPath) + "/" + dir;
+}
+
+void HostFsDevice::invalidatePath(std::string_view path) {
+  auto elems = splitPath(path);
+  auto key = joinPath(elems);
+
+  std::lock_guard lock(pathCacheMtx);
+  missingPaths.clear();
+
+  if (elems.empty()) {
+    dirIndexes.clear();
+    return;
+  }
+
+  auto parent = joinPath(std::span(elems).first(elems.size() - 1));
+  if (auto it = dirIndexes.find(std::string_view(parent));
+      it != dirIndexes.end()) {
+    dirIndexes.erase(it);
+  }
+
+  if (auto it = dirIndexes.find(std::string_view(key));
+      it != dirIndexes.end()) {
+    dirIndexes.erase(it);
+  }
+
+  auto prefix = key + "/";
+  auto it = dirIndexes.lower_bound(std::string_view(prefix));
+  while (it != dirIndexes.end() && it->first.starts_with(prefix)) {
+    it = dirIndexes.erase(it);
+  }
 }
 
 orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
@@ -827,7 +1012,7 @@ orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
   if (hostFd < 0) {
     error = convertErrno();
 
-    if (auto icaseRealPath = toRealPath(realPath)) {
+    if (auto icaseRealPath = resolvePath(path)) {
       ORBIS_LOG_WARNING(__FUNCTION__, path, realPath.c_str(),
                         icaseRealPath->c_str());
       hostFd = ::open(icaseRealPath->c_str(), realFlags, 0777);
@@ -844,6 +1029,10 @@ orbis::ErrorCode HostFsDevice::open(rx::Ref<orbis::File> *file,
     return error;
   }
 
+  if ((realFlags & O_CREAT) != 0) {
+    invalidatePath(path);
+  }
+
   // Assume the file is a directory and try to read direntries
   orbis::kvector<orbis::Dirent> dirEntries;
   char hostEntryBuffer[sizeof(dirent64) * 4];
@@ -905,6 +1094,7 @@ orbis::ErrorCode HostFsDevice::unlink(const char *path, bool recursive,
     std::filesystem::remove(hostPath + "/" + path, ec);
   }
 
+  invalidatePath(path);
   return convertErrorCode(ec);
 }
 
@@ -915,6 +1105,7 @@ orbis::ErrorCode HostFsDevice::createSymlink(const char *linkPath,
   std::filesystem::create_symlink(
       std::filesystem::absolute(hostPath + "/" + linkPath),
       hostPath + "/" + target, ec);
+  invalidatePath(target);
   return convertErrorCode(ec);
 }
 
@@ -922,17 +1113,21 @@ orbis::ErrorCode HostFsDevice::mkdir(const char *path, int mode,
                                      orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::create_directories(hostPath + "/" + path, ec);
+  invalidatePath(path);
   return convertErrorCode(ec);
 }
 orbis::ErrorCode HostFsDevice::rmdir(const char *path, orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::remove_all(hostPath + "/" + path, ec);
+  invalidatePath(path);
   return convertErrorCode(ec);
 }
 orbis::ErrorCode HostFsDevice::rename(const char *from, const char *to,
                                       orbis::Thread *thread) {
   std::error_code ec;
   std::filesystem::rename(hostPath + "/" + from, hostPath + "/" + to, ec);
+  invalidatePath(from);
+  invalidatePath(to);
   return convertErrorCode(ec);
 }
 
@@ -963,3 +1158,232 @@ orbis::IoDevice *createFdWrapDevice(int fd) {
   result->fd = fd;
   return result;
 }
+
+struct DiscImageDevice : orbis::IoDevice {
+  int hostFd = -1;
+  std::unique_ptr<rx::DiscImage> image;
+
+  ~DiscImageDevice() {
+    if (hostFd >= 0) {
+      ::close(hostFd);
+    }
+  }
+
+  orbis::ErrorCode open(rx::Ref<orbis::File> *file, const char *path,
+                        std::uint32_t flags, std::uint32_t mode,
+                        orbis::Thread *thread) override;
+};
+
+struct DiscImageFile : orbis::File {
+  std::uint32_t entryIndex = 0;
+
+  // read-ahead is skipped by concurrent readers instead of waiting for the
+  // buffer
+  rx::shared_mutex readAheadMtx;
+  rx::DiscImage::ReadAhead<orbis::kvector<std::byte>> readAhead;
+
+  const rx::DiscImage &image() const {
+    return *static_cast<DiscImageDevice *>(device.get())->image;
+  }
+
+  const rx::DiscImage::Entry &entry() const {
+    return image().entry(entryIndex);
+  }
+};
+
+static orbis::ErrorCode image_read(orbis::File *file, orbis::Uio *uio,
+                                   orbis::Thread *) {
+  auto imageFile = static_cast<DiscImageFile *>(file);
+  auto &entry = imageFile->entry();
+  if (entry.isDirectory) {
+    return orbis::ErrorCode::ISDIR;
+  }
+
+  std::unique_lock lock(imageFile->readAheadMtx, std::try_to_lock);
+
+  for (auto vec : std::span(uio->iov, uio->iovcnt)) {
+    auto count = lock.owns_lock()
+                     ? imageFile->image().read(entry, imageFile->readAhead,
+                                               uio->offset, vec.base, vec.len)
+                     : imageFile->image().read(entry, uio->offset, vec.base,
+                                               vec.len);
+    uio->offset += count;
+    uio->resid -= count;
+
+    if (count != vec.len) {
+      break;
+    }
+  }
+
+  return {};
+}
+
+static orbis::ErrorCode image_mmap(orbis::File *file, void **address,
+                                   std::uint64_t size, std::int32_t prot,
+                                   std::int32_t flags, std::int64_t offset,
+                                   orbis::Thread *thread) {
+  auto imageFile = static_cast<DiscImageFile *>(file);
+  auto &entry = imageFile->entry();
+  if (entry.isDirectory) {
+    return orbis::ErrorCode::ISDIR;
+  }
+
+  auto result = vm::map(*address, size, prot, flags,
+                        vm::kMapInternalReserveOnly, file->device.get(), offset);
+
+  if (result == (void *)-1) {
+    return orbis::ErrorCode::NOMEM;
+  }
+
+  size = rx::alignUp(size, vm::kPageSize);
+
+  auto &image = imageFile->image();
+  auto device = static_cast<DiscImageDevice *>(file->device.get());
+
+  // whole pages of the file stored contiguously at a page aligned image
+  // offset are mapped from the image, the rest is a private copy
+  std::uint64_t mappedSize = 0;
+  if (static_cast<std::uint64_t>(offset) < entry.size) {
+    mappedSize = rx::alignDown(std::min(size, entry.size - offset),
+                               rx::mem::pageSize);
+  }
+
+  if (mappedSize != 0) {
+    auto imageOffset = image.getContiguousOffset(entry, offset, mappedSize);
+
+    if (imageOffset == rx::DiscImage::kSparseExtent ||
+        imageOffset % rx::mem::pageSize != 0 ||
+        ::mmap(result, mappedSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_FIXED, device->hostFd,
+               imageOffset) == MAP_FAILED) {
+      mappedSize = 0;
+    }
+  }
+
+  if (mappedSize < size) {
+    auto copy = static_cast<std::byte *>(result) + mappedSize;
+    if (::mmap(copy, size - mappedSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+               0) == MAP_FAILED) {
+      return convertErrno();
+    }
+
+    image.read(entry, offset + mappedSize, copy, size - mappedSize);
+  }
+
+  ::mprotect(result, size, prot & vm::kMapProtCpuAll);
+
+  *address = result;
+  return {};
+}
+
+static orbis::ErrorCode image_stat(orbis::File *file, orbis::Stat *sb,
+                                   orbis::Thread *thread) {
+  auto imageFile = static_cast<DiscImageFile *>(file);
+  auto &entry = imageFile->entry();
+  orbis::timespec time{.sec = static_cast<std::uint64_t>(entry.mtime)};
+
+  *sb = {};
+  sb->ino = imageFile->entryIndex;
+  sb->mode = entry.isDirectory ? S_IFDIR | 0555 : S_IFREG | 0444;
+  sb->nlink = 1;
+  sb->atim = time;
+  sb->mtim = time;
+  sb->ctim = time;
+  sb->birthtim = time;
+  sb->size = entry.size;
+  sb->blocks = (entry.size + 511) / 512;
+  sb->blksize = rx::DiscImage::kSectorSize;
+  return {};
+}
+
+static const orbis::FileOps imageOps = {
+    .read = image_read,
+    .stat = image_stat,
+    .mmap = image_mmap,
+};
+
+orbis::ErrorCode DiscImageDevice::open(rx::Ref<orbis::File> *file,
+                                       const char *path, std::uint32_t flags,
+                                       std::uint32_t mode,
+                                       orbis::Thread *thread) {
+  if ((flags & (O_ACCMODE | orbis::kOpenFlagCreat | orbis::kOpenFlagTrunc)) !=
+      0) {
+    return orbis::ErrorCode::ROFS;
+  }
+
+  auto index = image->find(path);
+  if (index == rx::DiscImage::kNoEntry) {
+    return orbis::ErrorCode::NOENT;
+  }
+
+  auto &entry = image->entry(index);
+  if (!entry.isDirectory && (flags & orbis::kOpenFlagDirectory) != 0) {
+    return orbis::ErrorCode::NOTDIR;
+  }
+
+  auto newFile = orbis::knew<DiscImageFile>();
+  newFile->entryIndex = index;
+  newFile->ops = &imageOps;
+  newFile->device = this;
+
+  if (entry.isDirectory) {
+    for (auto &child : image->children(entry)) {
+      auto &dirEntry = newFile->dirEntries.emplace_back();
+      dirEntry.fileno = &child - &image->root();
+      dirEntry.reclen = sizeof(dirEntry);
+      dirEntry.type = child.isDirectory ? orbis::kDtDir : orbis::kDtReg;
+      dirEntry.namlen = std::min(child.name.size(), sizeof(dirEntry.name) - 1);
+      std::strncpy(dirEntry.name, child.name.c_str(), sizeof(dirEntry.name));
+    }
+  }
+
+  *file = newFile;
+  return {};
+}
+
+orbis::IoDevice *createDiscImageIoDevice(const char *imagePath) {
+  int hostFd = ::open(imagePath, O_RDONLY);
+  if (hostFd < 0) {
+    return nullptr;
+  }
+
+  struct stat hostStat;
+  if (::fstat(hostFd, &hostStat) != 0) {
+    ::close(hostFd);
+    return nullptr;
+  }
+
+  auto image = rx::DiscImage::open(
+      [hostFd](std::uint64_t offset, void *data,
+               std::size_t size) -> std::size_t {
+        std::size_t done = 0;
+
+        while (done < size) {
+          auto result = ::pread(hostFd, static_cast<char *>(data) + done,
+                                size - done, offset + done);
+          if (result < 0 && errno == EINTR) {
+            continue;
+          }
+
+          if (result <= 0) {
+            break;
+          }
+
+          done += result;
+        }
+
+        return done;
+      },
+      hostStat.st_size);
+
+  if (image == nullptr) {
+    ::close(hostFd);
+    return nullptr;
+  }
+
+  auto result = orbis::knew<DiscImageDevice>();
+  result->hostFd = hostFd;
+  result->image = std::move(image);
+  return result;
+}
@@ -4,15 +4,67 @@
 #include "orbis/KernelAllocator.hpp"
 #include "orbis/file.hpp"
 #include "rx/Rc.hpp"
+#include "rx/SharedMutex.hpp"
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <system_error>
 
 struct HostFsDevice : orbis::IoDevice {
+  struct PathCacheStats {
+    // paths resolved by case insensitive lookup
+    std::atomic<std::uint64_t> hits{0};
+
+    // paths not found, including negative cache hits
+    std::atomic<std::uint64_t> misses{0};
+
+    std::atomic<std::uint64_t> dirScans{0};
+  };
+
+  // case folded name -> real names of the directory entries
+  using DirIndex = orbis::kmap<orbis::kstring, orbis::kvector<orbis::kstring>,
+                               std::less<>>;
+
+  // directory contents are valid while the directory modification time is
+  // unchanged, so changes made by other processes or the host are seen
+  struct CachedDir {
+    std::int64_t mtime;
+    DirIndex index;
+  };
+
+  // path not found in the directory with the recorded modification time
+  struct MissingPath {
+    orbis::kstring dir;
+    std::int64_t mtime;
+  };
+
+  static constexpr std::size_t kMaxMissingPaths = 4096;
+
   orbis::kstring hostPath;
   orbis::kstring virtualPath;
 
+  // directory indexes and not resolved paths, keyed by normalized path
+  // relative to hostPath
+  rx::shared_mutex pathCacheMtx;
+  orbis::kmap<orbis::kstring, CachedDir, std::less<>> dirIndexes;
+  orbis::kmap<orbis::kstring, MissingPath, std::less<>> missingPaths;
+  PathCacheStats pathCacheStats;
+
   HostFsDevice(orbis::kstring path, orbis::kstring virtualPath)
       : hostPath(std::move(path)), virtualPath(std::move(virtualPath)) {}
+
+  ///
+  /// \brief Finds host path of the device path with case insensitive
+  /// comparison of the path components.
+  ///
+  std::optional<std::string> resolvePath(std::string_view path);
+
+  /// \brief Drops cached state of the path, its parent and subtree.
+  void invalidatePath(std::string_view path);
+
   orbis::ErrorCode open(rx::Ref<orbis::File> *file, const char *path,
                         std::uint32_t flags, std::uint32_t mode,
                         orbis::Thread *thread) override;
@@ -31,6 +83,13 @@ orbis::ErrorCode convertErrorCode(const std::error_code &code);
 orbis::ErrorCode convertErrno();
 orbis::IoDevice *createHostIoDevice(orbis::kstring hostPath,
                                     orbis::kstring virtualPath);
+
+///
+/// \brief Creates read-only device of the ISO 9660 or UDF disc image.
+///
+/// \returns nullptr if file cannot be opened or is not a disc image
+///
+orbis::IoDevice *createDiscImageIoDevice(const char *imagePath);
 rx::Ref<orbis::File> wrapSocket(int hostFd, orbis::kstring name, int dom,
                                 int type, int prot);
 orbis::ErrorCode createSocket(rx::Ref<orbis::File> *file, orbis::kstring name,
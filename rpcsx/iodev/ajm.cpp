@@ -6,10 +6,24 @@
 #include "orbis/file.hpp"
 #include "orbis/thread/Thread.hpp"
 #include "orbis/utils/Logs.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <rx/SharedCV.hpp>
 #include <rx/atScopeExit.hpp>
 #include <rx/hexdump.hpp>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 extern "C" {
 #include <libatrac9/decoder.h>
@@ -53,14 +67,25 @@ enum {
   AJM_IOCTL_INSTANCE_SWITCH = 0xc028890b,
 };
 
+struct AjmBatch {
+  orbis::uint32_t pendingJobs = 0;
+  orbis::ErrorCode error{};
+};
+
 struct AjmDevice
     : orbis::IoDeviceWithIoctl<orbis::ioctl::group(AJM_IOCTL_FINALIZE)> {
+  // completed batches are kept until waited or until this limit is reached
+  static constexpr std::size_t kMaxBatches = 256;
+
   rx::shared_mutex mtx;
   orbis::uint32_t batchId = 1; // temp
+  orbis::kmap<orbis::uint32_t, AjmBatch> batches;
+  rx::shared_cv batchCv;
 
   orbis::uint32_t instanceIds[AJM_CODEC_COUNT]{};
   orbis::uint32_t unimplementedInstanceId = 0;
   orbis::kmap<orbis::int32_t, Instance> instanceMap;
+
   orbis::ErrorCode open(rx::Ref<orbis::File> *file, const char *path,
                         std::uint32_t flags, std::uint32_t mode,
                         orbis::Thread *thread) override;
@@ -68,6 +93,129 @@ struct AjmDevice
   AjmDevice();
 };
 
+namespace {
+struct AjmWorker {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::function<void()>> jobs;
+
+  void entry() {
+    // process directed guest signals must be delivered to guest threads.
+    // Faults stay unblocked, jobs access guest memory
+    sigset_t set;
+    sigfillset(&set);
+    sigdelset(&set, SIGSEGV);
+    sigdelset(&set, SIGBUS);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    pthread_setname_np(pthread_self(), "ajm");
+
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [this] { return !jobs.empty(); });
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+
+      job();
+    }
+  }
+};
+
+struct AjmWorkers {
+  static constexpr std::size_t kWorkerCount = 4;
+
+  pid_t pid = ::getpid();
+  std::array<AjmWorker, kWorkerCount> workers;
+
+  AjmWorkers() {
+    for (auto &worker : workers) {
+      std::thread([&worker] { worker.entry(); }).detach();
+    }
+  }
+
+  void submit(orbis::uint32_t instanceId, std::function<void()> job) {
+    auto &worker = workers[instanceId % kWorkerCount];
+    {
+      std::lock_guard lock(worker.mtx);
+      worker.jobs.push_back(std::move(job));
+    }
+    worker.cv.notify_one();
+  }
+};
+} // namespace
+
+// workers are host threads, forked process starts its own
+static AjmWorkers &getAjmWorkers() {
+  static std::mutex mtx;
+  static AjmWorkers *workers = nullptr;
+
+  std::lock_guard lock(mtx);
+  if (workers == nullptr || workers->pid != ::getpid()) {
+    workers = new AjmWorkers();
+  }
+
+  return *workers;
+}
+
+namespace {
+// codec and resampler contexts of destroyed instances, reused by new
+// instances. Contexts are host pointers, so the pool is not shared with other
+// processes through the device
+struct AjmContextPool {
+  pid_t pid = ::getpid();
+  std::mutex mtx;
+  std::map<AJMCodecs, std::vector<AVCodecContext *>> codecs;
+  std::map<std::uint64_t, std::vector<SwrContext *>> resamplers;
+
+  template <typename T>
+  static T *take(std::vector<T *> &contexts) {
+    if (contexts.empty()) {
+      return nullptr;
+    }
+
+    auto context = contexts.back();
+    contexts.pop_back();
+    return context;
+  }
+
+  AVCodecContext *takeCodec(AJMCodecs codec) {
+    std::lock_guard lock(mtx);
+    return take(codecs[codec]);
+  }
+
+  SwrContext *takeResampler(std::uint64_t key) {
+    std::lock_guard lock(mtx);
+    return take(resamplers[key]);
+  }
+
+  void release(AJMCodecs codec, AVCodecContext *context) {
+    std::lock_guard lock(mtx);
+    codecs[codec].push_back(context);
+  }
+
+  void release(std::uint64_t key, SwrContext *context) {
+    std::lock_guard lock(mtx);
+    resamplers[key].push_back(context);
+  }
+};
+} // namespace
+
+// contexts inherited from the parent process are not reused, the parent can
+// still own them
+static AjmContextPool &getAjmContextPool() {
+  static std::mutex mtx;
+  static AjmContextPool *pool = nullptr;
+
+  std::lock_guard lock(mtx);
+  if (pool == nullptr || pool->pid != ::getpid()) {
+    pool = new AjmContextPool();
+  }
+
+  return *pool;
+}
+
 AVSampleFormat ajmToAvFormat(AJMFormat ajmFormat) {
   switch (ajmFormat) {
   case AJM_FORMAT_S16:
@@ -81,6 +229,71 @@ AVSampleFormat ajmToAvFormat(AJMFormat ajmFormat) {
   }
 }
 
+static std::uint64_t ajmResamplerKey(int channels, int sampleRate,
+                                     AJMFormat outputFormat) {
+  return static_cast<std::uint64_t>(channels) |
+         (static_cast<std::uint64_t>(sampleRate) << 8) |
+         (static_cast<std::uint64_t>(outputFormat) << 40);
+}
+
+static SwrContext *ajmAcquireResampler(std::uint64_t key, int channels,
+                                       int sampleRate,
+                                       AJMFormat outputFormat) {
+  if (auto resampler = getAjmContextPool().takeResampler(key)) {
+    return resampler;
+  }
+
+  auto resampler = swr_alloc();
+
+  AVChannelLayout chLayout;
+  av_channel_layout_default(&chLayout, channels);
+  av_opt_set_chlayout(resampler, "in_chlayout", &chLayout, 0);
+  av_opt_set_chlayout(resampler, "out_chlayout", &chLayout, 0);
+  av_opt_set_int(resampler, "in_sample_rate", sampleRate, 0);
+  av_opt_set_int(resampler, "out_sample_rate", sampleRate, 0);
+  av_opt_set_sample_fmt(resampler, "in_sample_fmt",
+                        ajmToAvFormat(AJM_FORMAT_FLOAT), 0);
+  av_opt_set_sample_fmt(resampler, "out_sample_fmt",
+                        ajmToAvFormat(outputFormat), 0);
+  if (swr_init(resampler) < 0) {
+    ORBIS_LOG_FATAL("Failed to initialize the resampling context");
+    std::abort();
+  }
+
+  return resampler;
+}
+
+static void ajmReleaseCodecContext(Instance &instance) {
+  if (instance.codecCtx == nullptr) {
+    return;
+  }
+
+  if (instance.isCustomCodecCtx) {
+    avcodec_free_context(&instance.codecCtx);
+    instance.isCustomCodecCtx = false;
+    return;
+  }
+
+  avcodec_flush_buffers(instance.codecCtx);
+  getAjmContextPool().release(instance.codec, instance.codecCtx);
+  instance.codecCtx = nullptr;
+}
+
+static void ajmReleaseResampler(Instance &instance) {
+  if (instance.resampler == nullptr) {
+    return;
+  }
+
+  // drop buffered samples of the previous stream
+  if (swr_init(instance.resampler) < 0) {
+    swr_free(&instance.resampler);
+    return;
+  }
+
+  getAjmContextPool().release(instance.resamplerKey, instance.resampler);
+  instance.resampler = nullptr;
+}
+
 void reset(Instance *instance) {
   instance->gapless.skipSamples = 0;
   instance->gapless.totalSamples = 0;
@@ -221,15 +434,19 @@ ajm_ioctl_instance_create(orbis::Thread *, AjmDevice *device,
         ORBIS_LOG_FATAL("Codec not found", (orbis::uint32_t)codecId);
         std::abort();
       }
-      AVCodecContext *codecCtx = avcodec_alloc_context3(codec);
-      if (!codecCtx) {
-        ORBIS_LOG_FATAL("Failed to allocate codec context");
-        std::abort();
-      }
+      AVCodecContext *codecCtx = getAjmContextPool().takeCodec(codecId);
 
-      if (int err = avcodec_open2(codecCtx, codec, nullptr); err < 0) {
-        ORBIS_LOG_FATAL("Could not open codec", err);
-        std::abort();
+      if (codecCtx == nullptr) {
+        codecCtx = avcodec_alloc_context3(codec);
+        if (!codecCtx) {
+          ORBIS_LOG_FATAL("Failed to allocate codec context");
+          std::abort();
+        }
+
+        if (int err = avcodec_open2(codecCtx, codec, nullptr); err < 0) {
+          ORBIS_LOG_FATAL("Could not open codec", err);
+          std::abort();
+        }
       }
 
       instance.avCodec = codec;
@@ -261,10 +478,20 @@ ajm_ioctl_instance_destroy(orbis::Thread *, AjmDevice *device,
                            AjmIoctlInstanceDestroy &args) {
   ORBIS_LOG_ERROR(__FUNCTION__, args.instanceId);
   std::lock_guard lock(device->mtx);
-  if (device->instanceMap.erase(args.instanceId) == 0) {
+  auto it = device->instanceMap.find(args.instanceId);
+  if (it == device->instanceMap.end()) {
     return orbis::ErrorCode::INVAL;
   }
 
+  {
+    // contexts can be used by a running job of the instance
+    std::lock_guard instanceLock(it->second.mtx);
+    ajmReleaseCodecContext(it->second);
+    ajmReleaseResampler(it->second);
+  }
+
+  device->instanceMap.erase(it);
+
   args.result = 0;
   return {};
 }
@@ -301,524 +528,575 @@ ajm_ioctl_instance_switch(orbis::Thread *thread, AjmDevice *device,
   return {};
 }
 
-struct AjmIoctlStartBatchBuffer {
-  orbis::uint32_t result;
-  orbis::uint32_t unk0;
-  orbis::ptr<std::byte> pBatch;
-  orbis::uint32_t batchSize;
-  orbis::uint32_t priority;
-  orbis::uint64_t batchError;
-  orbis::uint32_t batchId;
-};
-static orbis::ErrorCode
-ajm_ioctl_start_batch_buffer(orbis::Thread *, AjmDevice *device,
-                             AjmIoctlStartBatchBuffer &args) {
-  args.result = 0;
-  args.batchId = device->batchId++;
-  // ORBIS_LOG_ERROR(__FUNCTION__, args.result, args.unk0, args.pBatch,
-  //                 args.batchSize, args.priority, args.batchError, args.batchId);
-  // thread->where();
-
-  auto ptr = args.pBatch;
-  auto endPtr = args.pBatch + args.batchSize;
+static orbis::ErrorCode ajmRunInstruction(AjmDevice *device, Instance &instance,
+                                          orbis::uint32_t instanceId,
+                                          std::byte *ptr) {
+  auto header = (InstructionHeader *)ptr;
+  auto jobPtr = ptr + sizeof(InstructionHeader);
+  auto endJobPtr = ptr + header->len;
+
+  instance.inputBuffer.clear();
+  RunJob runJob{};
+  while (jobPtr < endJobPtr) {
+    auto typed = (OpcodeHeader *)jobPtr;
+    switch (typed->getOpcode()) {
+    case Opcode::ReturnAddress: {
+      // ReturnAddress *ra = (ReturnAddress *)jobPtr;
+      // ORBIS_LOG_ERROR(__FUNCTION__, request, "return address",
+      // ra->opcode,
+      //                 ra->unk, ra->returnAddress);
+      jobPtr += sizeof(ReturnAddress);
+      break;
+    }
+    case Opcode::ControlBufferRa: {
+      runJob.control = true;
+      auto *ctrl = (BatchJobControlBufferRa *)jobPtr;
+      auto *result =
+          reinterpret_cast<AJMSidebandResult *>(ctrl->pSidebandOutput);
+      *result = {};
 
-  while (ptr < endPtr) {
-    auto header = (InstructionHeader *)ptr;
-    auto instanceId = (header->id >> 6) & 0xfffff;
-    auto jobPtr = ptr + sizeof(InstructionHeader);
-    auto endJobPtr = ptr + header->len;
-    // TODO: handle unimplemented codecs, so auto create instance for now
-    auto &instance = device->instanceMap[instanceId];
-
-    instance.inputBuffer.clear();
-    RunJob runJob{};
-    while (jobPtr < endJobPtr) {
-      auto typed = (OpcodeHeader *)jobPtr;
-      switch (typed->getOpcode()) {
-      case Opcode::ReturnAddress: {
-        // ReturnAddress *ra = (ReturnAddress *)jobPtr;
-        // ORBIS_LOG_ERROR(__FUNCTION__, request, "return address",
-        // ra->opcode,
-        //                 ra->unk, ra->returnAddress);
-        jobPtr += sizeof(ReturnAddress);
-        break;
+      ORBIS_LOG_ERROR(__FUNCTION__, "control buffer", ctrl->opcode,
+                      ctrl->commandId, ctrl->flagsHi, ctrl->flagsLo,
+                      ctrl->sidebandInputSize, ctrl->sidebandOutputSize);
+      if (ctrl->getFlags() & CONTROL_RESET) {
+        reset(&instance);
+        if (instance.codec == AJM_CODEC_At9) {
+          resetAt9(&instance);
+        }
       }
-      case Opcode::ControlBufferRa: {
-        runJob.control = true;
-        auto *ctrl = (BatchJobControlBufferRa *)jobPtr;
-        auto *result =
-            reinterpret_cast<AJMSidebandResult *>(ctrl->pSidebandOutput);
-        *result = {};
-
-        ORBIS_LOG_ERROR(__FUNCTION__, "control buffer", ctrl->opcode,
-                        ctrl->commandId, ctrl->flagsHi, ctrl->flagsLo,
-                        ctrl->sidebandInputSize, ctrl->sidebandOutputSize);
-        if (ctrl->getFlags() & CONTROL_RESET) {
+
+      if (ctrl->getFlags() & CONTROL_INITIALIZE) {
+        if (instance.codec == AJM_CODEC_At9) {
+          struct InitalizeBuffer {
+            orbis::uint32_t configData;
+            orbis::int32_t unk0[2];
+          };
+          auto *initializeBuffer = (InitalizeBuffer *)ctrl->pSidebandInput;
+          instance.at9.configData = initializeBuffer->configData;
           reset(&instance);
-          if (instance.codec == AJM_CODEC_At9) {
-            resetAt9(&instance);
-          }
-        }
+          resetAt9(&instance);
+
+          orbis::uint32_t maxChannels =
+              instance.maxChannels == AJM_CHANNEL_DEFAULT
+                  ? 2
+                  : instance.maxChannels;
+          orbis::uint32_t outputChannels =
+              instance.at9.inputChannels > maxChannels
+                  ? maxChannels
+                  : instance.at9.inputChannels;
+          // TODO: check max channels
+          ORBIS_LOG_TODO("CONTROL_INITIALIZE AT9", instance.at9.inputChannels,
+                         instance.at9.sampleRate, instance.at9.frameSamples,
+                         instance.at9.superFrameSize, maxChannels,
+                         outputChannels, initializeBuffer->configData,
+                         (orbis::uint32_t)instance.outputFormat);
+        } else if (instance.codec == AJM_CODEC_AAC) {
+          struct InitializeBuffer {
+            orbis::uint32_t headerIndex;
+            orbis::uint32_t sampleRateIndex;
+          };
+          auto *initializeBuffer = (InitializeBuffer *)ctrl->pSidebandInput;
+          instance.aac.headerType =
+              AACHeaderType(initializeBuffer->headerIndex);
+          instance.aac.sampleRate = AACFreq[initializeBuffer->sampleRateIndex];
+          if (instance.aac.headerType == AAC_RAW) {
+            ajmReleaseCodecContext(instance);
+
+            AVCodecContext *codecCtx = avcodec_alloc_context3(instance.avCodec);
+            if (!codecCtx) {
+              ORBIS_LOG_FATAL("Failed to allocate codec context for raw aac");
+              std::abort();
+            }
 
-        if (ctrl->getFlags() & CONTROL_INITIALIZE) {
-          if (instance.codec == AJM_CODEC_At9) {
-            struct InitalizeBuffer {
-              orbis::uint32_t configData;
-              orbis::int32_t unk0[2];
-            };
-            auto *initializeBuffer = (InitalizeBuffer *)ctrl->pSidebandInput;
-            instance.at9.configData = initializeBuffer->configData;
-            reset(&instance);
-            resetAt9(&instance);
-
-            orbis::uint32_t maxChannels =
+            orbis::uint32_t outputChannels =
                 instance.maxChannels == AJM_CHANNEL_DEFAULT
                     ? 2
                     : instance.maxChannels;
-            orbis::uint32_t outputChannels =
-                instance.at9.inputChannels > maxChannels
-                    ? maxChannels
-                    : instance.at9.inputChannels;
-            // TODO: check max channels
-            ORBIS_LOG_TODO("CONTROL_INITIALIZE AT9", instance.at9.inputChannels,
-                           instance.at9.sampleRate, instance.at9.frameSamples,
-                           instance.at9.superFrameSize, maxChannels,
-                           outputChannels, initializeBuffer->configData,
-                           (orbis::uint32_t)instance.outputFormat);
-          } else if (instance.codec == AJM_CODEC_AAC) {
-            struct InitializeBuffer {
-              orbis::uint32_t headerIndex;
-              orbis::uint32_t sampleRateIndex;
-            };
-            auto *initializeBuffer = (InitializeBuffer *)ctrl->pSidebandInput;
-            instance.aac.headerType =
-                AACHeaderType(initializeBuffer->headerIndex);
-            instance.aac.sampleRate =
-                AACFreq[initializeBuffer->sampleRateIndex];
-            if (instance.aac.headerType == AAC_RAW) {
-              avcodec_free_context(&instance.codecCtx);
-
-              AVCodecContext *codecCtx =
-                  avcodec_alloc_context3(instance.avCodec);
-              if (!codecCtx) {
-                ORBIS_LOG_FATAL("Failed to allocate codec context for raw aac");
-                std::abort();
-              }
-
-              orbis::uint32_t outputChannels =
-                  instance.maxChannels == AJM_CHANNEL_DEFAULT
-                      ? 2
-                      : instance.maxChannels;
-
-              AVChannelLayout chLayout;
-              av_channel_layout_default(&chLayout, outputChannels);
-              codecCtx->ch_layout = chLayout;
-              codecCtx->sample_rate = instance.aac.sampleRate;
-
-              if (int err = avcodec_open2(codecCtx, instance.avCodec, nullptr);
-                  err < 0) {
-                ORBIS_LOG_FATAL("Could not open codec for raw aac", err);
-                std::abort();
-              }
-
-              instance.codecCtx = codecCtx;
+
+            AVChannelLayout chLayout;
+            av_channel_layout_default(&chLayout, outputChannels);
+            codecCtx->ch_layout = chLayout;
+            codecCtx->sample_rate = instance.aac.sampleRate;
+
+            if (int err = avcodec_open2(codecCtx, instance.avCodec, nullptr);
+                err < 0) {
+              ORBIS_LOG_FATAL("Could not open codec for raw aac", err);
+              std::abort();
             }
-            ORBIS_LOG_TODO(
-                "CONTROL_INITIALIZE AAC", (std::int16_t)instance.aac.headerType,
-                instance.aac.sampleRate, (std::int16_t)instance.maxChannels,
-                (orbis::uint32_t)instance.outputFormat);
-          }
-        }
-        if (ctrl->getFlags() & SIDEBAND_GAPLESS_DECODE) {
-          struct InitializeBuffer {
-            orbis::uint32_t totalSamples;
-            orbis::uint16_t skipSamples;
-            orbis::uint16_t totalSkippedSamples;
-          };
 
-          auto *initializeBuffer = (InitializeBuffer *)ctrl->pSidebandInput;
-          if (initializeBuffer->totalSamples > 0) {
-            instance.gapless.totalSamples = initializeBuffer->totalSamples;
-          }
-          if (initializeBuffer->skipSamples > 0) {
-            instance.gapless.skipSamples = initializeBuffer->skipSamples;
+            instance.codecCtx = codecCtx;
+            instance.isCustomCodecCtx = true;
           }
-          ORBIS_LOG_TODO("SIDEBAND_GAPLESS_DECODE",
-                         instance.gapless.skipSamples,
-                         instance.gapless.totalSamples);
+          ORBIS_LOG_TODO(
+              "CONTROL_INITIALIZE AAC", (std::int16_t)instance.aac.headerType,
+              instance.aac.sampleRate, (std::int16_t)instance.maxChannels,
+              (orbis::uint32_t)instance.outputFormat);
         }
-        jobPtr += sizeof(BatchJobControlBufferRa);
-        break;
-      }
-      case Opcode::RunBufferRa: {
-        auto *job = (BatchJobInputBufferRa *)jobPtr;
-        // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobInputBufferRa",
-        //                 job->opcode, job->szInputSize, job->pInput);
-
-        auto offset = instance.inputBuffer.size();
-        instance.inputBuffer.resize(offset + job->szInputSize);
-
-        std::memcpy(instance.inputBuffer.data() + offset, job->pInput,
-                    job->szInputSize);
-        // rx::hexdump({(std::byte*) job->pInput, job->szInputSize});
-        jobPtr += sizeof(BatchJobInputBufferRa);
-        break;
-      }
-      case Opcode::Flags: {
-        auto *job = (BatchJobFlagsRa *)jobPtr;
-        // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobFlagsRa",
-        //                 job->flagsHi, job->flagsLo);
-        runJob.flags = ((orbis::uint64_t)job->flagsHi << 0x1a) | job->flagsLo;
-        jobPtr += sizeof(BatchJobFlagsRa);
-        break;
-      }
-      case Opcode::JobBufferOutputRa: {
-        auto *job = (BatchJobOutputBufferRa *)jobPtr;
-        // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobOutputBufferRa",
-        //                 job->opcode, job->outputSize, job->pOutput);
-        runJob.outputBuffers.push_back({job->pOutput, job->outputSize});
-        runJob.totalOutputSize += job->outputSize;
-        jobPtr += sizeof(BatchJobOutputBufferRa);
-        break;
-      }
-      case Opcode::JobBufferSidebandRa: {
-        auto *job = (BatchJobSidebandBufferRa *)jobPtr;
-        // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobSidebandBufferRa",
-        //                 job->opcode, job->sidebandSize, job->pSideband);
-        runJob.pSideband = job->pSideband;
-        runJob.sidebandSize = job->sidebandSize;
-        jobPtr += sizeof(BatchJobSidebandBufferRa);
-        break;
       }
-      default:
-        jobPtr = endJobPtr;
-        break;
+      if (ctrl->getFlags() & SIDEBAND_GAPLESS_DECODE) {
+        struct InitializeBuffer {
+          orbis::uint32_t totalSamples;
+          orbis::uint16_t skipSamples;
+          orbis::uint16_t totalSkippedSamples;
+        };
+
+        auto *initializeBuffer = (InitializeBuffer *)ctrl->pSidebandInput;
+        if (initializeBuffer->totalSamples > 0) {
+          instance.gapless.totalSamples = initializeBuffer->totalSamples;
+        }
+        if (initializeBuffer->skipSamples > 0) {
+          instance.gapless.skipSamples = initializeBuffer->skipSamples;
+        }
+        ORBIS_LOG_TODO("SIDEBAND_GAPLESS_DECODE", instance.gapless.skipSamples,
+                       instance.gapless.totalSamples);
       }
+      jobPtr += sizeof(BatchJobControlBufferRa);
+      break;
     }
-    ptr = jobPtr;
-
-    if (!runJob.control && instanceId >= 0xC000) {
-      auto *result = reinterpret_cast<AJMSidebandResult *>(runJob.pSideband);
-      result->result = 0;
-      result->codecResult = 0;
-      if (runJob.flags & SIDEBAND_STREAM) {
-        auto *stream =
-            reinterpret_cast<AJMSidebandStream *>(runJob.pSideband + 8);
-        stream->inputSize = instance.inputBuffer.size();
-        stream->outputSize = runJob.totalOutputSize;
-      }
-    } else if (!runJob.control) {
-      // orbis::uint32_t maxChannels =
-      //     instance.maxChannels == AJM_CHANNEL_DEFAULT ? 2
-      //                                                 :
-      //                                                 instance.maxChannels;
-      auto *result = reinterpret_cast<AJMSidebandResult *>(runJob.pSideband);
-      *result = {};
+    case Opcode::RunBufferRa: {
+      auto *job = (BatchJobInputBufferRa *)jobPtr;
+      // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobInputBufferRa",
+      //                 job->opcode, job->szInputSize, job->pInput);
+
+      auto offset = instance.inputBuffer.size();
+      instance.inputBuffer.resize(offset + job->szInputSize);
+
+      std::memcpy(instance.inputBuffer.data() + offset, job->pInput,
+                  job->szInputSize);
+      // rx::hexdump({(std::byte*) job->pInput, job->szInputSize});
+      jobPtr += sizeof(BatchJobInputBufferRa);
+      break;
+    }
+    case Opcode::Flags: {
+      auto *job = (BatchJobFlagsRa *)jobPtr;
+      // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobFlagsRa",
+      //                 job->flagsHi, job->flagsLo);
+      runJob.flags = ((orbis::uint64_t)job->flagsHi << 0x1a) | job->flagsLo;
+      jobPtr += sizeof(BatchJobFlagsRa);
+      break;
+    }
+    case Opcode::JobBufferOutputRa: {
+      auto *job = (BatchJobOutputBufferRa *)jobPtr;
+      // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobOutputBufferRa",
+      //                 job->opcode, job->outputSize, job->pOutput);
+      runJob.outputBuffers.push_back({job->pOutput, job->outputSize});
+      runJob.totalOutputSize += job->outputSize;
+      jobPtr += sizeof(BatchJobOutputBufferRa);
+      break;
+    }
+    case Opcode::JobBufferSidebandRa: {
+      auto *job = (BatchJobSidebandBufferRa *)jobPtr;
+      // ORBIS_LOG_ERROR(__FUNCTION__, request, "BatchJobSidebandBufferRa",
+      //                 job->opcode, job->sidebandSize, job->pSideband);
+      runJob.pSideband = job->pSideband;
+      runJob.sidebandSize = job->sidebandSize;
+      jobPtr += sizeof(BatchJobSidebandBufferRa);
+      break;
+    }
+    default:
+      jobPtr = endJobPtr;
+      break;
+    }
+  }
 
-      orbis::uint32_t totalDecodedBytes = 0;
-      orbis::uint32_t outputWritten = 0;
-      orbis::uint32_t framesProcessed = 0;
-      orbis::uint32_t samplesCount = 0;
-      if (!instance.inputBuffer.empty() && runJob.totalOutputSize != 0) {
-        instance.inputBuffer.reserve(instance.inputBuffer.size() +
-                                     AV_INPUT_BUFFER_PADDING_SIZE);
+  if (!runJob.control && instanceId >= 0xC000) {
+    auto *result = reinterpret_cast<AJMSidebandResult *>(runJob.pSideband);
+    result->result = 0;
+    result->codecResult = 0;
+    if (runJob.flags & SIDEBAND_STREAM) {
+      auto *stream =
+          reinterpret_cast<AJMSidebandStream *>(runJob.pSideband + 8);
+      stream->inputSize = instance.inputBuffer.size();
+      stream->outputSize = runJob.totalOutputSize;
+    }
+  } else if (!runJob.control) {
+    // orbis::uint32_t maxChannels =
+    //     instance.maxChannels == AJM_CHANNEL_DEFAULT ? 2
+    //                                                 :
+    //                                                 instance.maxChannels;
+    auto *result = reinterpret_cast<AJMSidebandResult *>(runJob.pSideband);
+    *result = {};
+
+    orbis::uint32_t totalDecodedBytes = 0;
+    orbis::uint32_t outputWritten = 0;
+    orbis::uint32_t framesProcessed = 0;
+    orbis::uint32_t samplesCount = 0;
+    if (!instance.inputBuffer.empty() && runJob.totalOutputSize != 0) {
+      instance.inputBuffer.reserve(instance.inputBuffer.size() +
+                                   AV_INPUT_BUFFER_PADDING_SIZE);
+
+      AVPacket *pkt = av_packet_alloc();
+      rx::atScopeExit _free_pkt([&] { av_packet_free(&pkt); });
+
+      AVFrame *frame = av_frame_alloc();
+      rx::atScopeExit _free_frame([&] { av_frame_free(&frame); });
+
+      do {
+        if (instance.codec == AJM_CODEC_At9 &&
+            instance.at9.frameSamples == 0) {
+          break;
+        }
+        if (totalDecodedBytes >= instance.inputBuffer.size()) {
+          break;
+        }
 
-        AVPacket *pkt = av_packet_alloc();
-        rx::atScopeExit _free_pkt([&] { av_packet_free(&pkt); });
+        framesProcessed++;
 
-        AVFrame *frame = av_frame_alloc();
-        rx::atScopeExit _free_frame([&] { av_frame_free(&frame); });
+        std::uint32_t inputFrameSize = 0;
+        std::uint32_t outputBufferSize = 0;
 
-        do {
-          if (instance.codec == AJM_CODEC_At9 &&
-              instance.at9.frameSamples == 0) {
+        if (instance.codec == AJM_CODEC_At9) {
+          inputFrameSize = 4;
+          outputBufferSize = av_samples_get_buffer_size(
+              nullptr, instance.at9.inputChannels, instance.at9.frameSamples,
+              ajmToAvFormat(instance.outputFormat), 0);
+        } else if (instance.codec == AJM_CODEC_MP3) {
+          if (instance.inputBuffer.size() - totalDecodedBytes < 4) {
+            result->result = AJM_RESULT_INVALID_DATA;
             break;
           }
-          if (totalDecodedBytes >= instance.inputBuffer.size()) {
+
+          inputFrameSize = get_mp3_data_size(
+              (orbis::uint8_t *)(instance.inputBuffer.data() +
+                                 totalDecodedBytes));
+          if (inputFrameSize == 0) {
+            result->result = AJM_RESULT_INVALID_DATA;
             break;
           }
+        } else if (instance.codec == AJM_CODEC_AAC) {
+          inputFrameSize = instance.inputBuffer.size() - totalDecodedBytes;
+        }
 
-          framesProcessed++;
+        if (inputFrameSize >
+            instance.inputBuffer.size() - totalDecodedBytes) {
+          result->result |= AJM_RESULT_PARTIAL_INPUT;
+          break;
+        }
 
-          std::uint32_t inputFrameSize = 0;
-          std::uint32_t outputBufferSize = 0;
+        if (outputBufferSize > runJob.totalOutputSize - outputWritten) {
+          result->result |= AJM_RESULT_NOT_ENOUGH_ROOM;
+          break;
+        }
 
-          if (instance.codec == AJM_CODEC_At9) {
-            inputFrameSize = 4;
-            outputBufferSize = av_samples_get_buffer_size(
-                nullptr, instance.at9.inputChannels, instance.at9.frameSamples,
-                ajmToAvFormat(instance.outputFormat), 0);
-          } else if (instance.codec == AJM_CODEC_MP3) {
-            if (instance.inputBuffer.size() - totalDecodedBytes < 4) {
-              result->result = AJM_RESULT_INVALID_DATA;
-              break;
-            }
+        pkt->data =
+            (std::uint8_t *)instance.inputBuffer.data() + totalDecodedBytes;
+        pkt->size = inputFrameSize;
 
-            inputFrameSize = get_mp3_data_size(
-                (orbis::uint8_t *)(instance.inputBuffer.data() +
-                                   totalDecodedBytes));
-            if (inputFrameSize == 0) {
-              result->result = AJM_RESULT_INVALID_DATA;
-              break;
-            }
-          } else if (instance.codec == AJM_CODEC_AAC) {
-            inputFrameSize = instance.inputBuffer.size() - totalDecodedBytes;
-          }
-
-          if (inputFrameSize >
-              instance.inputBuffer.size() - totalDecodedBytes) {
-            result->result |= AJM_RESULT_PARTIAL_INPUT;
+        if (instance.codec == AJM_CODEC_At9) {
+          orbis::int32_t bytesUsed = 0;
+          instance.outputBuffer.resize(outputBufferSize);
+          int err =
+              Atrac9Decode(instance.at9.handle,
+                           instance.inputBuffer.data() + totalDecodedBytes,
+                           instance.outputBuffer.data(),
+                           instance.at9.outputFormat, &bytesUsed);
+          if (err != ERR_SUCCESS) {
+            rx::hexdump(
+                std::span(instance.inputBuffer).subspan(totalDecodedBytes));
+            ORBIS_LOG_FATAL("Could not decode AT9 frame", err,
+                            instance.at9.estimatedSizeUsed,
+                            instance.at9.superFrameSize,
+                            instance.at9.frameSamples, instance.at9.handle,
+                            totalDecodedBytes, outputWritten);
+            result->codecResult = err;
+            result->result |= AJM_RESULT_CODEC_ERROR | AJM_RESULT_FATAL;
             break;
           }
 
-          if (outputBufferSize > runJob.totalOutputSize - outputWritten) {
-            result->result |= AJM_RESULT_NOT_ENOUGH_ROOM;
-            break;
+          instance.at9.estimatedSizeUsed =
+              static_cast<orbis::uint32_t>(bytesUsed);
+          instance.at9.superFrameDataLeft -= bytesUsed;
+          instance.at9.superFrameDataIdx++;
+          if (instance.at9.superFrameDataIdx ==
+              instance.at9.framesInSuperframe) {
+            instance.at9.estimatedSizeUsed += instance.at9.superFrameDataLeft;
+            instance.at9.superFrameDataIdx = 0;
+            instance.at9.superFrameDataLeft = instance.at9.superFrameSize;
           }
-
-          pkt->data =
-              (std::uint8_t *)instance.inputBuffer.data() + totalDecodedBytes;
-          pkt->size = inputFrameSize;
-
-          if (instance.codec == AJM_CODEC_At9) {
-            orbis::int32_t bytesUsed = 0;
-            instance.outputBuffer.resize(outputBufferSize);
-            int err =
-                Atrac9Decode(instance.at9.handle,
-                             instance.inputBuffer.data() + totalDecodedBytes,
-                             instance.outputBuffer.data(),
-                             instance.at9.outputFormat, &bytesUsed);
-            if (err != ERR_SUCCESS) {
-              rx::hexdump(
-                  std::span(instance.inputBuffer).subspan(totalDecodedBytes));
-              ORBIS_LOG_FATAL("Could not decode AT9 frame", err,
-                              instance.at9.estimatedSizeUsed,
-                              instance.at9.superFrameSize,
-                              instance.at9.frameSamples, instance.at9.handle,
-                              totalDecodedBytes, outputWritten);
-              result->codecResult = err;
-              result->result |= AJM_RESULT_CODEC_ERROR | AJM_RESULT_FATAL;
-              break;
-            }
-
-            instance.at9.estimatedSizeUsed =
-                static_cast<orbis::uint32_t>(bytesUsed);
-            instance.at9.superFrameDataLeft -= bytesUsed;
-            instance.at9.superFrameDataIdx++;
-            if (instance.at9.superFrameDataIdx ==
-                instance.at9.framesInSuperframe) {
-              instance.at9.estimatedSizeUsed += instance.at9.superFrameDataLeft;
-              instance.at9.superFrameDataIdx = 0;
-              instance.at9.superFrameDataLeft = instance.at9.superFrameSize;
-            }
-            samplesCount = instance.at9.frameSamples;
-            inputFrameSize = instance.at9.estimatedSizeUsed;
-            instance.lastDecode.channels =
-                AJMChannels(instance.at9.inputChannels);
-            instance.lastDecode.sampleRate = instance.at9.sampleRate;
-            // ORBIS_LOG_TODO("at9 decode", instance.at9.estimatedSizeUsed,
-            //                instance.at9.superFrameDataLeft,
-            //                instance.at9.superFrameDataIdx,
-            //                instance.at9.framesInSuperframe);
-          } else if (instance.codec == AJM_CODEC_MP3) {
-            int ret = avcodec_send_packet(instance.codecCtx, pkt);
-            if (ret < 0) {
-              ORBIS_LOG_FATAL("Error sending packet for decoding", ret);
-              std::abort();
-            }
-            ret = avcodec_receive_frame(instance.codecCtx, frame);
-            if (ret < 0) {
-              ORBIS_LOG_FATAL("Error during decoding MP3");
-              rx::hexdump(
-                  std::span(instance.inputBuffer).subspan(totalDecodedBytes));
-              std::abort();
-            }
-            outputBufferSize = av_samples_get_buffer_size(
-                nullptr, frame->ch_layout.nb_channels, frame->nb_samples,
-                ajmToAvFormat(instance.outputFormat), 0);
-
-            samplesCount = frame->nb_samples;
-            instance.lastDecode.channels =
-                AJMChannels(frame->ch_layout.nb_channels);
-            instance.lastDecode.sampleRate = frame->sample_rate;
-          } else if (instance.codec == AJM_CODEC_AAC) {
-            // HACK: to avoid writing a bunch of useless calls
-            // we simply call this method directly (but it can be very
-            // unstable)
-            int gotFrame;
-            int len = ffcodec(instance.codecCtx->codec)
-                          ->cb.decode(instance.codecCtx, frame, &gotFrame, pkt);
-            if (len < 0) {
-              ORBIS_LOG_FATAL("Error during decoding AAC");
-              rx::hexdump(
-                  std::span(instance.inputBuffer).subspan(totalDecodedBytes));
-              std::abort();
-            }
-            outputBufferSize = av_samples_get_buffer_size(
-                nullptr, frame->ch_layout.nb_channels, frame->nb_samples,
-                ajmToAvFormat(instance.outputFormat), 0);
-            samplesCount = frame->nb_samples;
-            inputFrameSize = len;
-            instance.lastDecode.channels =
-                AJMChannels(frame->ch_layout.nb_channels);
-            instance.lastDecode.sampleRate = frame->sample_rate;
+          samplesCount = instance.at9.frameSamples;
+          inputFrameSize = instance.at9.estimatedSizeUsed;
+          instance.lastDecode.channels =
+              AJMChannels(instance.at9.inputChannels);
+          instance.lastDecode.sampleRate = instance.at9.sampleRate;
+          // ORBIS_LOG_TODO("at9 decode", instance.at9.estimatedSizeUsed,
+          //                instance.at9.superFrameDataLeft,
+          //                instance.at9.superFrameDataIdx,
+          //                instance.at9.framesInSuperframe);
+        } else if (instance.codec == AJM_CODEC_MP3) {
+          int ret = avcodec_send_packet(instance.codecCtx, pkt);
+          if (ret < 0) {
+            ORBIS_LOG_FATAL("Error sending packet for decoding", ret);
+            std::abort();
           }
-
-          if (inputFrameSize >
-              instance.inputBuffer.size() - totalDecodedBytes) {
-            result->result |= AJM_RESULT_PARTIAL_INPUT;
-            break;
+          ret = avcodec_receive_frame(instance.codecCtx, frame);
+          if (ret < 0) {
+            ORBIS_LOG_FATAL("Error during decoding MP3");
+            rx::hexdump(
+                std::span(instance.inputBuffer).subspan(totalDecodedBytes));
+            std::abort();
           }
-
-          if (outputBufferSize > runJob.totalOutputSize - outputWritten) {
-            result->result |= AJM_RESULT_NOT_ENOUGH_ROOM;
-            break;
+          outputBufferSize = av_samples_get_buffer_size(
+              nullptr, frame->ch_layout.nb_channels, frame->nb_samples,
+              ajmToAvFormat(instance.outputFormat), 0);
+
+          samplesCount = frame->nb_samples;
+          instance.lastDecode.channels =
+              AJMChannels(frame->ch_layout.nb_channels);
+          instance.lastDecode.sampleRate = frame->sample_rate;
+        } else if (instance.codec == AJM_CODEC_AAC) {
+          // HACK: to avoid writing a bunch of useless calls
+          // we simply call this method directly (but it can be very
+          // unstable)
+          int gotFrame;
+          int len = ffcodec(instance.codecCtx->codec)
+                        ->cb.decode(instance.codecCtx, frame, &gotFrame, pkt);
+          if (len < 0) {
+            ORBIS_LOG_FATAL("Error during decoding AAC");
+            rx::hexdump(
+                std::span(instance.inputBuffer).subspan(totalDecodedBytes));
+            std::abort();
           }
+          outputBufferSize = av_samples_get_buffer_size(
+              nullptr, frame->ch_layout.nb_channels, frame->nb_samples,
+              ajmToAvFormat(instance.outputFormat), 0);
+          samplesCount = frame->nb_samples;
+          inputFrameSize = len;
+          instance.lastDecode.channels =
+              AJMChannels(frame->ch_layout.nb_channels);
+          instance.lastDecode.sampleRate = frame->sample_rate;
+        }
+
+        if (inputFrameSize >
+            instance.inputBuffer.size() - totalDecodedBytes) {
+          result->result |= AJM_RESULT_PARTIAL_INPUT;
+          break;
+        }
+
+        if (outputBufferSize > runJob.totalOutputSize - outputWritten) {
+          result->result |= AJM_RESULT_NOT_ENOUGH_ROOM;
+          break;
+        }
 
-          totalDecodedBytes += inputFrameSize;
+        totalDecodedBytes += inputFrameSize;
 
-          if (instance.isNeedToSkipOutput()) {
-            instance.gapless.totalSkippedSamples += samplesCount;
-            continue;
+        if (instance.isNeedToSkipOutput()) {
+          instance.gapless.totalSkippedSamples += samplesCount;
+          continue;
+        }
+
+        // at least three codecs outputs in float
+        // and mp3 support sample rate resample (TODO), so made resampling
+        // with swr
+        if (instance.codec != AJM_CODEC_At9) {
+          instance.outputBuffer.resize(outputBufferSize);
+
+          if (instance.resampler == nullptr) {
+            instance.resamplerKey =
+                ajmResamplerKey(frame->ch_layout.nb_channels,
+                                frame->sample_rate, instance.outputFormat);
+            instance.resampler = ajmAcquireResampler(
+                instance.resamplerKey, frame->ch_layout.nb_channels,
+                frame->sample_rate, instance.outputFormat);
           }
 
-          // at least three codecs outputs in float
-          // and mp3 support sample rate resample (TODO), so made resampling
-          // with swr
-          if (instance.codec != AJM_CODEC_At9) {
-            instance.outputBuffer.resize(outputBufferSize);
-
-            if (instance.resampler == nullptr) {
-              instance.resampler = swr_alloc();
-              auto resampler = instance.resampler;
-
-              AVChannelLayout chLayout;
-              av_channel_layout_default(&chLayout,
-                                        frame->ch_layout.nb_channels);
-              av_opt_set_chlayout(resampler, "in_chlayout", &chLayout, 0);
-              av_opt_set_chlayout(resampler, "out_chlayout", &chLayout, 0);
-              av_opt_set_int(resampler, "in_sample_rate", frame->sample_rate,
-                             0);
-              av_opt_set_int(resampler, "out_sample_rate", frame->sample_rate,
-                             0);
-              av_opt_set_sample_fmt(resampler, "in_sample_fmt",
-                                    ajmToAvFormat(AJM_FORMAT_FLOAT), 0);
-              av_opt_set_sample_fmt(resampler, "out_sample_fmt",
-                                    ajmToAvFormat(instance.outputFormat), 0);
-              if (swr_init(resampler) < 0) {
-                ORBIS_LOG_FATAL("Failed to initialize the resampling context");
-                std::abort();
-              }
-            }
+          auto *outputBuffer = reinterpret_cast<orbis::uint8_t *>(
+              instance.outputBuffer.data());
+          int nb_samples = swr_convert(
+              instance.resampler, &outputBuffer, frame->nb_samples,
+              frame->extended_data, frame->nb_samples);
+          if (nb_samples != frame->nb_samples) {
+            ORBIS_LOG_FATAL("Error while converting");
+            std::abort();
+          }
+        }
 
-            auto *outputBuffer = reinterpret_cast<orbis::uint8_t *>(
-                instance.outputBuffer.data());
-            int nb_samples = swr_convert(
-                instance.resampler, &outputBuffer, frame->nb_samples,
-                frame->extended_data, frame->nb_samples);
-            if (nb_samples != frame->nb_samples) {
-              ORBIS_LOG_FATAL("Error while converting");
-              std::abort();
+        std::uint32_t bufferOutputWritten = 0;
+        for (std::size_t bufferOffset = 0;
+             auto buffer : runJob.outputBuffers) {
+          if (bufferOffset <= outputWritten &&
+              bufferOffset + buffer.size > outputWritten) {
+            auto byteOffset = outputWritten - bufferOffset;
+            auto size =
+                std::min(buffer.size - byteOffset,
+                         instance.outputBuffer.size() - bufferOutputWritten);
+            ORBIS_RET_ON_ERROR(orbis::uwrite(
+                buffer.pOutput + byteOffset,
+                instance.outputBuffer.data() + bufferOutputWritten, size));
+
+            bufferOutputWritten += size;
+            outputWritten += size;
+
+            if (bufferOutputWritten >= instance.outputBuffer.size()) {
+              break;
             }
           }
 
-          std::uint32_t bufferOutputWritten = 0;
-          for (std::size_t bufferOffset = 0;
-               auto buffer : runJob.outputBuffers) {
-            if (bufferOffset <= outputWritten &&
-                bufferOffset + buffer.size > outputWritten) {
-              auto byteOffset = outputWritten - bufferOffset;
-              auto size =
-                  std::min(buffer.size - byteOffset,
-                           instance.outputBuffer.size() - bufferOutputWritten);
-              ORBIS_RET_ON_ERROR(orbis::uwrite(
-                  buffer.pOutput + byteOffset,
-                  instance.outputBuffer.data() + bufferOutputWritten, size));
-
-              bufferOutputWritten += size;
-              outputWritten += size;
-
-              if (bufferOutputWritten >= instance.outputBuffer.size()) {
-                break;
-              }
-            }
+          bufferOffset += buffer.size;
+        }
 
-            bufferOffset += buffer.size;
-          }
+        instance.processedSamples += samplesCount;
+      } while ((runJob.flags & RUN_MULTIPLE_FRAMES) != 0);
+    }
 
-          instance.processedSamples += samplesCount;
-        } while ((runJob.flags & RUN_MULTIPLE_FRAMES) != 0);
-      }
+    orbis::int64_t currentSize = sizeof(AJMSidebandResult);
+
+    if (runJob.flags & SIDEBAND_STREAM) {
+      // ORBIS_LOG_TODO("SIDEBAND_STREAM", currentSize, outputWritten,
+      //                instance.processedSamples);
+      auto *stream = reinterpret_cast<AJMSidebandStream *>(runJob.pSideband +
+                                                           currentSize);
+      stream->inputSize = totalDecodedBytes;
+      stream->outputSize = outputWritten;
+      stream->decodedSamples = instance.processedSamples;
+      currentSize += sizeof(AJMSidebandStream);
+    }
 
-      orbis::int64_t currentSize = sizeof(AJMSidebandResult);
-
-      if (runJob.flags & SIDEBAND_STREAM) {
-        // ORBIS_LOG_TODO("SIDEBAND_STREAM", currentSize, outputWritten,
-        //                instance.processedSamples);
-        auto *stream = reinterpret_cast<AJMSidebandStream *>(runJob.pSideband +
-                                                             currentSize);
-        stream->inputSize = totalDecodedBytes;
-        stream->outputSize = outputWritten;
-        stream->decodedSamples = instance.processedSamples;
-        currentSize += sizeof(AJMSidebandStream);
-      }
+    if (runJob.flags & SIDEBAND_FORMAT) {
+      // ORBIS_LOG_TODO("SIDEBAND_FORMAT", currentSize,
+      //                (std::uint16_t)instance.lastDecode.channels,
+      //                (std::uint16_t)instance.outputFormat,
+      //                instance.lastDecode.sampleRate);
+      auto *format = reinterpret_cast<AJMSidebandFormat *>(runJob.pSideband +
+                                                           currentSize);
+      format->channels = AJMChannels(instance.lastDecode.channels);
+      format->sampleRate = instance.lastDecode.sampleRate;
+      format->sampleFormat = instance.outputFormat;
+      // TODO: channel mask and bitrate
+      currentSize += sizeof(AJMSidebandFormat);
+    }
 
-      if (runJob.flags & SIDEBAND_FORMAT) {
-        // ORBIS_LOG_TODO("SIDEBAND_FORMAT", currentSize,
-        //                (std::uint16_t)instance.lastDecode.channels,
-        //                (std::uint16_t)instance.outputFormat,
-        //                instance.lastDecode.sampleRate);
-        auto *format = reinterpret_cast<AJMSidebandFormat *>(runJob.pSideband +
-                                                             currentSize);
-        format->channels = AJMChannels(instance.lastDecode.channels);
-        format->sampleRate = instance.lastDecode.sampleRate;
-        format->sampleFormat = instance.outputFormat;
-        // TODO: channel mask and bitrate
-        currentSize += sizeof(AJMSidebandFormat);
-      }
+    if (runJob.flags & SIDEBAND_GAPLESS_DECODE) {
+      // ORBIS_LOG_TODO("SIDEBAND_GAPLESS_DECODE", currentSize);
+      auto *gapless = reinterpret_cast<AJMSidebandGaplessDecode *>(
+          runJob.pSideband + currentSize);
+      gapless->skipSamples = instance.gapless.skipSamples;
+      gapless->totalSamples = instance.gapless.totalSamples;
+      gapless->totalSkippedSamples = instance.gapless.totalSkippedSamples;
+      currentSize += sizeof(AJMSidebandGaplessDecode);
+    }
 
-      if (runJob.flags & SIDEBAND_GAPLESS_DECODE) {
-        // ORBIS_LOG_TODO("SIDEBAND_GAPLESS_DECODE", currentSize);
-        auto *gapless = reinterpret_cast<AJMSidebandGaplessDecode *>(
+    if (runJob.flags & RUN_GET_CODEC_INFO) {
+      // ORBIS_LOG_TODO("RUN_GET_CODEC_INFO");
+      if (instance.codec == AJM_CODEC_At9) {
+        auto *info = reinterpret_cast<AJMAt9CodecInfoSideband *>(
+            runJob.pSideband + currentSize);
+        info->superFrameSize = instance.at9.superFrameSize;
+        info->framesInSuperFrame = instance.at9.framesInSuperframe;
+        info->frameSamples = instance.at9.frameSamples;
+        currentSize += sizeof(AJMAt9CodecInfoSideband);
+      } else if (instance.codec == AJM_CODEC_MP3) {
+        // TODO
+        auto *info = reinterpret_cast<AJMMP3CodecInfoSideband *>(
             runJob.pSideband + currentSize);
-        gapless->skipSamples = instance.gapless.skipSamples;
-        gapless->totalSamples = instance.gapless.totalSamples;
-        gapless->totalSkippedSamples = instance.gapless.totalSkippedSamples;
-        currentSize += sizeof(AJMSidebandGaplessDecode);
+        currentSize += sizeof(AJMMP3CodecInfoSideband);
+      } else if (instance.codec == AJM_CODEC_AAC) {
+        // TODO
+        auto *info = reinterpret_cast<AJMAACCodecInfoSideband *>(
+            runJob.pSideband + currentSize);
+        info->heaac = instance.codecCtx->profile == FF_PROFILE_AAC_HE ||
+                      instance.codecCtx->profile == FF_PROFILE_AAC_HE_V2;
+        currentSize += sizeof(AJMAACCodecInfoSideband);
       }
+    }
 
-      if (runJob.flags & RUN_GET_CODEC_INFO) {
-        // ORBIS_LOG_TODO("RUN_GET_CODEC_INFO");
-        if (instance.codec == AJM_CODEC_At9) {
-          auto *info = reinterpret_cast<AJMAt9CodecInfoSideband *>(
-              runJob.pSideband + currentSize);
-          info->superFrameSize = instance.at9.superFrameSize;
-          info->framesInSuperFrame = instance.at9.framesInSuperframe;
-          info->frameSamples = instance.at9.frameSamples;
-          currentSize += sizeof(AJMAt9CodecInfoSideband);
-        } else if (instance.codec == AJM_CODEC_MP3) {
-          // TODO
-          auto *info = reinterpret_cast<AJMMP3CodecInfoSideband *>(
-              runJob.pSideband + currentSize);
-          currentSize += sizeof(AJMMP3CodecInfoSideband);
-        } else if (instance.codec == AJM_CODEC_AAC) {
-          // TODO
-          auto *info = reinterpret_cast<AJMAACCodecInfoSideband *>(
-              runJob.pSideband + currentSize);
-          info->heaac = instance.codecCtx->profile == FF_PROFILE_AAC_HE ||
-                        instance.codecCtx->profile == FF_PROFILE_AAC_HE_V2;
-          currentSize += sizeof(AJMAACCodecInfoSideband);
-        }
-      }
+    if (runJob.flags & RUN_MULTIPLE_FRAMES) {
+      // ORBIS_LOG_TODO("RUN_MULTIPLE_FRAMES", framesProcessed);
+      auto *multipleFrames = reinterpret_cast<AJMSidebandMultipleFrames *>(
+          runJob.pSideband + currentSize);
+      multipleFrames->framesProcessed = framesProcessed;
+      currentSize += sizeof(AJMSidebandMultipleFrames);
+    }
+  }
 
-      if (runJob.flags & RUN_MULTIPLE_FRAMES) {
-        // ORBIS_LOG_TODO("RUN_MULTIPLE_FRAMES", framesProcessed);
-        auto *multipleFrames = reinterpret_cast<AJMSidebandMultipleFrames *>(
-            runJob.pSideband + currentSize);
-        multipleFrames->framesProcessed = framesProcessed;
-        currentSize += sizeof(AJMSidebandMultipleFrames);
+  return {};
+}
+
+static void ajmRunJob(AjmDevice *device, orbis::uint32_t batchId,
+                      orbis::uint32_t instanceId, std::byte *ptr) {
+  Instance *instance;
+  {
+    std::lock_guard lock(device->mtx);
+    // TODO: handle unimplemented codecs, so auto create instance for now
+    instance = &device->instanceMap[instanceId];
+  }
+
+  orbis::ErrorCode error;
+  {
+    std::lock_guard lock(instance->mtx);
+    error = ajmRunInstruction(device, *instance, instanceId, ptr);
+  }
+
+  std::lock_guard lock(device->mtx);
+  auto it = device->batches.find(batchId);
+  if (it == device->batches.end()) {
+    return;
+  }
+
+  if (error != orbis::ErrorCode{}) {
+    it->second.error = error;
+  }
+
+  if (--it->second.pendingJobs == 0) {
+    device->batchCv.notify_all(device->mtx);
+  }
+}
+
+struct AjmIoctlStartBatchBuffer {
+  orbis::uint32_t result;
+  orbis::uint32_t unk0;
+  orbis::ptr<std::byte> pBatch;
+  orbis::uint32_t batchSize;
+  orbis::uint32_t priority;
+  orbis::uint64_t batchError;
+  orbis::uint32_t batchId;
+};
+static orbis::ErrorCode
+ajm_ioctl_start_batch_buffer(orbis::Thread *, AjmDevice *device,
+                             AjmIoctlStartBatchBuffer &args) {
+  // ORBIS_LOG_ERROR(__FUNCTION__, args.result, args.unk0, args.pBatch,
+  //                 args.batchSize, args.priority, args.batchError, args.batchId);
+  // thread->where();
+
+  std::vector<std::pair<orbis::uint32_t, std::byte *>> instructions;
+
+  auto ptr = args.pBatch;
+  auto endPtr = args.pBatch + args.batchSize;
+
+  while (ptr < endPtr) {
+    auto header = (InstructionHeader *)ptr;
+    auto instanceId = (header->id >> 6) & 0xfffff;
+    instructions.emplace_back(instanceId, ptr);
+    ptr += std::max<orbis::uint32_t>(header->len, sizeof(InstructionHeader));
+  }
+
+  args.result = 0;
+
+  {
+    std::lock_guard lock(device->mtx);
+    args.batchId = device->batchId++;
+
+    // forget completed batches which were never waited
+    for (auto it = device->batches.begin();
+         device->batches.size() >= AjmDevice::kMaxBatches &&
+         it != device->batches.end();) {
+      if (it->second.pendingJobs == 0) {
+        it = device->batches.erase(it);
+      } else {
+        ++it;
       }
     }
+
+    device->batches[args.batchId].pendingJobs = instructions.size();
+  }
+
+  // instructions of the instance are executed in submission order by the
+  // same worker
+  for (auto [instanceId, instruction] : instructions) {
+    getAjmWorkers().submit(
+        instanceId, [device, batchId = args.batchId, instanceId,
+                     instruction] {
+          ajmRunJob(device, batchId, instanceId, instruction);
+        });
   }
 
   return {};
@@ -839,7 +1117,41 @@ ajm_ioctl_wait_batch_buffer(orbis::Thread *thread, AjmDevice *device,
   // ORBIS_LOG_ERROR(__FUNCTION__, request, args.result, args.unk0,
   //                 args.batchId, args.timeout, args.batchError);
   // thread->where();
-  return {};
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::microseconds(args.timeout);
+
+  std::lock_guard lock(device->mtx);
+  while (true) {
+    auto it = device->batches.find(args.batchId);
+    if (it == device->batches.end()) {
+      return {};
+    }
+
+    if (it->second.pendingJobs == 0) {
+      auto error = it->second.error;
+      device->batches.erase(it);
+      return error;
+    }
+
+    if (args.timeout == ~orbis::uint32_t(0)) {
+      orbis::scoped_unblock unblock;
+      device->batchCv.wait(device->mtx);
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      // batch is still in progress
+      return orbis::ErrorCode::BUSY;
+    }
+
+    orbis::scoped_unblock unblock;
+    device->batchCv.wait(
+        device->mtx,
+        std::chrono::duration_cast<std::chrono::microseconds>(deadline - now)
+            .count());
+  }
 }
 
 static const orbis::FileOps fileOps = {};
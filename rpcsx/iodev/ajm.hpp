@@ -337,7 +337,11 @@ struct Instance {
 
   const AVCodec *avCodec;
   AVCodecContext *codecCtx;
+
+  // codec context opened with stream parameters, not returned to the pool
+  bool isCustomCodecCtx;
   SwrContext *resampler;
+  orbis::uint64_t resamplerKey;
   orbis::uint32_t lastBatchId;
   // TODO: use AJMSidebandGaplessDecode for these variables
   AJMSidebandGaplessDecode gapless;
@@ -490,13 +490,8 @@ static orbis::ErrorCode dce_ioctl(orbis::File *file, std::uint64_t request,
 
       // Mode set
       orbis::g_context->deviceEventEmitter->emit(
-          orbis::kEvFiltDisplay,
-          [](orbis::KNote *note) -> std::optional<orbis::intptr_t> {
-            if ((note->event.ident >> 48) == 0x64) {
-              return 0;
-            }
-            return {};
-          });
+          orbis::kEvFiltDisplay, 0x64ull << 48, (0x65ull << 48) - 1,
+          [](orbis::KNote *) -> std::optional<orbis::intptr_t> { return 0; });
 
     } else { // used during open/close
       ORBIS_LOG_NOTICE("dce: UNIMPLEMENTED FlipControl", args->id, args->arg2,
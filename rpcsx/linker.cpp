@@ -4,8 +4,10 @@
 #include "orbis/module/Module.hpp"
 #include "orbis/stat.hpp"
 #include "orbis/uio.hpp"
+#include "thread.hpp"
 #include "vfs.hpp"
 #include "vm.hpp"
+#include <algorithm>
 #include <bit>
 #include <crypto/sha1.h>
 #include <elf.h>
@@ -359,6 +361,85 @@ void rx::linker::override(std::string originalModuleName,
       std::move(replacedModulePath);
 }
 
+// thunk page is reserved at the end of the module image mapping, so it is
+// released with the image
+static std::byte *createSyscallThunk(std::byte *thunk, void *trampoline) {
+  if (!vm::protect(thunk, vm::kPageSize,
+                   vm::kMapProtCpuRead | vm::kMapProtCpuWrite)) {
+    return nullptr;
+  }
+
+  // mov r10, rcx; jmp [rip]
+  static constexpr std::uint8_t kThunkCode[] = {0x49, 0x89, 0xca, 0xff,
+                                                0x25, 0x00, 0x00, 0x00,
+                                                0x00};
+  std::memcpy(thunk, kThunkCode, sizeof(kThunkCode));
+  std::memcpy(thunk + sizeof(kThunkCode), &trampoline, sizeof(trampoline));
+  vm::protect(thunk, vm::kPageSize,
+              vm::kMapProtCpuRead | vm::kMapProtCpuExec);
+  return thunk;
+}
+
+// Replaces `mov r10, rcx; syscall` of `mov rax, imm32; mov r10, rcx; syscall;
+// jb` stubs with a call of the module thunk, which jumps to the host syscall
+// trampoline. Other syscall sites are left to SIGSYS
+static std::size_t patchSyscallStubs(std::byte *code, std::size_t size,
+                                     std::byte *&thunk, std::byte *thunkPage) {
+  auto trampoline = rx::thread::getSyscallTrampoline();
+  if (trampoline == nullptr) {
+    return 0;
+  }
+
+  static constexpr std::uint8_t kMovRax[] = {0x48, 0xc7, 0xc0};
+  static constexpr std::uint8_t kSyscall[] = {0x49, 0x89, 0xca, 0x0f, 0x05};
+  static constexpr std::size_t kStubSize =
+      sizeof(kMovRax) + sizeof(std::uint32_t) + sizeof(kSyscall);
+
+  auto bytes = reinterpret_cast<std::uint8_t *>(code);
+  std::size_t count = 0;
+
+  for (std::size_t i = 0; i + kStubSize + 2 <= size; ++i) {
+    if (std::memcmp(bytes + i, kMovRax, sizeof(kMovRax)) != 0) {
+      continue;
+    }
+
+    auto site = bytes + i + kStubSize - sizeof(kSyscall);
+    if (std::memcmp(site, kSyscall, sizeof(kSyscall)) != 0) {
+      continue;
+    }
+
+    // jb rel8 or jb rel32
+    auto next = bytes + i + kStubSize;
+    if (next[0] != 0x72 && (next[0] != 0x0f || next[1] != 0x82)) {
+      continue;
+    }
+
+    if (thunk == nullptr) {
+      thunk = createSyscallThunk(thunkPage, trampoline);
+
+      if (thunk == nullptr) {
+        break;
+      }
+    }
+
+    auto rel = reinterpret_cast<std::intptr_t>(thunk) -
+               reinterpret_cast<std::intptr_t>(site + 5);
+
+    if (rel != static_cast<std::int32_t>(rel)) {
+      break;
+    }
+
+    auto rel32 = static_cast<std::int32_t>(rel);
+    site[0] = 0xe8; // call rel32
+    std::memcpy(site + 1, &rel32, sizeof(rel32));
+
+    ++count;
+    i += kStubSize - 1;
+  }
+
+  return count;
+}
+
 rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
                                               orbis::Process *process) {
   rx::Ref<orbis::Module> result{orbis::knew<orbis::Module>()};
@@ -456,9 +537,19 @@ rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
 
   auto imageSize = endAddress - baseAddress;
 
+  bool hasCode = std::ranges::any_of(phdrs, [](const Elf64_Phdr &phdr) {
+    return phdr.p_type == kElfProgramTypeLoad && (phdr.p_flags & PF_X);
+  });
+
+  // one page after the image is reserved for the syscall thunk
+  auto thunkPageOffset = rx::alignUp(imageSize, vm::kPageSize);
+  auto mappedSize = thunkPageOffset;
+  if (hasCode && rx::thread::getSyscallTrampoline() != nullptr) {
+    mappedSize += vm::kPageSize;
+  }
+
   auto imageBase = reinterpret_cast<std::byte *>(
-      vm::map(reinterpret_cast<void *>(baseAddress),
-              rx::alignUp(imageSize, vm::kPageSize), 0,
+      vm::map(reinterpret_cast<void *>(baseAddress), mappedSize, 0,
               vm::kMapFlagPrivate | vm::kMapFlagAnonymous |
                   (baseAddress ? vm::kMapFlagFixed : 0)));
 
@@ -882,6 +973,8 @@ rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
     }
   }
 
+  std::byte *syscallThunk = nullptr;
+
   for (auto phdr : phdrs) {
     if (phdr.p_type == kElfProgramTypeLoad ||
         phdr.p_type == kElfProgramTypeSceRelRo ||
@@ -894,6 +987,14 @@ rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
       std::memcpy(imageBase + phdr.p_vaddr - baseAddress,
                   image.data() + phdr.p_offset, phdr.p_filesz);
 
+      if (phdr.p_type == kElfProgramTypeLoad && (phdr.p_flags & PF_X)) {
+        auto patched = patchSyscallStubs(
+            imageBase + phdr.p_vaddr - baseAddress, phdr.p_filesz,
+            syscallThunk, imageBase + thunkPageOffset);
+        rx::thread::getSyscallStats().patchedSites.fetch_add(
+            patched, std::memory_order::relaxed);
+      }
+
       if (phdr.p_type == kElfProgramTypeSceRelRo ||
           phdr.p_type == kElfProgramTypeGnuRelRo) {
         phdr.p_flags |= vm::kMapProtCpuWrite; // TODO: reprotect on relocations
@@ -945,7 +1046,10 @@ rx::Ref<orbis::Module> rx::linker::loadModule(std::span<std::byte> image,
   }
 
   result->base = imageBase - baseAddress;
-  result->size = imageSize + baseAddress;
+  // module range covers the thunk page, it is released with the image
+  result->size =
+      (syscallThunk != nullptr ? thunkPageOffset + vm::kPageSize : imageSize) +
+      baseAddress;
   result->phdrAddress = phdrPhdrIndex >= 0 ? phdrs[phdrPhdrIndex].p_vaddr
                                            : baseAddress + header.e_phoff;
   result->phNum = header.e_phnum;
@@ -30,6 +30,7 @@
 #include <orbis/KernelAllocator.hpp>
 #include <orbis/KernelContext.hpp>
 #include <orbis/KernelObject.hpp>
+#include <orbis/aio.hpp>
 #include <orbis/module.hpp>
 #include <orbis/module/Module.hpp>
 #include <orbis/sys/sysentry.hpp>
@@ -92,9 +93,18 @@ handle_signal(int sig, siginfo_t *info, void *ucontext) {
 
         if ((flags & amdgpu::kPageReadWriteLock) != 0) {
           if ((flags & amdgpu::kPageLazyLock) != 0) {
-            if (std::uint32_t gpuCommand = 0;
-                !gpuContext.gpuCacheCommand[vmid].compare_exchange_weak(
-                    gpuCommand, page)) {
+            bool queued = false;
+            for (auto &gpuCommand : gpuContext.gpuCacheCommands[vmid]) {
+              std::uint32_t expCommand = 0;
+              if (gpuCommand.compare_exchange_strong(
+                      expCommand, page, std::memory_order::release,
+                      std::memory_order::relaxed)) {
+                queued = true;
+                break;
+              }
+            }
+
+            if (!queued) {
               continue;
             }
 
@@ -760,13 +770,34 @@ static void usage(const char *argv0) {
   std::println("{} [<options>...] <virtual path to elf> [args...]", argv0);
   std::println("  options:");
   std::println("  --version, -v - print version");
-  std::println("    -m, --mount <host path> <virtual path>");
+  std::println("    -m, --mount <host path> <virtual path> - mount host "
+               "directory or ISO 9660/UDF disc image");
   std::println("    -o, --override <original module name> <virtual path to "
                "overriden module>");
   std::println("    --fw <path to firmware root>");
   std::println(
       "    --gpu <index> - specify physical gpu index to use, default is 0");
   std::println("    --disable-cache - disable cache of gpu resources");
+  std::println("    --shader-cache <host path> - store translated shaders in "
+               "specified directory");
+  std::println("    --async-shaders <off|wait|skip> - translate shaders on "
+               "worker threads, skip draws while translation is pending");
+  std::println("    --async-shaders-wait <ms> - time to wait for shader "
+               "translation in 'wait' mode, default is 2");
+  std::println("    --shader-workers <count> - count of shader translation "
+               "threads, default depends on cpu count");
+  std::println("    --gpu-pipe-workers <count> - count of gpu pipe processing "
+               "threads, 1 processes all pipes on presenter thread, default "
+               "is thread per vulkan queue");
+  std::println("    --trap-syscalls - do not patch guest syscall stubs, "
+               "handle every syscall with SIGSYS");
+  std::println("    --log-mode <sync|text|binary> - format logs on the calling "
+               "thread, on the formatter thread or write binary log, default "
+               "is sync");
+  std::println("    --log-file <host path> - path of the binary log, default "
+               "is orbis-log.bin");
+  std::println("    --log-drop <drop|block> - drop records or wait when log "
+               "ring of the thread is full, default is drop");
   // std::println("    --presenter <window>");
   std::println("    --trace");
 }
@@ -908,6 +939,9 @@ int main(int argc, const char *argv[]) {
   bool asRoot = false;
   bool isSystem = false;
   bool isSafeMode = false;
+  auto logMode = orbis::LogMode::Sync;
+  auto logDropPolicy = orbis::LogDropPolicy::Drop;
+  std::string logPath;
 
   int argIndex = 1;
   orbis::initializeAllocator();
@@ -922,6 +956,18 @@ int main(int argc, const char *argv[]) {
 
       std::println("mounting '{}' to virtual '{}'", argv[argIndex + 1],
                    argv[argIndex + 2]);
+      if (std::filesystem::is_regular_file(argv[argIndex + 1])) {
+        auto device = createDiscImageIoDevice(argv[argIndex + 1]);
+        if (device == nullptr) {
+          std::println(stderr, "'{}' is not a disc image", argv[argIndex + 1]);
+          return 1;
+        }
+
+        vfs::mount(argv[argIndex + 2], device);
+        argIndex += 3;
+        continue;
+      }
+
       if (!std::filesystem::is_directory(argv[argIndex + 1])) {
         std::println(stderr, "Directory '{}' not exists", argv[argIndex + 1]);
         return 1;
@@ -953,6 +999,59 @@ int main(int argc, const char *argv[]) {
       continue;
     }
 
+    if (argv[argIndex] == std::string_view("--log-mode")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      auto mode = std::string_view(argv[argIndex + 1]);
+      if (mode == "sync") {
+        logMode = orbis::LogMode::Sync;
+      } else if (mode == "text") {
+        logMode = orbis::LogMode::Text;
+      } else if (mode == "binary") {
+        logMode = orbis::LogMode::Binary;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--log-file")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      logPath = argv[argIndex + 1];
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--log-drop")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      auto policy = std::string_view(argv[argIndex + 1]);
+      if (policy == "drop") {
+        logDropPolicy = orbis::LogDropPolicy::Drop;
+      } else if (policy == "block") {
+        logDropPolicy = orbis::LogDropPolicy::Block;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+
+      argIndex += 2;
+      continue;
+    }
+
     if (argv[argIndex] == std::string_view("--root")) {
       argIndex++;
       asRoot = true;
@@ -999,6 +1098,83 @@ int main(int argc, const char *argv[]) {
       continue;
     }
 
+    if (argv[argIndex] == std::string_view("--shader-cache")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderCachePath = argv[argIndex + 1];
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--async-shaders")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      std::string_view mode = argv[argIndex + 1];
+
+      if (mode == "off") {
+        rx::g_config.asyncShaderMode = rx::AsyncShaderMode::Off;
+      } else if (mode == "wait") {
+        rx::g_config.asyncShaderMode = rx::AsyncShaderMode::Wait;
+      } else if (mode == "skip") {
+        rx::g_config.asyncShaderMode = rx::AsyncShaderMode::Skip;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--async-shaders-wait")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.asyncShaderWaitMs = std::atoi(argv[argIndex + 1]);
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--shader-workers")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.shaderWorkerCount = std::atoi(argv[argIndex + 1]);
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--gpu-pipe-workers")) {
+      if (argc <= argIndex + 1) {
+        usage(argv[0]);
+        return 1;
+      }
+
+      rx::g_config.gpuPipeWorkerCount = std::atoi(argv[argIndex + 1]);
+
+      argIndex += 2;
+      continue;
+    }
+
+    if (argv[argIndex] == std::string_view("--trap-syscalls")) {
+      argIndex++;
+      rx::g_config.fastSyscalls = false;
+      continue;
+    }
+
     if (argv[argIndex] == std::string_view("--debug-gpu")) {
       argIndex++;
       rx::g_config.debugGpu = true;
@@ -1026,6 +1202,8 @@ int main(int argc, const char *argv[]) {
     break;
   }
 
+  orbis::log_configure(logMode, logDropPolicy, std::move(logPath));
+
   setupSigHandlers();
   orbis::constructAllGlobals();
   orbis::g_context->deviceEventEmitter = orbis::knew<orbis::EventEmitter>();
@@ -1381,6 +1559,9 @@ int main(int argc, const char *argv[]) {
 
   vm::deinitialize();
   rx::thread::deinitialize();
+  orbis::log_flush();
+  orbis::printAioStats();
+  vfs::printStats();
 
   return status;
 }
@@ -294,6 +294,18 @@ query_memory_protection(orbis::Thread *thread, orbis::ptr<void> address,
   return ErrorCode::INVAL;
 }
 
+orbis::SysResult query_memory_backing(orbis::Thread *thread,
+                                      orbis::ptr<const void> addr,
+                                      orbis::uint64_t *object,
+                                      orbis::uint64_t *inode,
+                                      orbis::uint64_t *offset) {
+  if (!vm::queryBacking(addr, object, inode, offset)) {
+    return ErrorCode::INVAL;
+  }
+
+  return {};
+}
+
 orbis::SysResult open(orbis::Thread *thread, orbis::ptr<const char> path,
                       orbis::sint flags, orbis::sint mode,
                       rx::Ref<orbis::File> *file) {
@@ -996,6 +1008,7 @@ ProcessOps rx::procOpsTable = {
     .munlock = munlock,
     .virtual_query = virtual_query,
     .query_memory_protection = query_memory_protection,
+    .query_memory_backing = query_memory_backing,
     .open = open,
     .shm_open = shm_open,
     .unlink = unlink,
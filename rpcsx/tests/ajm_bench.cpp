@@ -0,0 +1,469 @@
+// Frames decoded per second by the AJM device replaying MP3, ADTS AAC and AT9
+// streams from disk. Every frame is submitted as one decode instruction, 1 to
+// 4 instances decode the stream in parallel.
+//
+// usage: rpcsx_bench_ajm <file.mp3|file.aac|file.at9>...
+
+#include "io-devices.hpp"
+#include "iodev/ajm.hpp"
+#include "orbis/KernelAllocator.hpp"
+#include "orbis/KernelObject.hpp"
+#include "orbis/file.hpp"
+#include "orbis/thread/Process.hpp"
+#include "orbis/thread/Thread.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+namespace {
+// ioctl arguments and job buffers must be in the guest address range
+constexpr std::uintptr_t kUserAddress = 0x10'0000'0000;
+constexpr std::size_t kMaxInstances = 4;
+constexpr std::size_t kFramesPerBatch = 32;
+constexpr std::size_t kMaxFrameOutput = 16 * 1024;
+constexpr std::size_t kSidebandSize = 64;
+
+constexpr std::uint64_t kIoctlInstanceCreate = 0xc0288905;
+constexpr std::uint64_t kIoctlInstanceDestroy = 0xc0288906;
+constexpr std::uint64_t kIoctlStartBatch = 0xc0288907;
+constexpr std::uint64_t kIoctlWaitBatch = 0xc0288908;
+
+// ioctl argument layouts of the device
+struct InstanceCreateArgs {
+  std::uint32_t result;
+  std::uint32_t unk0;
+  std::uint64_t flags;
+  std::uint32_t codec;
+  std::uint32_t instanceId;
+  std::uint32_t unk[4];
+};
+
+struct InstanceDestroyArgs {
+  std::uint32_t result;
+  std::uint32_t unk0;
+  std::uint32_t instanceId;
+  std::uint32_t unk[7];
+};
+
+struct StartBatchArgs {
+  std::uint32_t result;
+  std::uint32_t unk0;
+  std::byte *batch;
+  std::uint32_t batchSize;
+  std::uint32_t priority;
+  std::uint64_t batchError;
+  std::uint32_t batchId;
+};
+
+struct WaitBatchArgs {
+  std::uint32_t result;
+  std::uint32_t unk0;
+  std::uint32_t batchId;
+  std::uint32_t timeout;
+  std::uint64_t batchError;
+  std::uint32_t unk[4];
+};
+
+struct DecodeInstruction {
+  InstructionHeader header;
+  BatchJobInputBufferRa input;
+  BatchJobFlagsRa flags;
+  BatchJobOutputBufferRa output;
+  BatchJobSidebandBufferRa sideband;
+};
+
+struct ControlInstruction {
+  InstructionHeader header;
+  BatchJobControlBufferRa control;
+};
+
+struct Sideband {
+  AJMSidebandResult result;
+  AJMSidebandStream stream;
+  AJMSidebandMultipleFrames multipleFrames;
+  std::byte padding[kSidebandSize - 32];
+};
+
+static_assert(sizeof(Sideband) == kSidebandSize);
+
+struct InstanceState {
+  InstanceCreateArgs create;
+  InstanceDestroyArgs destroy;
+  StartBatchArgs start;
+  WaitBatchArgs wait;
+  std::uint32_t configData;
+  ControlInstruction control;
+  Sideband controlSideband;
+  DecodeInstruction batch[kFramesPerBatch];
+  Sideband sidebands[kFramesPerBatch];
+  std::byte output[kFramesPerBatch][kMaxFrameOutput];
+};
+
+// followed by the copy of the stream
+struct UserState {
+  InstanceState instances[kMaxInstances];
+};
+
+std::byte *getStreamCopy(UserState *state) {
+  return reinterpret_cast<std::byte *>(state + 1);
+}
+
+struct Stream {
+  AJMCodecs codec;
+  std::vector<std::byte> data;
+  std::vector<std::span<const std::byte>> frames;
+  std::uint32_t configData = 0;
+};
+
+std::uint32_t readLe32(const std::byte *data) {
+  std::uint32_t result;
+  std::memcpy(&result, data, sizeof(result));
+  return result;
+}
+
+void splitMp3(Stream &stream) {
+  auto data = reinterpret_cast<const std::uint8_t *>(stream.data.data());
+  std::size_t size = stream.data.size();
+  std::size_t pos = 0;
+
+  // ID3v2 tag, size is a syncsafe integer
+  if (size >= 10 && std::memcmp(data, "ID3", 3) == 0) {
+    pos = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14 |
+                (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+  }
+
+  while (pos + 4 <= size) {
+    auto frameSize = get_mp3_data_size(data + pos);
+    if (frameSize == 0) {
+      pos++;
+      continue;
+    }
+
+    if (pos + frameSize > size) {
+      break;
+    }
+
+    stream.frames.emplace_back(stream.data.data() + pos, frameSize);
+    pos += frameSize;
+  }
+}
+
+void splitAdts(Stream &stream) {
+  auto data = reinterpret_cast<const std::uint8_t *>(stream.data.data());
+  std::size_t size = stream.data.size();
+  std::size_t pos = 0;
+
+  while (pos + 7 <= size) {
+    if (data[pos] != 0xff || (data[pos + 1] & 0xf6) != 0xf0) {
+      pos++;
+      continue;
+    }
+
+    std::size_t frameSize = (data[pos + 3] & 0x3) << 11 | data[pos + 4] << 3 |
+                            data[pos + 5] >> 5;
+    if (frameSize < 7 || pos + frameSize > size) {
+      break;
+    }
+
+    stream.frames.emplace_back(stream.data.data() + pos, frameSize);
+    pos += frameSize;
+  }
+}
+
+// RIFF file with ATRAC9 WAVEFORMATEXTENSIBLE, superframes of block align size
+bool splitAt9(Stream &stream) {
+  auto data = stream.data.data();
+  std::size_t size = stream.data.size();
+
+  if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 ||
+      std::memcmp(data + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  std::size_t blockAlign = 0;
+
+  for (std::size_t pos = 12; pos + 8 <= size;) {
+    auto chunkSize = readLe32(data + pos + 4);
+    auto chunk = data + pos + 8;
+    if (pos + 8 + chunkSize > size) {
+      break;
+    }
+
+    if (std::memcmp(data + pos, "fmt ", 4) == 0 && chunkSize >= 48) {
+      blockAlign = std::to_integer<std::size_t>(chunk[12]) |
+                   std::to_integer<std::size_t>(chunk[13]) << 8;
+      std::memcpy(&stream.configData, chunk + 44, sizeof(stream.configData));
+    } else if (std::memcmp(data + pos, "data", 4) == 0 && blockAlign != 0) {
+      for (std::size_t offset = 0; offset + blockAlign <= chunkSize;
+           offset += blockAlign) {
+        stream.frames.emplace_back(chunk + offset, blockAlign);
+      }
+    }
+
+    pos += 8 + ((chunkSize + 1) & ~std::size_t(1));
+  }
+
+  return !stream.frames.empty();
+}
+
+bool loadStream(const std::string &path, Stream &stream) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  std::vector<char> bytes{std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>()};
+  stream.data.resize(bytes.size());
+  std::memcpy(stream.data.data(), bytes.data(), bytes.size());
+
+  if (path.ends_with(".mp3")) {
+    stream.codec = AJM_CODEC_MP3;
+    splitMp3(stream);
+  } else if (path.ends_with(".aac")) {
+    stream.codec = AJM_CODEC_AAC;
+    splitAdts(stream);
+  } else if (path.ends_with(".at9")) {
+    stream.codec = AJM_CODEC_At9;
+    splitAt9(stream);
+  } else {
+    return false;
+  }
+
+  return !stream.frames.empty();
+}
+
+bool deviceIoctl(orbis::Thread *thread, orbis::IoDevice *device,
+                 std::uint64_t request, void *args) {
+  return device->ioctl(request, args, thread) == orbis::ErrorCode{};
+}
+
+bool submit(orbis::Thread *thread, orbis::IoDevice *device,
+            InstanceState &state, const void *batch, std::size_t size) {
+  state.start = {};
+  state.start.batch = static_cast<std::byte *>(const_cast<void *>(batch));
+  state.start.batchSize = size;
+
+  if (!deviceIoctl(thread, device, kIoctlStartBatch, &state.start)) {
+    return false;
+  }
+
+  state.wait = {};
+  state.wait.batchId = state.start.batchId;
+  state.wait.timeout = ~std::uint32_t(0);
+  return deviceIoctl(thread, device, kIoctlWaitBatch, &state.wait);
+}
+
+// returns decoded frames, 0 on failure
+std::uint64_t decodeStream(orbis::Thread *thread, orbis::IoDevice *device,
+                           const Stream &stream, InstanceState &state,
+                           std::span<const std::byte> guestData) {
+  state.create = {};
+  state.create.codec = stream.codec;
+
+  // keeps AAC priming frames in the output
+  state.create.flags = 0x200000000;
+
+  if (!deviceIoctl(thread, device, kIoctlInstanceCreate, &state.create)) {
+    return 0;
+  }
+
+  auto instanceId = state.create.instanceId;
+
+  if (stream.codec == AJM_CODEC_At9) {
+    state.configData = stream.configData;
+    state.control = {};
+    state.control.header.id = instanceId << 6;
+    state.control.header.len = sizeof(ControlInstruction);
+    state.control.control.opcode =
+        static_cast<std::uint32_t>(Opcode::ControlBufferRa);
+    state.control.control.sidebandInputSize = sizeof(state.configData);
+    state.control.control.pSidebandInput =
+        reinterpret_cast<std::byte *>(&state.configData);
+    state.control.control.flagsLo = CONTROL_INITIALIZE;
+    state.control.control.sidebandOutputSize = sizeof(Sideband);
+    state.control.control.pSidebandOutput =
+        reinterpret_cast<std::byte *>(&state.controlSideband);
+
+    if (!submit(thread, device, state, &state.control, sizeof(state.control))) {
+      return 0;
+    }
+  }
+
+  // flags opcode is stored in the low bits of the high flags word
+  static constexpr std::uint64_t kRunFlags =
+      static_cast<std::uint64_t>(RUN_MULTIPLE_FRAMES) | SIDEBAND_STREAM;
+  std::uint64_t frames = 0;
+
+  for (std::size_t first = 0; first < stream.frames.size();
+       first += kFramesPerBatch) {
+    auto count = std::min(kFramesPerBatch, stream.frames.size() - first);
+
+    for (std::size_t i = 0; i < count; ++i) {
+      auto frame = stream.frames[first + i];
+      auto &instruction = state.batch[i];
+      instruction.header.id = instanceId << 6;
+      instruction.header.len = sizeof(DecodeInstruction);
+      instruction.input.opcode =
+          static_cast<std::uint32_t>(Opcode::RunBufferRa);
+      instruction.input.szInputSize = frame.size();
+      instruction.input.pInput = const_cast<std::byte *>(
+          guestData.data() + (frame.data() - stream.data.data()));
+      instruction.flags.flagsHi =
+          static_cast<std::uint32_t>(Opcode::Flags) |
+          static_cast<std::uint32_t>(kRunFlags >> 0x1a);
+      instruction.flags.flagsLo = kRunFlags & ((1 << 0x1a) - 1);
+      instruction.output.opcode =
+          static_cast<std::uint32_t>(Opcode::JobBufferOutputRa);
+      instruction.output.outputSize = kMaxFrameOutput;
+      instruction.output.pOutput = state.output[i];
+      instruction.sideband.opcode =
+          static_cast<std::uint32_t>(Opcode::JobBufferSidebandRa);
+      instruction.sideband.sidebandSize = sizeof(Sideband);
+      instruction.sideband.pSideband =
+          reinterpret_cast<std::byte *>(&state.sidebands[i]);
+    }
+
+    if (!submit(thread, device, state, state.batch,
+                count * sizeof(DecodeInstruction))) {
+      return 0;
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+      if (state.sidebands[i].result.result != 0) {
+        std::fprintf(stderr, "frame %zu: result %#x\n", first + i,
+                     state.sidebands[i].result.result);
+        return 0;
+      }
+
+      frames += state.sidebands[i].multipleFrames.framesProcessed;
+    }
+  }
+
+  state.destroy = {};
+  state.destroy.instanceId = instanceId;
+  deviceIoctl(thread, device, kIoctlInstanceDestroy, &state.destroy);
+  return frames;
+}
+
+double run(orbis::Process *process, orbis::IoDevice *device,
+           const Stream &stream, UserState *state, std::size_t instances) {
+  std::vector<std::uint64_t> frames(instances);
+  std::vector<std::thread> threads;
+  std::span<const std::byte> guestData(getStreamCopy(state),
+                                      stream.data.size());
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t i = 0; i < instances; ++i) {
+    auto thread = orbis::createThread(process, "bench");
+    threads.emplace_back([=, &frames] {
+      orbis::g_currentThread = thread;
+      frames[i] = decodeStream(thread, device, stream, state->instances[i],
+                               guestData);
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto time = std::chrono::steady_clock::now() - start;
+
+  std::uint64_t total = 0;
+  for (auto count : frames) {
+    if (count == 0) {
+      return 0;
+    }
+
+    total += count;
+  }
+
+  return static_cast<double>(total) /
+         std::chrono::duration<double>(time).count();
+}
+
+const char *getCodecName(AJMCodecs codec) {
+  switch (codec) {
+  case AJM_CODEC_MP3:
+    return "mp3";
+  case AJM_CODEC_At9:
+    return "at9";
+  case AJM_CODEC_AAC:
+    return "aac";
+  default:
+    return "unknown";
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <file.mp3|file.aac|file.at9>...\n",
+                 argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Stream> streams(argc - 1);
+  std::size_t maxStreamSize = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!loadStream(argv[i], streams[i - 1])) {
+      std::fprintf(stderr, "%s: unsupported or empty stream\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+
+    maxStreamSize = std::max(maxStreamSize, streams[i - 1].data.size());
+  }
+
+  orbis::initializeAllocator();
+  orbis::constructAllGlobals();
+
+  auto userSize = sizeof(UserState) + maxStreamSize;
+  auto user = ::mmap(reinterpret_cast<void *>(kUserAddress), userSize,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (user != reinterpret_cast<void *>(kUserAddress)) {
+    std::perror("mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto state = static_cast<UserState *>(user);
+  auto process = orbis::createProcess(nullptr, 10);
+  auto mainThread = orbis::createThread(process, "bench main");
+  orbis::g_currentThread = mainThread;
+
+  auto device = createAjmCharacterDevice();
+
+  std::printf("codec  frames  instances  frames/s\n");
+
+  for (int i = 1; i < argc; ++i) {
+    auto &stream = streams[i - 1];
+    std::memcpy(getStreamCopy(state), stream.data.data(), stream.data.size());
+
+    for (std::size_t instances = 1; instances <= kMaxInstances;
+         instances *= 2) {
+      auto rate = run(process, device, stream, state, instances);
+      if (rate == 0) {
+        std::fprintf(stderr, "%s: decode failed\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+
+      std::printf("%-5s %7zu %10zu %9.0f\n", getCodecName(stream.codec),
+                  stream.frames.size(), instances, rate);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
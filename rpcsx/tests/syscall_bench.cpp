@@ -0,0 +1,132 @@
+// getpid-style guest syscalls per second, trapped by Syscall User Dispatch
+// and delivered as SIGSYS, and through a patched site calling the host
+// SyscallTrampoline
+
+#include "SyscallTrampoline.hpp"
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <linux/prctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::uintptr_t kGuestAddress = 0x10'0000'0000;
+constexpr std::uintptr_t kGuestEnd = 0x100'0000'0000;
+constexpr std::size_t kPageSize = 0x1000;
+constexpr std::size_t kThunkOffset = 64;
+constexpr std::size_t kHostStackSize = 1024 * 1024;
+
+// loop: mov rax, 39; mov r10, rcx; syscall; jb +0; dec rdi; jnz loop; ret
+constexpr std::uint8_t kGuestLoop[] = {
+    0x48, 0xc7, 0xc0, 0x27, 0x00, 0x00, 0x00, 0x49, 0x89, 0xca,
+    0x0f, 0x05, 0x72, 0x00, 0x48, 0xff, 0xcf, 0x75, 0xed, 0xc3,
+};
+constexpr std::size_t kSyscallSiteOffset = 7;
+
+// mov r10, rcx; jmp [rip]
+constexpr std::uint8_t kThunkCode[] = {0x49, 0x89, 0xca, 0xff, 0x25,
+                                       0x00, 0x00, 0x00, 0x00};
+
+alignas(64) std::byte g_hostStack[kHostStackSize];
+thread_local std::uint64_t g_hostStackTop;
+
+void emulateGetpid(mcontext_t &context) {
+  context.gregs[REG_RAX] = ::getpid();
+  context.gregs[REG_EFL] &= ~1ll; // clear CF, success
+}
+
+void handleSigsys(int, siginfo_t *, void *ucontext) {
+  emulateGetpid(static_cast<ucontext_t *>(ucontext)->uc_mcontext);
+}
+
+void handleFastSyscall(ucontext_t *context) {
+  emulateGetpid(context->uc_mcontext);
+}
+
+using GuestLoop = void (*)(std::uint64_t iterations);
+
+double measure(GuestLoop loop, std::uint64_t iterations) {
+  loop(iterations / 16); // warm up
+
+  auto start = std::chrono::steady_clock::now();
+  loop(iterations);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(iterations) / elapsed.count();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::uint64_t iterations =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 0) : 1'000'000;
+
+  auto guest = static_cast<std::uint8_t *>(
+      ::mmap(reinterpret_cast<void *>(kGuestAddress), kPageSize * 2,
+             PROT_READ | PROT_WRITE | PROT_EXEC,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0));
+  if (guest != reinterpret_cast<std::uint8_t *>(kGuestAddress)) {
+    std::perror("guest mmap");
+    return EXIT_FAILURE;
+  }
+
+  auto trapLoop = guest;
+  auto fastLoop = guest + kPageSize;
+  std::memcpy(trapLoop, kGuestLoop, sizeof(kGuestLoop));
+  std::memcpy(fastLoop, kGuestLoop, sizeof(kGuestLoop));
+
+  // patch the syscall site of the second copy the way the linker does
+  g_hostStackTop =
+      reinterpret_cast<std::uint64_t>(g_hostStack + kHostStackSize);
+  _writegsbase_u64(_readfsbase_u64());
+
+  static rx::thread::SyscallTrampoline trampoline(
+      static_cast<std::int32_t>(
+          reinterpret_cast<std::uintptr_t>(&g_hostStackTop) -
+          _readfsbase_u64()),
+      handleFastSyscall);
+  auto trampolineCode = trampoline.getCode<void *>();
+
+  auto thunk = fastLoop + kThunkOffset;
+  std::memcpy(thunk, kThunkCode, sizeof(kThunkCode));
+  std::memcpy(thunk + sizeof(kThunkCode), &trampolineCode,
+              sizeof(trampolineCode));
+
+  auto site = fastLoop + kSyscallSiteOffset;
+  auto rel32 = static_cast<std::int32_t>(thunk - (site + 5));
+  site[0] = 0xe8; // call rel32
+  std::memcpy(site + 1, &rel32, sizeof(rel32));
+
+  struct sigaction act{};
+  act.sa_sigaction = handleSigsys;
+  act.sa_flags = SA_SIGINFO;
+  sigemptyset(&act.sa_mask);
+  sigaddset(&act.sa_mask, SIGSYS);
+  sigaddset(&act.sa_mask, SIGUSR1);
+  if (::sigaction(SIGSYS, &act, nullptr)) {
+    std::perror("sigaction");
+    return EXIT_FAILURE;
+  }
+
+  if (::prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+              reinterpret_cast<void *>(kGuestEnd), ~0ull - kGuestEnd,
+              nullptr)) {
+    std::perror("prctl");
+    return EXIT_FAILURE;
+  }
+
+  auto trapRate = measure(reinterpret_cast<GuestLoop>(trapLoop), iterations);
+  auto fastRate = measure(reinterpret_cast<GuestLoop>(fastLoop), iterations);
+
+  std::printf("sigsys:     %12.0f calls/s\n", trapRate);
+  std::printf("trampoline: %12.0f calls/s\n", fastRate);
+  std::printf("speedup:    %12.2fx\n", fastRate / trapRate);
+  return EXIT_SUCCESS;
+}
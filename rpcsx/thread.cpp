@@ -1,13 +1,16 @@
 #include "thread.hpp"
+#include "SyscallTrampoline.hpp"
 #include "orbis-config.hpp"
 #include "orbis/sys/sysentry.hpp"
 #include "orbis/thread/Process.hpp"
 #include "orbis/thread/Thread.hpp"
 #include "orbis/utils/Logs.hpp"
 #include "rx/mem.hpp"
+#include "rx/Config.hpp"
 #include "rx/print.hpp"
 #include <asm/prctl.h>
 #include <csignal>
+#include <cstddef>
 #include <immintrin.h>
 #include <link.h>
 #include <linux/prctl.h>
@@ -37,6 +40,70 @@ static auto setContext = [] {
   return setContextStorage.getCode<void (*)(const mcontext_t &)>();
 }();
 
+static rx::thread::SyscallStats g_syscallStats;
+
+// top of the host stack used by syscall trampoline, guest code runs on its own
+// stack so everything below invoke frame is free
+static thread_local std::uint64_t g_syscallStack = 0;
+
+// guest signal that interrupted syscall trampoline, delivered on the next
+// signal in guest code. Sender keeps retrying until delivery is confirmed
+static thread_local int g_deferredSignal = -1;
+
+static __attribute__((no_stack_protector)) void
+handleFastSyscall(ucontext_t *context) {
+  auto thread = orbis::g_currentThread;
+  auto prevContext = std::exchange(thread->context, context);
+
+  g_syscallStats.fastCalls.fetch_add(1, std::memory_order::relaxed);
+  orbis::syscall_entry(thread);
+
+  thread = orbis::g_currentThread;
+
+  if (g_deferredSignal >= 0) {
+    // signal interrupted trampoline prologue, deliver it to the saved context
+    auto signo = std::exchange(g_deferredSignal, -1);
+    rx::thread::invokeSignalHandler(thread, signo);
+
+    std::uint32_t prevValue = 1;
+    if (thread->interruptedMtx.compare_exchange_strong(prevValue, 0)) {
+      thread->interruptedMtx.notify_one();
+    }
+  }
+
+  thread->context = prevContext;
+  _writefsbase_u64(thread->fsBase);
+}
+
+
+// code range of the trampoline, readable from signal handlers
+static std::atomic<std::uint64_t> g_syscallTrampolineBegin{0};
+static std::atomic<std::uint64_t> g_syscallTrampolineEnd{0};
+
+static rx::thread::SyscallTrampoline &getSyscallTrampolineImpl() {
+  // must be called with host fs base
+  static rx::thread::SyscallTrampoline trampoline(
+      static_cast<std::int32_t>(
+          reinterpret_cast<std::uintptr_t>(&g_syscallStack) -
+          _readfsbase_u64()),
+      handleFastSyscall);
+
+  static bool registered = [] {
+    auto begin = reinterpret_cast<std::uint64_t>(trampoline.getCode());
+    g_syscallTrampolineEnd.store(begin + trampoline.getSize());
+    g_syscallTrampolineBegin.store(begin);
+    return true;
+  }();
+  static_cast<void>(registered);
+
+  return trampoline;
+}
+
+static bool isInSyscallTrampoline(std::uint64_t address) {
+  return address >= g_syscallTrampolineBegin.load(std::memory_order::relaxed) &&
+         address < g_syscallTrampolineEnd.load(std::memory_order::relaxed);
+}
+
 static __attribute__((no_stack_protector)) void
 handleSigSys(int sig, siginfo_t *info, void *ucontext) {
   if (auto hostFs = _readgsbase_u64()) {
@@ -54,6 +121,7 @@ handleSigSys(int sig, siginfo_t *info, void *ucontext) {
     std::abort();
   }
 
+  g_syscallStats.trappedCalls.fetch_add(1, std::memory_order::relaxed);
   orbis::syscall_entry(thread);
 
   thread = orbis::g_currentThread;
@@ -63,6 +131,8 @@ handleSigSys(int sig, siginfo_t *info, void *ucontext) {
 
 __attribute__((no_stack_protector)) static void
 handleSigUser(int sig, siginfo_t *info, void *ucontext) {
+  auto interruptedFs = _readfsbase_u64();
+
   if (auto hostFs = _readgsbase_u64()) {
     _writefsbase_u64(hostFs);
   }
@@ -79,6 +149,16 @@ handleSigUser(int sig, siginfo_t *info, void *ucontext) {
 
   int guestSignal = info->si_value.sival_int;
 
+  if (isInSyscallTrampoline(context->uc_mcontext.gregs[REG_RIP])) {
+    // neither guest nor syscall context is complete here
+    if (guestSignal >= 0) {
+      g_deferredSignal = guestSignal;
+      guestSignal = -2;
+    }
+  } else if (inGuestCode && guestSignal == -2 && g_deferredSignal >= 0) {
+    guestSignal = std::exchange(g_deferredSignal, -1);
+  }
+
   if (guestSignal == -1) {
     // ORBIS_LOG_ERROR("suspending thread", thread->tid, inGuestCode);
 
@@ -150,6 +230,8 @@ handleSigUser(int sig, siginfo_t *info, void *ucontext) {
 
   if (inGuestCode) {
     _writefsbase_u64(thread->fsBase);
+  } else if (isInSyscallTrampoline(context->uc_mcontext.gregs[REG_RIP])) {
+    _writefsbase_u64(interruptedFs);
   }
 }
 
@@ -337,7 +419,7 @@ void rx::thread::initialize() {
   }
 }
 
-void rx::thread::deinitialize() {}
+void rx::thread::deinitialize() { printSyscallStats(); }
 
 void *rx::thread::setupSignalStack(void *address) {
   stack_t ss{}, oss{};
@@ -389,6 +471,11 @@ void rx::thread::setupThisThread() {
 void rx::thread::invoke(orbis::Thread *thread) {
   orbis::g_currentThread = thread;
 
+  // keep some space for setContext call
+  auto prevSyscallStack = std::exchange(
+      g_syscallStack,
+      reinterpret_cast<std::uint64_t>(__builtin_frame_address(0)) - 0x4000);
+
   std::uint64_t hostFs = _readfsbase_u64();
   _writegsbase_u64(hostFs);
 
@@ -397,4 +484,24 @@ void rx::thread::invoke(orbis::Thread *thread) {
 
   ::setContext(context->uc_mcontext);
   _writefsbase_u64(hostFs);
+  g_syscallStack = prevSyscallStack;
+}
+
+void *rx::thread::getSyscallTrampoline() {
+  if (!rx::g_config.fastSyscalls) {
+    return nullptr;
+  }
+
+  return const_cast<std::uint8_t *>(getSyscallTrampolineImpl().getCode());
+}
+
+rx::thread::SyscallStats &rx::thread::getSyscallStats() {
+  return g_syscallStats;
+}
+
+void rx::thread::printSyscallStats() {
+  rx::println(stderr, "syscalls: {} patched sites, {} fast calls, {} trapped",
+              g_syscallStats.patchedSites.load(),
+              g_syscallStats.fastCalls.load(),
+              g_syscallStats.trappedCalls.load());
 }
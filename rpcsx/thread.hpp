@@ -1,8 +1,21 @@
 #pragma once
 
 #include "orbis/thread/Thread.hpp"
+#include <atomic>
+#include <cstdint>
 
 namespace rx::thread {
+struct SyscallStats {
+  // syscall sites rewritten to call the trampoline
+  std::atomic<std::uint64_t> patchedSites{0};
+
+  // syscalls dispatched through the trampoline
+  std::atomic<std::uint64_t> fastCalls{0};
+
+  // syscalls dispatched through SIGSYS
+  std::atomic<std::uint64_t> trappedCalls{0};
+};
+
 std::size_t getSigAltStackSize();
 void initialize();
 void deinitialize();
@@ -17,4 +30,15 @@ bool invokeSignalHandler(orbis::Thread *thread, int signo,
                          ucontext_t *context = nullptr);
 void setContext(orbis::Thread *thread, const orbis::UContext &src);
 void invoke(orbis::Thread *thread);
+
+///
+/// \brief Returns host entry point for patched guest syscall sites, nullptr if
+/// fast syscalls are disabled.
+///
+/// Entry expects the syscall number in rax, guest return address on top of the
+/// guest stack and clobbers rcx and r11, same as the syscall instruction.
+///
+void *getSyscallTrampoline();
+SyscallStats &getSyscallStats();
+void printSyscallStats();
 } // namespace rx::thread
@@ -4,6 +4,7 @@
 #include "io-device.hpp"
 #include "orbis/error/ErrorCode.hpp"
 #include "orbis/error/SysResult.hpp"
+#include "rx/print.hpp"
 #include <filesystem>
 #include <map>
 #include <string_view>
@@ -94,6 +95,27 @@ void vfs::deinitialize() {
   gMountsMap.clear();
 }
 
+void vfs::printStats() {
+  std::lock_guard lock(gMountMtx);
+
+  for (auto &[mountPoint, device] : gMountsMap) {
+    auto hostFs = dynamic_cast<HostFsDevice *>(device.get());
+    if (hostFs == nullptr) {
+      continue;
+    }
+
+    auto &stats = hostFs->pathCacheStats;
+    if (stats.hits.load() + stats.misses.load() == 0) {
+      continue;
+    }
+
+    rx::println(stderr,
+                "vfs: {}: {} path cache hits, {} misses, {} directory scans",
+                mountPoint, stats.hits.load(), stats.misses.load(),
+                stats.dirScans.load());
+  }
+}
+
 void vfs::addDevice(std::string name, orbis::IoDevice *device) {
   std::lock_guard lock(gMountMtx);
   gDevFs->devices[std::move(name)] = device;
@@ -267,6 +289,7 @@ orbis::ErrorCode vfs::createSymlink(std::string_view target,
         std::filesystem::absolute(fromHost->hostPath + "/" +
                                   fromDevPath.c_str()),
         targetHost->hostPath + "/" + toDevPath.c_str(), ec);
+    targetHost->invalidatePath(toDevPath.c_str());
     return convertErrorCode(ec);
   }
 
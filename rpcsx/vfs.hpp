@@ -13,6 +13,7 @@ namespace vfs {
 void fork();
 void initialize();
 void deinitialize();
+void printStats();
 void addDevice(std::string name, orbis::IoDevice *device);
 std::pair<rx::Ref<orbis::IoDevice>, std::string>
 get(const std::filesystem::path &guestPath);
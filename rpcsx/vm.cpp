@@ -8,15 +8,19 @@
 #include "orbis/thread/Thread.hpp"
 #include "orbis/utils/Logs.hpp"
 #include "rx/Rc.hpp"
+#include "rx/SharedMutex.hpp"
 #include "rx/format.hpp"
 #include "rx/print.hpp"
 #include "rx/watchdog.hpp"
 #include <bit>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <rx/MemoryTable.hpp>
 #include <rx/align.hpp>
 #include <rx/mem.hpp>
@@ -320,6 +324,19 @@ struct Block {
     return result;
   }
 
+  // true if all pages of the group have the same protection
+  bool isUniformGroup(std::uint64_t groupIndex) const {
+    auto &group = groups[groupIndex];
+    auto isUniform = [](std::uint64_t bits) {
+      return bits == 0 || bits == ~static_cast<std::uint64_t>(0);
+    };
+
+    return isUniform(group.allocated) && isUniform(group.shared) &&
+           isUniform(group.readable) && isUniform(group.writable) &&
+           isUniform(group.executable) && isUniform(group.gpuReadable) &&
+           isUniform(group.gpuWritable);
+  }
+
   void modifyFlags(std::uint64_t firstPage, std::uint64_t pagesCount,
                    std::uint32_t addFlags, std::uint32_t removeFlags,
                    bool noOverwrite = false) {
@@ -652,6 +669,9 @@ struct MapInfo {
   rx::Ref<orbis::IoDevice> device;
   std::uint64_t offset;
   std::uint32_t flags;
+  bool isShared;
+  std::uint64_t hostDevice;
+  std::uint64_t hostInode;
   char name[32];
 
   bool operator==(const MapInfo &) const = default;
@@ -659,6 +679,10 @@ struct MapInfo {
 
 static rx::MemoryTableWithPayload<MapInfo> gMapInfo;
 
+// modifications of gMapInfo also hold g_mtx, queries of the backing take only
+// the shared lock
+static rx::shared_mutex g_mapInfoMtx;
+
 static void reserve(std::uint64_t startAddress, std::uint64_t endAddress) {
   auto blockIndex = startAddress >> kBlockShift;
 
@@ -673,6 +697,24 @@ static void reserve(std::uint64_t startAddress, std::uint64_t endAddress) {
                                              false);
 }
 
+// moves private pages of the range to the new memory file, keeping contents
+static void forkPrivateRange(std::uint64_t address, std::uint64_t size,
+                             unsigned prot) {
+  auto mapping = rx::mem::map(nullptr, size, PROT_WRITE, MAP_SHARED,
+                              gMemoryShm, address - kMinAddress);
+  assert(mapping != MAP_FAILED);
+
+  rx::mem::protect(reinterpret_cast<void *>(address), size, PROT_READ);
+  std::memcpy(mapping, reinterpret_cast<void *>(address), size);
+  rx::mem::unmap(mapping, size);
+  rx::mem::unmap(reinterpret_cast<void *>(address), size);
+
+  mapping = rx::mem::map(reinterpret_cast<void *>(address), size, prot,
+                         MAP_FIXED | MAP_SHARED, gMemoryShm,
+                         address - kMinAddress);
+  assert(mapping != MAP_FAILED);
+}
+
 void vm::fork(std::uint64_t pid) {
   auto shmPath = rx::format("{}/memory-{}", rx::getShmPath(), pid);
   gMemoryShm =
@@ -681,6 +723,10 @@ void vm::fork(std::uint64_t pid) {
   (void)g_mtx.try_lock();
   g_mtx.unlock(); // release mutex
 
+  // no other thread exists after fork
+  std::destroy_at(&g_mapInfoMtx);
+  std::construct_at(&g_mapInfoMtx);
+
   if (gMemoryShm == -1) {
     rx::println(stderr, "Memory: failed to open {}", shmPath);
     std::abort();
@@ -691,33 +737,75 @@ void vm::fork(std::uint64_t pid) {
     std::abort();
   }
 
-  for (auto address = kMinAddress; address < kMaxAddress;
-       address += kPageSize) {
-    auto prot = gBlocks[(address >> kBlockShift) - kFirstBlock].getProtection(
-        (address & kBlockMask) >> vm::kPageShift);
+  auto startTime = std::chrono::steady_clock::now();
+  std::uint64_t copiedBytes = 0;
 
-    if (prot & kShared) {
-      continue;
+  // contiguous private pages with the same protection are copied at once
+  std::uint64_t rangeAddress = 0;
+  std::uint64_t rangeSize = 0;
+  unsigned rangeProt = 0;
+
+  auto flushRange = [&] {
+    if (rangeSize != 0) {
+      forkPrivateRange(rangeAddress, rangeSize, rangeProt);
+      copiedBytes += rangeSize;
+      rangeSize = 0;
+    }
+  };
+
+  auto addPages = [&](std::uint64_t address, std::uint64_t size,
+                      unsigned prot) {
+    // TODO: copy gpu memory?
+    if ((prot & kShared) || (prot & kMapProtCpuAll) == 0) {
+      flushRange();
+      return;
+    }
+
+    prot &= kMapProtCpuAll;
+
+    if (rangeSize != 0 && rangeAddress + rangeSize == address &&
+        rangeProt == prot) {
+      rangeSize += size;
+      return;
     }
 
-    if (prot & kMapProtCpuAll) {
-      auto mapping = rx::mem::map(nullptr, kPageSize, PROT_WRITE, MAP_SHARED,
-                                  gMemoryShm, address - kMinAddress);
-      assert(mapping != MAP_FAILED);
+    flushRange();
+    rangeAddress = address;
+    rangeSize = size;
+    rangeProt = prot;
+  };
+
+  static constexpr std::uint64_t kGroupBytes = kGroupSize * kPageSize;
+  static_assert((kMinAddress & (kGroupBytes - 1)) == 0);
+
+  for (auto address = kMinAddress; address < kMaxAddress;
+       address += kGroupBytes) {
+    auto &block = gBlocks[(address >> kBlockShift) - kFirstBlock];
+    auto firstPage = (address & kBlockMask) >> vm::kPageShift;
+    auto groupIndex = firstPage / kGroupSize;
 
-      rx::mem::protect(reinterpret_cast<void *>(address), kPageSize, PROT_READ);
-      std::memcpy(mapping, reinterpret_cast<void *>(address), kPageSize);
-      rx::mem::unmap(mapping, kPageSize);
-      rx::mem::unmap(reinterpret_cast<void *>(address), kPageSize);
+    if (block.groups[groupIndex].allocated == 0) {
+      flushRange();
+      continue;
+    }
 
-      mapping = rx::mem::map(reinterpret_cast<void *>(address), kPageSize,
-                             prot & kMapProtCpuAll, MAP_FIXED | MAP_SHARED,
-                             gMemoryShm, address - kMinAddress);
-      assert(mapping != MAP_FAILED);
+    if (block.isUniformGroup(groupIndex)) {
+      addPages(address, kGroupBytes, block.getProtection(firstPage));
+      continue;
     }
 
-    // TODO: copy gpu memory?
+    for (std::uint64_t page = 0; page < kGroupSize; ++page) {
+      addPages(address + page * kPageSize, kPageSize,
+               block.getProtection(firstPage + page));
+    }
   }
+
+  flushRange();
+
+  auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - startTime)
+                       .count();
+  ORBIS_LOG_TRACE("vm::fork: copied private memory", copiedBytes, elapsedUs);
 }
 
 void vm::reset() {
@@ -958,13 +1046,18 @@ void *vm::map(void *addr, std::uint64_t len, std::int32_t prot,
   }
 
   {
-    MapInfo info;
+    std::lock_guard lock(g_mapInfoMtx);
+
+    MapInfo info{};
     if (auto it = gMapInfo.queryArea(address); it != gMapInfo.end()) {
       info = it.get();
     }
     info.device = device;
     info.flags = flags;
     info.offset = offset;
+    info.isShared = isShared;
+    info.hostDevice = 0;
+    info.hostInode = 0;
 
     gMapInfo.map(address, address + len, info);
   }
@@ -1034,7 +1127,10 @@ bool vm::unmap(void *addr, std::uint64_t size) {
     std::println(stderr, "ignoring unmapping {:x}-{:x}", address,
                  address + size);
   }
-  gMapInfo.unmap(address, address + size);
+  {
+    std::lock_guard lock(g_mapInfoMtx);
+    gMapInfo.unmap(address, address + size);
+  }
   return rx::mem::unmap(addr, size);
 }
 
@@ -1208,10 +1304,53 @@ bool vm::virtualQuery(const void *addr, std::int32_t flags,
   return true;
 }
 
+void vm::setBackingFile(std::uint64_t start, std::uint64_t size,
+                        std::uint64_t hostDevice, std::uint64_t hostInode) {
+  std::lock_guard lock(g_mtx);
+  std::lock_guard mapInfoLock(g_mapInfoMtx);
+
+  MapInfo info{};
+  if (auto it = gMapInfo.queryArea(start); it != gMapInfo.end()) {
+    info = it.get();
+  }
+
+  info.hostDevice = hostDevice;
+  info.hostInode = hostInode;
+
+  gMapInfo.map(start, start + size, info);
+}
+
+bool vm::queryBacking(const void *addr, std::uint64_t *object,
+                      std::uint64_t *inode, std::uint64_t *offset) {
+  auto address = reinterpret_cast<std::uint64_t>(addr);
+  if (address < kMinAddress || address >= kMaxAddress) {
+    return false;
+  }
+
+  std::shared_lock lock(g_mapInfoMtx);
+
+  auto it = gMapInfo.queryArea(address);
+  if (it == gMapInfo.end() || !it->isShared) {
+    return false;
+  }
+
+  if (it->hostInode != 0) {
+    *object = it->hostDevice;
+    *inode = it->hostInode;
+  } else {
+    *object = reinterpret_cast<std::uintptr_t>(it->device.get());
+    *inode = 0;
+  }
+
+  *offset = it->offset + (address - it.beginAddress());
+  return true;
+}
+
 void vm::setName(std::uint64_t start, std::uint64_t size, const char *name) {
   std::lock_guard lock(g_mtx);
+  std::lock_guard mapInfoLock(g_mapInfoMtx);
 
-  MapInfo info;
+  MapInfo info{};
   if (auto it = gMapInfo.queryArea(start); it != gMapInfo.end()) {
     info = it.get();
   }
@@ -81,4 +81,16 @@ bool virtualQuery(const void *addr, std::int32_t flags, VirtualQueryInfo *info);
 bool queryProtection(const void *addr, std::uint64_t *startAddress,
                      std::uint64_t *endAddress, std::int32_t *prot);
 unsigned getPageProtection(std::uint64_t address);
+
+// records host device and inode of the file backing the mapping, shared file
+// mappings are identified by them instead of the mount device
+void setBackingFile(std::uint64_t start, std::uint64_t size,
+                    std::uint64_t hostDevice, std::uint64_t hostInode);
+
+// returns object and offset in it backing the shared mapping of the address.
+// Object is host device with nonzero inode for host files, the device for
+// other devices and zero for anonymous shared memory. Fails for private
+// mappings
+bool queryBacking(const void *addr, std::uint64_t *object,
+                  std::uint64_t *inode, std::uint64_t *offset);
 } // namespace vm
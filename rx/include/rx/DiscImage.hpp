@@ -0,0 +1,154 @@
+#pragma once
+
+#include "FunctionRef.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rx {
+///
+/// \brief Read-only ISO 9660 (with Joliet names) or UDF disc image.
+///
+/// Directory tree is parsed once when the image is opened, lookups and reads
+/// do not touch directory records of the image. Image is accessed only with
+/// positional reads, files can be read from any thread without locking.
+///
+class DiscImage {
+public:
+  // positional read of the image, must be thread safe. Returns count of read
+  // bytes
+  using ReadFn = std::function<std::size_t(std::uint64_t offset, void *data,
+                                           std::size_t size)>;
+
+  static constexpr std::uint32_t kSectorSize = 2048;
+  static constexpr std::uint32_t kNoEntry = ~static_cast<std::uint32_t>(0);
+
+  // image offset of extents which are not recorded and read as zeros
+  static constexpr std::uint64_t kSparseExtent = ~static_cast<std::uint64_t>(0);
+
+  static constexpr std::size_t kMinReadAhead = 64 * 1024;
+  static constexpr std::size_t kMaxReadAhead = 4 * 1024 * 1024;
+
+  enum class Format : std::uint8_t {
+    Iso9660,
+    Joliet,
+    Udf,
+  };
+
+  struct Extent {
+    std::uint64_t imageOffset;
+    std::uint64_t size;
+  };
+
+  struct Entry {
+    std::string name;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    bool isDirectory = false;
+    std::uint32_t parent = 0;
+
+    // children are stored contiguously, ordered by case insensitive name
+    std::uint32_t firstChild = 0;
+    std::uint32_t childCount = 0;
+
+    std::uint32_t firstExtent = 0;
+    std::uint32_t extentCount = 0;
+  };
+
+  // read-ahead state of the open file. Sequential reads double the window up
+  // to kMaxReadAhead, any other access drops it
+  struct ReadAheadState {
+    std::uint64_t bufferOffset = 0;
+    std::uint64_t bufferSize = 0;
+    std::uint64_t nextOffset = 0;
+    std::size_t window = 0;
+  };
+
+  template <typename BufferT> struct ReadAhead : ReadAheadState {
+    BufferT buffer;
+  };
+
+  DiscImage(const DiscImage &) = delete;
+  DiscImage &operator=(const DiscImage &) = delete;
+
+  // checks volume descriptors only, does not parse directories
+  static bool probe(const ReadFn &read, std::uint64_t imageSize);
+
+  static std::unique_ptr<DiscImage> open(ReadFn read, std::uint64_t imageSize);
+
+  Format format() const { return mFormat; }
+  std::uint64_t imageSize() const { return mImageSize; }
+  std::size_t entryCount() const { return mEntries.size(); }
+
+  const Entry &root() const { return mEntries.front(); }
+  const Entry &entry(std::uint32_t index) const { return mEntries[index]; }
+
+  std::span<const Entry> children(const Entry &dir) const {
+    return std::span(mEntries).subspan(dir.firstChild, dir.childCount);
+  }
+
+  std::span<const Extent> extents(const Entry &file) const {
+    return std::span(mExtents).subspan(file.firstExtent, file.extentCount);
+  }
+
+  ///
+  /// \brief Finds entry by path with case insensitive comparison of the path
+  /// components, both '/' and '\\' are separators.
+  ///
+  /// \returns index of the entry or kNoEntry
+  ///
+  std::uint32_t find(std::string_view path) const;
+
+  std::size_t read(const Entry &file, std::uint64_t offset, void *data,
+                   std::size_t size) const;
+
+  ///
+  /// \brief Finds image offset of the file range stored in a single recorded
+  /// extent, the range can be mapped from the image directly.
+  ///
+  /// \returns image offset of the range or kSparseExtent
+  ///
+  std::uint64_t getContiguousOffset(const Entry &file, std::uint64_t offset,
+                                    std::uint64_t size) const;
+
+  // not thread safe for the same state
+  template <typename BufferT>
+  std::size_t read(const Entry &file, ReadAhead<BufferT> &state,
+                   std::uint64_t offset, void *data, std::size_t size) const {
+    return readBuffered(
+        file, state, offset, data, size,
+        [&](std::size_t size) -> std::span<std::byte> {
+          if (state.buffer.size() < size) {
+            state.buffer.resize(size);
+          }
+
+          return {state.buffer.data(), state.buffer.size()};
+        });
+  }
+
+private:
+  struct Builder;
+
+  ReadFn mRead;
+  std::uint64_t mImageSize = 0;
+  Format mFormat = Format::Iso9660;
+  std::vector<Entry> mEntries;
+  std::vector<Extent> mExtents;
+
+  DiscImage() = default;
+
+  std::size_t readExtents(std::span<const Extent> extents,
+                          std::uint64_t fileSize, std::uint64_t offset,
+                          void *data, std::size_t size) const;
+
+  std::size_t
+  readBuffered(const Entry &file, ReadAheadState &state, std::uint64_t offset,
+               void *data, std::size_t size,
+               FunctionRef<std::span<std::byte>(std::size_t)> getBuffer) const;
+};
+} // namespace rx
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rx {
+///
+/// \brief Writes ISO 9660 images readable by DiscImage.
+///
+/// Files are kept in memory until the image is written. Files larger than
+/// 4 GiB are recorded as multi-extent files.
+///
+class DiscImageWriter {
+public:
+  // positional write of the image. Returns false on failure
+  using WriteFn = std::function<bool(std::uint64_t offset, const void *data,
+                                     std::size_t size)>;
+
+  DiscImageWriter();
+  ~DiscImageWriter();
+
+  DiscImageWriter(const DiscImageWriter &) = delete;
+  DiscImageWriter &operator=(const DiscImageWriter &) = delete;
+
+  void setVolumeId(std::string_view id) { mVolumeId = id; }
+
+  // alignment of file data in bytes, multiple of the sector size. Aligned
+  // files can be mapped from the image
+  void setFileAlignment(std::uint32_t alignment) { mFileAlignment = alignment; }
+
+  // missing parent directories are created, '/' is the only separator
+  bool addDirectory(std::string_view path, std::int64_t mtime = 0);
+  bool addFile(std::string_view path, std::vector<std::byte> data,
+               std::int64_t mtime = 0);
+
+  ///
+  /// \brief Writes the image.
+  ///
+  /// \returns image size or 0 on failure
+  ///
+  std::uint64_t write(const WriteFn &write) const;
+
+private:
+  struct Node;
+
+  std::unique_ptr<Node> mRoot;
+  std::string mVolumeId = "RX";
+  std::uint32_t mFileAlignment = 2048;
+
+  Node *getDirectory(std::string_view path, std::int64_t mtime);
+};
+} // namespace rx
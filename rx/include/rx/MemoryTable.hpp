@@ -34,35 +34,41 @@ class MemoryAreaTable : public InvalidationHandleT {
   enum class Kind { O, X };
   std::map<std::uint64_t, Kind> mAreas;
 
-public:
-  class iterator {
-    using map_iterator = typename std::map<std::uint64_t, Kind>::iterator;
-    map_iterator it;
+  template <typename MapIteratorT> class basic_iterator {
+    MapIteratorT it;
 
   public:
-    iterator() = default;
-    iterator(map_iterator it) : it(it) {}
+    basic_iterator() = default;
+    basic_iterator(MapIteratorT it) : it(it) {}
 
     AreaInfo operator*() const { return {it->first, std::next(it)->first}; }
 
-    iterator &operator++() {
+    basic_iterator &operator++() {
       ++it;
       ++it;
       return *this;
     }
 
-    iterator &operator--() {
+    basic_iterator &operator--() {
       --it;
       --it;
       return *this;
     }
 
-    bool operator==(iterator other) const { return it == other.it; }
-    bool operator!=(iterator other) const { return it != other.it; }
+    bool operator==(basic_iterator other) const { return it == other.it; }
+    bool operator!=(basic_iterator other) const { return it != other.it; }
   };
 
+public:
+  using iterator =
+      basic_iterator<typename std::map<std::uint64_t, Kind>::iterator>;
+  using const_iterator =
+      basic_iterator<typename std::map<std::uint64_t, Kind>::const_iterator>;
+
   iterator begin() { return iterator(mAreas.begin()); }
   iterator end() { return iterator(mAreas.end()); }
+  const_iterator begin() const { return const_iterator(mAreas.begin()); }
+  const_iterator end() const { return const_iterator(mAreas.end()); }
 
   void clear() { mAreas.clear(); }
 
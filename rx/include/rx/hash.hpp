@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace rx {
+inline constexpr std::uint64_t kFnv64Basis = 0xcbf29ce484222325ull;
+inline constexpr std::uint64_t kFnv64Prime = 0x100000001b3ull;
+
+inline constexpr std::uint64_t fnv1a64(std::span<const std::byte> data,
+                                       std::uint64_t hash = kFnv64Basis) {
+  for (auto byte : data) {
+    hash ^= static_cast<std::uint8_t>(byte);
+    hash *= kFnv64Prime;
+  }
+
+  return hash;
+}
+
+inline constexpr std::uint64_t fnv1a64(std::string_view data,
+                                       std::uint64_t hash = kFnv64Basis) {
+  for (auto c : data) {
+    hash ^= static_cast<std::uint8_t>(c);
+    hash *= kFnv64Prime;
+  }
+
+  return hash;
+}
+
+template <typename T>
+  requires std::is_trivially_copyable_v<T>
+inline std::uint64_t fnv1a64Value(const T &value,
+                                  std::uint64_t hash = kFnv64Basis) {
+  std::byte bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  return fnv1a64(bytes, hash);
+}
+} // namespace rx
@@ -0,0 +1,949 @@
+#include "DiscImage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <unordered_set>
+
+namespace {
+constexpr std::uint32_t kSectorSize = rx::DiscImage::kSectorSize;
+constexpr std::uint64_t kMaxDirectorySize = 64 * 1024 * 1024;
+constexpr std::size_t kMaxEntryCount = 1 << 24;
+
+// ISO 9660
+constexpr std::uint32_t kIsoDescriptorSector = 16;
+constexpr std::uint32_t kIsoMaxDescriptors = 64;
+constexpr std::size_t kIsoRootRecordOffset = 156;
+constexpr std::size_t kIsoRecordHeaderSize = 33;
+constexpr std::uint8_t kIsoFlagDirectory = 1 << 1;
+constexpr std::uint8_t kIsoFlagMultiExtent = 1 << 7;
+
+// ECMA-167 / UDF
+constexpr std::uint32_t kUdfAnchorSector = 256;
+constexpr std::uint32_t kUdfMaxDescriptors = 64;
+constexpr std::uint32_t kUdfMaxAllocationDepth = 16;
+constexpr std::uint16_t kUdfTagAnchor = 2;
+constexpr std::uint16_t kUdfTagPartition = 5;
+constexpr std::uint16_t kUdfTagLogicalVolume = 6;
+constexpr std::uint16_t kUdfTagTerminating = 8;
+constexpr std::uint16_t kUdfTagFileSet = 256;
+constexpr std::uint16_t kUdfTagFileId = 257;
+constexpr std::uint16_t kUdfTagAllocationExtent = 258;
+constexpr std::uint16_t kUdfTagFileEntry = 261;
+constexpr std::uint16_t kUdfTagExtendedFileEntry = 266;
+constexpr std::uint8_t kUdfFileTypeDirectory = 4;
+constexpr std::uint8_t kUdfFileTypeRegular = 5;
+constexpr std::uint8_t kUdfFileDeleted = 1 << 2;
+constexpr std::uint8_t kUdfFileParent = 1 << 3;
+
+std::uint16_t readLe16(const std::uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+std::uint32_t readLe32(const std::uint8_t *data) {
+  return readLe16(data) | (static_cast<std::uint32_t>(readLe16(data + 2)) << 16);
+}
+
+std::uint64_t readLe64(const std::uint8_t *data) {
+  return readLe32(data) | (static_cast<std::uint64_t>(readLe32(data + 4)) << 32);
+}
+
+char foldChar(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+bool lessNoCase(std::string_view lhs, std::string_view rhs) {
+  return std::lexicographical_compare(
+      lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+      [](char l, char r) { return foldChar(l) < foldChar(r); });
+}
+
+bool equalNoCase(std::string_view lhs, std::string_view rhs) {
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                    [](char l, char r) { return foldChar(l) == foldChar(r); });
+}
+
+void appendUtf8(std::string &result, char32_t c) {
+  if (c < 0x80) {
+    result += static_cast<char>(c);
+  } else if (c < 0x800) {
+    result += static_cast<char>(0xc0 | (c >> 6));
+    result += static_cast<char>(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    result += static_cast<char>(0xe0 | (c >> 12));
+    result += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+    result += static_cast<char>(0x80 | (c & 0x3f));
+  } else {
+    result += static_cast<char>(0xf0 | (c >> 18));
+    result += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+    result += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+    result += static_cast<char>(0x80 | (c & 0x3f));
+  }
+}
+
+std::string decodeUtf16Be(const std::uint8_t *data, std::size_t count) {
+  std::string result;
+  result.reserve(count);
+
+  for (std::size_t i = 0; i + 1 < count * 2; i += 2) {
+    char32_t c = (data[i] << 8) | data[i + 1];
+
+    if (c >= 0xd800 && c < 0xdc00 && i + 3 < count * 2) {
+      char32_t low = (data[i + 2] << 8) | data[i + 3];
+
+      if (low >= 0xdc00 && low < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+        i += 2;
+      }
+    }
+
+    appendUtf8(result, c);
+  }
+
+  return result;
+}
+
+std::string decodeLatin1(const std::uint8_t *data, std::size_t count) {
+  std::string result;
+  result.reserve(count);
+
+  for (std::size_t i = 0; i < count; ++i) {
+    appendUtf8(result, data[i]);
+  }
+
+  return result;
+}
+
+std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  auto era = (year >= 0 ? year : year - 399) / 400;
+  auto yearOfEra = static_cast<unsigned>(year - era * 400);
+  auto dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  auto dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+std::int64_t toUnixTime(std::int64_t year, unsigned month, unsigned day,
+                        unsigned hour, unsigned minute, unsigned second,
+                        int gmtOffsetMinutes) {
+  if (month < 1 || month > 12 || day < 1 || day > 31) {
+    return 0;
+  }
+
+  return daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 +
+         second - gmtOffsetMinutes * 60;
+}
+
+// 7 bytes recording date and time of the directory record
+std::int64_t isoTime(const std::uint8_t *data) {
+  return toUnixTime(1900 + data[0], data[1], data[2], data[3], data[4],
+                    data[5], static_cast<std::int8_t>(data[6]) * 15);
+}
+
+// 12 bytes timestamp of ECMA-167
+std::int64_t udfTime(const std::uint8_t *data) {
+  auto typeAndTimezone = readLe16(data);
+  int timezone = typeAndTimezone & 0xfff;
+  if (timezone & 0x800) {
+    timezone -= 0x1000;
+  }
+
+  if ((typeAndTimezone >> 12) != 1 || timezone == -2047) {
+    timezone = 0;
+  }
+
+  return toUnixTime(static_cast<std::int16_t>(readLe16(data + 2)), data[4],
+                    data[5], data[6], data[7], data[8], timezone);
+}
+
+bool isUdfTag(const std::uint8_t *data, std::uint16_t id) {
+  std::uint8_t checksum = 0;
+  for (std::size_t i = 0; i < 16; ++i) {
+    if (i != 4) {
+      checksum += data[i];
+    }
+  }
+
+  return checksum == data[4] && readLe16(data) == id;
+}
+
+// dstring or file identifier in OSTA compressed unicode
+std::string decodeCs0(const std::uint8_t *data, std::size_t size) {
+  if (size == 0) {
+    return {};
+  }
+
+  switch (data[0]) {
+  case 8:
+  case 254:
+    return decodeLatin1(data + 1, size - 1);
+
+  case 16:
+  case 255:
+    return decodeUtf16Be(data + 1, (size - 1) / 2);
+  }
+
+  return {};
+}
+} // namespace
+
+struct rx::DiscImage::Builder {
+  struct Item {
+    std::string name;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    bool isDirectory = false;
+    std::vector<Extent> extents;
+  };
+
+  struct UdfPartition {
+    std::uint16_t number = 0;
+    bool isMetadata = false;
+    std::uint64_t start = 0;
+
+    // extents of the metadata file, if partition is metadata partition
+    std::vector<Extent> metadata;
+  };
+
+  DiscImage &image;
+  std::vector<std::uint8_t> block;
+
+  bool isJoliet = false;
+
+  std::uint32_t udfBlockSize = kSectorSize;
+  std::vector<UdfPartition> udfPartitions;
+
+  bool readAt(std::uint64_t offset, std::size_t size) {
+    block.resize(size);
+    return image.mRead(offset, block.data(), size) == size;
+  }
+
+  std::vector<std::uint8_t> readDirectory(std::span<const Extent> extents,
+                                          std::uint64_t size) {
+    std::vector<std::uint8_t> result(std::min(size, kMaxDirectorySize));
+    result.resize(
+        image.readExtents(extents, size, 0, result.data(), result.size()));
+    return result;
+  }
+
+  template <typename ListFn> bool build(Item root, ListFn &&listDirectory) {
+    auto &entries = image.mEntries;
+    auto &extents = image.mExtents;
+
+    entries.clear();
+    extents.clear();
+    entries.push_back({
+        .size = root.size,
+        .mtime = root.mtime,
+        .isDirectory = true,
+        .extentCount = static_cast<std::uint32_t>(root.extents.size()),
+    });
+    extents = std::move(root.extents);
+
+    std::unordered_set<std::uint64_t> visited;
+    std::vector<Item> items;
+
+    // breadth first, children of every directory are placed contiguously
+    for (std::uint32_t index = 0; index < entries.size(); ++index) {
+      auto &dir = entries[index];
+      if (!dir.isDirectory || dir.extentCount == 0) {
+        continue;
+      }
+
+      // do not follow loops of the damaged images
+      if (!visited.insert(extents[dir.firstExtent].imageOffset).second) {
+        continue;
+      }
+
+      items.clear();
+      listDirectory(image.extents(dir), dir.size, items);
+
+      std::stable_sort(items.begin(), items.end(),
+                       [](const Item &lhs, const Item &rhs) {
+                         return lessNoCase(lhs.name, rhs.name);
+                       });
+
+      if (entries.size() + items.size() > kMaxEntryCount) {
+        return false;
+      }
+
+      entries[index].firstChild = entries.size();
+      entries[index].childCount = items.size();
+
+      for (auto &item : items) {
+        entries.push_back({
+            .name = std::move(item.name),
+            .size = item.size,
+            .mtime = item.mtime,
+            .isDirectory = item.isDirectory,
+            .parent = index,
+            .firstExtent = static_cast<std::uint32_t>(extents.size()),
+            .extentCount = static_cast<std::uint32_t>(item.extents.size()),
+        });
+
+        extents.insert(extents.end(), item.extents.begin(), item.extents.end());
+      }
+    }
+
+    return true;
+  }
+
+  Item parseIsoRecord(const std::uint8_t *record) {
+    auto lba = readLe32(record + 2) + record[1];
+    auto size = readLe32(record + 10);
+
+    Item result{
+        .size = size,
+        .mtime = isoTime(record + 18),
+        .isDirectory = (record[25] & kIsoFlagDirectory) != 0,
+    };
+
+    if (size != 0) {
+      result.extents.push_back({
+          .imageOffset = static_cast<std::uint64_t>(lba) * kSectorSize,
+          .size = size,
+      });
+    }
+
+    return result;
+  }
+
+  std::string decodeIsoName(const std::uint8_t *data, std::size_t size) {
+    auto name = isJoliet ? decodeUtf16Be(data, size / 2)
+                         : std::string(reinterpret_cast<const char *>(data), size);
+
+    // strip file version and the dot of names without extension
+    name.resize(std::min(name.size(), name.find(';')));
+    if (name.ends_with('.')) {
+      name.pop_back();
+    }
+
+    return name;
+  }
+
+  void listIsoDirectory(std::span<const Extent> extents, std::uint64_t size,
+                        std::vector<Item> &items) {
+    auto data = readDirectory(extents, size);
+    bool isContinuation = false;
+
+    for (std::size_t pos = 0; pos < data.size();) {
+      auto record = data.data() + pos;
+      auto length = record[0];
+
+      // records are not split across sectors
+      if (length < kIsoRecordHeaderSize || pos + length > data.size()) {
+        pos = (pos / kSectorSize + 1) * kSectorSize;
+        continue;
+      }
+
+      pos += length;
+
+      auto nameLength = record[32];
+      if (nameLength == 0 || kIsoRecordHeaderSize + nameLength > length) {
+        continue;
+      }
+
+      auto nameData = record + kIsoRecordHeaderSize;
+
+      // '.' and '..'
+      if (nameLength == 1 && nameData[0] <= 1) {
+        continue;
+      }
+
+      auto item = parseIsoRecord(record);
+      item.name = decodeIsoName(nameData, nameLength);
+
+      // files larger than 4 GiB are split into records with the same name
+      if (isContinuation && !items.empty() && items.back().name == item.name) {
+        auto &prev = items.back();
+        prev.size += item.size;
+        prev.extents.insert(prev.extents.end(), item.extents.begin(),
+                            item.extents.end());
+      } else if (!item.name.empty()) {
+        items.push_back(std::move(item));
+      }
+
+      isContinuation = (record[25] & kIsoFlagMultiExtent) != 0;
+    }
+  }
+
+  // finds root directory record of the primary or Joliet volume
+  bool findIsoRoot(std::uint8_t (&root)[34]) {
+    bool hasPrimary = false;
+
+    for (std::uint32_t i = 0; i < kIsoMaxDescriptors; ++i) {
+      if (!readAt((kIsoDescriptorSector + i) * std::uint64_t(kSectorSize),
+                  kSectorSize)) {
+        break;
+      }
+
+      auto type = block[0];
+      if (std::memcmp(block.data() + 1, "CD001", 5) != 0) {
+        continue;
+      }
+
+      if (type == 255) {
+        break;
+      }
+
+      // supplementary volume with UCS-2 escape sequence
+      bool isJolietVolume = type == 2 && block[88] == '%' && block[89] == '/' &&
+                            (block[90] == '@' || block[90] == 'C' ||
+                             block[90] == 'E');
+
+      if ((type == 1 && !isJoliet) || isJolietVolume) {
+        std::memcpy(root, block.data() + kIsoRootRecordOffset, sizeof(root));
+        hasPrimary = true;
+        isJoliet = isJolietVolume;
+      }
+    }
+
+    return hasPrimary;
+  }
+
+  bool openIso() {
+    std::uint8_t rootRecord[34];
+    if (!findIsoRoot(rootRecord)) {
+      return false;
+    }
+
+    image.mFormat = isJoliet ? Format::Joliet : Format::Iso9660;
+    return build(parseIsoRecord(rootRecord),
+                 [this](std::span<const Extent> extents, std::uint64_t size,
+                        std::vector<Item> &items) {
+                   listIsoDirectory(extents, size, items);
+                 });
+  }
+
+  // appends extent of the partition, extents of metadata partition can be
+  // split by the metadata file extents
+  bool addUdfExtent(std::uint16_t partitionRef, std::uint32_t lbn,
+                    std::uint64_t size, std::vector<Extent> &extents) {
+    if (partitionRef >= udfPartitions.size()) {
+      return false;
+    }
+
+    auto &partition = udfPartitions[partitionRef];
+    auto offset = static_cast<std::uint64_t>(lbn) * udfBlockSize;
+
+    if (!partition.isMetadata) {
+      extents.push_back({partition.start + offset, size});
+      return true;
+    }
+
+    for (auto &metadata : partition.metadata) {
+      if (size == 0) {
+        break;
+      }
+
+      if (offset >= metadata.size) {
+        offset -= metadata.size;
+        continue;
+      }
+
+      if (metadata.imageOffset == kSparseExtent) {
+        return false;
+      }
+
+      auto count = std::min(metadata.size - offset, size);
+      extents.push_back({metadata.imageOffset + offset, count});
+      size -= count;
+      offset = 0;
+    }
+
+    return size == 0;
+  }
+
+  bool readUdfBlock(std::uint16_t partitionRef, std::uint32_t lbn) {
+    std::vector<Extent> extents;
+    if (!addUdfExtent(partitionRef, lbn, udfBlockSize, extents) ||
+        extents.size() != 1) {
+      return false;
+    }
+
+    return readAt(extents[0].imageOffset, udfBlockSize);
+  }
+
+  bool parseUdfAllocation(std::vector<std::uint8_t> data, std::uint8_t adType,
+                          std::uint16_t partitionRef,
+                          std::vector<Extent> &extents, std::uint32_t depth) {
+    std::size_t adSize = adType == 0 ? 8 : 16;
+
+    for (std::size_t pos = 0; pos + adSize <= data.size(); pos += adSize) {
+      auto length = readLe32(data.data() + pos);
+      auto size = length & 0x3fffffff;
+      auto type = length >> 30;
+      auto lbn = readLe32(data.data() + pos + 4);
+      auto ref =
+          adType == 0 ? partitionRef : readLe16(data.data() + pos + 8);
+
+      if (size == 0) {
+        break;
+      }
+
+      if (type == 3) {
+        // continuation in the allocation extent descriptor
+        if (depth >= kUdfMaxAllocationDepth || !readUdfBlock(ref, lbn) ||
+            !isUdfTag(block.data(), kUdfTagAllocationExtent)) {
+          return false;
+        }
+
+        auto adLength = readLe32(block.data() + 20);
+        if (24 + adLength > udfBlockSize) {
+          return false;
+        }
+
+        std::vector<std::uint8_t> next(block.begin() + 24,
+                                       block.begin() + 24 + adLength);
+        return parseUdfAllocation(std::move(next), adType, ref, extents,
+                                  depth + 1);
+      }
+
+      if (type != 0) {
+        // allocated or not allocated, but not recorded
+        extents.push_back({kSparseExtent, size});
+        continue;
+      }
+
+      if (!addUdfExtent(ref, lbn, size, extents)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool parseUdfFileEntry(std::uint16_t partitionRef, std::uint32_t lbn,
+                         Item &item) {
+    std::vector<Extent> location;
+    if (!addUdfExtent(partitionRef, lbn, udfBlockSize, location) ||
+        location.size() != 1 || !readAt(location[0].imageOffset, udfBlockSize)) {
+      return false;
+    }
+
+    std::size_t mtimeOffset;
+    std::size_t eaLengthOffset;
+    std::size_t headerSize;
+
+    if (isUdfTag(block.data(), kUdfTagFileEntry)) {
+      mtimeOffset = 84;
+      eaLengthOffset = 168;
+      headerSize = 176;
+    } else if (isUdfTag(block.data(), kUdfTagExtendedFileEntry)) {
+      mtimeOffset = 92;
+      eaLengthOffset = 208;
+      headerSize = 216;
+    } else {
+      return false;
+    }
+
+    auto fileType = block[16 + 11];
+    auto adType = readLe16(block.data() + 16 + 18) & 7;
+    auto eaLength = readLe32(block.data() + eaLengthOffset);
+    auto adLength = readLe32(block.data() + eaLengthOffset + 4);
+    auto adOffset = static_cast<std::uint64_t>(headerSize) + eaLength;
+
+    if (fileType != kUdfFileTypeDirectory && fileType != kUdfFileTypeRegular) {
+      return false;
+    }
+
+    if (adOffset + adLength > udfBlockSize) {
+      return false;
+    }
+
+    item.isDirectory = fileType == kUdfFileTypeDirectory;
+    item.size = readLe64(block.data() + 56);
+    item.mtime = udfTime(block.data() + mtimeOffset);
+
+    if (adType == 3) {
+      // data is embedded into the file entry
+      item.extents.push_back({location[0].imageOffset + adOffset,
+                              std::min<std::uint64_t>(adLength, item.size)});
+      return true;
+    }
+
+    if (adType > 1) {
+      return false;
+    }
+
+    std::vector<std::uint8_t> ads(block.begin() + adOffset,
+                                  block.begin() + adOffset + adLength);
+    return parseUdfAllocation(std::move(ads), adType, partitionRef,
+                              item.extents, 0);
+  }
+
+  void listUdfDirectory(std::span<const Extent> extents, std::uint64_t size,
+                        std::vector<Item> &items) {
+    auto data = readDirectory(extents, size);
+
+    for (std::size_t pos = 0; pos + 38 <= data.size();) {
+      auto fid = data.data() + pos;
+      if (readLe16(fid) != kUdfTagFileId) {
+        break;
+      }
+
+      auto characteristics = fid[18];
+      auto nameLength = fid[19];
+      auto lbn = readLe32(fid + 24);
+      auto partitionRef = readLe16(fid + 28);
+      auto implUseLength = readLe16(fid + 36);
+
+      if (pos + 38 + implUseLength + nameLength > data.size()) {
+        break;
+      }
+
+      pos += (38 + implUseLength + nameLength + 3) & ~std::size_t(3);
+
+      if (characteristics & (kUdfFileDeleted | kUdfFileParent)) {
+        continue;
+      }
+
+      Item item{.name = decodeCs0(fid + 38 + implUseLength, nameLength)};
+      if (item.name.empty() || !parseUdfFileEntry(partitionRef, lbn, item)) {
+        continue;
+      }
+
+      items.push_back(std::move(item));
+    }
+  }
+
+  bool openUdf() {
+    if (!readAt(kUdfAnchorSector * std::uint64_t(kSectorSize), kSectorSize) ||
+        !isUdfTag(block.data(), kUdfTagAnchor)) {
+      return false;
+    }
+
+    auto vdsLength = readLe32(block.data() + 16);
+    auto vdsSector = readLe32(block.data() + 20);
+
+    std::vector<std::pair<std::uint16_t, std::uint32_t>> partitionStarts;
+    std::vector<std::uint8_t> logicalVolume;
+
+    for (std::uint32_t i = 0;
+         i < std::min(vdsLength / kSectorSize, kUdfMaxDescriptors); ++i) {
+      if (!readAt((vdsSector + i) * std::uint64_t(kSectorSize), kSectorSize)) {
+        return false;
+      }
+
+      if (isUdfTag(block.data(), kUdfTagPartition)) {
+        partitionStarts.emplace_back(readLe16(block.data() + 22),
+                                     readLe32(block.data() + 188));
+      } else if (isUdfTag(block.data(), kUdfTagLogicalVolume)) {
+        logicalVolume = block;
+      } else if (isUdfTag(block.data(), kUdfTagTerminating)) {
+        break;
+      }
+    }
+
+    if (logicalVolume.empty()) {
+      return false;
+    }
+
+    udfBlockSize = readLe32(logicalVolume.data() + 212);
+    if (udfBlockSize != kSectorSize) {
+      return false;
+    }
+
+    auto findStart = [&](std::uint16_t number) -> std::optional<std::uint64_t> {
+      for (auto &[partitionNumber, start] : partitionStarts) {
+        if (partitionNumber == number) {
+          return static_cast<std::uint64_t>(start) * udfBlockSize;
+        }
+      }
+
+      return {};
+    };
+
+    auto mapCount = readLe32(logicalVolume.data() + 268);
+    std::vector<std::pair<std::size_t, std::uint32_t>> metadataFiles;
+
+    for (std::size_t i = 0, pos = 440;
+         i < mapCount && pos + 2 <= logicalVolume.size(); ++i) {
+      auto type = logicalVolume[pos];
+      auto length = logicalVolume[pos + 1];
+      if (length < 6 || pos + length > logicalVolume.size()) {
+        return false;
+      }
+
+      auto map = logicalVolume.data() + pos;
+      pos += length;
+
+      UdfPartition partition;
+
+      if (type == 1) {
+        partition.number = readLe16(map + 4);
+      } else if (type == 2 && length >= 44) {
+        std::string_view id(reinterpret_cast<const char *>(map + 5), 23);
+        partition.number = readLe16(map + 38);
+
+        if (id.starts_with("*UDF Metadata Partition")) {
+          partition.isMetadata = true;
+          metadataFiles.emplace_back(udfPartitions.size(), readLe32(map + 40));
+        } else if (!id.starts_with("*UDF Sparable Partition")) {
+          // virtual partitions of the recordable media are not supported
+          return false;
+        }
+      } else {
+        return false;
+      }
+
+      auto start = findStart(partition.number);
+      if (!start) {
+        return false;
+      }
+
+      partition.start = *start;
+      udfPartitions.push_back(std::move(partition));
+    }
+
+    for (auto [index, metadataLbn] : metadataFiles) {
+      // metadata file is recorded in the physical partition with the same
+      // number, it is appended after the partitions of the logical volume
+      udfPartitions.push_back({
+          .number = udfPartitions[index].number,
+          .start = udfPartitions[index].start,
+      });
+
+      Item metadataFile;
+      if (!parseUdfFileEntry(udfPartitions.size() - 1, metadataLbn,
+                             metadataFile)) {
+        return false;
+      }
+
+      udfPartitions[index].metadata = std::move(metadataFile.extents);
+    }
+
+    auto fileSetLbn = readLe32(logicalVolume.data() + 252);
+    auto fileSetPartition = readLe16(logicalVolume.data() + 256);
+
+    if (!readUdfBlock(fileSetPartition, fileSetLbn) ||
+        !isUdfTag(block.data(), kUdfTagFileSet)) {
+      return false;
+    }
+
+    auto rootLbn = readLe32(block.data() + 404);
+    auto rootPartition = readLe16(block.data() + 408);
+
+    Item root;
+    if (!parseUdfFileEntry(rootPartition, rootLbn, root) || !root.isDirectory) {
+      return false;
+    }
+
+    image.mFormat = Format::Udf;
+    return build(std::move(root),
+                 [this](std::span<const Extent> extents, std::uint64_t size,
+                        std::vector<Item> &items) {
+                   listUdfDirectory(extents, size, items);
+                 });
+  }
+};
+
+bool rx::DiscImage::probe(const ReadFn &read, std::uint64_t imageSize) {
+  std::uint8_t sector[kSectorSize];
+
+  for (std::uint32_t i = 0; i < kIsoMaxDescriptors; ++i) {
+    auto offset = (kIsoDescriptorSector + i) * std::uint64_t(kSectorSize);
+    if (offset + kSectorSize > imageSize ||
+        read(offset, sector, kSectorSize) != kSectorSize) {
+      break;
+    }
+
+    if (std::memcmp(sector + 1, "CD001", 5) != 0) {
+      continue;
+    }
+
+    if (sector[0] == 255) {
+      break;
+    }
+
+    if (sector[0] == 1) {
+      return true;
+    }
+  }
+
+  auto anchorOffset = kUdfAnchorSector * std::uint64_t(kSectorSize);
+  return anchorOffset + kSectorSize <= imageSize &&
+         read(anchorOffset, sector, kSectorSize) == kSectorSize &&
+         isUdfTag(sector, kUdfTagAnchor);
+}
+
+std::unique_ptr<rx::DiscImage> rx::DiscImage::open(ReadFn read,
+                                                   std::uint64_t imageSize) {
+  if (!probe(read, imageSize)) {
+    return {};
+  }
+
+  std::unique_ptr<DiscImage> result(new DiscImage());
+  result->mRead = std::move(read);
+  result->mImageSize = imageSize;
+
+  // ISO 9660 is preferred on bridge discs with both file systems
+  if (Builder{.image = *result}.openIso() ||
+      Builder{.image = *result}.openUdf()) {
+    return result;
+  }
+
+  return {};
+}
+
+std::uint32_t rx::DiscImage::find(std::string_view path) const {
+  std::uint32_t index = 0;
+
+  while (!path.empty()) {
+    auto sepPos = path.find_first_of("/\\");
+    auto name = path.substr(0, sepPos);
+    path = sepPos == std::string_view::npos ? std::string_view{}
+                                            : path.substr(sepPos + 1);
+
+    if (name.empty() || name == ".") {
+      continue;
+    }
+
+    auto &dir = mEntries[index];
+
+    if (name == "..") {
+      index = dir.parent;
+      continue;
+    }
+
+    if (!dir.isDirectory) {
+      return kNoEntry;
+    }
+
+    auto list = children(dir);
+    auto it = std::lower_bound(list.begin(), list.end(), name,
+                               [](const Entry &entry, std::string_view name) {
+                                 return lessNoCase(entry.name, name);
+                               });
+
+    // names can differ only in case, exact match is preferred
+    std::uint32_t found = kNoEntry;
+    for (; it != list.end() && equalNoCase(it->name, name); ++it) {
+      if (found == kNoEntry || it->name == name) {
+        found = dir.firstChild + (it - list.begin());
+      }
+
+      if (it->name == name) {
+        break;
+      }
+    }
+
+    if (found == kNoEntry) {
+      return kNoEntry;
+    }
+
+    index = found;
+  }
+
+  return index;
+}
+
+std::size_t rx::DiscImage::read(const Entry &file, std::uint64_t offset,
+                                void *data, std::size_t size) const {
+  return readExtents(extents(file), file.size, offset, data, size);
+}
+
+std::uint64_t rx::DiscImage::getContiguousOffset(const Entry &file,
+                                                std::uint64_t offset,
+                                                std::uint64_t size) const {
+  if (size == 0 || offset >= file.size || file.size - offset < size) {
+    return kSparseExtent;
+  }
+
+  for (auto &extent : extents(file)) {
+    if (offset >= extent.size) {
+      offset -= extent.size;
+      continue;
+    }
+
+    if (extent.imageOffset == kSparseExtent || extent.size - offset < size) {
+      return kSparseExtent;
+    }
+
+    return extent.imageOffset + offset;
+  }
+
+  return kSparseExtent;
+}
+
+std::size_t rx::DiscImage::readExtents(std::span<const Extent> extents,
+                                       std::uint64_t fileSize,
+                                       std::uint64_t offset, void *data,
+                                       std::size_t size) const {
+  if (offset >= fileSize) {
+    return 0;
+  }
+
+  size = std::min<std::uint64_t>(size, fileSize - offset);
+  auto out = static_cast<std::byte *>(data);
+  std::size_t done = 0;
+
+  for (auto &extent : extents) {
+    if (done == size) {
+      break;
+    }
+
+    if (offset >= extent.size) {
+      offset -= extent.size;
+      continue;
+    }
+
+    auto count = std::min<std::uint64_t>(extent.size - offset, size - done);
+
+    if (extent.imageOffset == kSparseExtent) {
+      std::memset(out + done, 0, count);
+    } else {
+      auto result = mRead(extent.imageOffset + offset, out + done, count);
+      if (result != count) {
+        return done + result;
+      }
+    }
+
+    done += count;
+    offset = 0;
+  }
+
+  return done;
+}
+
+std::size_t rx::DiscImage::readBuffered(
+    const Entry &file, ReadAheadState &state, std::uint64_t offset,
+    void *data, std::size_t size,
+    FunctionRef<std::span<std::byte>(std::size_t)> getBuffer) const {
+  auto out = static_cast<std::byte *>(data);
+  std::size_t done = 0;
+
+  if (offset >= state.bufferOffset &&
+      offset < state.bufferOffset + state.bufferSize) {
+    auto buffer = getBuffer(0);
+    auto count = std::min<std::uint64_t>(
+        state.bufferOffset + state.bufferSize - offset, size);
+    std::memcpy(out, buffer.data() + (offset - state.bufferOffset), count);
+    done = count;
+    offset += count;
+
+    if (done == size) {
+      state.nextOffset = offset;
+      return done;
+    }
+  }
+
+  if (done != 0 || offset == state.nextOffset) {
+    state.window = std::clamp(state.window * 2, kMinReadAhead, kMaxReadAhead);
+  } else {
+    state.window = 0;
+  }
+
+  if (state.window == 0 || size - done >= state.window) {
+    auto count = read(file, offset, out + done, size - done);
+    state.nextOffset = offset + count;
+    return done + count;
+  }
+
+  auto buffer = getBuffer(state.window);
+  state.bufferOffset = offset;
+  state.bufferSize = read(file, offset, buffer.data(), state.window);
+
+  auto count = std::min<std::uint64_t>(state.bufferSize, size - done);
+  std::memcpy(out + done, buffer.data(), count);
+  state.nextOffset = offset + count;
+  return done + count;
+}
@@ -0,0 +1,456 @@
+#include "DiscImageWriter.hpp"
+#include "DiscImage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+
+namespace {
+constexpr std::uint32_t kSectorSize = rx::DiscImage::kSectorSize;
+constexpr std::uint32_t kDescriptorSector = 16;
+constexpr std::uint32_t kPathTableSector = 18;
+constexpr std::size_t kRecordHeaderSize = 33;
+constexpr std::size_t kMaxNameLength = 200;
+constexpr std::uint8_t kFlagDirectory = 1 << 1;
+constexpr std::uint8_t kFlagMultiExtent = 1 << 7;
+
+// largest extent of a single directory record, multiple of the sector size
+constexpr std::uint64_t kMaxExtentSize = 0xffff'f800;
+
+std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void putLe16(std::uint8_t *data, std::uint16_t value) {
+  data[0] = value;
+  data[1] = value >> 8;
+}
+
+void putBe16(std::uint8_t *data, std::uint16_t value) {
+  data[0] = value >> 8;
+  data[1] = value;
+}
+
+void putLe32(std::uint8_t *data, std::uint32_t value) {
+  putLe16(data, value);
+  putLe16(data + 2, value >> 16);
+}
+
+void putBe32(std::uint8_t *data, std::uint32_t value) {
+  putBe16(data, value >> 16);
+  putBe16(data + 2, value);
+}
+
+void putBoth16(std::uint8_t *data, std::uint16_t value) {
+  putLe16(data, value);
+  putBe16(data + 2, value);
+}
+
+void putBoth32(std::uint8_t *data, std::uint32_t value) {
+  putLe32(data, value);
+  putBe32(data + 4, value);
+}
+
+void putPadded(std::uint8_t *data, std::size_t size, std::string_view text) {
+  std::memset(data, ' ', size);
+  std::memcpy(data, text.data(), std::min(size, text.size()));
+}
+
+// 7 bytes recording date and time, GMT
+void putTime(std::uint8_t *data, std::int64_t time) {
+  auto days = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+  auto seconds = time - days * 86400;
+
+  days += 719468;
+  auto era = (days >= 0 ? days : days - 146096) / 146097;
+  auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+  auto yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 -
+                    dayOfEra / 146096) /
+                   365;
+  auto dayOfYear =
+      dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  auto monthIndex = (5 * dayOfYear + 2) / 153;
+  auto day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+  auto month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+  auto year = static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2);
+
+  data[0] = static_cast<std::uint8_t>(
+      std::clamp<std::int64_t>(year - 1900, 0, 255));
+  data[1] = month;
+  data[2] = day;
+  data[3] = seconds / 3600;
+  data[4] = seconds / 60 % 60;
+  data[5] = seconds % 60;
+  data[6] = 0;
+}
+
+bool isValidName(std::string_view name) {
+  return !name.empty() && name.size() <= kMaxNameLength && name != "." &&
+         name != ".." && name.find_first_of("/;") == std::string_view::npos;
+}
+} // namespace
+
+struct rx::DiscImageWriter::Node {
+  std::string name;
+  bool isDirectory = false;
+  std::int64_t mtime = 0;
+  std::vector<std::byte> data;
+  Node *parent = nullptr;
+  std::vector<std::unique_ptr<Node>> children;
+
+  // name recorded in the directory, files have version suffix
+  std::string identifier() const {
+    return isDirectory ? name : name + ";1";
+  }
+
+  std::uint64_t size() const { return data.size(); }
+
+  std::size_t extentCount() const {
+    return std::max<std::size_t>(
+        1, (data.size() + kMaxExtentSize - 1) / kMaxExtentSize);
+  }
+
+  Node *find(std::string_view childName) {
+    for (auto &child : children) {
+      if (child->name == childName) {
+        return child.get();
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+rx::DiscImageWriter::DiscImageWriter() : mRoot(std::make_unique<Node>()) {
+  mRoot->isDirectory = true;
+  mRoot->parent = mRoot.get();
+}
+
+rx::DiscImageWriter::~DiscImageWriter() = default;
+
+rx::DiscImageWriter::Node *
+rx::DiscImageWriter::getDirectory(std::string_view path, std::int64_t mtime) {
+  auto node = mRoot.get();
+
+  while (!path.empty()) {
+    auto sepPos = path.find('/');
+    auto name = path.substr(0, sepPos);
+    path = sepPos == std::string_view::npos ? std::string_view{}
+                                            : path.substr(sepPos + 1);
+
+    if (name.empty()) {
+      continue;
+    }
+
+    if (!isValidName(name)) {
+      return nullptr;
+    }
+
+    auto child = node->find(name);
+
+    if (child == nullptr) {
+      auto newNode = std::make_unique<Node>();
+      newNode->name = name;
+      newNode->isDirectory = true;
+      newNode->mtime = mtime;
+      newNode->parent = node;
+      child = node->children.emplace_back(std::move(newNode)).get();
+    }
+
+    if (!child->isDirectory) {
+      return nullptr;
+    }
+
+    node = child;
+  }
+
+  return node;
+}
+
+bool rx::DiscImageWriter::addDirectory(std::string_view path,
+                                       std::int64_t mtime) {
+  return getDirectory(path, mtime) != nullptr;
+}
+
+bool rx::DiscImageWriter::addFile(std::string_view path,
+                                  std::vector<std::byte> data,
+                                  std::int64_t mtime) {
+  auto sepPos = path.rfind('/');
+  auto name = sepPos == std::string_view::npos ? path : path.substr(sepPos + 1);
+  auto dirPath = sepPos == std::string_view::npos ? std::string_view{}
+                                                  : path.substr(0, sepPos);
+
+  if (!isValidName(name)) {
+    return false;
+  }
+
+  auto dir = getDirectory(dirPath, mtime);
+  if (dir == nullptr || dir->find(name) != nullptr) {
+    return false;
+  }
+
+  auto node = std::make_unique<Node>();
+  node->name = name;
+  node->mtime = mtime;
+  node->data = std::move(data);
+  node->parent = dir;
+  dir->children.push_back(std::move(node));
+  return true;
+}
+
+std::uint64_t rx::DiscImageWriter::write(const WriteFn &write) const {
+  if (mFileAlignment == 0 || mFileAlignment % kSectorSize != 0) {
+    return 0;
+  }
+
+  struct Location {
+    std::uint32_t lba = 0;
+    std::uint64_t size = 0;
+  };
+
+  // directories in path table order: breadth first, children are ordered by
+  // identifier
+  std::vector<const Node *> dirs;
+  std::vector<const Node *> files;
+  std::map<const Node *, std::vector<const Node *>> sortedChildren;
+  std::map<const Node *, std::uint16_t> dirNumbers;
+  std::map<const Node *, Location> locations;
+
+  std::deque<const Node *> queue{mRoot.get()};
+  while (!queue.empty()) {
+    auto dir = queue.front();
+    queue.pop_front();
+
+    dirs.push_back(dir);
+    dirNumbers[dir] = dirs.size();
+
+    auto &children = sortedChildren[dir];
+    for (auto &child : dir->children) {
+      children.push_back(child.get());
+    }
+
+    std::ranges::sort(children, [](const Node *lhs, const Node *rhs) {
+      return lhs->identifier() < rhs->identifier();
+    });
+
+    for (auto child : children) {
+      if (child->isDirectory) {
+        queue.push_back(child);
+      } else {
+        files.push_back(child);
+      }
+    }
+  }
+
+  if (dirs.size() > 0xffff) {
+    return 0;
+  }
+
+  auto recordSize = [](std::size_t nameLength) {
+    return kRecordHeaderSize + nameLength + (nameLength % 2 == 0 ? 1 : 0);
+  };
+
+  // records are not split across sectors
+  auto forEachRecord = [&](const Node *dir, auto &&fn) {
+    std::uint64_t pos = 0;
+
+    auto place = [&](std::size_t size) {
+      if (pos % kSectorSize + size > kSectorSize) {
+        pos = alignUp(pos, kSectorSize);
+      }
+
+      auto result = pos;
+      pos += size;
+      return result;
+    };
+
+    // '.' and '..'
+    fn(place(recordSize(1)), dir, 0, std::string_view("\0", 1));
+    fn(place(recordSize(1)), dir->parent, 0, std::string_view("\1", 1));
+
+    for (auto child : sortedChildren[dir]) {
+      auto identifier = child->identifier();
+      for (std::size_t i = 0; i < child->extentCount(); ++i) {
+        fn(place(recordSize(identifier.size())), child, i, identifier);
+      }
+    }
+
+    return alignUp(pos, kSectorSize);
+  };
+
+  std::uint64_t pathTableSize = 0;
+  for (auto dir : dirs) {
+    auto nameLength = dir == mRoot.get() ? 1 : dir->name.size();
+    pathTableSize += 8 + nameLength + nameLength % 2;
+  }
+
+  auto pathTableSectors = alignUp(pathTableSize, kSectorSize) / kSectorSize;
+  std::uint64_t lba = kPathTableSector + pathTableSectors * 2;
+
+  for (auto dir : dirs) {
+    auto size = forEachRecord(dir, [](auto...) {});
+    locations[dir] = {.lba = static_cast<std::uint32_t>(lba), .size = size};
+    lba += size / kSectorSize;
+  }
+
+  auto offset = lba * kSectorSize;
+  for (auto file : files) {
+    offset = alignUp(offset, mFileAlignment);
+    locations[file] = {.lba = static_cast<std::uint32_t>(offset / kSectorSize),
+                       .size = file->size()};
+    offset += alignUp(file->size(), kSectorSize);
+  }
+
+  auto imageSize = alignUp(offset, kSectorSize);
+  if (imageSize / kSectorSize > 0xffff'ffff) {
+    return 0;
+  }
+
+  auto fillRecord = [&](std::uint8_t *record, const Node *node,
+                        std::size_t extentIndex, std::string_view identifier) {
+    auto &location = locations[node];
+    auto extentSize = std::min(location.size - extentIndex * kMaxExtentSize,
+                               kMaxExtentSize);
+    if (node->isDirectory || location.size == 0) {
+      extentSize = location.size;
+    }
+
+    auto extentLba =
+        location.lba + extentIndex * (kMaxExtentSize / kSectorSize);
+
+    record[0] = recordSize(identifier.size());
+    putBoth32(record + 2, extentLba);
+    putBoth32(record + 10, extentSize);
+    putTime(record + 18, node->mtime);
+    record[25] = node->isDirectory ? kFlagDirectory : 0;
+    if (!node->isDirectory && extentIndex + 1 < node->extentCount()) {
+      record[25] |= kFlagMultiExtent;
+    }
+    putBoth16(record + 28, 1);
+    record[32] = identifier.size();
+    std::memcpy(record + kRecordHeaderSize, identifier.data(),
+                identifier.size());
+  };
+
+  std::vector<std::uint8_t> buffer(kSectorSize * kDescriptorSector);
+  if (!write(0, buffer.data(), buffer.size())) {
+    return 0;
+  }
+
+  // primary volume descriptor and terminator
+  buffer.assign(kSectorSize * 2, 0);
+  {
+    auto pvd = buffer.data();
+    pvd[0] = 1;
+    std::memcpy(pvd + 1, "CD001", 5);
+    pvd[6] = 1;
+    putPadded(pvd + 8, 32, "");
+    putPadded(pvd + 40, 32, mVolumeId);
+    putBoth32(pvd + 80, imageSize / kSectorSize);
+    putBoth16(pvd + 120, 1);
+    putBoth16(pvd + 124, 1);
+    putBoth16(pvd + 128, kSectorSize);
+    putBoth32(pvd + 132, pathTableSize);
+    putLe32(pvd + 140, kPathTableSector);
+    putBe32(pvd + 148, kPathTableSector + pathTableSectors);
+    fillRecord(pvd + 156, mRoot.get(), 0, std::string_view("\0", 1));
+    putPadded(pvd + 190, 813 - 190, "");
+
+    // creation, modification, expiration and effective dates are not
+    // specified
+    for (std::size_t i = 0; i < 4; ++i) {
+      std::memset(pvd + 813 + i * 17, '0', 16);
+    }
+    pvd[881] = 1;
+
+    auto terminator = buffer.data() + kSectorSize;
+    terminator[0] = 255;
+    std::memcpy(terminator + 1, "CD001", 5);
+    terminator[6] = 1;
+  }
+
+  if (!write(kDescriptorSector * kSectorSize, buffer.data(), buffer.size())) {
+    return 0;
+  }
+
+  // little and big endian path tables
+  for (int bigEndian = 0; bigEndian < 2; ++bigEndian) {
+    buffer.assign(pathTableSectors * kSectorSize, 0);
+    std::size_t pos = 0;
+
+    for (auto dir : dirs) {
+      auto name = dir == mRoot.get() ? std::string_view("\0", 1)
+                                     : std::string_view(dir->name);
+      auto record = buffer.data() + pos;
+      record[0] = name.size();
+
+      if (bigEndian) {
+        putBe32(record + 2, locations[dir].lba);
+        putBe16(record + 6, dirNumbers[dir->parent]);
+      } else {
+        putLe32(record + 2, locations[dir].lba);
+        putLe16(record + 6, dirNumbers[dir->parent]);
+      }
+
+      std::memcpy(record + 8, name.data(), name.size());
+      pos += 8 + name.size() + name.size() % 2;
+    }
+
+    auto sector = kPathTableSector + pathTableSectors * bigEndian;
+    if (!write(sector * kSectorSize, buffer.data(), buffer.size())) {
+      return 0;
+    }
+  }
+
+  for (auto dir : dirs) {
+    auto &location = locations[dir];
+    buffer.assign(location.size, 0);
+
+    forEachRecord(dir, [&](std::uint64_t pos, const Node *node,
+                           std::size_t extentIndex,
+                           std::string_view identifier) {
+      fillRecord(buffer.data() + pos, node, extentIndex, identifier);
+    });
+
+    if (!write(std::uint64_t(location.lba) * kSectorSize, buffer.data(),
+               buffer.size())) {
+      return 0;
+    }
+  }
+
+  // file data, gaps of the alignment and sector tails are zero filled
+  std::uint64_t end = (locations[dirs.back()].lba +
+                       locations[dirs.back()].size / kSectorSize) *
+                      std::uint64_t(kSectorSize);
+  std::vector<std::uint8_t> zeros(kSectorSize);
+
+  auto writeZeros = [&](std::uint64_t from, std::uint64_t to) {
+    while (from < to) {
+      auto count = std::min<std::uint64_t>(to - from, zeros.size());
+      if (!write(from, zeros.data(), count)) {
+        return false;
+      }
+      from += count;
+    }
+
+    return true;
+  };
+
+  for (auto file : files) {
+    auto fileOffset = std::uint64_t(locations[file].lba) * kSectorSize;
+
+    if (!writeZeros(end, fileOffset) ||
+        (!file->data.empty() &&
+         !write(fileOffset, file->data.data(), file->data.size()))) {
+      return 0;
+    }
+
+    end = fileOffset + file->data.size();
+  }
+
+  if (!writeZeros(end, imageSize)) {
+    return 0;
+  }
+
+  return imageSize;
+}
@@ -0,0 +1,251 @@
+// Round trip of the images produced by DiscImageWriter through DiscImage reads
+// and direct mappings of the image file
+
+#include "rx/DiscImage.hpp"
+#include "rx/DiscImageWriter.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+int g_failures = 0;
+
+void check(bool condition, const char *what) {
+  if (!condition) {
+    std::fprintf(stderr, "disc_image: %s\n", what);
+    g_failures++;
+  }
+}
+
+std::vector<std::byte> makeData(std::uint32_t seed, std::size_t size) {
+  std::vector<std::byte> result(size);
+  std::uint32_t state = seed * 0x9e3779b9u + 1;
+
+  for (auto &byte : result) {
+    state = state * 1664525u + 1013904223u;
+    byte = static_cast<std::byte>(state >> 24);
+  }
+
+  return result;
+}
+
+struct TestFile {
+  std::string_view path;
+  std::vector<std::byte> data;
+};
+
+std::size_t readAll(int fd, std::uint64_t offset, void *data,
+                    std::size_t size) {
+  std::size_t done = 0;
+
+  while (done < size) {
+    auto result = ::pread(fd, static_cast<char *>(data) + done, size - done,
+                          offset + done);
+    if (result <= 0) {
+      break;
+    }
+
+    done += result;
+  }
+
+  return done;
+}
+
+void checkReads(const rx::DiscImage &image, const TestFile &file) {
+  auto index = image.find(file.path);
+  check(index != rx::DiscImage::kNoEntry, "file not found");
+  if (index == rx::DiscImage::kNoEntry) {
+    return;
+  }
+
+  auto &entry = image.entry(index);
+  check(!entry.isDirectory, "file is a directory");
+  check(entry.size == file.data.size(), "file size differs");
+
+  std::vector<std::byte> buffer(file.data.size() + 100);
+  auto count = image.read(entry, 0, buffer.data(), buffer.size());
+  check(count == file.data.size(), "short read of the whole file");
+  check(std::equal(file.data.begin(), file.data.end(), buffer.begin()),
+        "file data differs");
+
+  // unaligned reads crossing sector boundaries
+  for (std::uint64_t offset = 1; offset < file.data.size(); offset += 3001) {
+    auto size = std::min<std::size_t>(5000, file.data.size() - offset);
+    count = image.read(entry, offset, buffer.data(), size);
+    check(count == size, "short read at offset");
+    check(std::memcmp(buffer.data(), file.data.data() + offset, size) == 0,
+          "data at offset differs");
+  }
+
+  check(image.read(entry, file.data.size(), buffer.data(), 1) == 0,
+        "read past the end of file");
+
+  // sequential reads grow the read-ahead window, seeks drop it
+  rx::DiscImage::ReadAhead<std::vector<std::byte>> readAhead;
+  std::vector<std::byte> sequential;
+
+  for (std::uint64_t offset = 0; offset < file.data.size();) {
+    std::byte chunk[4096];
+    count = image.read(entry, readAhead, offset, chunk, sizeof(chunk));
+    if (count == 0) {
+      break;
+    }
+
+    sequential.insert(sequential.end(), chunk, chunk + count);
+    offset += count;
+  }
+
+  check(sequential == file.data, "sequential read-ahead data differs");
+
+  for (std::uint64_t offset : {std::uint64_t(0), file.data.size() / 2,
+                               file.data.size() / 3, std::uint64_t(7)}) {
+    if (offset >= file.data.size()) {
+      continue;
+    }
+
+    auto size = std::min<std::size_t>(1000, file.data.size() - offset);
+    count = image.read(entry, readAhead, offset, buffer.data(), size);
+    check(count == size, "short random read-ahead read");
+    check(std::memcmp(buffer.data(), file.data.data() + offset, size) == 0,
+          "random read-ahead data differs");
+  }
+}
+
+// mapping of the image file must show the same data as the reads
+void checkMapping(const rx::DiscImage &image, int fd, const TestFile &file) {
+  auto &entry = image.entry(image.find(file.path));
+  auto pageSize = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+
+  for (std::uint64_t offset = 0; offset < entry.size; offset += pageSize * 3) {
+    auto size = (entry.size - offset) / pageSize * pageSize;
+    if (size == 0) {
+      break;
+    }
+
+    auto imageOffset = image.getContiguousOffset(entry, offset, size);
+    check(imageOffset != rx::DiscImage::kSparseExtent,
+          "file range is not contiguous");
+    check(imageOffset % pageSize == 0, "aligned file is not page aligned");
+
+    if (imageOffset == rx::DiscImage::kSparseExtent ||
+        imageOffset % pageSize != 0) {
+      continue;
+    }
+
+    auto mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd,
+                          imageOffset);
+    check(mapping != MAP_FAILED, "failed to map the image");
+    if (mapping == MAP_FAILED) {
+      continue;
+    }
+
+    check(std::memcmp(mapping, file.data.data() + offset, size) == 0,
+          "mapped data differs");
+    ::munmap(mapping, size);
+  }
+
+  check(image.getContiguousOffset(entry, 0, entry.size + 1) ==
+            rx::DiscImage::kSparseExtent,
+        "range past the end of file is contiguous");
+}
+} // namespace
+
+int main() {
+  auto path = std::filesystem::temp_directory_path() /
+              ("rx_test_disc_image_" + std::to_string(::getpid()) + ".iso");
+
+  std::vector<TestFile> files;
+  files.push_back({"README.TXT", makeData(1, 100)});
+  files.push_back({"DATA/BIG.BIN", makeData(2, 300 * 1024 + 17)});
+  files.push_back({"DATA/ODD.BIN", makeData(3, 5000)});
+  files.push_back({"DATA/SUB/Mixed_Case.dat", makeData(4, 2048)});
+  files.push_back({"DATA/SUB/EMPTY.BIN", {}});
+
+  rx::DiscImageWriter writer;
+  writer.setVolumeId("RX_TEST");
+
+  // aligned to the largest supported page size
+  writer.setFileAlignment(64 * 1024);
+  check(writer.addDirectory("EMPTY_DIR"), "failed to add directory");
+
+  for (auto &file : files) {
+    check(writer.addFile(file.path, file.data, 1'700'000'000),
+          "failed to add file");
+  }
+
+  check(!writer.addFile("README.TXT", {}), "duplicate file was added");
+  check(!writer.addFile("README.TXT/NESTED", {}), "file used as directory");
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    std::perror("open");
+    return EXIT_FAILURE;
+  }
+
+  auto imageSize = writer.write(
+      [fd](std::uint64_t offset, const void *data, std::size_t size) {
+        return ::pwrite(fd, data, size, offset) ==
+               static_cast<ssize_t>(size);
+      });
+  check(imageSize != 0, "failed to write the image");
+
+  auto image = rx::DiscImage::open(
+      [fd](std::uint64_t offset, void *data, std::size_t size) {
+        return readAll(fd, offset, data, size);
+      },
+      imageSize);
+  check(image != nullptr, "failed to open the image");
+
+  if (image != nullptr) {
+    check(image->format() == rx::DiscImage::Format::Iso9660,
+          "unexpected image format");
+
+    for (auto &file : files) {
+      checkReads(*image, file);
+      if (!file.data.empty()) {
+        checkMapping(*image, fd, file);
+      }
+    }
+
+    check(image->find("data/sub/mixed_case.DAT") != rx::DiscImage::kNoEntry,
+          "case insensitive lookup failed");
+    check(image->find("DATA/MISSING.BIN") == rx::DiscImage::kNoEntry,
+          "missing file was found");
+    check(image->find("README.TXT/X") == rx::DiscImage::kNoEntry,
+          "file was used as directory");
+
+    auto dir = image->find("EMPTY_DIR");
+    check(dir != rx::DiscImage::kNoEntry && image->entry(dir).isDirectory &&
+              image->entry(dir).childCount == 0,
+          "empty directory differs");
+
+    auto data = image->find("DATA");
+    check(data != rx::DiscImage::kNoEntry &&
+              image->children(image->entry(data)).size() == 3,
+          "unexpected child count of DATA");
+
+    auto readme = image->find("README.TXT");
+    check(readme != rx::DiscImage::kNoEntry &&
+              image->entry(readme).mtime == 1'700'000'000,
+          "modification time differs");
+  }
+
+  ::close(fd);
+  std::filesystem::remove(path);
+
+  if (g_failures != 0) {
+    return EXIT_FAILURE;
+  }
+
+  std::printf("disc_image: %zu files match\n", files.size());
+  return EXIT_SUCCESS;
+}
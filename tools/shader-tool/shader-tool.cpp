@@ -1,6 +1,9 @@
 
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -11,11 +14,14 @@
 #include <shader/glsl.hpp>
 #include <shader/ir.hpp>
 #include <shader/spv.hpp>
+#include <string>
 #include <string_view>
+#include <sys/resource.h>
 #include <vector>
 
 #ifdef GCN
 #include <shader/GcnConverter.hpp>
+#include <shader/ShaderCache.hpp>
 #include <shader/gcn.hpp>
 #include <shaders/rdna-semantic-spirv.hpp>
 #endif
@@ -166,6 +172,16 @@ struct InputParam {
 #ifdef GCN
   std::string semanticPath;
   std::optional<shader::gcn::Stage> gcnStage;
+  std::uint8_t vgprCount = 0;
+  std::uint8_t sgprCount = 0;
+  std::uint8_t numThreads[3] = {};
+  bool supportsBarycentric = false;
+  bool supportsInt8 = false;
+  bool supportsInt64Atomics = false;
+  bool supportsNonSemanticInfo = false;
+  std::vector<std::uint32_t> userSgprs;
+  std::string cacheDir;
+  std::uint64_t cacheAddress = 0;
 #endif
 };
 
@@ -289,12 +305,36 @@ static shader::ir::Region parseIsa(shader::ir::Context &context,
       shader::gcn::collectSemanticInfo(gcnSemanticModuleInfo);
 
   shader::gcn::Context isaContext;
-  shader::gcn::Environment env;
-  auto ir = shader::gcn::deserialize(
-      isaContext, env, gcnSemanticInfo, 0,
-      [&](std::uint64_t address) -> std::uint32_t {
-        return *reinterpret_cast<const std::uint32_t *>(bytes.data() + address);
-      });
+  // every environment field is a part of the cache key, cache entries are
+  // reused only if the tool was invoked with the guest environment
+  shader::gcn::Environment env{
+      .vgprCount = inputParam.vgprCount,
+      .sgprCount = inputParam.sgprCount,
+      .numThreadX = inputParam.numThreads[0],
+      .numThreadY = inputParam.numThreads[1],
+      .numThreadZ = inputParam.numThreads[2],
+      .supportsBarycentric = inputParam.supportsBarycentric,
+      .supportsInt8 = inputParam.supportsInt8,
+      .supportsInt64Atomics = inputParam.supportsInt64Atomics,
+      .supportsNonSemanticInfo = inputParam.supportsNonSemanticInfo,
+      .userSgprs = inputParam.userSgprs,
+  };
+
+  // shader binary is placed at cacheAddress, so cache entries produced here
+  // match the address the shader is loaded at by the guest
+  auto readMemory = [&](std::uint64_t address) -> std::uint32_t {
+    auto offset = address - inputParam.cacheAddress;
+    if (offset + sizeof(std::uint32_t) > bytes.size()) {
+      return 0;
+    }
+
+    std::uint32_t result;
+    std::memcpy(&result, bytes.data() + offset, sizeof(result));
+    return result;
+  };
+
+  auto ir = shader::gcn::deserialize(isaContext, env, gcnSemanticInfo,
+                                     inputParam.cacheAddress, readMemory);
 
   if (outputParam.type == OutputType::Ir) {
     return ir;
@@ -303,6 +343,20 @@ static shader::ir::Region parseIsa(shader::ir::Context &context,
   if (auto converted = shader::gcn::convertToSpv(
           isaContext, ir, gcnSemanticInfo, gcnSemanticModuleInfo,
           *inputParam.gcnStage, env)) {
+    if (!inputParam.cacheDir.empty()) {
+      shader::gcn::ShaderCache cache;
+      if (!inputParam.semanticPath.empty()) {
+        std::fprintf(stderr, "shader cache requires builtin semantic\n");
+      } else if (cache.open(inputParam.cacheDir, g_rdna_semantic_spirv)) {
+        cache.store(*inputParam.gcnStage, env, inputParam.cacheAddress,
+                    *converted, readMemory);
+
+        if (cache.getStats().stores == 0) {
+          std::fprintf(stderr, "shader is not cacheable\n");
+        }
+      }
+    }
+
     if (auto result = shader::spv::deserialize(context, converted->spv, loc)) {
       return result->merge(context);
     }
@@ -327,6 +381,146 @@ static shader::ir::Region parseSb(shader::ir::Context &context,
 }
 #endif
 
+#ifdef GCN
+static std::optional<std::vector<std::string_view>>
+splitList(std::string_view list) {
+  std::vector<std::string_view> result;
+
+  while (!list.empty()) {
+    auto pos = list.find(',');
+    auto item = list.substr(0, pos);
+    if (item.empty()) {
+      return {};
+    }
+
+    result.push_back(item);
+    list = pos == std::string_view::npos ? std::string_view{}
+                                         : list.substr(pos + 1);
+  }
+
+  return result;
+}
+
+static bool parseUserSgprs(InputParam &inputParam, std::string_view list) {
+  auto items = splitList(list);
+  if (!items) {
+    return false;
+  }
+
+  inputParam.userSgprs.clear();
+  for (auto item : *items) {
+    inputParam.userSgprs.push_back(
+        std::strtoul(std::string(item).c_str(), nullptr, 0));
+  }
+
+  return true;
+}
+
+static bool parseNumThreads(InputParam &inputParam, std::string_view list) {
+  auto items = splitList(list);
+  if (!items || items->size() != 3) {
+    return false;
+  }
+
+  for (std::size_t i = 0; i < 3; ++i) {
+    inputParam.numThreads[i] =
+        std::strtoul(std::string((*items)[i]).c_str(), nullptr, 0);
+  }
+
+  return true;
+}
+
+static bool parseFeatures(InputParam &inputParam, std::string_view list) {
+  auto items = splitList(list);
+  if (!items) {
+    return false;
+  }
+
+  for (auto item : *items) {
+    if (item == "barycentric") {
+      inputParam.supportsBarycentric = true;
+    } else if (item == "int8") {
+      inputParam.supportsInt8 = true;
+    } else if (item == "int64-atomics") {
+      inputParam.supportsInt64Atomics = true;
+    } else if (item == "non-semantic-info") {
+      inputParam.supportsNonSemanticInfo = true;
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static int verifyShaderCache(const std::filesystem::path &cacheDir,
+                             bool prune) {
+  shader::gcn::ShaderCache cache;
+  if (!cache.open(cacheDir, g_rdna_semantic_spirv)) {
+    return 1;
+  }
+
+  std::size_t fileCount = 0;
+  std::size_t staleFileCount = 0;
+  std::size_t recordCount = 0;
+  std::size_t brokenCount = 0;
+
+  for (auto &entry : std::filesystem::directory_iterator(cacheDir)) {
+    if (!entry.is_regular_file() || entry.path().extension() != ".bin") {
+      continue;
+    }
+
+    fileCount++;
+
+    std::size_t fileBrokenCount = 0;
+    auto records = shader::gcn::ShaderCache::readBucket(
+        entry.path(), cache.getFingerprint(), &fileBrokenCount);
+
+    if (!records) {
+      std::fprintf(stderr, "%s: stale or unreadable\n",
+                   entry.path().string().c_str());
+      staleFileCount++;
+
+      if (prune) {
+        std::filesystem::remove(entry.path());
+      }
+      continue;
+    }
+
+    std::vector<shader::gcn::ShaderCache::Record> validRecords;
+
+    for (auto &record : *records) {
+      if (!shader::gcn::deserializeShaderInfo(record.info) ||
+          !shader::spv::validate(record.spv)) {
+        std::fprintf(stderr, "%s: invalid entry for address 0x%llx\n",
+                     entry.path().string().c_str(),
+                     static_cast<unsigned long long>(record.address));
+        fileBrokenCount++;
+        continue;
+      }
+
+      validRecords.push_back(std::move(record));
+    }
+
+    recordCount += validRecords.size();
+    brokenCount += fileBrokenCount;
+
+    if (prune && fileBrokenCount != 0) {
+      if (validRecords.empty()) {
+        std::filesystem::remove(entry.path());
+      } else {
+        shader::gcn::ShaderCache::writeBucket(
+            entry.path(), cache.getFingerprint(), validRecords);
+      }
+    }
+  }
+
+  std::printf("%zu files, %zu stale files, %zu entries, %zu broken entries\n",
+              fileCount, staleFileCount, recordCount, brokenCount);
+  return staleFileCount == 0 && brokenCount == 0 ? 0 : 1;
+}
+#endif
+
 static std::optional<shader::ir::Region>
 parseFile(shader::ir::Context &context, InputParam &inputParam,
           OutputParam &outputParam, const std::filesystem::path &path) {
@@ -419,6 +613,19 @@ void usage(std::FILE *out, const char *argv0) {
   std::fprintf(out, "    --input-type <glsl|spirv-bin|sb|isa>\n");
   std::fprintf(out, "    --semantic <semantic file>\n");
   std::fprintf(out, "    --input-isa-stage <isa-stage>\n");
+  std::fprintf(out, "    --vgpr-count <count>\n");
+  std::fprintf(out, "    --sgpr-count <count>\n");
+  std::fprintf(out, "    --num-threads <x,y,z> - compute workgroup size\n");
+  std::fprintf(out, "    --user-sgprs <value,...> - user data registers\n");
+  std::fprintf(out, "    --features <feature,...> - enabled device features: "
+                    "barycentric, int8, int64-atomics, non-semantic-info\n");
+  std::fprintf(out, "    --cache-dir <dir> - store translated shader in "
+                    "shader cache\n");
+  std::fprintf(out, "    --cache-address <address> - guest address of the "
+                    "shader\n");
+  std::fprintf(out, "    --cache-verify <dir> - verify shader cache entries\n");
+  std::fprintf(out, "    --cache-prune - remove invalid entries while "
+                    "verifying\n");
 #else
   std::fprintf(out, "    --input-type <glsl|spirv-bin>\n");
 #endif
@@ -427,6 +634,8 @@ void usage(std::FILE *out, const char *argv0) {
   std::fprintf(
       out, "    --output-type <glsl|spirv-bin|spirv-header|spirv-asm|ir>\n");
   std::fprintf(out, "    --validate - validate output spirv\n");
+  std::fprintf(out, "    --stats - print translation time, ir memory usage "
+                    "and peak rss\n");
   std::fprintf(out, "    --output-var-name <name> - specify variable name for "
                     "spirv-header\n");
   std::fprintf(out, "    -O<0|1|2|3> - optimize spirv\n");
@@ -468,6 +677,11 @@ int main(int argc, const char *argv[]) {
   const char *outputFile = nullptr;
   InputParam inputParam;
   OutputParam outputParam;
+  bool printStats = false;
+#ifdef GCN
+  const char *cacheVerifyDir = nullptr;
+  bool cachePrune = false;
+#endif
 
   for (int i = 1; i < argc; ++i) {
     if (argv[i] == std::string_view("-h") ||
@@ -486,6 +700,18 @@ int main(int argc, const char *argv[]) {
       continue;
     }
 
+    if (argv[i] == std::string_view{"--stats"}) {
+      printStats = true;
+      continue;
+    }
+
+#ifdef GCN
+    if (argv[i] == std::string_view{"--cache-prune"}) {
+      cachePrune = true;
+      continue;
+    }
+#endif
+
     if (argv[i] == std::string_view{"-O0"}) {
       outputParam.optLevel = 0;
       continue;
@@ -555,6 +781,49 @@ int main(int argc, const char *argv[]) {
           continue;
         }
       }
+
+      if (key == std::string_view{"--vgpr-count"}) {
+        inputParam.vgprCount = std::strtoul(value, nullptr, 0);
+        continue;
+      }
+
+      if (key == std::string_view{"--sgpr-count"}) {
+        inputParam.sgprCount = std::strtoul(value, nullptr, 0);
+        continue;
+      }
+
+      if (key == std::string_view{"--num-threads"}) {
+        if (parseNumThreads(inputParam, value)) {
+          continue;
+        }
+      }
+
+      if (key == std::string_view{"--user-sgprs"}) {
+        if (parseUserSgprs(inputParam, value)) {
+          continue;
+        }
+      }
+
+      if (key == std::string_view{"--features"}) {
+        if (parseFeatures(inputParam, value)) {
+          continue;
+        }
+      }
+
+      if (key == std::string_view{"--cache-dir"}) {
+        inputParam.cacheDir = value;
+        continue;
+      }
+
+      if (key == std::string_view{"--cache-address"}) {
+        inputParam.cacheAddress = std::strtoull(value, nullptr, 0);
+        continue;
+      }
+
+      if (key == std::string_view{"--cache-verify"}) {
+        cacheVerifyDir = value;
+        continue;
+      }
 #endif
     }
 
@@ -562,6 +831,12 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
 
+#ifdef GCN
+  if (cacheVerifyDir != nullptr) {
+    return verifyShaderCache(cacheVerifyDir, cachePrune);
+  }
+#endif
+
   if (outputFile == nullptr) {
     outputFile = "-";
   }
@@ -587,6 +862,7 @@ int main(int argc, const char *argv[]) {
     }
   }
 
+  auto startTime = std::chrono::steady_clock::now();
   shader::ir::Context context;
   auto ir = parseFile(context, inputParam, outputParam, inputFile);
   if (!ir) {
@@ -612,6 +888,18 @@ int main(int argc, const char *argv[]) {
     return 1;
   }
 
+  if (printStats) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime);
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::fprintf(stderr, "%s: %lld us, ir %zu bytes, peak rss %ld KiB\n",
+                 inputFile, static_cast<long long>(elapsed.count()),
+                 context.getAllocatedBytes(), usage.ru_maxrss);
+  }
+
   if (!ostream) {
     std::fprintf(stderr, "failed to write to '%s'\n", outputFile);
     return 1;